@@ -9,6 +9,12 @@ namespace lllm {
 	class Analyzer {
 		public:
 			static ast::AstPtr analyze( sexpr::SexprPtr, GlobalScopePtr scope );
+
+			typedef std::vector<ast::DefinePtr, gc_allocator<ast::DefinePtr>> Definitions;
+
+			// the globals a top level form defines, in order. a define defines one, a defrecord several.
+			// empty for all other forms, which are just evaluated
+			static Definitions definitions( ast::AstPtr );
 	};
 };
 
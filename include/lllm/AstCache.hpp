@@ -0,0 +1,129 @@
+#ifndef __AST_CACHE_HPP__
+#define __AST_CACHE_HPP__ 1
+
+#include "lllm/lllm.hpp"
+#include "lllm/ast/Ast.hpp"
+#include "lllm/util/Scope.tpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace lllm {
+	// binary files of analyzed top level forms, written next to their source (<source>.ast).
+	// a cache file is only used if the hash of the source it was written for matches.
+	//
+	// a file is a header, a string table and the forms, each form is its nodes in post order.
+	// nodes refer to their children by index, reading a form is one pass over the mapped file
+	// that fixes the indices up into pointers.
+	// globals are stored by name and resolved when a form is read, so forms have to be read in order.
+	class AstCache final {
+		public:
+			// hash of the contents of a file, 0 if it can not be read
+			static uint64_t hashFile( util::CStr fileName );
+
+			static std::string pathFor( util::CStr sourceName );
+	};
+
+	class AstWriter final {
+		public:
+			AstWriter( util::CStr sourceName, uint64_t sourceHash );
+
+			void add( ast::AstPtr form );
+
+			// a form can also be built node by node, nodes shared by several roots are written once.
+			// node returns the index of a node in its form.
+			uint32_t node( ast::AstPtr );
+			void     endForm();
+			uint32_t string( util::CStr );
+
+			// contents of the whole file
+			std::string bytes() const;
+			// false if the file could not be written
+			bool write( util::CStr fileName ) const;
+		private:
+			void value( value::ValuePtr );
+
+			void u8( uint8_t );
+			void u32( uint32_t );
+			void u64( uint64_t );
+			void location( ast::AstPtr );
+
+			const uint64_t sourceHash;
+
+			std::unordered_map<std::string,uint32_t> stringIds;
+			std::string                              strings;
+			uint32_t                                 numStrings;
+			std::string                              forms;
+			uint32_t                                 numForms;
+			// nodes mostly come from the same file as the node before them
+			util::CStr                               lastFile;
+			uint32_t                                 lastFileId;
+
+			// the form being written
+			std::unordered_map<ast::AstPtr,uint32_t> nodeIds;
+			std::string                              nodes;
+	};
+
+	class AstReader final {
+		public:
+			// a reader for a missing, stale or broken file is not valid
+			AstReader( util::CStr fileName, uint64_t sourceHash );
+			// reads from memory that belongs to the caller
+			AstReader( const char* data, size_t size, uint64_t sourceHash );
+			~AstReader();
+
+			AstReader( const AstReader& ) = delete;
+			AstReader& operator=( const AstReader& ) = delete;
+
+			bool valid() const;
+
+			// null after the last form
+			ast::AstPtr read( util::ScopePtr<ast::VariablePtr> globals );
+
+			// node of the form read last
+			ast::AstPtr          at( uint32_t id ) const;
+			util::CStr           string( uint32_t id ) const;
+			util::InternedString name( uint32_t id ) const;
+		private:
+			void             open( uint64_t sourceHash );
+			ast::AstPtr      node( util::ScopePtr<ast::VariablePtr> globals );
+			ast::AstPtr      ref();
+			ast::VariablePtr variable();
+			value::ValuePtr  value();
+			util::CStr       location();
+
+			util::CStr           string();
+			util::InternedString name();
+			size_t               offset( uint32_t id ) const;
+
+			uint8_t  u8();
+			uint32_t u32();
+			uint64_t u64();
+
+			void check( size_t bytes ) const;
+
+			const char* data;
+			size_t      size;
+			size_t      pos;
+			uint32_t    formsLeft;
+			bool        mapped;
+
+			util::CStr                     file;
+			// file of the node read last
+			uint32_t                       lastFileId;
+			util::CStr                     lastFile;
+			// offsets of the strings in the mapped file
+			std::vector<size_t>            strings;
+			// nodes of the form being read
+			ast::AstVector                 nodes;
+			// children of the node being read, nodes copy them
+			ast::AstVector                 exprs;
+			ast::Let::Bindings             bindings;
+			ast::Lambda::Bindings          params;
+			ast::Lambda::Bindings          capture;
+	};
+};
+
+#endif /* __AST_CACHE_HPP__ */
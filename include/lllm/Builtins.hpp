@@ -5,6 +5,7 @@
 #include "lllm/util/Scope.tpp"
 
 #include <map>
+#include <gc_allocator.h>
 
 namespace lllm {
 	class Builtins : public util::Scope<ast::AstPtr>,
@@ -22,8 +23,15 @@ namespace lllm {
 		private:
 			Builtins();
 
-			static Builtins* INSTANCE;
-			std::map<util::InternedString,std::pair<ast::VariablePtr,value::ValuePtr>> data;
+			typedef std::pair<ast::VariablePtr,value::ValuePtr> Entry;
+			typedef std::map<
+				util::InternedString,
+				Entry,
+				std::less<util::InternedString>,
+				traceable_allocator<std::pair<const util::InternedString,Entry>>
+			> Table;
+
+			Table data;
 	};
 };
 
@@ -9,23 +9,50 @@
 namespace lllm {
 	class Evaluator {
 		public:
+			// for evaluations outside of a vm and the default of new vms
 			static void setJittingThreshold( size_t threshold );
 
 			static value::ValuePtr evaluate( ast::AstPtr ast, const util::ScopePtr<value::ValuePtr> env );
 
+			// calls a function from native code (builtins, other threads),
+			// interpreted functions see the globals of the evaluation running on this thread
+			static value::ValuePtr apply( value::LambdaPtr fn, const value::ValueVector& args );
+
+			// globals of the evaluation running on this thread, null outside of one
+			static util::ScopePtr<value::ValuePtr> globals();
+			// for green threads, which switch between evaluations on one thread (see Fibers)
+			static void setGlobals( util::ScopePtr<value::ValuePtr> globals );
+
+			// makes apply use other globals, for threads that run work for an evaluation
+			class GlobalsFor final {
+				public:
+					GlobalsFor( util::ScopePtr<value::ValuePtr> globals );
+					~GlobalsFor();
+
+					GlobalsFor( const GlobalsFor& ) = delete;
+					GlobalsFor& operator=( const GlobalsFor& ) = delete;
+				private:
+					util::ScopePtr<value::ValuePtr> saved;
+			};
 		private:
-			static value::ValuePtr applyFun( value::LambdaPtr fn, size_t arity, value::Lambda::FnPtr code, const std::vector<value::ValuePtr>& args );
-			static value::ValuePtr applyAST( value::LambdaPtr fn, util::ScopePtr<value::ValuePtr> env, const std::vector<value::ValuePtr>& args );
+			static value::ValuePtr eval( ast::AstPtr ast, util::ScopePtr<value::ValuePtr> env );
+			static value::ValuePtr applyFun( value::LambdaPtr fn, size_t arity, value::Lambda::FnPtr code, const value::ValueVector& args );
+			static value::ValuePtr applyAST( value::LambdaPtr fn, util::ScopePtr<value::ValuePtr> env, const value::ValueVector& args );
 
 			static size_t jittingThreshold;
+
+		friend class Vm;
 	};
 
-	class EvalScope : public util::Scope<value::ValuePtr> {
+	class EvalScope : public util::Scope<value::ValuePtr>, public gc {
 		public:
 			EvalScope( const util::InternedString& name, value::ValuePtr val, util::ScopePtr<value::ValuePtr> parent = nullptr );
 
 			bool lookup( const util::InternedString& name, value::ValuePtr* dst ) override final;
 			bool contains( const util::InternedString& name ) override final;
+
+			// the scope a chain of local scopes ends in
+			static util::ScopePtr<value::ValuePtr> globals( util::ScopePtr<value::ValuePtr> env );
 		private:
 			const util::ScopePtr<value::ValuePtr> parent;
 			util::InternedString                  name;
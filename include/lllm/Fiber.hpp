@@ -0,0 +1,84 @@
+#ifndef __FIBER_HPP__
+#define __FIBER_HPP__ 1
+
+#include "lllm/lllm.hpp"
+#include "lllm/Scheduler.hpp"
+
+#include <cstddef>
+
+namespace lllm {
+	// a green thread: a function that runs on one of the workers of Fibers and can be switched out halfway.
+	// its result is the result of the function, join it with Scheduler::join or touch a future of it.
+	class Fiber final : public Task {
+		public:
+			// registers a green thread switched out, kept as plain words in the fiber
+			struct Context final {
+				void* rsp;
+				void* rbx;
+				void* rbp;
+				void* r12;
+				void* r13;
+				void* r14;
+				void* r15;
+			};
+
+			Fiber( value::LambdaPtr fn );
+
+			// switching state, only Fibers touches it
+			Context ctx;
+			// copy of the stack while switched out, null before the fiber first runs.
+			// kept for the next switch while the fiber runs
+			char*   stack;
+			size_t  stackSize;
+			// the worker it started on, it can only continue there
+			void*   home;
+			// what the evaluation running on the fiber had set for its thread
+			util::ScopePtr<value::ValuePtr> threadGlobals;
+			VmPtr                           threadVm;
+		protected:
+			void run() override;
+		private:
+			const value::LambdaPtr fn;
+	};
+
+	// M:N green threads, any number of fibers on a few worker threads, started on the first spawn.
+	//
+	// a fiber runs on the stack of its worker thread, switching out copies the part of the stack it uses
+	// into the heap and switching in copies it back.
+	// switching costs a copy of the stack in use, a switched out fiber costs as much memory as its stack is deep.
+	// since the copy has to come back to the same addresses a fiber stays on the worker it started on,
+	// idle workers only steal fibers that have not started yet.
+	//
+	// fibers yield when their fuel runs out, every call takes one unit (see Heap::fuel),
+	// so a long computation can not keep the other fibers of its worker waiting.
+	// LLLM_GREEN_WORKERS sets the number of workers, the default is one per core.
+	// only x86-64 can switch stacks, on other architectures spawn fails and yield does nothing.
+	class Fibers final {
+		public:
+			// calls a fiber may make before it has to yield
+			static const long SLICE = 10000;
+
+			static Fiber* spawn( value::LambdaPtr fn );
+
+			// lets the other fibers of this worker run, does nothing outside of a fiber.
+			// false if no other fiber ran
+			static bool yield();
+			// called when the fuel of this thread runs out
+			static void preempt();
+
+			// the fiber running on this thread, null outside of one
+			static Fiber* current();
+
+			static size_t workers();
+
+			struct Stats {
+				size_t spawned;
+				size_t switches;   // times a fiber was switched out
+				size_t stackBytes; // stack copies of switched out fibers
+				size_t peakBytes;  // the most stackBytes ever were
+			};
+			static Stats stats();
+	};
+};
+
+#endif /* __FIBER_HPP__ */
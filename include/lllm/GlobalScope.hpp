@@ -3,13 +3,23 @@
 
 #include "lllm/util/Scope.tpp"
 
-#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 namespace lllm {
+	// bindings of global names.
+	// any number of threads can look names up while another one adds bindings, lookups never lock.
 	class GlobalScope : public util::Scope<ast::AstPtr>,
 	                    public util::Scope<ast::VariablePtr>,
 	                    public util::Scope<value::ValuePtr> {
 		public:
+			GlobalScope();
+			~GlobalScope();
+
+			GlobalScope( const GlobalScope& ) = delete;
+			GlobalScope& operator=( const GlobalScope& ) = delete;
+
 			void add( const util::SourceLocation& loc, const util::InternedString& name, ast::AstPtr ast, value::ValuePtr val );
 
 			bool lookup( const util::InternedString& name, ast::AstPtr*      dst ) override final;
@@ -20,7 +30,29 @@ namespace lllm {
 
 			void dump() override final;
 		private:
-			std::map<util::InternedString,std::pair<ast::VariablePtr,value::ValuePtr>> data;
+			// a binding never changes, redefining a name replaces it
+			struct Binding final {
+				ast::VariablePtr var;
+				value::ValuePtr  val;
+			};
+			struct Node;
+			struct Table;
+
+			static Table*  makeTable( size_t numBuckets );
+			const Binding* find( const util::InternedString& name ) const;
+			void           grow();
+
+			// all bindings, in no particular order
+			std::vector<std::pair<util::InternedString,Binding>> bindings() const;
+
+			// a hash table keyed by the address of interned names, names are never removed.
+			// the current table sits in an uncollectable cell, so bound values stay alive wherever the scope itself lives.
+			// tables, nodes and bindings are collectable, a reader keeps the ones it is looking at alive.
+			Table**    root;
+			// writers take turns, readers see a binding once it is complete
+			std::mutex writeLock;
+
+			friend class Image;
 	};
 };
 
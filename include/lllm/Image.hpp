@@ -0,0 +1,27 @@
+#ifndef __IMAGE_HPP__
+#define __IMAGE_HPP__ 1
+
+#include "lllm/lllm.hpp"
+
+namespace lllm {
+	// snapshots of a global scope: every binding, its value and the ASTs both refer to.
+	//
+	// an image is a header, an AST cache holding all nodes as one form (see AstCache),
+	// the values in post order and the bindings.
+	// values refer to each other and to nodes by index, so shared structure stays shared.
+	// builtin functions are stored by name, record types by name and fields,
+	// refs, vectors and hash tables get their contents after all values are read,
+	// which is how cycles are restored.
+	// jitted code is not saved, call counts are, so hot functions are jitted again on their next call.
+	class Image final {
+		public:
+			// false if the file could not be written, fails for values that can not be saved
+			static bool save( GlobalScopePtr scope, util::CStr fileName );
+
+			// adds the bindings of an image to a scope, replacing bindings with the same name.
+			// false if the file is missing or not an image of this version
+			static bool restore( util::CStr fileName, GlobalScopePtr scope );
+	};
+};
+
+#endif /* __IMAGE_HPP__ */
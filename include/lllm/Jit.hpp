@@ -4,15 +4,32 @@
 #include "lllm/value/Value.hpp"
 #include "lllm/util/Scope.tpp"
 
+#include <cstdint>
+
 namespace lllm {
 	class Jit {
 		public:
+			// for compiling outside of a vm and the defaults of new vms
 			static void setInliningThreshold( size_t depthThreshold );
 			static void setInliningDepth( size_t maxRecurison );
 
 			static void compile( value::LambdaPtr fn, util::ScopePtr<value::ValuePtr> globals );
 
 			static ast::LambdaPtr performInlining( ast::LambdaPtr fn, util::ScopePtr<value::ValuePtr> globals );
+
+			// the same for a function in every process as long as the code compiled for it would be the same:
+			// a structural hash of its AST, the version of the compiler and the options that change the code
+			static uint64_t codeKey( ast::LambdaPtr fn );
+
+			// functions whose ASTs are structurally equal after inlining and whose globals (also those of nested lambdas) have the same values
+			// share one copy of machine code (see ast::equal), also when they belong to different vms.
+			struct Stats {
+				size_t compiled;    // functions that got code of their own
+				size_t shared;      // functions that reused the code of another
+				size_t codeBytes;   // machine code generated
+				size_t sharedBytes; // machine code not generated because it was shared
+			};
+			static Stats stats();
 		private:
 			Jit( const Jit& ) = delete;
 			Jit& operator=( const Jit& ) = delete;
@@ -22,6 +39,12 @@ namespace lllm {
 
 			static size_t inliningThreshold;
 			static size_t inliningDepth;
+
+			// the settings of the vm running on this thread
+			static size_t currentInliningThreshold();
+			static size_t currentInliningDepth();
+
+		friend class Vm;
 	};
 };
 
@@ -0,0 +1,34 @@
+#ifndef __JIT_CACHE_HPP__
+#define __JIT_CACHE_HPP__ 1
+
+#include "lllm/lllm.hpp"
+
+#include <cstddef>
+
+namespace lllm {
+	// remembers across processes which functions got jitted, keyed by Jit::codeKey.
+	// a function that was jitted in an earlier run is compiled on its first call,
+	// instead of being interpreted until it reaches the jitting threshold.
+	//
+	// the code itself is not stored: libjit can not write compiled functions to a file
+	// (jit_writeelf_add_function is a stub) and jitted code holds the absolute addresses
+	// of globals, builtins and other functions without any relocation info.
+	class JitCache final {
+		public:
+			// nothing is looked up or recorded while the cache is off, it is off by default
+			static void setEnabled( bool enabled );
+			static bool enabled();
+
+			// adds the keys in a file, false if it is missing or not a cache of this version
+			static bool load( util::CStr fileName );
+			// false if the file could not be written
+			static bool save( util::CStr fileName );
+
+			// was code compiled for a function like this one, in this run or an earlier one?
+			static bool   contains( ast::LambdaPtr fn );
+			static void   add( ast::LambdaPtr fn );
+			static size_t size();
+	};
+};
+
+#endif /* __JIT_CACHE_HPP__ */
@@ -0,0 +1,63 @@
+#ifndef __LOADER_HPP__
+#define __LOADER_HPP__ 1
+
+#include "lllm/lllm.hpp"
+#include "lllm/Reader.hpp"
+
+#include <functional>
+
+namespace lllm {
+	class AstReader;
+	class AstWriter;
+
+	// streams forms through Reader -> Analyzer -> Evaluator without printing anything.
+	// top level defines are added to the scope like in the repl.
+	// an error in one form is reported and loading goes on with the next,
+	// after a syntax error the rest of the input is skipped.
+	class Loader final {
+		public:
+			struct Error final {
+				// null for syntax errors, only valid during the error handler
+				sexpr::SexprPtr form;
+				util::CStr      message;
+			};
+
+			struct Stats final {
+				size_t forms  = 0;
+				size_t errors = 0;
+				// read from an AST cache, reading includes analysis then
+				bool   cached = false;
+				// the value of the last form evaluated without an error
+				value::ValuePtr value = nullptr;
+				// time spent in each stage, only measured if timing is on
+				unsigned long long readNs     = 0;
+				unsigned long long analyzeNs  = 0;
+				unsigned long long evaluateNs = 0;
+			};
+
+			typedef std::function<void( const Error& )> ErrorHandler;
+
+			Loader( GlobalScopePtr scope );
+
+			void setTiming( bool timing );
+			// loadFile uses the AST cache next to a file if it is up to date and writes it if not, see AstCache
+			void setCaching( bool caching );
+			// the default handler prints errors to stderr
+			void setErrorHandler( const ErrorHandler& handler );
+
+			Stats load( Reader& reader );
+			Stats load( AstReader& cache );
+			Stats loadFile( util::CStr fileName );
+		private:
+			Stats load( Reader& reader, AstWriter* cache );
+			value::ValuePtr evaluate( ast::AstPtr ast );
+			void  report( Stats& stats, sexpr::SexprPtr form, util::CStr message );
+
+			const GlobalScopePtr scope;
+			bool                 timing;
+			bool                 caching;
+			ErrorHandler         onError;
+	};
+};
+
+#endif /* __LOADER_HPP__ */
@@ -1,11 +1,14 @@
 #ifndef __OBJ_HPP__
 #define __OBJ_HPP__ 1
 
+#include <gc_cpp.h>
+
 namespace lllm {
-	class Obj {
+	// base of parse trees and syntax trees.
+	// they live in the collected heap so pointers from them into values are visible to the GC
+	class Obj : public gc {
 
 	};
 };
 
 #endif /* __OBJ_HPP__ */
-
@@ -4,9 +4,18 @@
 #include "lllm/lllm.hpp"
 #include "lllm/sexpr/Sexpr.hpp"
 
-#include <iosfwd>
+#include <gc_allocator.h>
+
+#include <string>
+#include <vector>
 
 namespace lllm {
+	// the reader lexes directly over a byte buffer: files are memory mapped,
+	// strings are read in place (they must outlive the reader), stdin is buffered line by line.
+	//
+	// trees returned by the static read functions live in the collected heap.
+	// a reader instance allocates its trees in an arena instead: a tree is only valid
+	// until the next call to read() or release(), analyze it before reading on.
 	class Reader {
 		public:
 			static sexpr::SexprPtr read( util::CStr str );
@@ -14,30 +23,62 @@ namespace lllm {
 
 			static Reader fromString( util::CStr source );
 			static Reader fromString( util::CStr sourceName, util::CStr source );
+			static Reader fromString( util::CStr sourceName, const char* source, size_t length );
 	
 			static Reader fromFile( util::CStr fileName );
 			static Reader fromStdin();			
 
+			Reader( Reader&& );
 			~Reader();
 
+			// frees the previous tree
 			sexpr::SexprPtr read();
+			// frees the last tree read, strings the program still needs must have been copied out
+			void release();
 		private:
-			Reader( util::CStr srcName, std::istream* src );
+			enum class Source { STRING, FILE, STDIN };
+
+			Reader( util::CStr srcName, Source, const char* data, size_t size, bool useArena );
 
+			sexpr::SexprPtr  readExpr();
 			sexpr::ListPtr   readList();
+			sexpr::VectorPtr readVector();
+			size_t           readItems( util::CStr what );
 			sexpr::ListPtr   readQuote();
 			sexpr::SexprPtr  readNumber();
 			sexpr::CharPtr   readChar();
 			sexpr::StringPtr readString();
 			sexpr::SymbolPtr readSymbol();
 
-			void skipComment();
 			void skipWhitespace();
-			void consume( char expected );
 
-			int                  la;
-			std::istream*        stream;
-			util::SourceLocation loc;
+			// next byte or -1 at the end of the input, reads another line from stdin if needed
+			inline int peek() { return (pos < size || fill()) ? (unsigned char) data[pos] : -1; }
+			bool fill();
+			// scans to the end of the current token, returns its length (the token starts at pos)
+			size_t token();
+
+			util::SourceLocation location( size_t offset ) const;
+
+			// null for trees in the collected heap
+			inline util::Arena* nodes() { return useArena ? &arena : nullptr; }
+
+			util::CStr  srcName;
+			Source      source;
+			// the input, tokens are slices of it
+			const char* data;
+			size_t      size;
+			size_t      pos;
+			// for source locations
+			unsigned    line;
+			size_t      lineStart;
+			// lines read from stdin
+			std::string buffer;
+
+			const bool           useArena;
+			util::Arena          arena;
+			// children of the lists being read, visible to the GC
+			std::vector<sexpr::SexprPtr, traceable_allocator<sexpr::SexprPtr>> items;
 	};
 };
 
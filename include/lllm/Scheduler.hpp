@@ -0,0 +1,64 @@
+#ifndef __SCHEDULER_HPP__
+#define __SCHEDULER_HPP__ 1
+
+#include "lllm/lllm.hpp"
+#include "lllm/util/Scope.tpp"
+
+namespace lllm {
+	// a piece of work that runs once, on whichever thread gets to it first.
+	// a task runs with the globals and in the vm of the evaluation that spawned it.
+	class Task : public gc {
+		public:
+			Task();
+
+			bool done() const;
+
+			// runs the task on this thread, only the scheduler does this
+			void execute();
+
+			// what the task computed, if it computes a single value
+			value::ValuePtr result;
+		protected:
+			virtual void run() = 0;
+		private:
+			util::ScopePtr<value::ValuePtr> globals;
+			VmPtr                           vm;
+			// message of the failure that ended the task, null if it did not fail
+			util::CStr                      failure;
+			bool                            finished;
+
+		friend class Scheduler;
+	};
+
+	// work stealing over a fixed set of worker threads, started on the first spawn.
+	//
+	// every worker has a deque, it pushes and pops new tasks at the back,
+	// idle workers steal the oldest tasks from the front of other deques.
+	// threads that are not workers push to a shared deque workers also steal from.
+	// LLLM_WORKERS sets the number of workers, the default is one less than there are cores.
+	class Scheduler final {
+		public:
+			static void spawn( TaskPtr );
+
+			// runs other tasks until a task is done.
+			// join also fails with the failure of the task and returns its result
+			static void            wait( TaskPtr );
+			static value::ValuePtr join( TaskPtr );
+
+			// lets other fibers or threads run while this one waits for something,
+			// round is how often the caller has waited in a row, long waits back off.
+			// unlike wait it does not run tasks, they might wait for the same thing
+			static void relax( size_t round );
+			static const size_t SPINS = 64;
+
+			// true if the tasks this thread spawned have all been taken,
+			// tasks that can split their work do so while this is true (lazy binary splitting)
+			static bool hungry();
+
+			static size_t workers();
+			// only the first n workers take tasks, for benchmarks
+			static void setWorkers( size_t n );
+	};
+};
+
+#endif /* __SCHEDULER_HPP__ */
@@ -0,0 +1,69 @@
+#ifndef __VM_HPP__
+#define __VM_HPP__ 1
+
+#include "lllm/lllm.hpp"
+#include "lllm/GlobalScope.hpp"
+#include "lllm/Loader.hpp"
+
+namespace lllm {
+	// an isolated instance of the language, with globals and jit settings of its own.
+	//
+	// builtins, interned names and compiled code are shared by all vms in a process:
+	// functions that are equal after inlining and see the same globals run the same machine code (see Jit).
+	// settings start out as the process wide ones (see Evaluator::setJittingThreshold, Jit::setInliningThreshold),
+	// which are also used outside of any vm.
+	// any number of threads can evaluate in the same vm.
+	class Vm final {
+		public:
+			Vm();
+
+			Vm( const Vm& ) = delete;
+			Vm& operator=( const Vm& ) = delete;
+
+			GlobalScopePtr globals();
+
+			void setJittingThreshold( size_t threshold );
+			void setInliningThreshold( size_t depthThreshold );
+			void setInliningDepth( size_t maxRecursion );
+
+			size_t jittingThreshold() const;
+			size_t inliningThreshold() const;
+			size_t inliningDepth() const;
+
+			// loads all forms of a string, top level defines add bindings. the value of the last form.
+			// like the Loader it goes on after a form fails, then fails with the first error
+			value::ValuePtr evaluate( util::CStr source );
+
+			// like a Loader for the globals of this vm
+			Loader::Stats load( Reader& reader );
+			Loader::Stats loadFile( util::CStr fileName );
+
+			// the vm evaluating on this thread, null outside of one
+			static VmPtr current();
+			// for green threads, which switch between evaluations on one thread (see Fibers)
+			static void setCurrent( VmPtr vm );
+
+			// makes a vm the current one of this thread while it lives
+			class Enter final {
+				public:
+					Enter( VmPtr vm );
+					~Enter();
+
+					Enter( const Enter& ) = delete;
+					Enter& operator=( const Enter& ) = delete;
+				private:
+					VmPtr saved;
+			};
+		private:
+			GlobalScope scope;
+			size_t      jitting;
+			size_t      inlining;
+			size_t      inliningRecursion;
+
+			static __thread Vm* active;
+	};
+
+	inline VmPtr Vm::current() { return active; }
+};
+
+#endif /* __VM_HPP__ */
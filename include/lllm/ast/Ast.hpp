@@ -10,6 +10,7 @@
 #include "lllm/util/EscapeStatus.hpp"
 
 #include <vector>
+#include <gc_allocator.h>
 
 #if LLLM_DBG_LVL >= 4
 #	include <iostream>
@@ -23,33 +24,40 @@
 
 namespace lllm {
 	namespace ast {
-		enum class Type {
+		enum class Type : unsigned char {
 			#define LLLM_VISITOR( TYPE ) TYPE, 
 			#include "lllm/ast/Ast_concrete.inc"
 		};
 
+		// child arrays of ast nodes live in the collected heap, like the nodes themselves
+		typedef std::vector<AstPtr, gc_allocator<AstPtr>> AstVector;
+
+		// nodes have no vtable, the kind of a node is its type tag.
+		// visit() and as() dispatch on the tag and static_cast to the concrete class,
+		// each concrete class names its tag in TAG.
 		class Ast : public Obj {
 			private:
-				Ast( Type type, const util::SourceLocation& loc );
+				Ast( Type type, const util::SourceLocation& loc, size_t depth = 1 );
 			public:
-				virtual util::TypeSet possibleTypes() const = 0;
-				virtual size_t        depth()         const = 0;
+				util::TypeSet possibleTypes() const;
+				size_t        depth()         const { return _depth; }
 	
+				// nullptr if this is not a T
 				template<typename T>
 				T* as();
+				template<typename T>
+				const T* as() const;
 
 				template<typename Return, typename Visitor, typename... Args>
 				Return visit( Visitor&&, Args... );
 				template<typename Return, typename Visitor, typename... Args>
 				Return visit( Visitor&&, Args... ) const;
-				// template<typename Return, typename Visitor, typename... Args>
-				// Return visit( const Visitor&, Args... );
-				// template<typename Return, typename Visitor, typename... Args>
-				// Return visit( const Visitor&, Args... ) const;
 
 				const util::SourceLocation location;
 			private:
-				const Type                   type;
+				const Type                 type;
+				// computed at construction, the children of a node never change
+				unsigned                   _depth;
 
 			#define LLLM_VISITOR( TYPE ) friend class TYPE;
 			#include "lllm/ast/Ast.inc"
@@ -59,10 +67,13 @@ namespace lllm {
 		class Atom : public Ast {
 			public:
 				util::EscapeStatus escape;
+
+				// runtime value of the literal, materialized once by the Analyzer (nil for Nil).
+				// the interpreter and the JIT both use it, evaluating a literal never allocates.
+				const value::ValuePtr constant;
 			private:
-				Atom( Type type, const util::SourceLocation& );
+				Atom( Type type, const util::SourceLocation&, value::ValuePtr constant );
 
-				size_t        depth()         const override final;
 
 			friend class Nil;
 			friend class Int;
@@ -72,39 +83,49 @@ namespace lllm {
 		};
 		class Nil final : public Atom {
 			public:
+				static const Type TAG = Type::Nil;
+
 				Nil( const util::SourceLocation& );
 	
-				util::TypeSet possibleTypes() const override final;
+				util::TypeSet possibleTypes() const;
 		};
 		class Int final : public Atom {
 			public:
-				Int( const util::SourceLocation&, long );
+				static const Type TAG = Type::Int;
+
+				Int( const util::SourceLocation&, long, value::ValuePtr constant );
 
-				util::TypeSet possibleTypes() const override final;
+				util::TypeSet possibleTypes() const;
 	
 				const long value;
 		};
 		class Real final : public Atom {
 			public:
-				Real( const util::SourceLocation&, double );
+				static const Type TAG = Type::Real;
+
+				Real( const util::SourceLocation&, double, value::ValuePtr constant );
 	
-				util::TypeSet possibleTypes() const override final;
+				util::TypeSet possibleTypes() const;
 	
 				const double value;
 		};
 		class Char final : public Atom {
 			public:
-				Char( const util::SourceLocation&, char );
+				static const Type TAG = Type::Char;
+
+				Char( const util::SourceLocation&, char, value::ValuePtr constant );
 	
-				util::TypeSet possibleTypes() const override final;
+				util::TypeSet possibleTypes() const;
 
 				const char value;
 		};
 		class String final : public Atom {
 			public:
-				String( const util::SourceLocation&, util::CStr );
+				static const Type TAG = Type::String;
+
+				String( const util::SourceLocation&, util::CStr, value::ValuePtr constant );
 	
-				util::TypeSet possibleTypes() const override final;
+				util::TypeSet possibleTypes() const;
 
 				const util::CStr value;
 		};
@@ -112,13 +133,14 @@ namespace lllm {
 		//***** VARIABLES            ****************************************************************//
 		class Variable : public Ast {
 			public:
+				static const Type TAG = Type::Variable;
+
 				static VariablePtr makeGlobal( const util::SourceLocation&, const util::InternedString&, const AstPtr ast );
 				static VariablePtr makeLocal( const util::SourceLocation&, const util::InternedString&, const AstPtr ast );
 				static VariablePtr makeParameter( const util::SourceLocation&, const util::InternedString& );
 				static VariablePtr makeCaptured( const util::SourceLocation&, const util::InternedString&, const AstPtr ast );
 
-				util::TypeSet possibleTypes() const override final;
-				size_t        depth()         const override final;
+				util::TypeSet possibleTypes() const;
 
 				// info collected at construction time
 				const util::InternedString name;
@@ -134,83 +156,82 @@ namespace lllm {
 		//***** SPECIAL FORMS        ****************************************************************//
 		class Quote : public Ast {
 			public:
+				static const Type TAG = Type::Quote;
+
 				Quote( const util::SourceLocation&, value::ValuePtr value );
 	
-				util::TypeSet possibleTypes() const override final;
-				size_t        depth()         const override final;
+				util::TypeSet possibleTypes() const;
 	
 				const value::ValuePtr value;
 		};
 		class If : public Ast {
 			public:
+				static const Type TAG = Type::If;
+
 				If( const util::SourceLocation&, AstPtr test, AstPtr thenBranch, AstPtr elseBranch );
 	
-				util::TypeSet possibleTypes() const override final;
-				size_t        depth()         const override final;
+				util::TypeSet possibleTypes() const;
 	
 				const AstPtr test;
 				const AstPtr thenBranch;
 				const AstPtr elseBranch;
-			private:
-				size_t _depth;
 		};
 		class Do : public Ast {
 			public:
-				Do( const util::SourceLocation&, const std::vector<AstPtr>& exprs );
+				static const Type TAG = Type::Do;
 
-				util::TypeSet possibleTypes() const override final;
-				size_t        depth()         const override final;
+				Do( const util::SourceLocation&, const AstVector& exprs );
+
+				util::TypeSet possibleTypes() const;
 	
-				std::vector<AstPtr>::const_iterator begin() const;
-				std::vector<AstPtr>::const_iterator end()   const;
+				AstVector::const_iterator begin() const;
+				AstVector::const_iterator end()   const;
 				
 				AstPtr back() const;
 
-				const std::vector<AstPtr> exprs;
-			private:
-				size_t _depth;
+				const AstVector exprs;
 		};
 		class Let : public Ast {
 			public:
-				typedef std::pair<util::InternedString,AstPtr> Binding;
-				typedef std::vector<Binding>                   Bindings;
+				static const Type TAG = Type::Let;
+
+				typedef std::pair<util::InternedString,AstPtr>      Binding;
+				typedef std::vector<Binding,gc_allocator<Binding>> Bindings;
 
 				Let( const util::SourceLocation&, const Bindings&, AstPtr );
 
-				util::TypeSet possibleTypes() const override final;
-				size_t        depth()         const override final;
+				util::TypeSet possibleTypes() const;
 
 				Bindings::const_iterator begin() const;
 				Bindings::const_iterator end()   const;
 
 				const Bindings bindings;
 				const AstPtr   body;
-			private:
-				size_t _depth;
 		};
 		class LetStar : public Ast {
 			public:
-				typedef std::pair<util::InternedString,AstPtr> Binding;
-				typedef std::vector<Binding>                   Bindings;
+				static const Type TAG = Type::LetStar;
+
+				typedef std::pair<util::InternedString,AstPtr>      Binding;
+				typedef std::vector<Binding,gc_allocator<Binding>> Bindings;
 
 				LetStar( const util::SourceLocation&, const Bindings&, AstPtr );
 
-				util::TypeSet possibleTypes() const override final;
-				size_t        depth()         const override final;
+				util::TypeSet possibleTypes() const;
 
 				Bindings::const_iterator begin() const;
 				Bindings::const_iterator end()   const;
 
 				const Bindings bindings;
 				const AstPtr   body;
-			private:
-				size_t _depth;
 		};
 		class Lambda : public Ast {
 			public:
-				typedef VariablePtr              Binding;
-				typedef std::vector<Binding>     Bindings;
-				typedef Bindings::const_iterator Iterator;
+				static const Type TAG = Type::Lambda;
+
+				typedef VariablePtr                                 Binding;
+				typedef std::vector<Binding,gc_allocator<Binding>> Bindings;
+				typedef Bindings::const_iterator                    Iterator;
 
 				Lambda( const util::SourceLocation&, 
 				        const util::InternedString& name,
@@ -218,8 +239,7 @@ namespace lllm {
 						const Bindings& capture,
 				        AstPtr body );
 
-				util::TypeSet possibleTypes() const override final;
-				size_t        depth()         const override final;
+				util::TypeSet possibleTypes() const;
 
 				size_t arity()   const;
 				size_t envSize() const;
@@ -239,14 +259,15 @@ namespace lllm {
 				const Bindings               capture;
 				const value::Lambda::DataPtr data;
 			private:
-				std::vector<util::EscapeStatus> escapes;
+				std::vector<util::EscapeStatus,gc_allocator<util::EscapeStatus>> escapes;
 		};
 		class Define : public Ast {
 			public:
+				static const Type TAG = Type::Define;
+
 				Define( const util::SourceLocation&, const util::InternedString& name, AstPtr ast );
 	
-				util::TypeSet possibleTypes() const override final;
-				size_t        depth()         const override final;
+				util::TypeSet possibleTypes() const;
 	
 				const util::InternedString name;
 				const AstPtr               expr;
@@ -255,51 +276,60 @@ namespace lllm {
 		//***** FUNCTION APPLICATION ****************************************************************//
 		class Application : public Ast {
 			public:
-				typedef std::vector<AstPtr>::const_iterator iterator;
+				static const Type TAG = Type::Application;
+
+				typedef AstVector::const_iterator iterator;
 
-				Application( const util::SourceLocation&, AstPtr fun, const std::vector<AstPtr>& args );
+				Application( const util::SourceLocation&, AstPtr fun, const AstVector& args );
 	
-				util::TypeSet possibleTypes() const override final;
-				size_t        depth()         const override final;
+				util::TypeSet possibleTypes() const;
 	
 				const AstPtr              fun;
-				const std::vector<AstPtr> args;
+				const AstVector           args;
 
 				iterator begin() const;
 				iterator end()   const;
 				size_t   arity() const;
-			private:
-				size_t _depth;
 		};
 
+		// structural equality, trees are equal if they have the same shape, names and literals of the same type.
+		// locations and analysis results are ignored.
+		bool   equal( ConstAstPtr, ConstAstPtr );
+		// consistent with equal. it never depends on addresses, so it is the same in every process.
+		size_t hash( ConstAstPtr );
+
 		//***** VISITORS             ****************************************************************//
 		template<typename T>
-		T* Ast::as() { return dynamic_cast<T*>( this ); }
+		T* Ast::as() { return (type == T::TAG) ? static_cast<T*>( this ) : nullptr; }
+		template<typename T>
+		const T* Ast::as() const { return (type == T::TAG) ? static_cast<const T*>( this ) : nullptr; }
 
 		template<typename Return, typename Visitor, typename... Args>
 		Return Ast::visit( Visitor&& v, Args... args ) {
 			AST_VISIT_DBG_BEGIN;
 			switch ( type ) {
-				#define LLLM_VISITOR( TYPE ) case ast::Type::TYPE: return v.visit( dynamic_cast<TYPE##Ptr>( this ), args... );
+				#define LLLM_VISITOR( TYPE ) case ast::Type::TYPE: return v.visit( static_cast<TYPE##Ptr>( this ), args... );
 				#include "lllm/ast/Ast_concrete.inc"
-				default: return v.visit( dynamic_cast<LambdaPtr>( this ), args... );
 			}
+			// every tag is handled above
+			__builtin_unreachable();
 			AST_VISIT_DBG_END;
 		}
 		template<typename Return, typename Visitor, typename... Args>
 		Return Ast::visit( Visitor&& v, Args... args ) const {
 			AST_VISIT_DBG_BEGIN;
 			switch ( type ) {
-				#define LLLM_VISITOR( TYPE ) case ast::Type::TYPE: return v.visit( dynamic_cast<Const##TYPE##Ptr>( this ), args... );
+				#define LLLM_VISITOR( TYPE ) case ast::Type::TYPE: return v.visit( static_cast<Const##TYPE##Ptr>( this ), args... );
 				#include "lllm/ast/Ast_concrete.inc"
-				default: return v.visit( dynamic_cast<ConstLambdaPtr>( this ), args... );
 			}
+			// every tag is handled above
+			__builtin_unreachable();
 			AST_VISIT_DBG_END;
 		}
 
 		template<typename... T>
 		ApplicationPtr apply( AstPtr fn, std::initializer_list<T...> args ) {
-			return new Application( util::SourceLocation("*api*"), fn, std::vector<AstPtr>( args ) );
+			return new Application( util::SourceLocation("*api*"), fn, AstVector( args ) );
 		}
 	};
 };
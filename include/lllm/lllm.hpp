@@ -64,6 +64,14 @@ namespace lllm {
 	class   GlobalScope;
 	typedef GlobalScope* GlobalScopePtr;
 
+	// ** reads, analyzes and evaluates whole files
+	class   Loader;
+	typedef Loader* LoaderPtr;
+
+	// ** work for the parallel builtins, see Scheduler
+	class   Task;
+	typedef Task* TaskPtr;
+
 	//***** UTILITIES *********************************************************
 
 	namespace util {
@@ -5,8 +5,7 @@
 #include "lllm/Obj.hpp"
 #include "lllm/util/SourceLocation.hpp"
 #include "lllm/util/InternedString.hpp"
-
-#include <vector>
+#include "lllm/util/Arena.hpp"
 
 namespace lllm {
 	namespace sexpr {
@@ -15,8 +14,13 @@ namespace lllm {
 			#include "lllm/sexpr/Sexpr_concrete.inc"
 		};
 
-		typedef std::vector<SexprPtr>       SexprVector;
-		typedef SexprVector::const_iterator SexprIterator;
+		typedef const SexprPtr* SexprIterator;
+
+		// children of a list or vector, stored in the same block right behind the node (see makeList)
+		struct ListItems {
+			const SexprPtr* items;
+			size_t          length;
+		};
 
 		class Sexpr : public Obj {
 			private:
@@ -52,6 +56,17 @@ namespace lllm {
 			};
 		#include "lllm/sexpr/Sexpr_concrete.inc"
 
+		// nodes are allocated in the arena if there is one, in the collected heap otherwise.
+		// nodes in an arena must only point to the arena, interned strings or uncollectable memory.
+		template<typename T, typename V>
+		T* make( util::Arena* arena, const util::SourceLocation& loc, const V& value ) {
+			void* mem = arena ? arena->alloc( sizeof(T) ) : GC_MALLOC( sizeof(T) );
+			return new (mem) T( loc, value );
+		}
+		extern ListPtr   makeList( util::Arena*, const util::SourceLocation&, const SexprPtr* items, size_t length );
+		// a vector literal #(...)
+		extern VectorPtr makeVector( util::Arena*, const util::SourceLocation&, const SexprPtr* items, size_t length );
+
 		extern SexprPtr  nil;
 		extern IntPtr    number( int );
 		extern IntPtr    number( long );
@@ -0,0 +1,57 @@
+#ifndef __ARENA_HPP__
+#define __ARENA_HPP__ 1
+
+#include "lllm/lllm.hpp"
+
+#include <cstddef>
+
+namespace lllm {
+	namespace util {
+		// bump allocator for short lived data, everything in it is freed at once by release().
+		// arena memory is not scanned by the GC, it must not hold the only pointer to a collected object.
+		class Arena final {
+			public:
+				static const size_t ALIGN      = 8;
+				static const size_t CHUNK_SIZE = 64 * 1024;
+
+				Arena();
+				Arena( Arena&& );
+				~Arena();
+
+				Arena( const Arena& )            = delete;
+				Arena& operator=( const Arena& ) = delete;
+
+				inline void* alloc( size_t bytes ) {
+					bytes = (bytes + ALIGN - 1) & ~(ALIGN - 1);
+
+					if ( bytes > size_t(end - top) ) return grow( bytes );
+
+					void* mem = top;
+					top += bytes;
+					return mem;
+				}
+
+				// copy of a string of the given length (plus a terminating zero)
+				CStr copy( const char* str, size_t length );
+
+				// free everything, keeps one chunk around for reuse
+				void release();
+
+				// bytes allocated from the system
+				size_t size() const;
+			private:
+				struct Chunk {
+					Chunk* next;
+					size_t size;
+				};
+
+				void* grow( size_t bytes );
+
+				Chunk* chunks;
+				char*  top;
+				char*  end;
+		};
+	};
+};
+
+#endif /* __ARENA_HPP__ */
@@ -10,6 +10,8 @@ namespace lllm {
 		class InternedString {
 			public:
 				inline InternedString( CStr str ) : string( intern( str ) ) {}
+				// interns a slice of a buffer, the slice need not be zero terminated
+				inline InternedString( const char* str, size_t length ) : string( intern( str, length ) ) {}
 				inline constexpr InternedString() : string( nullptr ) {}
 				inline constexpr InternedString( const InternedString&  str ) : string( str.string ) {}
 				inline constexpr InternedString( const InternedString&& str ) : string( str.string ) {}
@@ -26,6 +28,7 @@ namespace lllm {
 				}
 
 				static CStr intern( CStr );
+				static CStr intern( const char*, size_t length );
 			private:
 				CStr string;
 		};
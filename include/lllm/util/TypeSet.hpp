@@ -5,7 +5,7 @@
 
 namespace lllm {
 	namespace util {
-		static_assert( (sizeof( short ) * 8) >= long(value::Type::END), "TypeSet cannot be packed into a short, it's too small" );
+		static_assert( (sizeof( unsigned ) * 8) > long(value::Type::END), "TypeSet cannot be packed into an unsigned, it's too small" );
 
 		class TypeSet;
 
@@ -45,17 +45,17 @@ namespace lllm {
 					return *this;
 				}
 			private:
-				inline constexpr TypeSet( short mask ) : mask( mask ) {}
+				inline constexpr TypeSet( unsigned mask ) : mask( mask ) {}
 
-				short mask;
+				unsigned mask;
 
-				static inline constexpr short bits()                       { return 0; }
-				static inline constexpr short bits( value::Type t ) { 
-					return 1 << ((short) (t > value::Type::Lambda ? value::Type::Lambda : t)); 
+				static inline constexpr unsigned bits()                       { return 0; }
+				static inline constexpr unsigned bits( value::Type t ) { 
+					return 1u << ((unsigned) (t > value::Type::Lambda ? value::Type::Lambda : t)); 
 				}
-				static inline constexpr short bits( const TypeSet& t )     { return t.mask; }
+				static inline constexpr unsigned bits( const TypeSet& t )     { return t.mask; }
 				template<typename... Ts>
-				static inline constexpr short bits( value::Type t, Ts... ts ) { return bits( t ) | bits( ts... ); }
+				static inline constexpr unsigned bits( value::Type t, Ts... ts ) { return bits( t ) | bits( ts... ); }
 
 				static inline constexpr TypeSet all( const TypeSet& accum, value::Type t ) {
 					return t <= value::Type::END ? all( accum | t, value::Type( short( t ) + 1 ) ) : accum; 
@@ -2,12 +2,28 @@
 #define __FAIL_HPP__ 1
 
 #include <sstream>
+#include <string>
 
 namespace lllm {
 		namespace util {
-		// print message, then print a stack trace, then abort
+		// print message, then print a stack trace, then abort.
+		// while a CatchFailures is alive on this thread a Failure is thrown instead.
 		void fail( const char* file, const char* function, int line, const char* msg ) __attribute__((noreturn));
 
+		struct Failure final {
+			std::string message;
+		};
+
+		// errors raised in compiled code can not be unwound, they still abort
+		class CatchFailures final {
+			public:
+				CatchFailures();
+				~CatchFailures();
+
+				CatchFailures( const CatchFailures& ) = delete;
+				CatchFailures& operator=( const CatchFailures& ) = delete;
+		};
+
 		#define LLLM_FAIL( MSG ) ({ \
 			::std::stringstream _str_; \
 			_str_ << MSG; \
@@ -0,0 +1,59 @@
+#ifndef __GC_HPP__
+#define __GC_HPP__ 1
+
+#include "lllm/lllm.hpp"
+
+#include <gc.h>
+
+#include <cstddef>
+
+namespace lllm {
+	namespace value {
+		// collector configuration.
+		// LLLM_GC=incremental selects the incremental mode at startup, LLLM_GC_PAUSE_MS sets the pause goal.
+		class Gc {
+			public:
+				enum class Mode {
+					STOP_THE_WORLD,
+					// mark in small steps interleaved with allocation, bounded by the pause goal.
+					// bdwgc can not go back to stop the world once this is on.
+					INCREMENTAL
+				};
+
+				static const unsigned long DEFAULT_PAUSE_GOAL_MS = 5;
+
+				static void          setMode( Mode mode, unsigned long pauseGoalMs = DEFAULT_PAUSE_GOAL_MS );
+				static Mode          mode();
+				static unsigned long pauseGoal();
+				// number of threads marking in parallel, 1 unless the collector was built with threads
+				static size_t markers();
+
+				// call on the main thread before other threads touch the heap
+				static void enableThreads();
+
+				// registers the calling thread with the collector for as long as it lives.
+				// threads started with GC_pthread_create are registered already and need none.
+				struct Thread final {
+					Thread();
+					~Thread();
+
+					Thread( const Thread& ) = delete;
+					Thread& operator=( const Thread& ) = delete;
+				private:
+					bool registered;
+				};
+
+				// write barrier, call after storing a pointer into an object that was already initialized.
+				// with dirty bits from page protection this is a no-op,
+				// a collector built for manual dirty bits (MANUAL_VDB) relies on it.
+				inline static void written( const void* obj ) {
+					if ( incremental ) GC_end_stubborn_change( obj );
+				}
+			private:
+				static bool          incremental;
+				static unsigned long pauseGoalMs;
+		};
+	};
+};
+
+#endif /* __GC_HPP__ */
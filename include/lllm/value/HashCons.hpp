@@ -0,0 +1,42 @@
+#ifndef __HASH_CONS_HPP__
+#define __HASH_CONS_HPP__ 1
+
+#include "lllm/value/Value.hpp"
+
+#include <cstddef>
+
+namespace lllm {
+	namespace value {
+		// optional hash consing: while enabled value::cons returns the existing cell
+		// for a car and cdr that were consed before, so structurally equal lists share one instance.
+		// the table only holds weak references, cells nobody else points to are still collected.
+		// setting LLLM_HASHCONS=1 enables it at startup.
+		class HashCons {
+			public:
+				struct Stats {
+					unsigned long long lookups;
+					// lookups that returned an existing cell
+					unsigned long long shared;
+					// cells currently in the table (including ones collected since the last lookup)
+					size_t             entries;
+					size_t             buckets;
+
+					inline size_t bytesSaved() const { return shared * sizeof(Cons); }
+				};
+
+				// lists built while disabled are not in the table, they are only shared with
+				// lists built later if their cells are consed again
+				static void enable( bool );
+				static bool enabled() { return on; }
+
+				// find or allocate the cell for (car . cdr)
+				static ConsPtr cons( ValuePtr car, ListPtr cdr );
+
+				static Stats stats();
+			private:
+				static bool on;
+		};
+	};
+};
+
+#endif /* __HASH_CONS_HPP__ */
@@ -0,0 +1,66 @@
+#ifndef __HEAP_HPP__
+#define __HEAP_HPP__ 1
+
+#include "lllm/lllm.hpp"
+
+#include <gc.h>
+
+#include <cstddef>
+
+namespace lllm {
+	namespace value {
+		// per thread free lists for small scanned objects (conses and closures).
+		// lists are refilled in batches with GC_malloc_many, so most allocations never call into the GC.
+		// compiled code pops from these lists inline, see Jit.
+		class Heap final {
+			public:
+				static const size_t GRANULE_BYTES = 16;
+				static const size_t MAX_GRANULES  = 8;
+
+				static inline Heap& local() {
+					if ( !current ) current = create();
+					return *current;
+				}
+
+				// like GC_MALLOC this keeps a byte at the end of each object, see refill()
+				static inline size_t granules( size_t bytes ) {
+					return (bytes + GRANULE_BYTES) / GRANULE_BYTES;
+				}
+
+				// the free list link in the first word is overwritten by the type tag of the value
+				inline void* alloc( size_t bytes ) {
+					size_t g = granules( bytes );
+
+					if ( g > MAX_GRANULES ) return GC_MALLOC( bytes );
+
+					void* obj = lists[g];
+
+					if ( !obj ) return refill( g );
+
+					lists[g] = GC_NEXT( obj );
+					return obj;
+				}
+
+				// refill an empty free list and pop from it
+				void* refill( size_t granules );
+
+				// drops the lists of this thread, objects still on them are collected
+				static void release();
+
+				// heads of the free lists, indexed by size in granules
+				void* lists[MAX_GRANULES + 1];
+
+				// calls left before the green thread running on this thread yields (see Fibers).
+				// every call takes one, compiled code counts here too since it has the heap at hand
+				long fuel;
+			private:
+				Heap();
+
+				static Heap* create();
+
+				static __thread Heap* current;
+		};
+	};
+};
+
+#endif /* __HEAP_HPP__ */
@@ -0,0 +1,53 @@
+#ifndef __KERNELS_HPP__
+#define __KERNELS_HPP__ 1
+
+#include "lllm/lllm.hpp"
+
+#include <cstddef>
+
+namespace lllm {
+	namespace value {
+		// bulk operations on unboxed numbers (see F64Vector and I64Vector).
+		// every kernel has a scalar version, on x86-64 there are SSE2 and AVX2 versions too.
+		// the best set the cpu supports is picked at startup, LLLM_SIMD=scalar, sse2 or avx2 asks for another one.
+		// sums of doubles are added up in a different order by each set, so their results may differ in the last bits.
+		// min and max of doubles return the first NaN if there is one, the same on every set.
+		class Kernels final {
+			public:
+				enum class Isa { SCALAR, SSE2, AVX2 };
+
+				// falls back to the best supported set below the one asked for
+				static void use( Isa isa );
+				static Isa  current();
+				static Isa  best();
+
+				static util::CStr name( Isa isa );
+
+				// out may be one of the inputs
+				static void   add(   const double* a, const double* b, double* out, size_t n );
+				static void   mul(   const double* a, const double* b, double* out, size_t n );
+				static void   scale( const double* a, double k,        double* out, size_t n );
+				static double dot(   const double* a, const double* b, size_t n );
+				static double sum(   const double* a, size_t n );
+				// n must not be 0
+				static double min(   const double* a, size_t n );
+				static double max(   const double* a, size_t n );
+
+				// ints wrap around on overflow
+				static void   add(   const long* a, const long* b, long* out, size_t n );
+				static void   mul(   const long* a, const long* b, long* out, size_t n );
+				static void   scale( const long* a, long k,        long* out, size_t n );
+				static long   dot(   const long* a, const long* b, size_t n );
+				static long   sum(   const long* a, size_t n );
+				static long   min(   const long* a, size_t n );
+				static long   max(   const long* a, size_t n );
+
+				struct Table;
+			private:
+				static const Table* active;
+				static Isa          activeIsa;
+		};
+	};
+};
+
+#endif /* __KERNELS_HPP__ */
@@ -0,0 +1,92 @@
+#ifndef __TELEMETRY_HPP__
+#define __TELEMETRY_HPP__ 1
+
+#include "lllm/value/Value.hpp"
+
+#include <iosfwd>
+
+namespace lllm {
+	namespace value {
+		// allocation and GC counters.
+		// GC collections are always recorded, allocations only while telemetry is enabled.
+		// setting LLLM_TELEMETRY=<file> enables telemetry and dumps it as JSON at exit ('-' means stderr).
+		// counters are updated atomically, each thread charges allocations to the function it runs.
+		class Telemetry {
+			public:
+				struct Counter {
+					unsigned long long count;
+					unsigned long long bytes;
+				};
+
+				// bucket i counts pauses shorter than (64us << i), the last one also everything longer
+				static const size_t PAUSE_BUCKETS = 16;
+
+				struct GcStats {
+					unsigned long long collections;
+					unsigned long long totalPauseNs;
+					unsigned long long maxPauseNs;
+					unsigned long long pauses[PAUSE_BUCKETS];
+
+					size_t heapSize;
+					size_t freeBytes;
+					size_t unmappedBytes;
+					size_t bytesSinceGc;
+					size_t totalBytes;
+				};
+
+				static void enable( bool );
+				static bool enabled();
+				static void reset();
+
+				// all lambdas are counted as Type::Lambda
+				static Counter allocations( Type );
+				static GcStats gc();
+
+				// functions whose allocations are listed in the report, called by the JIT
+				static void addFunction( Lambda::DataPtr );
+
+				static void print( std::ostream& );
+				static void printJson( std::ostream& );
+				static void dumpJsonAtExit( util::CStr file );
+
+				inline static void allocated( Type t, size_t bytes ) {
+					if ( !on ) return;
+
+					if ( t > Type::Lambda ) t = Type::Lambda;
+
+					__atomic_add_fetch( &counters[size_t(t)].count, 1,     __ATOMIC_RELAXED );
+					__atomic_add_fetch( &counters[size_t(t)].bytes, bytes, __ATOMIC_RELAXED );
+
+					if ( current ) {
+						__atomic_add_fetch( &current->allocCnt,   1,     __ATOMIC_RELAXED );
+						__atomic_add_fetch( &current->allocBytes, bytes, __ATOMIC_RELAXED );
+					}
+				}
+
+				// function that allocations on this thread are charged to.
+				// set by the interpreter and by code compiled while telemetry was enabled.
+				static __thread Lambda::DataPtr current;
+
+				// charges allocations to a function until it goes out of scope, does nothing while telemetry is off
+				struct Charge final {
+					inline Charge( Lambda::DataPtr data ) : active( on ), saved( nullptr ) {
+						if ( !active ) return;
+
+						saved   = current;
+						current = data;
+					}
+					inline ~Charge() {
+						if ( active ) current = saved;
+					}
+
+					const bool      active;
+					Lambda::DataPtr saved;
+				};
+			private:
+				static bool    on;
+				static Counter counters[size_t(Type::END) + 1];
+		};
+	};
+};
+
+#endif /* __TELEMETRY_HPP__ */
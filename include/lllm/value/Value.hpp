@@ -5,6 +5,8 @@
 #include "lllm/util/InternedString.hpp"
 
 #include <iosfwd>
+#include <vector>
+#include <gc_allocator.h>
 
 namespace lllm {
 	namespace value {
@@ -94,30 +96,199 @@ namespace lllm {
 				
 				const util::CStr value;
 		};
+		// symbols are unique, there is exactly one symbol per name (see value::symbol).
+		// so symbols are equal iff they are identical.
 		class Symbol : public Value {
 			public:
+				const util::InternedString value;
+			private:
 				Symbol( const util::InternedString& );
 
-				const util::InternedString& value;
+				friend SymbolPtr symbol( const util::InternedString& );
 		};
+		// a mutable cell threads can share.
+		// every operation on a ref is atomic and sequentially consistent with all others.
 		class Ref : public Value {
 			public:
 				Ref();
 				Ref( ValuePtr );
 
 				ValuePtr get() const;
+				// the old value
 				ValuePtr set( ValuePtr ) const;
+				// only stores when the ref still holds expected (by identity), true if it did
+				bool     compareAndSet( ValuePtr expected, ValuePtr ) const;
 			private:
 				mutable ValuePtr value;
 		};
+		// the result of a task that may still be running on another thread (see Scheduler).
+		// futures are only equal to themselves.
+		class Future : public Value {
+			public:
+				Future( TaskPtr );
+
+				const TaskPtr task;
+		};
+		// a bounded queue any number of threads can send to and receive from without locks.
+		// a ring of cells with sequence numbers (Vyukov's bounded MPMC queue):
+		// a sender or receiver claims a cell with one compare and swap on tail or head,
+		// the sequence number of the cell tells it if the cell is free or full.
+		// channels are only equal to themselves.
+		class Channel : public Value {
+			public:
+				// the capacity has to be a power of two, value::channel rounds it up
+				Channel( size_t capacity );
+
+				// larger capacities fail, their cells would not fit in memory (or in a size_t)
+				static const size_t MAX_CAPACITY = size_t( 1 ) << 32;
+
+				// false if the channel is full or empty, these never block (see the send and recv builtins)
+				bool trySend( ValuePtr ) const;
+				bool tryReceive( ValuePtr* ) const;
+
+				size_t capacity() const;
+			private:
+				struct Cell {
+					size_t   sequence;
+					ValuePtr value;
+				};
+
+				const size_t   mask;
+				Cell* const    cells;
+				// senders and receivers do not share a cache line
+				char           pad0[64];
+				mutable size_t head;
+				char           pad1[64];
+				mutable size_t tail;
+				char           pad2[64];
+		};
+		// a fixed number of values stored right behind the header, like the env of a lambda.
+		// vectors are equal if their elements are, literals are constants and must not be changed.
+		class Vector : public Value {
+			public:
+				static Vector* alloc( size_t length, ValuePtr fill );
+
+				const   size_t   length;
+				mutable ValuePtr elements[0];
+			private:
+				Vector( size_t length );
+		};
+		// vectors of unboxed numbers, for bulk arithmetic (see Kernels).
+		// they hold no pointers, so the collector never scans them
+		class F64Vector : public Value {
+			public:
+				static F64Vector* alloc( size_t length, double fill );
+
+				const   size_t length;
+				mutable double elements[0];
+			private:
+				F64Vector( size_t length );
+		};
+		class I64Vector : public Value {
+			public:
+				static I64Vector* alloc( size_t length, long fill );
+
+				const   size_t length;
+				mutable long   elements[0];
+			private:
+				I64Vector( size_t length );
+		};
+		// a mutable map from values to values, keys are hashed with value::hash and compared with value::equal.
+		// open addressing with linear probing.
+		// growing does not move all entries at once, every later operation moves a few of them
+		// from the old slots to the new ones, so no single operation pays for the whole table.
+		// a key must not change while it is in a table, tables are not safe to share between threads.
+		// tables are only equal to themselves.
+		class HashTable : public Value {
+			public:
+				HashTable();
+
+				// false if the key is not in the table
+				bool     lookup( ValuePtr key, ValuePtr* dst ) const;
+				// the old value, null if there was none
+				ValuePtr put( ValuePtr key, ValuePtr val ) const;
+				// false if the key was not in the table
+				bool     remove( ValuePtr key, ValuePtr* old ) const;
+
+				size_t   size() const;
+
+				// calls fn( key, value ) for every entry, the table must not change meanwhile
+				template<typename Fn>
+				void     each( Fn fn ) const;
+
+				struct Slot {
+					// 0 for a slot that was never used, 1 for a removed entry
+					size_t   hash;
+					ValuePtr key;
+					ValuePtr value;
+				};
+			private:
+				void     step() const;
+				void     grow() const;
+
+				mutable Slot*  slots;
+				mutable size_t capacity;
+				mutable size_t used;     // slots with an entry or a removed one
+				mutable size_t count;    // entries in both slots and old
+				// the slots before the last resize, entries before next have been moved already
+				mutable Slot*  old;
+				mutable size_t oldCapacity;
+				mutable size_t next;
+		};
+		// the layout of the records defrecord makes, a name and the names of the fields.
+		// there is one type per name and list of fields, they live forever,
+		// so compiled code can compare a record's type with a constant.
+		class RecordType : public gc {
+			public:
+				// the type with this name and these fields, made on first use
+				static const RecordType* get( const util::InternedString& name, const std::vector<util::InternedString>& fields );
+
+				size_t numFields() const;
+				// the index of a field, false if there is no such field
+				bool   fieldIndex( const util::InternedString& field, size_t* dst ) const;
+
+				// the functions defrecord binds, made with the type
+				LambdaPtr constructor() const;
+				LambdaPtr predicate() const;
+				LambdaPtr accessor( size_t field ) const;
+
+				// is fn one of the functions of a record type? which one?
+				static bool isConstructor( LambdaPtr fn, const RecordType** type );
+				static bool isPredicate(   LambdaPtr fn, const RecordType** type );
+				static bool isAccessor(    LambdaPtr fn, const RecordType** type, size_t* field );
+
+				const util::InternedString              name;
+				const std::vector<util::InternedString> fields;
+			private:
+				RecordType( const util::InternedString& name, const std::vector<util::InternedString>& fields );
+
+				LambdaPtr                                       _constructor;
+				LambdaPtr                                       _predicate;
+				std::vector<LambdaPtr, gc_allocator<LambdaPtr>> _accessors;
+		};
+		typedef const RecordType* RecordTypePtr;
+		// a fixed number of named fields right behind the header and the type, see defrecord.
+		// records can not change, they are equal if their types are the same and their fields are equal
+		class Record : public Value {
+			public:
+				// the fields are copied
+				static Record* alloc( RecordTypePtr type, const ValuePtr* fields );
+
+				const RecordTypePtr type;
+				ValuePtr            fields[0];
+			private:
+				Record( RecordTypePtr type );
+		};
 		class Lambda : public Value {
 			public:
 				typedef ValuePtr (*FnPtr)( LambdaPtr );
 
-				struct Data {
-					inline constexpr Data( ast::LambdaPtr ast ) : callCnt( 0 ), code( nullptr ), ast( ast ) {}
+				struct Data : public gc {
+					inline constexpr Data( ast::LambdaPtr ast ) : callCnt( 0 ), allocCnt( 0 ), allocBytes( 0 ), code( nullptr ), ast( ast ) {}
 
 					size_t         callCnt;
+					size_t         allocCnt;   // allocations charged to this function, see Telemetry
+					size_t         allocBytes;
 					FnPtr          code;
 					ast::LambdaPtr ast;										
 				};
@@ -136,7 +307,14 @@ namespace lllm {
 				Lambda( size_t arity, Data* data, FnPtr code );
 		};
 
-		bool equal( ValuePtr, ValuePtr );
+		// vector for values that are only referenced from C++ code (e.g. evaluated arguments)
+		typedef std::vector<ValuePtr, gc_allocator<ValuePtr>> ValueVector;
+
+		bool   equal( ValuePtr, ValuePtr );
+		// consistent with equal: equal values have equal hashes
+		size_t hash( ValuePtr );
+		// hash a cons with this car and cdr would have, without allocating it
+		size_t hash( ValuePtr car, ListPtr cdr );
 
 		extern NilPtr    nil;
 		extern ValuePtr  True();
@@ -148,9 +326,14 @@ namespace lllm {
 		extern RealPtr   number( double );
 		extern CharPtr   character( char );
 		extern StringPtr string( util::CStr );
+		// never allocates for a name that was seen before
 		extern SymbolPtr symbol( const util::InternedString& );
 		extern RefPtr    ref();
 		extern RefPtr    ref( ValuePtr );
+		extern FuturePtr future( TaskPtr );
+		extern ChannelPtr channel( size_t capacity );
+		extern VectorPtr vector( size_t length, ValuePtr fill );
+		extern HashTablePtr hashTable();
 
 		inline ListPtr list() { return nil; }
 		template<typename... Tail>
@@ -177,9 +360,43 @@ namespace lllm {
 			}
 		}
 
+		template<typename Fn>
+		void HashTable::each( Fn fn ) const {
+			for ( size_t i = next; i < oldCapacity; i++ ) {
+				if ( old[i].hash > 1 ) fn( old[i].key, old[i].value );
+			}
+			for ( size_t i = 0; i < capacity; i++ ) {
+				if ( slots[i].hash > 1 ) fn( slots[i].key, slots[i].value );
+			}
+		}
+
+		// byte offsets of the fields compiled code accesses directly (see Jit).
+		// values are not standard layout, so offsetof is only conditionally supported for them,
+		// gcc lays them out like C structs. it is only used here
+		#pragma GCC diagnostic push
+		#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+		constexpr size_t INT_VALUE_OFFSET          = offsetof( Int,       value    );
+		constexpr size_t CONS_CAR_OFFSET           = offsetof( Cons,      car      );
+		constexpr size_t CONS_CDR_OFFSET           = offsetof( Cons,      cdr      );
+		constexpr size_t LAMBDA_CODE_OFFSET        = offsetof( Lambda,    code     );
+		constexpr size_t LAMBDA_DATA_OFFSET        = offsetof( Lambda,    data     );
+		constexpr size_t LAMBDA_ENV_OFFSET         = offsetof( Lambda,    env      );
+		constexpr size_t VECTOR_LENGTH_OFFSET      = offsetof( Vector,    length   );
+		constexpr size_t VECTOR_ELEMENTS_OFFSET    = offsetof( Vector,    elements );
+		constexpr size_t F64VECTOR_ELEMENTS_OFFSET = offsetof( F64Vector, elements );
+		constexpr size_t I64VECTOR_ELEMENTS_OFFSET = offsetof( I64Vector, elements );
+		constexpr size_t RECORD_TYPE_OFFSET        = offsetof( Record,    type     );
+		constexpr size_t RECORD_FIELDS_OFFSET      = offsetof( Record,    fields   );
+		#pragma GCC diagnostic pop
+
 		static_assert( sizeof( Value ) == 8, "Value must be 8 bytes in size" );
-		static_assert( offsetof( Lambda, code ) ==  8, "The code must start at byte 8 of a lambda" );
-		static_assert( offsetof( Lambda, env  ) == 24, "The environment must start at byte 24 of a lambda" );
+		static_assert( LAMBDA_CODE_OFFSET        ==  8, "The code must start at byte 8 of a lambda" );
+		static_assert( LAMBDA_ENV_OFFSET         == 24, "The environment must start at byte 24 of a lambda" );
+		static_assert( VECTOR_ELEMENTS_OFFSET    == 16, "The elements must start at byte 16 of a vector" );
+		static_assert( F64VECTOR_ELEMENTS_OFFSET == 16, "The elements must start at byte 16 of a vector" );
+		static_assert( I64VECTOR_ELEMENTS_OFFSET == 16, "The elements must start at byte 16 of a vector" );
+		static_assert( RECORD_TYPE_OFFSET        ==  8, "The type must start at byte 8 of a record" );
+		static_assert( RECORD_FIELDS_OFFSET      == 16, "The fields must start at byte 16 of a record" );
 	};
 
 	bool operator==( const value::Value&, const value::Value& );
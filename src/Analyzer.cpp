@@ -2,12 +2,14 @@
 #include "lllm/Analyzer.hpp"
 #include "lllm/ast/AstIO.hpp"
 #include "lllm/sexpr/SexprIO.hpp"
+#include "lllm/value/Gc.hpp"
 #include "lllm/util/fail.hpp"
 #include "lllm/util/util_io.hpp"
 
 #include <cassert>
 #include <cstring>
 #include <map>
+#include <string>
 #include <iostream>
 
 using namespace lllm;
@@ -16,6 +18,14 @@ using namespace lllm::util;
 
 typedef util::ScopePtr<ast::VariablePtr> AnalyzerScopePtr;
 
+// variables only referenced from here until they are used in the AST, so the map must be visible to the GC
+typedef std::map<
+	util::InternedString,
+	ast::VariablePtr,
+	std::less<util::InternedString>,
+	gc_allocator<std::pair<const util::InternedString,ast::VariablePtr>>
+> VarMap;
+
 class LocalScope : public util::Scope<ast::VariablePtr> {
 	public:
 		LocalScope( util::ScopePtr<ast::VariablePtr> parent );
@@ -31,7 +41,7 @@ class LocalScope : public util::Scope<ast::VariablePtr> {
 	private:
 		const util::ScopePtr<ast::VariablePtr>          parent;
 		ast::LetStar::Bindings                          asts;
-		std::map<util::InternedString,ast::VariablePtr> vars;
+		VarMap                                          vars;
 };
 struct LambdaScope : public util::Scope<ast::VariablePtr> {
 	LambdaScope( util::ScopePtr<ast::VariablePtr> parent );
@@ -55,26 +65,83 @@ private:
 	ast::Lambda::Bindings                  capture;
 };
 
+// runtime values of the literals in one top level form.
+// equal literals share one value, so the pool also keeps repeated constants from allocating twice.
+class ConstantPool final {
+	public:
+		value::ValuePtr number( long l ) {
+			value::ValuePtr& v = ints[l];
+			if ( !v ) v = value::number( l );
+			return v;
+		}
+		value::ValuePtr number( double d ) {
+			// by bits, so 0.0 and -0.0 stay apart
+			long bits;
+			std::memcpy( &bits, &d, sizeof(bits) );
+
+			value::ValuePtr& v = reals[bits];
+			if ( !v ) v = value::number( d );
+			return v;
+		}
+		value::ValuePtr character( char c ) {
+			value::ValuePtr& v = chars[(unsigned char) c];
+			if ( !v ) v = value::character( c );
+			return v;
+		}
+		value::StringPtr string( CStr str ) {
+			value::StringPtr& v = strings[str];
+			// the reader's copy is freed with its arena
+			if ( !v ) v = value::string( GC_STRDUP( str ) );
+			return v;
+		}
+
+		// the pool of the form being analyzed on this thread
+		static __thread ConstantPool* current;
+	private:
+		template<typename K, typename V = value::ValuePtr>
+		using Table = std::map<K, V, std::less<K>, traceable_allocator<std::pair<const K, V>>>;
+
+		Table<long>                          ints;
+		Table<long>                          reals;
+		Table<std::string, value::StringPtr> strings;
+		value::ValuePtr                      chars[256] = {};
+};
+
+__thread ConstantPool* ConstantPool::current = nullptr;
+
 static AstPtr analyzeExpr( sexpr::SexprPtr expr, AnalyzerScopePtr ctx );
 static AstPtr analyzeQuote( sexpr::ListPtr expr );
+static value::ValuePtr quote( sexpr::SexprPtr expr );
 static AstPtr analyzeIf( sexpr::ListPtr expr, AnalyzerScopePtr ctx );
 static AstPtr analyzeLet( sexpr::ListPtr expr, AnalyzerScopePtr ctx );
 static AstPtr analyzeLetStar( sexpr::ListPtr expr, AnalyzerScopePtr ctx );
 static AstPtr analyzeDo( sexpr::ListPtr expr, AnalyzerScopePtr ctx );
 static AstPtr analyzeLambda( sexpr::ListPtr expr, AnalyzerScopePtr ctx );
 static AstPtr analyzeDefine( sexpr::ListPtr expr, AnalyzerScopePtr ctx );
+static AstPtr analyzeDefrecord( sexpr::ListPtr expr, AnalyzerScopePtr ctx );
 static AstPtr analyzeApplication( sexpr::ListPtr expr, AnalyzerScopePtr ctx );
 
 static inline bool isLambda( sexpr::SexprPtr form );
 
 AstPtr Analyzer::analyze( sexpr::SexprPtr expr, GlobalScopePtr scope ) {
-	// handle define form specially
+	ConstantPool  pool;
+	ConstantPool* outer = ConstantPool::current;
+	ConstantPool::current = &pool;
+	struct Restore final {
+		~Restore() { ConstantPool::current = outer; }
+		ConstantPool* outer;
+	} restore{ outer };
+
+	// handle define forms specially
 	if ( sexpr::ListPtr form = expr->asList() ) {
 		if ( sexpr::length( form ) > 0 ) {
 			if ( sexpr::SymbolPtr sym = sexpr::at( form, 0 )->asSymbol() ) {
 				if ( "define" == sym->value ) {
 					return analyzeDefine( form, scope );
 				}
+				if ( "defrecord" == sym->value ) {
+					return analyzeDefrecord( form, scope );
+				}
 			}
 		}
 	}	
@@ -82,19 +149,38 @@ AstPtr Analyzer::analyze( sexpr::SexprPtr expr, GlobalScopePtr scope ) {
 	return analyzeExpr( expr, scope );
 }
 
+Analyzer::Definitions Analyzer::definitions( AstPtr ast ) {
+	Definitions defs;
+
+	if ( DefinePtr def = ast->as<Define>() ) {
+		defs.push_back( def );
+	} else if ( DoPtr forms = ast->as<Do>() ) {
+		// only a defrecord makes a do of defines, defines can not appear in a do otherwise
+		for ( auto it = forms->begin(), end = forms->end(); it != end; ++it ) {
+			DefinePtr def = (*it)->as<Define>();
+			if ( !def ) return Definitions();
+
+			defs.push_back( def );
+		}
+	}
+
+	return defs;
+}
+
 AstPtr analyzeExpr( sexpr::SexprPtr expr, AnalyzerScopePtr ctx ) {
 	struct Visitor final {
 		AstPtr visit( sexpr::IntPtr    expr, AnalyzerScopePtr ctx ) const {
-			return new Int( expr->location, expr->value );
+			return new Int( expr->location, expr->value, ConstantPool::current->number( expr->value ) );
 		}
 		AstPtr visit( sexpr::RealPtr   expr, AnalyzerScopePtr ctx ) const {
-			return new Real( expr->location, expr->value );
+			return new Real( expr->location, expr->value, ConstantPool::current->number( expr->value ) );
 		}
 		AstPtr visit( sexpr::CharPtr   expr, AnalyzerScopePtr ctx ) const {
-			return new Char( expr->location, expr->value );
+			return new Char( expr->location, expr->value, ConstantPool::current->character( expr->value ) );
 		}
 		AstPtr visit( sexpr::StringPtr expr, AnalyzerScopePtr ctx ) const {
-			return new String( expr->location, expr->value );
+			value::StringPtr str = ConstantPool::current->string( expr->value );
+			return new String( expr->location, str->value, str );
 		}
 		AstPtr visit( sexpr::SymbolPtr expr, AnalyzerScopePtr ctx ) const {
 			VariablePtr var;
@@ -115,13 +201,17 @@ AstPtr analyzeExpr( sexpr::SexprPtr expr, AnalyzerScopePtr ctx ) {
 				if ( "let*"   == sym->value ) return analyzeLetStar( expr, ctx );
 				if ( "do"     == sym->value ) return analyzeDo( expr, ctx );
 				if ( "lambda" == sym->value ) return analyzeLambda( expr, ctx );
-				if ( "define" == sym->value ) {
-					LLLM_FAIL( expr->location << " : define forms may only appear at the top level" );
+				if ( "define" == sym->value || "defrecord" == sym->value ) {
+					LLLM_FAIL( expr->location << " : " << sym->value << " forms may only appear at the top level" );
 				}
 			}
 
 			return analyzeApplication( expr, ctx );
 		}
+		// vector literals quote themselves
+		AstPtr visit( sexpr::VectorPtr expr, AnalyzerScopePtr ctx ) const {
+			return new Quote( expr->location, quote( expr ) );
+		}
 	};
 
 //	std::cout << "ANALYZING   '" << expr << "'" << std::endl;
@@ -139,11 +229,17 @@ AstPtr analyzeQuote( sexpr::ListPtr expr ) {
 
 	if ( sexpr::length( expr ) != 2 ) LLLM_FAIL( expr->location << "A quote must be of the form (quote <value>) not " << expr );
 
+	return new Quote( expr->location, quote( sexpr::at( expr, 1 ) ) );
+}
+
+static value::ValuePtr quote( sexpr::SexprPtr expr ) {
+	using namespace value;
+
 	struct Visitor final {
-		ValuePtr       visit( sexpr::IntPtr    expr ) const { return value::number( expr->value );    }
-		ValuePtr       visit( sexpr::RealPtr   expr ) const { return value::number( expr->value );    }
-		ValuePtr       visit( sexpr::CharPtr   expr ) const { return value::character( expr->value ); }
-		ValuePtr       visit( sexpr::StringPtr expr ) const { return value::string( expr->value );    }
+		ValuePtr       visit( sexpr::IntPtr    expr ) const { return ConstantPool::current->number( expr->value );    }
+		ValuePtr       visit( sexpr::RealPtr   expr ) const { return ConstantPool::current->number( expr->value );    }
+		ValuePtr       visit( sexpr::CharPtr   expr ) const { return ConstantPool::current->character( expr->value ); }
+		ValuePtr       visit( sexpr::StringPtr expr ) const { return ConstantPool::current->string( expr->value );    }
 		ValuePtr       visit( sexpr::SymbolPtr expr ) const { return value::symbol( expr->value );    }
 		value::ListPtr visit( sexpr::ListPtr   expr ) const { return visit( expr, 0 );                }
 		value::ListPtr visit( sexpr::ListPtr expr, int i ) const {
@@ -156,11 +252,17 @@ AstPtr analyzeQuote( sexpr::ListPtr expr ) {
 				return value::nil;
 			}
 		}
-	};
+		ValuePtr       visit( sexpr::VectorPtr expr ) const {
+			Vector* vec = Vector::alloc( expr->value.length, nullptr );
 
-	ValuePtr val = sexpr::at( expr, 1 )->visit<ValuePtr>( Visitor() );
+			for ( size_t i = 0; i < expr->value.length; i++ ) vec->elements[i] = expr->value.items[i]->visit<ValuePtr>( *this );
+			Gc::written( vec );
+
+			return vec;
+		}
+	};
 
-	return new Quote( expr->location, val );
+	return expr->visit<ValuePtr>( Visitor() );
 }
 
 AstPtr analyzeIf( sexpr::ListPtr expr, AnalyzerScopePtr ctx ) {
@@ -178,8 +280,6 @@ AstPtr analyzeIf( sexpr::ListPtr expr, AnalyzerScopePtr ctx ) {
 	);
 }
 static AstPtr analyzeLet( sexpr::ListPtr expr, AnalyzerScopePtr ctx ) {
-	std::cout << "LET " << expr << std::endl;
-
 	using namespace value;
 
 	assert( sexpr::at( expr, 0 )->asSymbol() );
@@ -262,9 +362,9 @@ static AstPtr analyzeDo( sexpr::ListPtr expr, AnalyzerScopePtr ctx ) {
 	assert( sexpr::at( expr, 0 )->asSymbol() );
 	assert( sexpr::at( expr, 0 )->asSymbol()->value == "do" );
 
-	std::vector<AstPtr> exprs;
+	AstVector exprs;
 
-	for ( auto it = ++(sexpr::begin( expr )), end = sexpr::end( expr ); it != end; ++it ) {
+	for ( auto it = sexpr::begin( expr ) + 1, end = sexpr::end( expr ); it != end; ++it ) {
 		sexpr::SexprPtr sexpr = *it;
 
 		exprs.push_back( analyzeExpr( sexpr, ctx ) );
@@ -322,9 +422,9 @@ static AstPtr analyzeApplication( sexpr::ListPtr expr, AnalyzerScopePtr ctx ) {
 		LLLM_FAIL( expr->location << " : The head of an application must be a function, " << fun << ", is one of " << fun->possibleTypes() );
 	}
 
-	std::vector<AstPtr> args;
+	AstVector args;
 	
-	for ( auto it = ++sexpr::begin( expr ), end = sexpr::end( expr ); it != end; ++it ) {
+	for ( auto it = sexpr::begin( expr ) + 1, end = sexpr::end( expr ); it != end; ++it ) {
 		args.push_back( analyzeExpr( *it, ctx ) );
 	}	
 
@@ -351,6 +451,51 @@ AstPtr analyzeDefine( sexpr::ListPtr expr, AnalyzerScopePtr ctx ) {
 	}
 }
 
+// (defrecord point x y) defines make-point, point?, point-x and point-y.
+// each define calls the builtin that finds the function for the type, every defrecord of the same type finds the same ones
+AstPtr analyzeDefrecord( sexpr::ListPtr expr, AnalyzerScopePtr ctx ) {
+	sexpr::SymbolPtr name = sexpr::length( expr ) >= 2 ? sexpr::at( expr, 1 )->asSymbol() : nullptr;
+	if ( !name ) LLLM_FAIL( expr->location << ": A defrecord must be of the form (defrecord <name> <field>...) not " << expr );
+
+	std::vector<InternedString> fields;
+	for ( auto it = sexpr::begin( expr ) + 2, end = sexpr::end( expr ); it != end; ++it ) {
+		sexpr::SymbolPtr field = (*it)->asSymbol();
+		if ( !field ) LLLM_FAIL( (*it)->location << ": The fields of a record must all be symbols, not " << (*it) );
+
+		for ( auto& other : fields ) {
+			if ( other == field->value ) LLLM_FAIL( (*it)->location << ": Record " << name << " has two fields named " << field );
+		}
+		fields.push_back( field->value );
+	}
+
+	value::ListPtr fieldList = value::nil;
+	for ( size_t i = fields.size(); i > 0; i-- ) fieldList = value::cons( value::symbol( fields[i - 1] ), fieldList );
+
+	auto builtin = [&]( CStr fn ) -> AstPtr {
+		VariablePtr var;
+		if ( !ctx->lookup( fn, &var ) ) LLLM_FAIL( expr->location << ": Undefined symbol '" << fn << "'" );
+		return var;
+	};
+	auto define = [&]( const std::string& global, CStr fn, AstVector args ) -> AstPtr {
+		args.insert( args.begin(), new Quote( expr->location, fieldList ) );
+		args.insert( args.begin(), new Quote( expr->location, value::symbol( name->value ) ) );
+
+		return new Define( expr->location, InternedString( global.c_str() ), new Application( expr->location, builtin( fn ), args ) );
+	};
+
+	std::string prefix( (CStr) name->value );
+
+	AstVector defines;
+	defines.push_back( define( "make-" + prefix, "record-constructor", AstVector() ) );
+	defines.push_back( define( prefix + "?",     "record-predicate",   AstVector() ) );
+	for ( auto& field : fields ) {
+		AstVector args{ new Quote( expr->location, value::symbol( field ) ) };
+		defines.push_back( define( prefix + "-" + (CStr) field, "record-accessor", args ) );
+	}
+
+	return new Do( expr->location, defines );
+}
+
 LocalScope::LocalScope( util::ScopePtr<ast::VariablePtr> parent )   : parent( parent ) {}
 LambdaScope::LambdaScope( util::ScopePtr<ast::VariablePtr> parent ) : parent( parent ), self( nullptr ) {}
 
@@ -0,0 +1,691 @@
+#include "lllm/AstCache.hpp"
+#include "lllm/value/Value.hpp"
+#include "lllm/value/Gc.hpp"
+#include "lllm/value/ValueIO.hpp"
+#include "lllm/util/fail.hpp"
+#include "lllm/util/util_io.hpp"
+
+#include <gc.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace lllm;
+using namespace lllm::ast;
+using namespace lllm::util;
+
+static const char     MAGIC[8] = { 'L', 'L', 'L', 'M', 'A', 'S', 'T', '\0' };
+static const uint32_t VERSION  = 2;
+
+// magic, version, source hash, size of the whole file, number of strings, number of forms.
+// a node starts with its type and location (file, line, column)
+static const size_t HEADER_SIZE = sizeof(MAGIC) + 4 + 8 + 8 + 4 + 4;
+
+// tags of quoted values
+enum : uint8_t { NIL, INT, REAL, CHAR, STRING, SYMBOL, LIST, VECTOR };
+
+// kinds of variables
+enum : uint8_t { GLOBAL, LOCAL };
+
+// maps a whole file read only, null for empty or unreadable files
+static const char* mapFile( CStr fileName, size_t* size ) {
+	int fd = open( fileName, O_RDONLY );
+	if ( fd < 0 ) return nullptr;
+
+	struct stat st;
+	void* data = nullptr;
+
+	if ( fstat( fd, &st ) == 0 && st.st_size > 0 ) {
+		data = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if ( data == MAP_FAILED ) data = nullptr;
+	}
+
+	close( fd );
+
+	*size = data ? st.st_size : 0;
+	return (const char*) data;
+}
+
+//***** AST CACHE ******************************************************************************************************
+
+uint64_t AstCache::hashFile( CStr fileName ) {
+	size_t      size;
+	const char* data = mapFile( fileName, &size );
+
+	if ( !data ) return 0;
+
+	// FNV-1a
+	uint64_t h = 14695981039346656037ull;
+	for ( size_t i = 0; i < size; i++ ) {
+		h ^= (unsigned char) data[i];
+		h *= 1099511628211ull;
+	}
+	h ^= size;
+
+	munmap( (void*) data, size );
+
+	// 0 means 'no hash'
+	return h ? h : 1;
+}
+
+std::string AstCache::pathFor( CStr sourceName ) {
+	return std::string( sourceName ) + ".ast";
+}
+
+//***** WRITER *********************************************************************************************************
+
+AstWriter::AstWriter( CStr sourceName, uint64_t sourceHash ) : sourceHash( sourceHash ), numStrings( 0 ), numForms( 0 ), lastFile( nullptr ), lastFileId( 0 ) {
+	// string 0 is the name of the source
+	string( sourceName );
+}
+
+void AstWriter::add( AstPtr form ) {
+	node( form );
+	endForm();
+}
+
+void AstWriter::endForm() {
+	if ( nodeIds.empty() ) return;
+
+	uint32_t count = nodeIds.size();
+	forms.append( (const char*) &count, sizeof(count) );
+	forms.append( nodes );
+	numForms++;
+
+	nodeIds.clear();
+	nodes.clear();
+}
+
+std::string AstWriter::bytes() const {
+	uint64_t fileSize = HEADER_SIZE + strings.size() + forms.size();
+
+	std::string out( MAGIC, sizeof(MAGIC) );
+	out.reserve( fileSize );
+	out.append( (const char*) &VERSION,    4 );
+	out.append( (const char*) &sourceHash, 8 );
+	out.append( (const char*) &fileSize,   8 );
+	out.append( (const char*) &numStrings, 4 );
+	out.append( (const char*) &numForms,   4 );
+	out.append( strings );
+	out.append( forms );
+	return out;
+}
+
+bool AstWriter::write( CStr fileName ) const {
+	std::string contents = bytes();
+
+	// written to the side and renamed, a reader never sees half a file
+	std::string tmp = std::string( fileName ) + ".tmp";
+
+	FILE* out = std::fopen( tmp.c_str(), "wb" );
+	if ( !out ) return false;
+
+	bool ok = std::fwrite( contents.data(), 1, contents.size(), out ) == contents.size();
+
+	ok = (std::fclose( out ) == 0) && ok;
+	ok = ok && (std::rename( tmp.c_str(), fileName ) == 0);
+
+	if ( !ok ) std::remove( tmp.c_str() );
+
+	return ok;
+}
+
+uint32_t AstWriter::node( AstPtr ast ) {
+	auto it = nodeIds.find( ast );
+	if ( it != nodeIds.end() ) return it->second;
+
+	// children are written first, so a node only refers to nodes before it
+	struct Visitor final {
+		void visit( NilPtr ast ) const {
+			w->u8( uint8_t( Nil::TAG ) );
+			w->location( ast );
+		}
+		void visit( IntPtr ast ) const {
+			w->u8( uint8_t( Int::TAG ) );
+			w->location( ast );
+			w->u64( ast->value );
+			w->u8( uint8_t( ast->escape ) );
+		}
+		void visit( RealPtr ast ) const {
+			uint64_t bits;
+			std::memcpy( &bits, &ast->value, sizeof(bits) );
+
+			w->u8( uint8_t( Real::TAG ) );
+			w->location( ast );
+			w->u64( bits );
+			w->u8( uint8_t( ast->escape ) );
+		}
+		void visit( CharPtr ast ) const {
+			w->u8( uint8_t( Char::TAG ) );
+			w->location( ast );
+			w->u8( ast->value );
+			w->u8( uint8_t( ast->escape ) );
+		}
+		void visit( StringPtr ast ) const {
+			w->u8( uint8_t( String::TAG ) );
+			w->location( ast );
+			w->u32( w->string( ast->value ) );
+			w->u8( uint8_t( ast->escape ) );
+		}
+		void visit( VariablePtr ast ) const {
+			// globals are looked up by name when the form is read
+			if ( ast->hasGlobalStorage ) {
+				w->u8( uint8_t( Variable::TAG ) );
+				w->location( ast );
+				w->u8( GLOBAL );
+				w->u32( w->string( ast->name ) );
+				return;
+			}
+
+			uint32_t init = ast->ast ? w->node( ast->ast ) + 1 : 0;
+
+			w->u8( uint8_t( Variable::TAG ) );
+			w->location( ast );
+			w->u8( LOCAL );
+			w->u32( w->string( ast->name ) );
+			w->u32( init );
+			w->u8( ast->getsCaptured );
+		}
+		void visit( QuotePtr ast ) const {
+			w->u8( uint8_t( Quote::TAG ) );
+			w->location( ast );
+			w->value( ast->value );
+		}
+		void visit( IfPtr ast ) const {
+			uint32_t test       = w->node( ast->test );
+			uint32_t thenBranch = w->node( ast->thenBranch );
+			uint32_t elseBranch = w->node( ast->elseBranch );
+
+			w->u8( uint8_t( If::TAG ) );
+			w->location( ast );
+			w->u32( test );
+			w->u32( thenBranch );
+			w->u32( elseBranch );
+		}
+		void visit( DoPtr ast ) const {
+			std::vector<uint32_t> exprs;
+			for ( AstPtr expr : ast->exprs ) exprs.push_back( w->node( expr ) );
+
+			w->u8( uint8_t( Do::TAG ) );
+			w->location( ast );
+			refs( exprs );
+		}
+		void visit( LetPtr ast ) const {
+			bindings( ast, Let::TAG, ast->bindings, ast->body );
+		}
+		void visit( LetStarPtr ast ) const {
+			bindings( ast, LetStar::TAG, ast->bindings, ast->body );
+		}
+		void visit( LambdaPtr ast ) const {
+			std::vector<uint32_t> params, capture;
+			for ( VariablePtr var : ast->params )  params.push_back( w->node( var ) );
+			for ( VariablePtr var : ast->capture ) capture.push_back( w->node( var ) );
+			uint32_t body = w->node( ast->body );
+
+			w->u8( uint8_t( Lambda::TAG ) );
+			w->location( ast );
+			w->u32( w->string( ast->name ) );
+			refs( params );
+			refs( capture );
+			w->u32( body );
+		}
+		void visit( DefinePtr ast ) const {
+			uint32_t expr = w->node( ast->expr );
+
+			w->u8( uint8_t( Define::TAG ) );
+			w->location( ast );
+			w->u32( w->string( ast->name ) );
+			w->u32( expr );
+		}
+		void visit( ApplicationPtr ast ) const {
+			uint32_t fun = w->node( ast->fun );
+
+			std::vector<uint32_t> args;
+			for ( AstPtr arg : ast->args ) args.push_back( w->node( arg ) );
+
+			w->u8( uint8_t( Application::TAG ) );
+			w->location( ast );
+			w->u32( fun );
+			refs( args );
+		}
+
+		// let and let* bindings have the same type
+		void bindings( AstPtr ast, Type tag, const Let::Bindings& bindings, AstPtr body ) const {
+			std::vector<uint32_t> values;
+			for ( auto& binding : bindings ) values.push_back( w->node( binding.second ) );
+			uint32_t b = w->node( body );
+
+			w->u8( uint8_t( tag ) );
+			w->location( ast );
+			w->u32( values.size() );
+			for ( size_t i = 0; i < values.size(); i++ ) {
+				w->u32( w->string( bindings[i].first ) );
+				w->u32( values[i] );
+			}
+			w->u32( b );
+		}
+		void refs( const std::vector<uint32_t>& ids ) const {
+			w->u32( ids.size() );
+			for ( uint32_t id : ids ) w->u32( id );
+		}
+
+		AstWriter* w;
+	};
+
+	ast->visit<void>( Visitor{ this } );
+
+	uint32_t id = nodeIds.size();
+	nodeIds[ast] = id;
+	return id;
+}
+
+uint32_t AstWriter::string( CStr str ) {
+	auto it = stringIds.find( str );
+	if ( it != stringIds.end() ) return it->second;
+
+	uint32_t length = std::strlen( str );
+	strings.append( (const char*) &length, sizeof(length) );
+	strings.append( str, length + 1 );
+
+	stringIds[str] = numStrings;
+	return numStrings++;
+}
+
+void AstWriter::value( value::ValuePtr val ) {
+	switch ( value::typeOf( val ) ) {
+		case value::Type::Nil:
+			u8( NIL );
+			return;
+		case value::Type::Int:
+			u8( INT );
+			u64( value::Value::asInt( val )->value );
+			return;
+		case value::Type::Real: {
+			double   d = value::Value::asReal( val )->value;
+			uint64_t bits;
+			std::memcpy( &bits, &d, sizeof(bits) );
+
+			u8( REAL );
+			u64( bits );
+			return;
+		}
+		case value::Type::Char:
+			u8( CHAR );
+			u8( value::Value::asChar( val )->value );
+			return;
+		case value::Type::String:
+			u8( STRING );
+			u32( string( value::Value::asString( val )->value ) );
+			return;
+		case value::Type::Symbol:
+			u8( SYMBOL );
+			u32( string( value::Value::asSymbol( val )->value ) );
+			return;
+		case value::Type::Cons: {
+			// elements first, then the tail, so long lists do not recurse
+			uint32_t length = 0;
+			for ( value::ValuePtr v = val; value::typeOf( v ) == value::Type::Cons; v = value::Value::asCons( v )->cdr ) length++;
+
+			u8( LIST );
+			u32( length );
+
+			value::ValuePtr v = val;
+			for ( ; value::typeOf( v ) == value::Type::Cons; v = value::Value::asCons( v )->cdr ) {
+				value( value::Value::asCons( v )->car );
+			}
+			value( v );
+			return;
+		}
+		case value::Type::Vector: {
+			value::VectorPtr vec = value::Value::asVector( val );
+
+			u8( VECTOR );
+			u32( vec->length );
+			for ( size_t i = 0; i < vec->length; i++ ) value( vec->elements[i] );
+			return;
+		}
+		default:
+			LLLM_FAIL( "Can not cache quoted value " << val );
+	}
+}
+
+void AstWriter::u8( uint8_t v )   { nodes.push_back( char( v ) ); }
+void AstWriter::u32( uint32_t v ) { nodes.append( (const char*) &v, sizeof(v) ); }
+void AstWriter::u64( uint64_t v ) { nodes.append( (const char*) &v, sizeof(v) ); }
+
+void AstWriter::location( AstPtr ast ) {
+	CStr file = ast->location.file();
+
+	if ( file != lastFile ) {
+		lastFile   = file;
+		lastFileId = string( file );
+	}
+
+	u32( lastFileId );
+	u32( ast->location.line() );
+	u32( ast->location.column() );
+}
+
+//***** READER *********************************************************************************************************
+
+AstReader::AstReader( CStr fileName, uint64_t sourceHash ) : data( nullptr ), size( 0 ), pos( 0 ), formsLeft( 0 ), mapped( true ), file( nullptr ), lastFileId( 0 ), lastFile( nullptr ) {
+	data = mapFile( fileName, &size );
+
+	if ( data ) open( sourceHash );
+}
+AstReader::AstReader( const char* data, size_t size, uint64_t sourceHash ) : data( data ), size( size ), pos( 0 ), formsLeft( 0 ), mapped( false ), file( nullptr ), lastFileId( 0 ), lastFile( nullptr ) {
+	if ( data ) open( sourceHash );
+}
+
+void AstReader::open( uint64_t sourceHash ) {
+
+	uint32_t version, numStrings;
+	uint64_t hash, fileSize;
+
+	bool ok = size >= HEADER_SIZE && std::memcmp( data, MAGIC, sizeof(MAGIC) ) == 0;
+
+	if ( ok ) {
+		pos = sizeof(MAGIC);
+		version    = u32();
+		hash       = u64();
+		fileSize   = u64();
+		numStrings = u32();
+		formsLeft  = u32();
+
+		// a truncated file is rejected here instead of failing halfway through loading it
+		ok = version == VERSION && hash == sourceHash && fileSize == size && numStrings > 0;
+	}
+
+	// strings are used in place, only their offsets are collected
+	for ( uint32_t i = 0; ok && i < numStrings; i++ ) {
+		uint32_t length;
+
+		ok = pos + sizeof(length) <= size;
+		if ( !ok ) break;
+
+		std::memcpy( &length, data + pos, sizeof(length) );
+		pos += sizeof(length);
+
+		ok = size - pos > length && data[pos + length] == '\0';
+		if ( !ok ) break;
+
+		strings.push_back( pos );
+		pos += length + 1;
+	}
+
+	if ( !ok ) {
+		if ( mapped ) munmap( (void*) data, size );
+		data = nullptr;
+		return;
+	}
+
+	file       = InternedString( data + strings[0] );
+	lastFile   = file;
+}
+
+AstReader::~AstReader() {
+	if ( data && mapped ) munmap( (void*) data, size );
+}
+
+bool AstReader::valid() const { return data != nullptr; }
+
+AstPtr AstReader::read( ScopePtr<VariablePtr> globals ) {
+	if ( !formsLeft ) return nullptr;
+
+	uint32_t count = u32();
+
+	if ( count == 0 ) LLLM_FAIL( "Corrupt AST cache for " << file << ": empty form" );
+
+	nodes.clear();
+	nodes.reserve( count );
+
+	// nearly every node read stays alive, collecting while they are built would be wasted work
+	GC_disable();
+	struct Enable final {
+		~Enable() { GC_enable(); }
+	} enable;
+
+	for ( uint32_t i = 0; i < count; i++ ) {
+		nodes.push_back( node( globals ) );
+	}
+
+	formsLeft--;
+
+	// the root comes last
+	return nodes.back();
+}
+
+AstPtr AstReader::node( ScopePtr<VariablePtr> globals ) {
+	Type type = Type( u8() );
+
+	CStr     source = location();
+	unsigned line   = u32();
+	unsigned column = u32();
+
+	SourceLocation loc( source, line, column );
+
+	switch ( type ) {
+		case Type::Nil:
+			return new Nil( loc );
+		case Type::Int: {
+			long  l   = (long) u64();
+			IntPtr ast = new Int( loc, l, value::number( l ) );
+			ast->escape = EscapeStatus( u8() );
+			return ast;
+		}
+		case Type::Real: {
+			uint64_t bits = u64();
+			double   d;
+			std::memcpy( &d, &bits, sizeof(d) );
+
+			RealPtr ast = new Real( loc, d, value::number( d ) );
+			ast->escape = EscapeStatus( u8() );
+			return ast;
+		}
+		case Type::Char: {
+			char    c   = (char) u8();
+			CharPtr ast = new Char( loc, c, value::character( c ) );
+			ast->escape = EscapeStatus( u8() );
+			return ast;
+		}
+		case Type::String: {
+			value::StringPtr str = value::string( GC_STRDUP( string() ) );
+			StringPtr        ast = new String( loc, str->value, str );
+			ast->escape = EscapeStatus( u8() );
+			return ast;
+		}
+		case Type::Variable: {
+			uint8_t kind = u8();
+
+			InternedString name = this->name();
+
+			if ( kind == GLOBAL ) {
+				VariablePtr var;
+				if ( !globals->lookup( name, &var ) ) {
+					LLLM_FAIL( loc << ": Undefined global '" << name << "' in cached form" );
+				}
+				return var;
+			}
+
+			uint32_t    init = u32();
+			VariablePtr var  = Variable::makeLocal( loc, name, init ? nodes.at( init - 1 ) : nullptr );
+			var->getsCaptured = u8();
+			return var;
+		}
+		case Type::Quote:
+			return new Quote( loc, value() );
+		case Type::If: {
+			AstPtr test       = ref();
+			AstPtr thenBranch = ref();
+			AstPtr elseBranch = ref();
+			return new If( loc, test, thenBranch, elseBranch );
+		}
+		case Type::Do: {
+			exprs.resize( u32() );
+			for ( AstPtr& expr : exprs ) expr = ref();
+			return new Do( loc, exprs );
+		}
+		case Type::Let:
+		case Type::LetStar: {
+			bindings.resize( u32() );
+			for ( Let::Binding& binding : bindings ) {
+				binding.first  = name();
+				binding.second = ref();
+			}
+			AstPtr body = ref();
+
+			if ( type == Type::Let ) return new Let( loc, bindings, body );
+			return new LetStar( loc, bindings, body );
+		}
+		case Type::Lambda: {
+			InternedString name = this->name();
+
+			params.resize( u32() );
+			for ( VariablePtr& var : params ) var = variable();
+			capture.resize( u32() );
+			for ( VariablePtr& var : capture ) var = variable();
+
+			return new Lambda( loc, name, params, capture, ref() );
+		}
+		case Type::Define: {
+			InternedString name = this->name();
+
+			return new Define( loc, name, ref() );
+		}
+		case Type::Application: {
+			AstPtr fun = ref();
+			exprs.resize( u32() );
+			for ( AstPtr& arg : exprs ) arg = ref();
+			return new Application( loc, fun, exprs );
+		}
+	}
+
+	LLLM_FAIL( "Corrupt AST cache for " << file << ": unknown node type " << size_t( type ) );
+}
+
+AstPtr AstReader::ref() {
+	uint32_t id = u32();
+
+	if ( id >= nodes.size() ) LLLM_FAIL( "Corrupt AST cache for " << file << ": node " << id << " does not exist yet" );
+
+	return nodes[id];
+}
+
+VariablePtr AstReader::variable() {
+	VariablePtr var = ref()->as<Variable>();
+
+	if ( !var ) LLLM_FAIL( "Corrupt AST cache for " << file << ": expected a variable" );
+
+	return var;
+}
+
+value::ValuePtr AstReader::value() {
+	switch ( u8() ) {
+		case NIL:
+			return value::nil;
+		case INT:
+			return value::number( (long) u64() );
+		case REAL: {
+			uint64_t bits = u64();
+			double   d;
+			std::memcpy( &d, &bits, sizeof(d) );
+			return value::number( d );
+		}
+		case CHAR:
+			return value::character( (char) u8() );
+		case STRING:
+			return value::string( GC_STRDUP( string() ) );
+		case SYMBOL:
+			return value::symbol( name() );
+		case LIST: {
+			value::ValueVector elems( u32() );
+			for ( value::ValuePtr& elem : elems ) elem = value();
+
+			value::ValuePtr tail = value();
+			if ( !value::Value::isList( tail ) ) LLLM_FAIL( "Corrupt AST cache for " << file << ": improper list" );
+
+			value::ListPtr list = static_cast<value::ListPtr>( tail );
+			for ( size_t i = elems.size(); i > 0; i-- ) list = value::cons( elems[i - 1], list );
+			return list;
+		}
+		case VECTOR: {
+			value::Vector* vec = value::Vector::alloc( u32(), nullptr );
+			for ( size_t i = 0; i < vec->length; i++ ) vec->elements[i] = value();
+			value::Gc::written( vec );
+			return vec;
+		}
+	}
+
+	LLLM_FAIL( "Corrupt AST cache for " << file << ": unknown value" );
+}
+
+AstPtr AstReader::at( uint32_t id ) const {
+	if ( id >= nodes.size() ) LLLM_FAIL( "Corrupt AST cache for " << file << ": node " << id << " does not exist" );
+
+	return nodes[id];
+}
+
+CStr AstReader::string( uint32_t id ) const {
+	return data + offset( id );
+}
+
+InternedString AstReader::name( uint32_t id ) const {
+	size_t   at = offset( id );
+	uint32_t length;
+	std::memcpy( &length, data + at - sizeof(length), sizeof(length) );
+
+	return InternedString( data + at, length );
+}
+
+CStr AstReader::location() {
+	uint32_t id = u32();
+
+	if ( id != lastFileId ) {
+		lastFileId = id;
+		lastFile   = name( id );
+	}
+
+	return lastFile;
+}
+
+CStr AstReader::string() {
+	return string( u32() );
+}
+
+InternedString AstReader::name() {
+	return name( u32() );
+}
+
+size_t AstReader::offset( uint32_t id ) const {
+	if ( id >= strings.size() ) LLLM_FAIL( "Corrupt AST cache for " << file << ": string " << id << " does not exist" );
+
+	return strings[id];
+}
+
+uint8_t AstReader::u8() {
+	check( 1 );
+	return (uint8_t) data[pos++];
+}
+uint32_t AstReader::u32() {
+	uint32_t v;
+	check( sizeof(v) );
+	std::memcpy( &v, data + pos, sizeof(v) );
+	pos += sizeof(v);
+	return v;
+}
+uint64_t AstReader::u64() {
+	uint64_t v;
+	check( sizeof(v) );
+	std::memcpy( &v, data + pos, sizeof(v) );
+	pos += sizeof(v);
+	return v;
+}
+
+void AstReader::check( size_t bytes ) const {
+	if ( size - pos < bytes ) LLLM_FAIL( "Corrupt AST cache for " << file << ": unexpected end of file" );
+}
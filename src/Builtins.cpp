@@ -1,8 +1,13 @@
 
 #include "lllm/Builtins.hpp"
 #include "lllm/Evaluator.hpp"
+#include "lllm/Fiber.hpp"
+#include "lllm/Scheduler.hpp"
 #include "lllm/ast/AstIO.hpp"
 #include "lllm/value/ValueIO.hpp"
+#include "lllm/value/Telemetry.hpp"
+#include "lllm/value/Gc.hpp"
+#include "lllm/value/Kernels.hpp"
 #include "lllm/util/fail.hpp"
 #include "lllm/util/util_io.hpp"
 
@@ -14,14 +19,13 @@ using namespace lllm::util;
 
 static SourceLocation builtin_location("*builtin*");
 	
-Builtins* Builtins::INSTANCE;
-
 static ValuePtr TRUE = nullptr;
 
 Builtins& Builtins::get() {
-	if ( !INSTANCE ) INSTANCE = new Builtins();
+	// initialized once, even if several threads get here first at the same time
+	static Builtins* instance = new Builtins();
 
-	return *INSTANCE;
+	return *instance;
 }
 
 bool Builtins::lookup( const util::InternedString& name, ast::AstPtr*      dst ) {
@@ -87,6 +91,250 @@ static ValuePtr builtin_cdr( LambdaPtr fn, ValuePtr v ) {
 	}
 }
 
+//***** VECTORS ********************************************************************************************************
+
+// compiled code indexes plain vectors inline and only calls these when a check fails (see Jit).
+// typed vectors box what they hand out and unbox what they are given
+static double asDouble( ValuePtr val, CStr name ) {
+	switch ( typeOf( val ) ) {
+		case Type::Int:  return static_cast<IntPtr>( val )->value;
+		case Type::Real: return static_cast<RealPtr>( val )->value;
+		default:         LLLM_FAIL( "builtin function '" << name << "' expects a number, not a " << val );
+	}
+}
+static long asLong( ValuePtr val, CStr name ) {
+	if ( IntPtr i = Value::asInt( val ) ) return i->value;
+
+	LLLM_FAIL( "builtin function '" << name << "' expects an int, not a " << val );
+}
+static size_t lengthOf( ValuePtr vec, CStr name ) {
+	switch ( typeOf( vec ) ) {
+		case Type::Vector:    return static_cast<VectorPtr>( vec )->length;
+		case Type::F64Vector: return static_cast<F64VectorPtr>( vec )->length;
+		case Type::I64Vector: return static_cast<I64VectorPtr>( vec )->length;
+		default:              LLLM_FAIL( "builtin function '" << name << "' expects a vector as first argument, not a " << vec );
+	}
+}
+static size_t asIndex( ValuePtr vec, ValuePtr idx, CStr name ) {
+	size_t length = lengthOf( vec, name );
+	IntPtr i      = Value::asInt( idx );
+
+	if ( !i ) LLLM_FAIL( "builtin function '" << name << "' expects an int as index, not a " << idx );
+	if ( size_t( i->value ) >= length ) LLLM_FAIL( "builtin function '" << name << "': index " << i->value << " is out of range for a vector of length " << length );
+
+	return i->value;
+}
+static size_t asLength( ValuePtr length, CStr name ) {
+	IntPtr n = Value::asInt( length );
+
+	if ( !n || n->value < 0 ) LLLM_FAIL( "builtin function '" << name << "' expects a length >= 0 as first argument, not " << length );
+
+	return n->value;
+}
+static ValuePtr builtin_make_vector( LambdaPtr fn, ValuePtr length, ValuePtr fill ) {
+	return value::vector( asLength( length, "make-vector" ), fill );
+}
+static ValuePtr builtin_make_f64vector( LambdaPtr fn, ValuePtr length, ValuePtr fill ) {
+	return F64Vector::alloc( asLength( length, "make-f64vector" ), asDouble( fill, "make-f64vector" ) );
+}
+static ValuePtr builtin_make_i64vector( LambdaPtr fn, ValuePtr length, ValuePtr fill ) {
+	return I64Vector::alloc( asLength( length, "make-i64vector" ), asLong( fill, "make-i64vector" ) );
+}
+static size_t listLength( ValuePtr list, CStr name ) {
+	size_t n = 0;
+	for ( ; ConsPtr c = Value::asCons( list ); list = c->cdr ) n++;
+
+	if ( list != nil ) LLLM_FAIL( "builtin function '" << name << "' expects a list, not a " << list );
+	return n;
+}
+static ValuePtr builtin_list_to_f64vector( LambdaPtr fn, ValuePtr list ) {
+	F64Vector* vec = F64Vector::alloc( listLength( list, "list->f64vector" ), 0 );
+
+	for ( size_t i = 0; i < vec->length; i++, list = Value::asCons( list )->cdr ) {
+		vec->elements[i] = asDouble( Value::asCons( list )->car, "list->f64vector" );
+	}
+	return vec;
+}
+static ValuePtr builtin_list_to_i64vector( LambdaPtr fn, ValuePtr list ) {
+	I64Vector* vec = I64Vector::alloc( listLength( list, "list->i64vector" ), 0 );
+
+	for ( size_t i = 0; i < vec->length; i++, list = Value::asCons( list )->cdr ) {
+		vec->elements[i] = asLong( Value::asCons( list )->car, "list->i64vector" );
+	}
+	return vec;
+}
+static ValuePtr builtin_vector_ref( LambdaPtr fn, ValuePtr vec, ValuePtr idx ) {
+	size_t i = asIndex( vec, idx, "vector-ref" );
+
+	switch ( typeOf( vec ) ) {
+		case Type::F64Vector: return number( static_cast<F64VectorPtr>( vec )->elements[i] );
+		case Type::I64Vector: return number( static_cast<I64VectorPtr>( vec )->elements[i] );
+		default:              return static_cast<VectorPtr>( vec )->elements[i];
+	}
+}
+// the old element, like set
+static ValuePtr builtin_vector_set( LambdaPtr fn, ValuePtr vec, ValuePtr idx, ValuePtr val ) {
+	size_t i = asIndex( vec, idx, "vector-set!" );
+
+	switch ( typeOf( vec ) ) {
+		case Type::F64Vector: {
+			F64VectorPtr v   = static_cast<F64VectorPtr>( vec );
+			double       old = v->elements[i];
+			v->elements[i] = asDouble( val, "vector-set!" );
+			return number( old );
+		}
+		case Type::I64Vector: {
+			I64VectorPtr v   = static_cast<I64VectorPtr>( vec );
+			long         old = v->elements[i];
+			v->elements[i] = asLong( val, "vector-set!" );
+			return number( old );
+		}
+		default: {
+			VectorPtr v   = static_cast<VectorPtr>( vec );
+			ValuePtr  old = v->elements[i];
+			v->elements[i] = val;
+			Gc::written( v );
+			return old;
+		}
+	}
+}
+static ValuePtr builtin_vector_length( LambdaPtr fn, ValuePtr vec ) {
+	return number( long( lengthOf( vec, "vector-length" ) ) );
+}
+
+// bulk arithmetic on typed vectors, done by Kernels.
+// elementwise operations return a new vector of the same type and need vectors of the same type and length
+static void sameShape( ValuePtr a, ValuePtr b, CStr name ) {
+	if ( typeOf( a ) != Type::F64Vector && typeOf( a ) != Type::I64Vector ) {
+		LLLM_FAIL( "builtin function '" << name << "' expects an f64vector or i64vector, not a " << a );
+	}
+	if ( typeOf( a ) != typeOf( b ) ) {
+		LLLM_FAIL( "builtin function '" << name << "' expects two vectors of the same type, not a " << a << " and a " << b );
+	}
+	if ( lengthOf( a, name ) != lengthOf( b, name ) ) {
+		LLLM_FAIL( "builtin function '" << name << "' expects two vectors of the same length, not " << lengthOf( a, name ) << " and " << lengthOf( b, name ) );
+	}
+}
+#define BUILTIN_ELEMENTWISE( NAME, KERNEL, A, B ) ({                                 \
+	sameShape( A, B, NAME );                                                         \
+	ValuePtr result;                                                                 \
+	if ( F64VectorPtr f = Value::asF64Vector( A ) ) {                                \
+		F64Vector* out = F64Vector::alloc( f->length, 0 );                           \
+		Kernels::KERNEL( f->elements, Value::asF64Vector( B )->elements, out->elements, f->length ); \
+		result = out;                                                                \
+	} else {                                                                         \
+		I64VectorPtr l   = Value::asI64Vector( A );                                  \
+		I64Vector*   out = I64Vector::alloc( l->length, 0 );                         \
+		Kernels::KERNEL( l->elements, Value::asI64Vector( B )->elements, out->elements, l->length ); \
+		result = out;                                                                \
+	}                                                                                \
+	result;                                                                          \
+})
+// sums, minimum and maximum, an empty vector has no minimum or maximum
+#define BUILTIN_REDUCE( NAME, KERNEL, V, NONEMPTY ) {                                 \
+	if ( F64VectorPtr f = Value::asF64Vector( V ) ) {                                \
+		if ( NONEMPTY && !f->length ) LLLM_FAIL( "builtin function '" << NAME << "' expects a vector that is not empty" ); \
+		return number( Kernels::KERNEL( f->elements, f->length ) );                  \
+	}                                                                                \
+	if ( I64VectorPtr l = Value::asI64Vector( V ) ) {                                \
+		if ( NONEMPTY && !l->length ) LLLM_FAIL( "builtin function '" << NAME << "' expects a vector that is not empty" ); \
+		return number( Kernels::KERNEL( l->elements, l->length ) );                  \
+	}                                                                                \
+	LLLM_FAIL( "builtin function '" << NAME << "' expects an f64vector or i64vector, not a " << V ); \
+}
+
+static ValuePtr builtin_vector_add( LambdaPtr fn, ValuePtr a, ValuePtr b ) { return BUILTIN_ELEMENTWISE( "vector-add", add, a, b ); }
+static ValuePtr builtin_vector_mul( LambdaPtr fn, ValuePtr a, ValuePtr b ) { return BUILTIN_ELEMENTWISE( "vector-mul", mul, a, b ); }
+static ValuePtr builtin_vector_dot( LambdaPtr fn, ValuePtr a, ValuePtr b ) {
+	sameShape( a, b, "vector-dot" );
+
+	if ( F64VectorPtr f = Value::asF64Vector( a ) ) return number( Kernels::dot( f->elements, Value::asF64Vector( b )->elements, f->length ) );
+
+	I64VectorPtr l = Value::asI64Vector( a );
+	return number( Kernels::dot( l->elements, Value::asI64Vector( b )->elements, l->length ) );
+}
+// an f64vector can be scaled by any number, an i64vector only by an int
+static ValuePtr builtin_vector_scale( LambdaPtr fn, ValuePtr v, ValuePtr k ) {
+	if ( F64VectorPtr f = Value::asF64Vector( v ) ) {
+		F64Vector* out = F64Vector::alloc( f->length, 0 );
+		Kernels::scale( f->elements, asDouble( k, "vector-scale" ), out->elements, f->length );
+		return out;
+	}
+	if ( I64VectorPtr l = Value::asI64Vector( v ) ) {
+		I64Vector* out = I64Vector::alloc( l->length, 0 );
+		Kernels::scale( l->elements, asLong( k, "vector-scale" ), out->elements, l->length );
+		return out;
+	}
+	LLLM_FAIL( "builtin function 'vector-scale' expects an f64vector or i64vector, not a " << v );
+}
+static ValuePtr builtin_vector_sum( LambdaPtr fn, ValuePtr v ) { BUILTIN_REDUCE( "vector-sum", sum, v, false ); }
+static ValuePtr builtin_vector_min( LambdaPtr fn, ValuePtr v ) { BUILTIN_REDUCE( "vector-min", min, v, true ); }
+static ValuePtr builtin_vector_max( LambdaPtr fn, ValuePtr v ) { BUILTIN_REDUCE( "vector-max", max, v, true ); }
+
+//***** HASH TABLES ****************************************************************************************************
+
+// compiled code checks the table inline and calls the table directly (see Jit)
+static HashTablePtr asHashTable( ValuePtr table, CStr name ) {
+	if ( HashTablePtr t = Value::asHashTable( table ) ) return t;
+
+	LLLM_FAIL( "builtin function '" << name << "' expects a hash table as first argument, not a " << table );
+}
+static ValuePtr builtin_make_hash_table( LambdaPtr fn ) {
+	return hashTable();
+}
+// otherwise if the key is not in the table
+static ValuePtr builtin_hash_ref( LambdaPtr fn, ValuePtr table, ValuePtr key, ValuePtr otherwise ) {
+	ValuePtr v;
+	return asHashTable( table, "hash-ref" )->lookup( key, &v ) ? v : otherwise;
+}
+// the old value, like set
+static ValuePtr builtin_hash_set( LambdaPtr fn, ValuePtr table, ValuePtr key, ValuePtr val ) {
+	return asHashTable( table, "hash-set!" )->put( key, val );
+}
+// the removed value
+static ValuePtr builtin_hash_remove( LambdaPtr fn, ValuePtr table, ValuePtr key ) {
+	ValuePtr old = nullptr;
+	asHashTable( table, "hash-remove!" )->remove( key, &old );
+	return old;
+}
+static ValuePtr builtin_hash_count( LambdaPtr fn, ValuePtr table ) {
+	return number( long( asHashTable( table, "hash-count" )->size() ) );
+}
+
+//***** RECORDS ********************************************************************************************************
+
+// defrecord binds what these return (see Analyzer), the type is found by its name and the names of its fields
+static RecordTypePtr asRecordType( ValuePtr name, ValuePtr fields, CStr fn ) {
+	SymbolPtr sym = Value::asSymbol( name );
+	if ( !sym ) LLLM_FAIL( "builtin function '" << fn << "' expects a symbol as record name, not " << name );
+
+	std::vector<InternedString> names;
+	for ( ValuePtr l = fields; l; l = Value::asCons( l )->cdr ) {
+		ConsPtr   c     = Value::asCons( l );
+		SymbolPtr field = c ? Value::asSymbol( c->car ) : nullptr;
+		if ( !field ) LLLM_FAIL( "builtin function '" << fn << "' expects a list of symbols as record fields, not " << fields );
+
+		names.push_back( field->value );
+	}
+
+	return RecordType::get( sym->value, names );
+}
+static ValuePtr builtin_record_constructor( LambdaPtr fn, ValuePtr name, ValuePtr fields ) {
+	return asRecordType( name, fields, "record-constructor" )->constructor();
+}
+static ValuePtr builtin_record_predicate( LambdaPtr fn, ValuePtr name, ValuePtr fields ) {
+	return asRecordType( name, fields, "record-predicate" )->predicate();
+}
+static ValuePtr builtin_record_accessor( LambdaPtr fn, ValuePtr name, ValuePtr fields, ValuePtr field ) {
+	RecordTypePtr type = asRecordType( name, fields, "record-accessor" );
+	SymbolPtr     sym  = Value::asSymbol( field );
+
+	size_t idx;
+	if ( !sym || !type->fieldIndex( sym->value, &idx ) ) LLLM_FAIL( "record " << type->name << " has no field " << field );
+
+	return type->accessor( idx );
+}
+
 //***** ARITHMETIC *****************************************************************************************************
 
 #define BUILTIN_BINARY_ARITH( OP, A, B ) 																				\
@@ -120,6 +368,10 @@ static ValuePtr builtin_or ( LambdaPtr fn, ValuePtr a, ValuePtr b ) { return (a
 static ValuePtr builtin_equal( LambdaPtr fn, ValuePtr a, ValuePtr b ) {
 	return equal( a, b ) ? TRUE : nullptr;
 }
+// identity, compiled code does this inline (see Jit)
+static ValuePtr builtin_eq( LambdaPtr fn, ValuePtr a, ValuePtr b ) {
+	return (a == b) ? TRUE : nullptr;
+}
 #define BUILTIN_BINARY_CMP( OP, A, B )                                                                                           \
 	switch ( typeOf( A ) ) {                                                                                                     \
 		case Type::Int:                                                                                                          \
@@ -162,6 +414,250 @@ static ValuePtr builtin_set( LambdaPtr fn, ValuePtr ref, ValuePtr v ) {
 	}
 }
 
+// the updates below retry until no other thread got in between, values are immutable so that is enough.
+// libjit has no atomic instructions, compiled code calls these too
+static RefPtr asRef( ValuePtr ref, CStr name ) {
+	if ( RefPtr r = Value::asRef( ref ) ) return r;
+
+	LLLM_FAIL( "builtin function '" << name << "' expects a ref as first argument, not a " << ref );
+}
+// (cas! ref expected new) stores new if the ref holds a value equal to expected, true if it did
+static ValuePtr builtin_cas( LambdaPtr fn, ValuePtr ref, ValuePtr expected, ValuePtr v ) {
+	RefPtr r = asRef( ref, "cas!" );
+
+	for (;;) {
+		ValuePtr old = r->get();
+
+		if ( !equal( old, expected ) ) return nullptr;
+		if ( r->compareAndSet( old, v ) ) return TRUE;
+	}
+}
+// (swap! ref f) stores (f old), f may run more than once. the new value
+static ValuePtr builtin_swap( LambdaPtr fn, ValuePtr ref, ValuePtr f ) {
+	RefPtr    r = asRef( ref, "swap!" );
+	LambdaPtr l = Value::asLambda( f );
+
+	if ( !l ) LLLM_FAIL( "builtin function 'swap!' expects a function as second argument, not a " << f );
+
+	for (;;) {
+		ValuePtr old = r->get();
+		ValuePtr v   = Evaluator::apply( l, ValueVector{ old } );
+
+		if ( r->compareAndSet( old, v ) ) return v;
+	}
+}
+// (fetch-add! ref n) adds n to the number in a ref. the old number
+static ValuePtr builtin_fetch_add( LambdaPtr fn, ValuePtr ref, ValuePtr n ) {
+	RefPtr r = asRef( ref, "fetch-add!" );
+
+	if ( !TypeSet::Number().contains( typeOf( n ) ) ) LLLM_FAIL( "builtin function 'fetch-add!' expects a number as second argument, not a " << n );
+
+	for (;;) {
+		ValuePtr old = r->get();
+
+		if ( !TypeSet::Number().contains( typeOf( old ) ) ) LLLM_FAIL( "builtin function 'fetch-add!' expects a ref to a number, not to a " << old );
+		if ( r->compareAndSet( old, builtin_add( nullptr, old, n ) ) ) return old;
+	}
+}
+
+//***** PARALLELISM ***************************************************************************************************
+
+namespace {
+	struct FutureTask final : public Task {
+		FutureTask( LambdaPtr fn ) : fn( fn ) {}
+
+		void run() override {
+			result = Evaluator::apply( fn, ValueVector() );
+		}
+
+		const LambdaPtr fn;
+	};
+
+	// the elements of a list in an array, so tasks can split it by index
+	ValuePtr* toArray( ValuePtr list, size_t* length ) {
+		size_t n = 0;
+		for ( ValuePtr v = list; ConsPtr c = Value::asCons( v ); v = c->cdr ) n++;
+
+		ValuePtr* array = (ValuePtr*) GC_MALLOC( (n ? n : 1) * sizeof(ValuePtr) );
+
+		size_t i = 0;
+		for ( ValuePtr v = list; ConsPtr c = Value::asCons( v ); v = c->cdr ) array[i++] = c->car;
+
+		*length = n;
+		return array;
+	}
+
+	// works on elements [begin, end) and gives the second half of what is left away
+	// while other threads run out of work (lazy binary splitting).
+	// the halves given away are ordered from last to first
+	struct RangeTask : public Task {
+		RangeTask( size_t begin, size_t end ) : begin( begin ), end( end ) {}
+
+		void run() override {
+			ValuePtr acc = first();
+
+			for ( size_t i = begin; i < end; i++ ) {
+				if ( end - i > 1 && Scheduler::hungry() ) {
+					size_t middle = i + (end - i) / 2;
+
+					TaskPtr half = split( middle, end );
+					halves.push_back( half );
+					Scheduler::spawn( half );
+
+					end = middle;
+				}
+
+				acc = step( acc, i );
+			}
+
+			for ( auto it = halves.rbegin(), e = halves.rend(); it != e; ++it ) {
+				acc = combine( acc, Scheduler::join( *it ) );
+			}
+
+			result = acc;
+		}
+
+		virtual TaskPtr  split( size_t begin, size_t end ) = 0;
+		virtual ValuePtr first() = 0;
+		virtual ValuePtr step( ValuePtr acc, size_t i ) = 0;
+		virtual ValuePtr combine( ValuePtr acc, ValuePtr half ) = 0;
+
+		size_t begin, end;
+		std::vector<TaskPtr,gc_allocator<TaskPtr>> halves;
+	};
+
+	struct MapTask final : public RangeTask {
+		MapTask( LambdaPtr fn, ValuePtr* in, ValuePtr* out, size_t begin, size_t end ) :
+			RangeTask( begin, end ), fn( fn ), in( in ), out( out ) {}
+
+		TaskPtr  split( size_t b, size_t e ) override { return new MapTask( fn, in, out, b, e ); }
+		ValuePtr first() override { return nullptr; }
+		ValuePtr step( ValuePtr acc, size_t i ) override {
+			ValueVector args{ in[i] };
+			out[i] = Evaluator::apply( fn, args );
+			return nullptr;
+		}
+		ValuePtr combine( ValuePtr acc, ValuePtr half ) override { return nullptr; }
+
+		const LambdaPtr fn;
+		ValuePtr* const in;
+		ValuePtr* const out;
+	};
+
+	// every range starts from init, so init has to be an identity of fn
+	struct ReduceTask final : public RangeTask {
+		ReduceTask( LambdaPtr fn, ValuePtr init, ValuePtr* in, size_t begin, size_t end ) :
+			RangeTask( begin, end ), fn( fn ), init( init ), in( in ) {}
+
+		TaskPtr  split( size_t b, size_t e ) override { return new ReduceTask( fn, init, in, b, e ); }
+		ValuePtr first() override { return init; }
+		ValuePtr step( ValuePtr acc, size_t i ) override { return combine( acc, in[i] ); }
+		ValuePtr combine( ValuePtr acc, ValuePtr v ) override {
+			ValueVector args{ acc, v };
+			return Evaluator::apply( fn, args );
+		}
+
+		const LambdaPtr fn;
+		const ValuePtr  init;
+		ValuePtr* const in;
+	};
+}
+
+static ValuePtr builtin_future( LambdaPtr fn, ValuePtr f ) {
+	if ( LambdaPtr lambda = Value::asLambda( f, 0 ) ) {
+		TaskPtr task = new FutureTask( lambda );
+		Scheduler::spawn( task );
+		return future( task );
+	} else {
+		LLLM_FAIL( "builtin function 'future' expects a function without parameters as first argument, not a " << f );
+	}
+}
+static ValuePtr builtin_touch( LambdaPtr fn, ValuePtr v ) {
+	if ( FuturePtr f = Value::asFuture( v ) ) {
+		return Scheduler::join( f->task );
+	} else {
+		return v;
+	}
+}
+static ValuePtr builtin_spawn( LambdaPtr fn, ValuePtr f ) {
+	if ( LambdaPtr lambda = Value::asLambda( f, 0 ) ) {
+		return future( Fibers::spawn( lambda ) );
+	} else {
+		LLLM_FAIL( "builtin function 'spawn' expects a function without parameters as first argument, not a " << f );
+	}
+}
+static ValuePtr builtin_yield( LambdaPtr fn ) {
+	Fibers::yield();
+	return nullptr;
+}
+static ValuePtr builtin_channel( LambdaPtr fn, ValuePtr n ) {
+	if ( typeOf( n ) == Type::Int && static_cast<IntPtr>( n )->value > 0 ) {
+		return channel( static_cast<IntPtr>( n )->value );
+	} else {
+		LLLM_FAIL( "builtin function 'channel' expects a positive capacity as first argument, not a " << n );
+	}
+}
+static ChannelPtr asChannel( ValuePtr ch, CStr fn ) {
+	if ( ChannelPtr c = Value::asChannel( ch ) ) {
+		return c;
+	} else {
+		LLLM_FAIL( "builtin function '" << fn << "' expects a channel as first argument, not a " << ch );
+	}
+}
+// the lock free path comes first, only a full or empty channel waits
+static ValuePtr builtin_send( LambdaPtr fn, ValuePtr ch, ValuePtr v ) {
+	ChannelPtr c = asChannel( ch, "send" );
+
+	for ( size_t round = 0; !c->trySend( v ); round++ ) Scheduler::relax( round );
+	return v;
+}
+static ValuePtr builtin_recv( LambdaPtr fn, ValuePtr ch ) {
+	ChannelPtr c = asChannel( ch, "recv" );
+
+	ValuePtr v;
+	for ( size_t round = 0; !c->tryReceive( &v ); round++ ) Scheduler::relax( round );
+	return v;
+}
+static ValuePtr builtin_try_send( LambdaPtr fn, ValuePtr ch, ValuePtr v ) {
+	return asChannel( ch, "try-send" )->trySend( v ) ? TRUE : nullptr;
+}
+// the default is returned if nothing was sent, nil is a value like any other
+static ValuePtr builtin_try_recv( LambdaPtr fn, ValuePtr ch, ValuePtr otherwise ) {
+	ValuePtr v;
+	return asChannel( ch, "try-recv" )->tryReceive( &v ) ? v : otherwise;
+}
+static ValuePtr builtin_pmap( LambdaPtr fn, ValuePtr f, ValuePtr list ) {
+	LambdaPtr lambda = Value::asLambda( f, 1 );
+
+	if ( !lambda )              LLLM_FAIL( "builtin function 'pmap' expects a function with one parameter as first argument, not a " << f );
+	if ( !Value::isList( list ) ) LLLM_FAIL( "builtin function 'pmap' expects a list as second argument, not a " << list );
+
+	size_t    n;
+	ValuePtr* in  = toArray( list, &n );
+	ValuePtr* out = (ValuePtr*) GC_MALLOC( (n ? n : 1) * sizeof(ValuePtr) );
+
+	TaskPtr task = new MapTask( lambda, in, out, 0, n );
+	Scheduler::spawn( task );
+	Scheduler::join( task );
+
+	ListPtr result = nil;
+	for ( size_t i = n; i > 0; i-- ) result = cons( out[i - 1], result );
+	return result;
+}
+static ValuePtr builtin_preduce( LambdaPtr fn, ValuePtr f, ValuePtr init, ValuePtr list ) {
+	LambdaPtr lambda = Value::asLambda( f, 2 );
+
+	if ( !lambda )              LLLM_FAIL( "builtin function 'preduce' expects a function with two parameters as first argument, not a " << f );
+	if ( !Value::isList( list ) ) LLLM_FAIL( "builtin function 'preduce' expects a list as third argument, not a " << list );
+
+	size_t    n;
+	ValuePtr* in = toArray( list, &n );
+
+	TaskPtr task = new ReduceTask( lambda, init, in, 0, n );
+	Scheduler::spawn( task );
+	return Scheduler::join( task );
+}
+
 //***** IO *************************************************************************************************************
 static ValuePtr builtin_print( LambdaPtr fn, ValuePtr v ) {
 	struct Visitor {
@@ -180,6 +676,12 @@ static ValuePtr builtin_println( LambdaPtr fn, ValuePtr v ) {
 	return nullptr;
 }
 
+//***** RUNTIME ********************************************************************************************************
+static ValuePtr builtin_telemetry( LambdaPtr fn ) {
+	Telemetry::print( std::cout );
+	return nullptr;
+}
+
 const ValuePtr Builtins::CLEAR_MARK = value::symbol("__BUILTIN_CLEAR_MARK__");
 
 //***** SETUP **********************************************************************************************************
@@ -189,13 +691,13 @@ template<typename T, typename... Ts>
 inline size_t numArgs( const T& t, const Ts&... ts ) { return 1 + numArgs( ts... ); }
 
 inline ast::LambdaPtr doMakeBuiltinFn( CStr name, TypeSet returnT, size_t arity ) {
-	std::vector<ast::VariablePtr> params;
+	ast::Lambda::Bindings params;
 
 	for ( size_t i = 0; i < arity; i++ ) {
 		params.push_back( ast::Variable::makeParameter( builtin_location, "arg" ) );
 	}
 
-	return new ast::Lambda( builtin_location, name, params, std::vector<ast::VariablePtr>(), nullptr );
+	return new ast::Lambda( builtin_location, name, params, ast::Lambda::Bindings(), nullptr );
 }
 
 inline void initEscape( ast::LambdaPtr lambda, ast::Lambda::Iterator it ) {}
@@ -249,6 +751,33 @@ Builtins::Builtins() {
 	BUILTIN_FN( "cons",    builtin_cons,    TypeSet::Cons(), ESCAPE_AS_RETURN, ESCAPE_AS_RETURN );
 	BUILTIN_FN( "car",     builtin_car,     TypeSet::all(),  NO_ESCAPE );
 	BUILTIN_FN( "cdr",     builtin_cdr,     TypeSet::Cons(), NO_ESCAPE );
+	// ***** VECTORS
+	BUILTIN_FN( "make-vector",   builtin_make_vector,   TypeSet::Vector(), NO_ESCAPE, ESCAPE_GLOBAL );
+	BUILTIN_FN( "vector-ref",    builtin_vector_ref,    TypeSet::all(),    NO_ESCAPE, NO_ESCAPE );
+	BUILTIN_FN( "vector-set!",   builtin_vector_set,    TypeSet::all(),    NO_ESCAPE, NO_ESCAPE, ESCAPE_GLOBAL );
+	BUILTIN_FN( "vector-length", builtin_vector_length, TypeSet::Int(),    NO_ESCAPE );
+	// unboxed numbers
+	BUILTIN_FN( "make-f64vector",  builtin_make_f64vector,    TypeSet::F64Vector(), NO_ESCAPE, NO_ESCAPE );
+	BUILTIN_FN( "make-i64vector",  builtin_make_i64vector,    TypeSet::I64Vector(), NO_ESCAPE, NO_ESCAPE );
+	BUILTIN_FN( "list->f64vector", builtin_list_to_f64vector, TypeSet::F64Vector(), NO_ESCAPE );
+	BUILTIN_FN( "list->i64vector", builtin_list_to_i64vector, TypeSet::I64Vector(), NO_ESCAPE );
+	BUILTIN_FN( "vector-add",      builtin_vector_add,   TypeSet::F64Vector() | TypeSet::I64Vector(), NO_ESCAPE, NO_ESCAPE );
+	BUILTIN_FN( "vector-mul",      builtin_vector_mul,   TypeSet::F64Vector() | TypeSet::I64Vector(), NO_ESCAPE, NO_ESCAPE );
+	BUILTIN_FN( "vector-scale",    builtin_vector_scale, TypeSet::F64Vector() | TypeSet::I64Vector(), NO_ESCAPE, NO_ESCAPE );
+	BUILTIN_FN( "vector-dot",      builtin_vector_dot,   TypeSet::Number(), NO_ESCAPE, NO_ESCAPE );
+	BUILTIN_FN( "vector-sum",      builtin_vector_sum,   TypeSet::Number(), NO_ESCAPE );
+	BUILTIN_FN( "vector-min",      builtin_vector_min,   TypeSet::Number(), NO_ESCAPE );
+	BUILTIN_FN( "vector-max",      builtin_vector_max,   TypeSet::Number(), NO_ESCAPE );
+	// ***** HASH TABLES
+	BUILTIN_FN( "make-hash-table", builtin_make_hash_table, TypeSet::HashTable() );
+	BUILTIN_FN( "hash-ref",        builtin_hash_ref,        TypeSet::all(), NO_ESCAPE, NO_ESCAPE, ESCAPE_AS_RETURN );
+	BUILTIN_FN( "hash-set!",       builtin_hash_set,        TypeSet::all(), NO_ESCAPE, ESCAPE_GLOBAL, ESCAPE_GLOBAL );
+	BUILTIN_FN( "hash-remove!",    builtin_hash_remove,     TypeSet::all(), NO_ESCAPE, NO_ESCAPE );
+	BUILTIN_FN( "hash-count",      builtin_hash_count,      TypeSet::Int(), NO_ESCAPE );
+	// ***** RECORDS
+	BUILTIN_FN( "record-constructor", builtin_record_constructor, TypeSet::Lambda(), NO_ESCAPE, NO_ESCAPE );
+	BUILTIN_FN( "record-predicate",   builtin_record_predicate,   TypeSet::Lambda(), NO_ESCAPE, NO_ESCAPE );
+	BUILTIN_FN( "record-accessor",    builtin_record_accessor,    TypeSet::Lambda(), NO_ESCAPE, NO_ESCAPE, NO_ESCAPE );
 	// ***** ARITHMETIC
 	BUILTIN_FN( "+",       builtin_add,     TypeSet::Number(), NO_ESCAPE, NO_ESCAPE );
 	BUILTIN_FN( "-",       builtin_sub,     TypeSet::Number(), NO_ESCAPE, NO_ESCAPE );
@@ -261,15 +790,36 @@ Builtins::Builtins() {
 	BUILTIN_FN( "ref",     builtin_ref,     TypeSet::Ref() );
 	BUILTIN_FN( "get",     builtin_get,     TypeSet::all(), NO_ESCAPE );
 	BUILTIN_FN( "set",     builtin_set,     TypeSet::Nil(), NO_ESCAPE, ESCAPE_GLOBAL );
+	BUILTIN_FN( "cas!",       builtin_cas,       TypeSet::all(),    NO_ESCAPE, NO_ESCAPE, ESCAPE_GLOBAL );
+	BUILTIN_FN( "swap!",      builtin_swap,      TypeSet::all(),    NO_ESCAPE, NO_ESCAPE );
+	BUILTIN_FN( "fetch-add!", builtin_fetch_add, TypeSet::Number(), NO_ESCAPE, NO_ESCAPE );
 	// ***** EQUALITY
 	BUILTIN_FN( "=",       builtin_equal,   TypeSet::all(), NO_ESCAPE, NO_ESCAPE );
+	BUILTIN_FN( "eq",      builtin_eq,      TypeSet::all(), NO_ESCAPE, NO_ESCAPE );
 	BUILTIN_FN( "<",       builtin_lt,      TypeSet::all(), NO_ESCAPE, NO_ESCAPE );
 	BUILTIN_FN( ">",       builtin_gt,      TypeSet::all(), NO_ESCAPE, NO_ESCAPE );
 	BUILTIN_FN( "<=",      builtin_le,      TypeSet::all(), NO_ESCAPE, NO_ESCAPE );
 	BUILTIN_FN( ">=",      builtin_ge,      TypeSet::all(), NO_ESCAPE, NO_ESCAPE );
+	// ***** PARALLELISM
+	// the escape analysis does not follow values into other threads
+	BUILTIN_FN( "future",  builtin_future,  TypeSet::Future(), ESCAPE_GLOBAL );
+	BUILTIN_FN( "touch",   builtin_touch,   TypeSet::all(),    NO_ESCAPE );
+	BUILTIN_FN( "pmap",    builtin_pmap,    TypeSet::Nil() | TypeSet::Cons(), ESCAPE_GLOBAL, ESCAPE_GLOBAL );
+	BUILTIN_FN( "preduce", builtin_preduce, TypeSet::all(),    ESCAPE_GLOBAL, ESCAPE_GLOBAL, ESCAPE_GLOBAL );
+	// green threads, touch joins them too
+	BUILTIN_FN( "spawn",   builtin_spawn,   TypeSet::Future(), ESCAPE_GLOBAL );
+	BUILTIN_FN( "yield",   builtin_yield,   TypeSet::Nil() );
+	// message passing between threads and fibers
+	BUILTIN_FN( "channel",  builtin_channel,  TypeSet::Channel(), NO_ESCAPE );
+	BUILTIN_FN( "send",     builtin_send,     TypeSet::all(),     NO_ESCAPE, ESCAPE_GLOBAL );
+	BUILTIN_FN( "recv",     builtin_recv,     TypeSet::all(),     NO_ESCAPE );
+	BUILTIN_FN( "try-send", builtin_try_send, TypeSet::all(),     NO_ESCAPE, ESCAPE_GLOBAL );
+	BUILTIN_FN( "try-recv", builtin_try_recv, TypeSet::all(),     NO_ESCAPE, ESCAPE_AS_RETURN );
 	// ***** IO
 	BUILTIN_FN( "print",   builtin_print,   TypeSet::Nil(), NO_ESCAPE );
 	BUILTIN_FN( "println", builtin_println, TypeSet::Nil(), NO_ESCAPE );
+	// ***** RUNTIME
+	BUILTIN_FN( "telemetry", builtin_telemetry, TypeSet::Nil() );
 }
 
 // (define sum (lambda (a b) (if (= a 0) b (sum (- a 1) (+ 1 b)))))
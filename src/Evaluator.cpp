@@ -1,8 +1,14 @@
 
 #include "lllm/Evaluator.hpp"
+#include "lllm/Fiber.hpp"
 #include "lllm/Jit.hpp"
+#include "lllm/JitCache.hpp"
+#include "lllm/Vm.hpp"
 #include "lllm/ast/AstIO.hpp"
 #include "lllm/value/ValueIO.hpp"
+#include "lllm/value/Telemetry.hpp"
+#include "lllm/value/Gc.hpp"
+#include "lllm/value/Heap.hpp"
 #include "lllm/util/fail.hpp"
 #include "lllm/util/util_io.hpp"
 
@@ -22,6 +28,9 @@ using namespace lllm::util;
 
 size_t Evaluator::jittingThreshold = 1000;
 
+// globals of the outermost evaluate on this thread, builtins that call functions look them up here
+static __thread util::Scope<value::ValuePtr>* currentGlobals = nullptr;
+
 void Evaluator::setJittingThreshold( size_t threshold ) {
 	jittingThreshold = threshold;
 }
@@ -51,9 +60,17 @@ bool EvalScope::contains( const util::InternedString& name ) {
 	}
 }
 
+util::ScopePtr<value::ValuePtr> EvalScope::globals( util::ScopePtr<value::ValuePtr> env ) {
+	while ( EvalScope* local = dynamic_cast<EvalScope*>( env ) ) {
+		env = local->parent;
+	}
+
+	return env;
+}
+
 namespace lllm {
-template<typename T>
-static std::ostream& operator<<( std::ostream& os, const std::vector<T>& v ) {
+template<typename T, typename A>
+static std::ostream& operator<<( std::ostream& os, const std::vector<T,A>& v ) {
 	if ( v.size() ) return os;
 
 	os << v.front();
@@ -67,22 +84,56 @@ static std::ostream& operator<<( std::ostream& os, const std::vector<T>& v ) {
 }
 
 ValuePtr Evaluator::evaluate( ast::AstPtr ast, const util::ScopePtr<value::ValuePtr> env ) {
+	GlobalsFor globals( EvalScope::globals( env ) );
+
+	return eval( ast, env );
+}
+
+ValuePtr Evaluator::apply( LambdaPtr fn, const ValueVector& args ) {
+	if ( fn->code ) {
+		return applyFun( fn, args.size(), fn->code, args );
+	} else if ( Lambda::FnPtr code = fn->data->code ) {
+		fn->code = code;
+
+		return applyFun( fn, args.size(), code, args );
+	} else if ( currentGlobals ) {
+		return applyAST( fn, currentGlobals, args );
+	} else {
+		LLLM_FAIL( fn->data->ast->location << ": Cannot apply '" << fn << "' outside of an evaluation" );
+	}
+}
+
+util::ScopePtr<value::ValuePtr> Evaluator::globals() {
+	return currentGlobals;
+}
+void Evaluator::setGlobals( util::ScopePtr<value::ValuePtr> globals ) {
+	currentGlobals = globals;
+}
+
+Evaluator::GlobalsFor::GlobalsFor( util::ScopePtr<value::ValuePtr> globals ) : saved( currentGlobals ) {
+	currentGlobals = globals;
+}
+Evaluator::GlobalsFor::~GlobalsFor() {
+	currentGlobals = saved;
+}
+
+ValuePtr Evaluator::eval( ast::AstPtr ast, util::ScopePtr<value::ValuePtr> env ) {
 	struct Visitor {
 		// ***** ATOMS
 		ValuePtr visit( ast::NilPtr         ast, util::ScopePtr<value::ValuePtr> env ) const {
 			return nil;
 		}
 		ValuePtr visit( ast::IntPtr         ast, util::ScopePtr<value::ValuePtr> env ) const {
-			return number( ast->value );
+			return ast->constant;
 		}		
 		ValuePtr visit( ast::RealPtr        ast, util::ScopePtr<value::ValuePtr> env ) const {
-			return number( ast->value );
+			return ast->constant;
 		}
 		ValuePtr visit( ast::CharPtr        ast, util::ScopePtr<value::ValuePtr> env ) const {
-			return character( ast->value );
+			return ast->constant;
 		}
 		ValuePtr visit( ast::StringPtr      ast, util::ScopePtr<value::ValuePtr> env ) const {
-			return string( ast->value );
+			return ast->constant;
 		}
 		ValuePtr visit( ast::VariablePtr    ast, util::ScopePtr<value::ValuePtr> env ) const {
 			ValuePtr val;
@@ -97,16 +148,16 @@ ValuePtr Evaluator::evaluate( ast::AstPtr ast, const util::ScopePtr<value::Value
 			return ast->value;
 		}		
 		ValuePtr visit( ast::IfPtr          ast, util::ScopePtr<value::ValuePtr> env ) const {
-			if ( evaluate( ast->test, env ) ) {
-				return evaluate( ast->thenBranch, env );
+			if ( eval( ast->test, env ) ) {
+				return eval( ast->thenBranch, env );
 			} else {
-				return evaluate( ast->elseBranch, env );
+				return eval( ast->elseBranch, env );
 			}
 		}
 		ValuePtr visit( ast::DoPtr          ast, util::ScopePtr<value::ValuePtr> env ) const {
 			ValuePtr val;
 			for ( auto it = ast->exprs.begin(), end = ast->exprs.end(); it != end; ++it ) {
-				val = evaluate( *it, env );
+				val = eval( *it, env );
 			}
 			return val;
 		}
@@ -115,20 +166,20 @@ ValuePtr Evaluator::evaluate( ast::AstPtr ast, const util::ScopePtr<value::Value
 
 			for ( auto it = ast->bindings.begin(), end = ast->bindings.end(); it != end; ++it ) {
 				const ast::Let::Binding& b = *it;
-				ValuePtr val = evaluate( b.second, env );
+				ValuePtr val = eval( b.second, env );
 
 				newEnv = new EvalScope( b.first, val, newEnv );
 			}
-			return evaluate( ast->body, newEnv );
+			return eval( ast->body, newEnv );
 		}
 		ValuePtr visit( ast::LetStarPtr     ast, util::ScopePtr<value::ValuePtr> env ) const {
 			for ( auto it = ast->bindings.begin(), end = ast->bindings.end(); it != end; ++it ) {
 				const ast::Let::Binding& b = *it;
-				ValuePtr val = evaluate( b.second, env );
+				ValuePtr val = eval( b.second, env );
 
 				env = new EvalScope( b.first, val, env );
 			}
-			return evaluate( ast->body, env );
+			return eval( ast->body, env );
 		}
 		ValuePtr visit( ast::LambdaPtr      ast, util::ScopePtr<value::ValuePtr> env ) const {
 			Lambda* clojure = Lambda::alloc( ast );
@@ -142,28 +193,32 @@ ValuePtr Evaluator::evaluate( ast::AstPtr ast, const util::ScopePtr<value::Value
 					LLLM_FAIL( (*it)->location << ": Unknown variable " << (*it)->name );
 				}
 			}
+			Gc::written( clojure );
 
 			return clojure;
 		}
 		ValuePtr visit( ast::DefinePtr      ast, util::ScopePtr<value::ValuePtr> env ) const {
-			return evaluate( ast->expr, env );
+			return eval( ast->expr, env );
 		}
 		// ***** FUNCTION APPLICATION
 		ValuePtr visit( ast::ApplicationPtr ast, util::ScopePtr<value::ValuePtr> env ) const {
-			ValuePtr head = evaluate( ast->fun, env );
+			ValuePtr head = eval( ast->fun, env );
 
 			size_t arity = ast->args.size();
 
 			if ( LambdaPtr fun = Value::asLambda( head, arity ) ) {
 				// evaluate args
-				std::vector<ValuePtr> evaluatedArgs;
+				ValueVector evaluatedArgs;
 				evaluatedArgs.resize( ast->args.size() );
 				
 				size_t i = 0;
 				for ( auto it = ast->args.begin(), end = ast->args.end(); it != end; ++it, ++i ) {
-					evaluatedArgs[i] = evaluate( *it, env );
+					evaluatedArgs[i] = eval( *it, env );
 				}
 
+				// every call burns fuel, a green thread that runs out yields (see Fibers)
+				if ( --Heap::local().fuel < 0 ) Fibers::preempt();
+
 				Lambda::FnPtr code = fun->code;
 
 				// apply function to args
@@ -191,13 +246,16 @@ ValuePtr Evaluator::evaluate( ast::AstPtr ast, const util::ScopePtr<value::Value
 //	return nullptr;
 }
 
-ValuePtr Evaluator::applyFun( LambdaPtr fn, size_t arity, Lambda::FnPtr code, const std::vector<ValuePtr>& args ) {
+ValuePtr Evaluator::applyFun( LambdaPtr fn, size_t arity, Lambda::FnPtr code, const ValueVector& args ) {
 //	std::cout << "APPLYING CODE " << fn->data->ast << " TO ";
 //	for ( auto it = args.begin(), end = args.end(); it != end; ++it ) {
 //		std::cout << *it << " ";
 //	}
 //	std::cout << std::endl;
 
+	// compiled code charges allocations to itself, give them back to the caller afterwards
+	Telemetry::Charge charge( Telemetry::current );
+
 	switch ( arity ) {
 	#define V    ValuePtr
 	#define L    LambdaPtr
@@ -223,7 +281,7 @@ ValuePtr Evaluator::applyFun( LambdaPtr fn, size_t arity, Lambda::FnPtr code, co
 	}
 }
 
-ValuePtr Evaluator::applyAST( LambdaPtr fn, util::ScopePtr<value::ValuePtr> env, const std::vector<ValuePtr>& args ) {
+ValuePtr Evaluator::applyAST( LambdaPtr fn, util::ScopePtr<value::ValuePtr> env, const ValueVector& args ) {
 	Lambda::Data*  data = fn->data;
 	ast::LambdaPtr ast  = data->ast;
 
@@ -233,10 +291,16 @@ ValuePtr Evaluator::applyAST( LambdaPtr fn, util::ScopePtr<value::ValuePtr> env,
 //	}
 //	std::cout << std::endl;
 
-	data->callCnt++;
+	// threads calling the same function all count
+	size_t calls = __atomic_add_fetch( &data->callCnt, 1, __ATOMIC_RELAXED );
+
+	VmPtr  vm        = Vm::current();
+	size_t threshold = vm ? vm->jittingThreshold() : jittingThreshold;
 
-	if ( data->callCnt > jittingThreshold ) {
-		Jit::compile( fn, env );
+	// functions that got hot in an earlier run do not have to warm up again
+	if ( calls > threshold || (calls == 1 && JitCache::contains( ast )) ) {
+		// free variables of a function are globals, a local scope of the caller could shadow them
+		Jit::compile( fn, EvalScope::globals( env ) );
 		assert( fn->data->code );
 		fn->code = fn->data->code;
 
@@ -265,6 +329,8 @@ ValuePtr Evaluator::applyAST( LambdaPtr fn, util::ScopePtr<value::ValuePtr> env,
 	}		
 
 	// eval body
-	return evaluate( ast->body, env );
+	Telemetry::Charge charge( data );
+
+	return eval( ast->body, env );
 }
 
@@ -0,0 +1,393 @@
+
+#include "lllm/Fiber.hpp"
+#include "lllm/Evaluator.hpp"
+#include "lllm/Vm.hpp"
+#include "lllm/value/Gc.hpp"
+#include "lllm/value/Heap.hpp"
+#include "lllm/util/fail.hpp"
+
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// green threads switch stacks with x86-64 assembly.
+// elsewhere spawning fails and yielding does nothing, the rest of the runtime works as usual
+#if defined( __x86_64__ )
+#	define LLLM_GREEN_THREADS 1
+#else
+#	define LLLM_GREEN_THREADS 0
+#endif
+
+using namespace lllm;
+using namespace lllm::value;
+using namespace lllm::util;
+
+//***** CONTEXT SWITCH *************************************************************************************************
+
+extern "C" {
+	// saves the registers a call has to keep in from, calls hook( arg ) if there is one and continues with to.
+	// the hook still runs on the stack of from, so everything on it stays visible to the GC
+	void lllm_fiber_switch( Fiber::Context* from, Fiber::Context* to, void (*hook)( void* ), void* arg );
+	// where a new fiber starts, its Fiber is in rbx
+	void lllm_fiber_start();
+	void lllm_fiber_main( Fiber* f ) __attribute__((noreturn));
+}
+
+#if LLLM_GREEN_THREADS
+asm(
+	".text\n"
+	".p2align 4\n"
+	".type lllm_fiber_switch, @function\n"
+	"lllm_fiber_switch:\n"
+	"	movq %rsp,  0(%rdi)\n"
+	"	movq %rbx,  8(%rdi)\n"
+	"	movq %rbp, 16(%rdi)\n"
+	"	movq %r12, 24(%rdi)\n"
+	"	movq %r13, 32(%rdi)\n"
+	"	movq %r14, 40(%rdi)\n"
+	"	movq %r15, 48(%rdi)\n"
+	"	testq %rdx, %rdx\n"
+	"	jz 1f\n"
+	"	movq %rsi, %rbx\n"
+	"	movq %rcx, %rdi\n"
+	"	subq $8, %rsp\n"
+	"	call *%rdx\n"
+	"	movq %rbx, %rsi\n"
+	"1:\n"
+	"	movq  0(%rsi), %rsp\n"
+	"	movq  8(%rsi), %rbx\n"
+	"	movq 16(%rsi), %rbp\n"
+	"	movq 24(%rsi), %r12\n"
+	"	movq 32(%rsi), %r13\n"
+	"	movq 40(%rsi), %r14\n"
+	"	movq 48(%rsi), %r15\n"
+	"	ret\n"
+	".size lllm_fiber_switch, .-lllm_fiber_switch\n"
+	"\n"
+	".p2align 4\n"
+	".type lllm_fiber_start, @function\n"
+	"lllm_fiber_start:\n"
+	"	movq %rbx, %rdi\n"
+	"	andq $-16, %rsp\n"
+	"	call lllm_fiber_main@PLT\n"
+	"	ud2\n"
+	".size lllm_fiber_start, .-lllm_fiber_start\n"
+);
+#else
+// never called, no fiber can be spawned
+extern "C" void lllm_fiber_switch( Fiber::Context*, Fiber::Context*, void (*)( void* ), void* ) {
+	LLLM_FAIL( "Green threads are not supported on this architecture" );
+}
+extern "C" void lllm_fiber_start() {
+	LLLM_FAIL( "Green threads are not supported on this architecture" );
+}
+#endif
+
+//***** WORKERS ********************************************************************************************************
+
+namespace {
+	typedef std::deque<Fiber*,traceable_allocator<Fiber*>> Queue;
+
+	// uncollectable, so the GC sees the registers of the scheduler loop while a fiber runs
+	struct Worker final : public gc {
+		Worker() : base( nullptr ), fresh( 0 ), freshFirst( false ), resumes( 0 ), switches( 0 ), stackBytes( 0 ), peakBytes( 0 ) {}
+
+		Fiber::Context ctx;
+		// fibers run below this address, the scheduler loop above it
+		char*          base;
+
+		std::mutex     lock;
+		// switched out fibers, only this worker can continue them
+		Queue          ready;
+		// fibers that have not started, other workers steal from here
+		Queue          unstarted;
+		size_t         fresh;
+		// new fibers and old ones take turns, only the worker touches this
+		bool           freshFirst;
+		// fibers continued so far, only the worker touches this
+		size_t         resumes;
+
+		size_t         switches;
+		size_t         stackBytes;
+		size_t         peakBytes;
+	};
+
+	// never destroyed, the workers sleep on it until the process ends
+	struct Pool final {
+		Pool() : injectedSize( 0 ), spawned( 0 ), idle( 0 ) {}
+
+		std::vector<Worker*>    workers;
+		// fibers spawned outside of a worker
+		std::mutex              injectedLock;
+		Queue                   injected;
+		size_t                  injectedSize;
+		size_t                  spawned;
+
+		std::mutex              sleepLock;
+		std::condition_variable wakeUp;
+		size_t                  idle;
+	};
+
+	Pool* pool = nullptr;
+
+	__thread Worker* self    = nullptr;
+	__thread Fiber*  running = nullptr;
+
+	// the scheduler loop and what it calls never get this deep, signal handlers included
+	const size_t SCHEDULER_STACK = 64 * 1024;
+
+	Fiber* take( Queue& q, size_t* size ) {
+		if ( q.empty() ) return nullptr;
+
+		Fiber* f = q.front();
+		q.pop_front();
+		if ( size ) __atomic_sub_fetch( size, 1, __ATOMIC_RELAXED );
+		return f;
+	}
+
+	Fiber* takeInjected() {
+		if ( !__atomic_load_n( &pool->injectedSize, __ATOMIC_RELAXED ) ) return nullptr;
+
+		std::lock_guard<std::mutex> guard( pool->injectedLock );
+		return take( pool->injected, &pool->injectedSize );
+	}
+
+	Fiber* takeOwn( Worker* w, bool fresh ) {
+		std::lock_guard<std::mutex> guard( w->lock );
+
+		return fresh ? take( w->unstarted, &w->fresh ) : take( w->ready, nullptr );
+	}
+
+	Fiber* next( Worker* w ) {
+		w->freshFirst = !w->freshFirst;
+
+		if ( w->freshFirst ) {
+			if ( Fiber* f = takeOwn( w, true ) )  return f;
+			if ( Fiber* f = takeInjected() )      return f;
+			if ( Fiber* f = takeOwn( w, false ) ) return f;
+		} else {
+			if ( Fiber* f = takeOwn( w, false ) ) return f;
+			if ( Fiber* f = takeOwn( w, true ) )  return f;
+			if ( Fiber* f = takeInjected() )      return f;
+		}
+
+		for ( Worker* victim : pool->workers ) {
+			if ( victim == w || !__atomic_load_n( &victim->fresh, __ATOMIC_RELAXED ) ) continue;
+
+			std::lock_guard<std::mutex> guard( victim->lock );
+			if ( Fiber* f = take( victim->unstarted, &victim->fresh ) ) return f;
+		}
+
+		return nullptr;
+	}
+
+	// runs on the stack of the fiber being switched out
+	void saveStack( void* raw ) {
+		Fiber*  f    = (Fiber*) raw;
+		Worker* w    = self;
+		char*   top  = (char*) f->ctx.rsp;
+		size_t  size = w->base - top;
+
+		// the copy from the last switch is reused if the stack still fits
+		char* copy = f->stack;
+		if ( !copy || GC_size( copy ) < size ) {
+			copy = (char*) GC_MALLOC( size );
+			if ( !copy ) LLLM_FAIL( "Out of memory" );
+		}
+
+		std::memcpy( copy, top, size );
+		Gc::written( copy );
+
+		f->stack     = copy;
+		f->stackSize = size;
+
+		w->switches++;
+		w->stackBytes += size;
+		if ( w->stackBytes > w->peakBytes ) w->peakBytes = w->stackBytes;
+	}
+
+	void resume( Worker* w, Fiber* f ) {
+		if ( !f->home ) {
+			// a new fiber returns into lllm_fiber_start at the top of the fiber stack
+			void** top = (void**) (w->base - 16);
+			top[0] = (void*) lllm_fiber_start;
+			top[1] = nullptr;
+
+			f->home    = w;
+			f->ctx     = Fiber::Context{ top, f, nullptr, nullptr, nullptr, nullptr, nullptr };
+		} else {
+			std::memcpy( f->ctx.rsp, f->stack, f->stackSize );
+			w->stackBytes -= f->stackSize;
+		}
+
+		// the evaluation on the fiber takes over the thread
+		Evaluator::setGlobals( f->threadGlobals );
+		Vm::setCurrent( f->threadVm );
+		Heap::local().fuel        = Fibers::SLICE;
+		running                   = f;
+		w->resumes++;
+
+		lllm_fiber_switch( &w->ctx, &f->ctx, nullptr, nullptr );
+
+		running                   = nullptr;
+		Heap::local().fuel        = LONG_MAX;
+		f->threadGlobals          = Evaluator::globals();
+		f->threadVm               = Vm::current();
+		Evaluator::setGlobals( nullptr );
+		Vm::setCurrent( nullptr );
+
+		if ( !f->done() ) {
+			std::lock_guard<std::mutex> guard( w->lock );
+			w->ready.push_back( f );
+		}
+	}
+
+	void runWorker( Worker* w ) {
+		Gc::Thread registered;
+
+		self    = w;
+		w->base = (char*) ((uintptr_t( __builtin_frame_address( 0 ) ) - SCHEDULER_STACK) & ~uintptr_t( 15 ));
+
+		for (;;) {
+			if ( Fiber* f = next( w ) ) {
+				resume( w, f );
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock( pool->sleepLock );
+			__atomic_add_fetch( &pool->idle, 1, __ATOMIC_SEQ_CST );
+
+			// spawn checks idle after queueing its fiber, so one of the two always sees the other
+			if ( !__atomic_load_n( &pool->injectedSize, __ATOMIC_SEQ_CST ) ) {
+				pool->wakeUp.wait_for( lock, std::chrono::milliseconds( 10 ) );
+			}
+
+			__atomic_sub_fetch( &pool->idle, 1, __ATOMIC_SEQ_CST );
+		}
+	}
+
+	void start() {
+		static std::once_flag started;
+
+		std::call_once( started, []() {
+			CStr   env = std::getenv( "LLLM_GREEN_WORKERS" );
+			size_t n   = env ? std::strtoul( env, nullptr, 10 ) : std::thread::hardware_concurrency();
+
+			// the number of cores is 0 if it is not known
+			if ( n < 1 || n > 1024 ) n = 1;
+
+			Gc::enableThreads();
+
+			Pool* p = new Pool();
+			for ( size_t i = 0; i < n; i++ ) p->workers.push_back( new (NoGC) Worker() );
+
+			__atomic_store_n( &pool, p, __ATOMIC_RELEASE );
+
+			for ( Worker* w : p->workers ) std::thread( runWorker, w ).detach();
+		} );
+	}
+}
+
+extern "C" void lllm_fiber_main( Fiber* f ) {
+	f->execute();
+
+	// the stack of a finished fiber is simply dropped
+	f->stack = nullptr;
+	Fiber::Context done;
+	lllm_fiber_switch( &done, &self->ctx, nullptr, nullptr );
+	__builtin_unreachable();
+}
+
+//***** FIBERS *********************************************************************************************************
+
+Fiber::Fiber( LambdaPtr fn ) :
+  ctx{ nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr },
+  stack( nullptr ),
+  stackSize( 0 ),
+  home( nullptr ),
+  threadGlobals( nullptr ),
+  threadVm( nullptr ),
+  fn( fn ) {}
+
+void Fiber::run() {
+	result = Evaluator::apply( fn, ValueVector() );
+}
+
+Fiber* Fibers::spawn( LambdaPtr fn ) {
+	if ( !LLLM_GREEN_THREADS ) LLLM_FAIL( "Green threads are not supported on this architecture" );
+
+	start();
+
+	Fiber* f = new Fiber( fn );
+
+	if ( Worker* w = self ) {
+		std::lock_guard<std::mutex> guard( w->lock );
+		w->unstarted.push_back( f );
+		__atomic_add_fetch( &w->fresh, 1, __ATOMIC_SEQ_CST );
+	} else {
+		std::lock_guard<std::mutex> guard( pool->injectedLock );
+		pool->injected.push_back( f );
+		__atomic_add_fetch( &pool->injectedSize, 1, __ATOMIC_SEQ_CST );
+	}
+	__atomic_add_fetch( &pool->spawned, 1, __ATOMIC_RELAXED );
+
+	if ( __atomic_load_n( &pool->idle, __ATOMIC_SEQ_CST ) ) {
+		{ std::lock_guard<std::mutex> lock( pool->sleepLock ); }
+		pool->wakeUp.notify_one();
+	}
+
+	return f;
+}
+
+bool Fibers::yield() {
+	Fiber* f = running;
+	if ( !LLLM_GREEN_THREADS || !f ) return false;
+
+	Worker* w      = self;
+	size_t  before = w->resumes;
+
+	lllm_fiber_switch( &f->ctx, &self->ctx, saveStack, f );
+
+	return w->resumes != before + 1;
+}
+
+void Fibers::preempt() {
+	if ( running ) {
+		yield();
+	} else {
+		Heap::local().fuel = LONG_MAX;
+	}
+}
+
+Fiber* Fibers::current() {
+	return running;
+}
+
+size_t Fibers::workers() {
+	start();
+
+	return pool->workers.size();
+}
+
+Fibers::Stats Fibers::stats() {
+	Stats stats{ 0, 0, 0, 0 };
+	if ( !pool ) return stats;
+
+	stats.spawned = __atomic_load_n( &pool->spawned, __ATOMIC_RELAXED );
+
+	// per worker and not synchronized, the peak is the sum of the peaks of all workers
+	for ( Worker* w : pool->workers ) {
+		stats.switches   += __atomic_load_n( &w->switches,   __ATOMIC_RELAXED );
+		stats.stackBytes += __atomic_load_n( &w->stackBytes, __ATOMIC_RELAXED );
+		stats.peakBytes  += __atomic_load_n( &w->peakBytes,  __ATOMIC_RELAXED );
+	}
+
+	return stats;
+}
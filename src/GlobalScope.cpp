@@ -3,6 +3,10 @@
 #include "lllm/Builtins.hpp"
 #include "lllm/ast/Ast.hpp"
 #include "lllm/value/Value.hpp"
+#include "lllm/value/Gc.hpp"
+#include "lllm/util/fail.hpp"
+
+#include <gc.h>
 
 #include <cstring>
 #include <iostream>
@@ -10,35 +14,148 @@
 using namespace lllm;
 using namespace lllm::util;
 
+struct GlobalScope::Node final {
+	InternedString name;
+	// replaced when the name is defined again
+	const Binding* binding;
+	Node*          next;
+};
+struct GlobalScope::Table final {
+	size_t numBuckets;
+	size_t numNodes;
+	Node** buckets;
+};
+
+static const size_t INITIAL_BUCKETS = 256;
+
+template<typename T>
+static T* alloc( size_t n = 1 ) {
+	T* t = (T*) GC_MALLOC( n * sizeof(T) );
+	if ( !t ) LLLM_FAIL( "Out of memory" );
+	return t;
+}
+
+static inline size_t bucketOf( const InternedString& name, size_t numBuckets ) {
+	size_t h = size_t( (CStr) name ) * 0x9e3779b97f4a7c15UL;
+	return (h ^ (h >> 32)) % numBuckets;
+}
+
+GlobalScope::Table* GlobalScope::makeTable( size_t numBuckets ) {
+	Table* t = alloc<Table>();
+	t->numBuckets = numBuckets;
+	t->numNodes   = 0;
+	// GC_MALLOC clears memory, all buckets start out empty
+	t->buckets    = alloc<Node*>( numBuckets );
+	return t;
+}
+
+GlobalScope::GlobalScope() {
+	root = (Table**) GC_MALLOC_UNCOLLECTABLE( sizeof(Table*) );
+	if ( !root ) LLLM_FAIL( "Out of memory" );
+
+	*root = makeTable( INITIAL_BUCKETS );
+}
+GlobalScope::~GlobalScope() {
+	GC_FREE( root );
+}
+
 void GlobalScope::add( const util::SourceLocation& loc, const util::InternedString& name, ast::AstPtr ast, value::ValuePtr val ) {
-	data[name] = std::make_pair( ast::Variable::makeGlobal( loc, name, ast ), val );
+	Binding* binding = alloc<Binding>();
+	binding->var = ast::Variable::makeGlobal( loc, name, ast );
+	binding->val = val;
+
+	std::lock_guard<std::mutex> guard( writeLock );
+
+	// only writers change the table pointer
+	Table* table = *root;
+	Node** bucket = &table->buckets[bucketOf( name, table->numBuckets )];
+
+	for ( Node* node = *bucket; node; node = node->next ) {
+		if ( node->name == name ) {
+			__atomic_store_n( &node->binding, binding, __ATOMIC_RELEASE );
+			value::Gc::written( node );
+			return;
+		}
+	}
+
+	Node* node = alloc<Node>();
+	node->name    = name;
+	node->binding = binding;
+	node->next    = *bucket;
+
+	__atomic_store_n( bucket, node, __ATOMIC_RELEASE );
+	value::Gc::written( table->buckets );
+
+	if ( ++table->numNodes > 2 * table->numBuckets ) grow();
 }
 
-bool GlobalScope::lookup( const util::InternedString& name, ast::AstPtr*      dst ) {
-	auto lb = data.lower_bound( name );
+// readers may still walk the old table, so nodes are copied instead of moved
+void GlobalScope::grow() {
+	Table* old    = *root;
+	Table* bigger = makeTable( 2 * old->numBuckets );
 
-	if ( lb != data.end() && lb->first == name ) {
-		*dst = lb->second.first->ast;
+	for ( size_t i = 0; i < old->numBuckets; i++ ) {
+		for ( Node* node = old->buckets[i]; node; node = node->next ) {
+			Node** bucket = &bigger->buckets[bucketOf( node->name, bigger->numBuckets )];
+
+			Node* copy = alloc<Node>();
+			copy->name    = node->name;
+			copy->binding = node->binding;
+			copy->next    = *bucket;
+			*bucket       = copy;
+		}
+	}
+	bigger->numNodes = old->numNodes;
+
+	__atomic_store_n( root, bigger, __ATOMIC_RELEASE );
+	value::Gc::written( root );
+}
+
+const GlobalScope::Binding* GlobalScope::find( const util::InternedString& name ) const {
+	Table* table = __atomic_load_n( root, __ATOMIC_ACQUIRE );
+
+	Node* node = __atomic_load_n( &table->buckets[bucketOf( name, table->numBuckets )], __ATOMIC_ACQUIRE );
+
+	for ( ; node; node = node->next ) {
+		if ( node->name == name ) return __atomic_load_n( &node->binding, __ATOMIC_ACQUIRE );
+	}
+
+	return nullptr;
+}
+
+std::vector<std::pair<InternedString,GlobalScope::Binding>> GlobalScope::bindings() const {
+	std::vector<std::pair<InternedString,Binding>> all;
+
+	Table* table = __atomic_load_n( root, __ATOMIC_ACQUIRE );
+
+	for ( size_t i = 0; i < table->numBuckets; i++ ) {
+		for ( Node* node = __atomic_load_n( &table->buckets[i], __ATOMIC_ACQUIRE ); node; node = node->next ) {
+			all.push_back( std::make_pair( node->name, *__atomic_load_n( &node->binding, __ATOMIC_ACQUIRE ) ) );
+		}
+	}
+
+	return all;
+}
+
+bool GlobalScope::lookup( const util::InternedString& name, ast::AstPtr*      dst ) {
+	if ( const Binding* b = find( name ) ) {
+		*dst = b->var->ast;
 		return true;
 	} else {
 		return Builtins::get().lookup( name, dst );
 	}
 }
 bool GlobalScope::lookup( const util::InternedString& name, ast::VariablePtr* dst ) {
-	auto lb = data.lower_bound( name );
-
-	if ( lb != data.end() && lb->first == name ) {
-		*dst = lb->second.first;
+	if ( const Binding* b = find( name ) ) {
+		*dst = b->var;
 		return true;
 	} else {
 		return Builtins::get().lookup( name, dst );
 	}
 }
 bool GlobalScope::lookup( const util::InternedString& name, value::ValuePtr* dst ) {
-	auto lb = data.lower_bound( name );
-
-	if ( lb != data.end() && lb->first == name ) {
-		*dst = lb->second.second;
+	if ( const Binding* b = find( name ) ) {
+		*dst = b->val;
 		return true;
 	} else {
 		return Builtins::get().lookup( name, dst );
@@ -46,9 +163,7 @@ bool GlobalScope::lookup( const util::InternedString& name, value::ValuePtr* dst
 }
 
 bool GlobalScope::contains( const util::InternedString& name ) {
-	auto lb = data.lower_bound( name );
-
-	if ( lb != data.end() && lb->first == name ) {
+	if ( find( name ) ) {
 		return true;
 	} else {
 		return Builtins::get().contains( name );
@@ -56,8 +171,8 @@ bool GlobalScope::contains( const util::InternedString& name ) {
 }
 
 void GlobalScope::dump() {
-	for ( auto it = data.begin(), end = data.end(); it != end; it++ ) {
-		std::cout << "*GLO " << it->first << "\t->\t" << it->second.first << "\t->\t" << it->second.second << std::endl;
+	for ( auto& entry : bindings() ) {
+		std::cout << "*GLO " << entry.first << "\t->\t" << entry.second.var << "\t->\t" << entry.second.val << std::endl;
 	}
 }
 
@@ -0,0 +1,561 @@
+#include "lllm/Image.hpp"
+#include "lllm/AstCache.hpp"
+#include "lllm/Builtins.hpp"
+#include "lllm/GlobalScope.hpp"
+#include "lllm/ast/Ast.hpp"
+#include "lllm/value/Gc.hpp"
+#include "lllm/value/Value.hpp"
+#include "lllm/value/ValueIO.hpp"
+#include "lllm/util/fail.hpp"
+#include "lllm/util/util_io.hpp"
+
+#include <gc.h>
+
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace lllm;
+using namespace lllm::util;
+using namespace lllm::value;
+
+static const char     MAGIC[8] = { 'L', 'L', 'L', 'M', 'I', 'M', 'G', '\0' };
+static const uint32_t VERSION  = 2;
+
+// magic, version, size of the whole file, size of the AST section, number of values, fixups and bindings
+static const size_t HEADER_SIZE = sizeof(MAGIC) + 4 + 8 + 8 + 4 + 4 + 4;
+
+// tags of values, NONE is a null pointer (e.g. an empty ref)
+enum : uint8_t { NONE, NIL, INT, REAL, CHAR, STRING, SYMBOL, CONS, REF, LAMBDA, BUILTIN, VECTOR, F64VECTOR, I64VECTOR, HASHTABLE, RECORD, RECORDFN };
+
+//***** SAVE ***********************************************************************************************************
+
+namespace {
+	struct ImageWriter final {
+		ImageWriter() : asts( "*image*", 0 ), numValues( 0 ), numFixups( 0 ), numBindings( 0 ) {}
+
+		uint32_t value( ValuePtr val ) {
+			auto it = ids.find( val );
+			if ( it != ids.end() ) return it->second;
+
+			switch ( val ? typeOf( val ) : Type::Nil ) {
+				case Type::Nil:
+					return record( val, val ? NIL : NONE );
+				case Type::Int:
+					u64( Value::asInt( val )->value );
+					return record( val, INT );
+				case Type::Real: {
+					double   d = Value::asReal( val )->value;
+					uint64_t bits;
+					std::memcpy( &bits, &d, sizeof(bits) );
+
+					u64( bits );
+					return record( val, REAL );
+				}
+				case Type::Char:
+					u8( Value::asChar( val )->value );
+					return record( val, CHAR );
+				case Type::String:
+					u32( asts.string( Value::asString( val )->value ) );
+					return record( val, STRING );
+				case Type::Symbol:
+					u32( asts.string( Value::asSymbol( val )->value ) );
+					return record( val, SYMBOL );
+				case Type::Cons:
+					return list( val );
+				case Type::Ref:
+					// the contents are written later, they may refer back to the ref
+					pending.push_back( val );
+					return record( val, REF );
+				case Type::Vector:
+					// like refs, only the length comes first
+					u32( Value::asVector( val )->length );
+					pending.push_back( val );
+					return record( val, VECTOR );
+				// typed vectors hold no values, their elements are written right away
+				case Type::F64Vector: {
+					F64VectorPtr vec = Value::asF64Vector( val );
+					u32( vec->length );
+					for ( size_t i = 0; i < vec->length; i++ ) {
+						uint64_t bits;
+						std::memcpy( &bits, &vec->elements[i], sizeof(bits) );
+						u64( bits );
+					}
+					return record( val, F64VECTOR );
+				}
+				case Type::I64Vector: {
+					I64VectorPtr vec = Value::asI64Vector( val );
+					u32( vec->length );
+					for ( size_t i = 0; i < vec->length; i++ ) u64( vec->elements[i] );
+					return record( val, I64VECTOR );
+				}
+				case Type::HashTable:
+					// like refs, the entries are written later
+					pending.push_back( val );
+					return record( val, HASHTABLE );
+				case Type::Record: {
+					// records can not change, like the env of a lambda their fields come first
+					RecordPtr r = Value::asRecord( val );
+
+					std::vector<uint32_t> fields;
+					for ( size_t i = 0; i < r->type->numFields(); i++ ) fields.push_back( value( r->fields[i] ) );
+
+					recordType( r->type );
+					for ( uint32_t id : fields ) u32( id );
+					return record( val, RECORD );
+				}
+				case Type::Future:
+					LLLM_FAIL( "Can not save future " << val << " in an image" );
+				case Type::Channel:
+					LLLM_FAIL( "Can not save channel " << val << " in an image" );
+				default:
+					return lambda( Value::asLambda( val ) );
+			}
+		}
+
+		// walks down the cdrs, so long lists do not recurse
+		uint32_t list( ValuePtr val ) {
+			std::vector<ConsPtr> conses;
+			for ( ; typeOf( val ) == Type::Cons && !ids.count( val ); val = Value::asCons( val )->cdr ) {
+				conses.push_back( Value::asCons( val ) );
+			}
+
+			uint32_t tail = value( val );
+
+			for ( size_t i = conses.size(); i > 0; i-- ) {
+				uint32_t car = value( conses[i - 1]->car );
+
+				u32( car );
+				u32( tail );
+				tail = record( conses[i - 1], CONS );
+			}
+
+			return tail;
+		}
+
+		uint32_t lambda( LambdaPtr fn ) {
+			ast::LambdaPtr ast = fn->data->ast;
+
+			// the functions of a record type are made with the type: 0 is the constructor, 1 the predicate, 2 + i accessor i
+			RecordTypePtr type;
+			size_t        field;
+			if ( RecordType::isConstructor( fn, &type ) || RecordType::isPredicate( fn, &type ) || RecordType::isAccessor( fn, &type, &field ) ) {
+				recordType( type );
+				u32( fn == type->constructor() ? 0 : fn == type->predicate() ? 1 : 2 + field );
+				return record( fn, RECORDFN );
+			}
+
+			// builtins have no body, they are looked up by name when the image is restored
+			if ( !ast || !ast->body ) {
+				ValuePtr builtin;
+				if ( !ast || !Builtins::get().lookup( ast->name, &builtin ) || builtin != fn ) {
+					LLLM_FAIL( "Can not save function " << fn << " in an image" );
+				}
+
+				u32( asts.string( ast->name ) );
+				return record( fn, BUILTIN );
+			}
+
+			std::vector<uint32_t> env;
+			for ( size_t i = 0; i < ast->envSize(); i++ ) env.push_back( value( fn->env[i] ) );
+
+			u32( asts.node( ast ) );
+			u64( fn->data->callCnt );
+			u32( env.size() );
+			for ( uint32_t id : env ) u32( id );
+			return record( fn, LAMBDA );
+		}
+
+		// a record type is its name and the names of its fields
+		void recordType( RecordTypePtr type ) {
+			u32( asts.string( type->name ) );
+			u32( type->numFields() );
+			for ( auto& field : type->fields ) u32( asts.string( field ) );
+		}
+
+		// writes the contents of all refs, vectors and hash tables seen so far, which may find more of them
+		void flushPending() {
+			while ( !pending.empty() ) {
+				ValuePtr val = pending.back();
+				pending.pop_back();
+
+				if ( RefPtr ref = Value::asRef( val ) ) {
+					fixup( ids[ref], 0, value( ref->get() ) );
+				} else if ( VectorPtr vec = Value::asVector( val ) ) {
+					for ( size_t i = 0; i < vec->length; i++ ) fixup( ids[vec], i, value( vec->elements[i] ) );
+				} else {
+					// a key in the even slot, its value in the odd one after it
+					HashTablePtr table = Value::asHashTable( val );
+					std::vector<ValuePtr> entries;
+					table->each( [&]( ValuePtr key, ValuePtr v ) {
+						entries.push_back( key );
+						entries.push_back( v );
+					} );
+
+					for ( size_t i = 0; i < entries.size(); i++ ) fixup( ids[table], i, value( entries[i] ) );
+				}
+			}
+		}
+		// slot is always 0 for refs
+		void fixup( uint32_t target, uint32_t slot, uint32_t contents ) {
+			uint32_t words[] = { target, slot, contents };
+			fixups.append( (const char*) words, sizeof(words) );
+			numFixups++;
+		}
+
+		void binding( const InternedString& name, ast::VariablePtr var, ValuePtr val ) {
+			uint32_t id  = value( val );
+			flushPending();
+			uint32_t ast = var->ast ? asts.node( var->ast ) + 1 : 0;
+
+			bindings.append( (const char*) &id, 4 );
+			bindings.append( (const char*) &ast, 4 );
+
+			uint32_t strs[] = { asts.string( name ), asts.string( var->location.file() ), var->location.line(), var->location.column() };
+			bindings.append( (const char*) strs, sizeof(strs) );
+			numBindings++;
+		}
+
+		// the operands of a value are written before its tag, so write them to the side first
+		uint32_t record( ValuePtr val, uint8_t tag ) {
+			values.push_back( char( tag ) );
+			values.append( operands );
+			operands.clear();
+
+			ids[val] = numValues;
+			return numValues++;
+		}
+
+		void u8( uint8_t v )   { operands.push_back( char( v ) ); }
+		void u32( uint32_t v ) { operands.append( (const char*) &v, sizeof(v) ); }
+		void u64( uint64_t v ) { operands.append( (const char*) &v, sizeof(v) ); }
+
+		AstWriter                              asts;
+		std::unordered_map<ValuePtr,uint32_t>  ids;
+		std::vector<ValuePtr>                  pending;
+		std::string                            operands;
+		std::string                            values, fixups, bindings;
+		uint32_t                               numValues, numFixups, numBindings;
+	};
+}
+
+bool Image::save( GlobalScopePtr scope, CStr fileName ) {
+	ImageWriter w;
+
+	for ( auto& entry : scope->bindings() ) {
+		w.binding( entry.first, entry.second.var, entry.second.val );
+	}
+	w.asts.endForm();
+
+	std::string asts     = w.asts.bytes();
+	uint64_t    astSize  = asts.size();
+	uint64_t    fileSize = HEADER_SIZE + astSize + w.values.size() + w.fixups.size() + w.bindings.size();
+
+	std::string header( MAGIC, sizeof(MAGIC) );
+	header.append( (const char*) &VERSION,       4 );
+	header.append( (const char*) &fileSize,      8 );
+	header.append( (const char*) &astSize,       8 );
+	header.append( (const char*) &w.numValues,   4 );
+	header.append( (const char*) &w.numFixups,   4 );
+	header.append( (const char*) &w.numBindings, 4 );
+
+	// written to the side and renamed, like AST caches
+	std::string tmp = std::string( fileName ) + ".tmp";
+
+	FILE* out = std::fopen( tmp.c_str(), "wb" );
+	if ( !out ) return false;
+
+	bool ok = true;
+	for ( const std::string* part : { &header, &asts, &w.values, &w.fixups, &w.bindings } ) {
+		ok = ok && std::fwrite( part->data(), 1, part->size(), out ) == part->size();
+	}
+
+	ok = (std::fclose( out ) == 0) && ok;
+	ok = ok && (std::rename( tmp.c_str(), fileName ) == 0);
+
+	if ( !ok ) std::remove( tmp.c_str() );
+
+	return ok;
+}
+
+//***** RESTORE ********************************************************************************************************
+
+namespace {
+	// globals the nodes refer to, names the scope does not know yet are bound by the image itself
+	struct ImageGlobals final : public Scope<ast::VariablePtr> {
+		ImageGlobals( GlobalScopePtr scope ) : scope( scope ) {}
+
+		bool contains( const InternedString& name ) override final { return true; }
+
+		bool lookup( const InternedString& name, ast::VariablePtr* dst ) override final {
+			if ( scope->lookup( name, dst ) ) return true;
+
+			ast::VariablePtr& var = placeholders[name];
+			if ( !var ) var = ast::Variable::makeGlobal( SourceLocation( "*image*" ), name, nullptr );
+
+			*dst = var;
+			return true;
+		}
+
+		GlobalScopePtr                                     scope;
+		std::unordered_map<CStr,ast::VariablePtr>          placeholders;
+	};
+
+	struct ImageReader final {
+		ImageReader( CStr file, const char* data, size_t size ) : file( file ), data( data ), size( size ), pos( 0 ) {}
+
+		uint8_t u8() {
+			check( 1 );
+			return (uint8_t) data[pos++];
+		}
+		uint32_t u32() {
+			uint32_t v;
+			check( sizeof(v) );
+			std::memcpy( &v, data + pos, sizeof(v) );
+			pos += sizeof(v);
+			return v;
+		}
+		uint64_t u64() {
+			uint64_t v;
+			check( sizeof(v) );
+			std::memcpy( &v, data + pos, sizeof(v) );
+			pos += sizeof(v);
+			return v;
+		}
+
+		void check( size_t bytes ) const {
+			if ( size - pos < bytes ) LLLM_FAIL( "Corrupt image " << file << ": unexpected end of file" );
+		}
+
+		const CStr        file;
+		const char* const data;
+		const size_t      size;
+		size_t            pos;
+	};
+}
+
+static ValuePtr restoreValue( ImageReader& in, AstReader& asts, const ValueVector& values ) {
+	// a value refers to values before it
+	auto operand = [&]() -> ValuePtr {
+		uint32_t id = in.u32();
+		if ( id >= values.size() ) LLLM_FAIL( "Corrupt image " << in.file << ": value " << id << " does not exist yet" );
+		return values[id];
+	};
+	// length of a typed vector, whose elements must all be in the file
+	auto elements = [&]() -> uint32_t {
+		uint32_t length = in.u32();
+		if ( length > (in.size - in.pos) / 8 ) LLLM_FAIL( "Corrupt image " << in.file << ": truncated vector" );
+		return length;
+	};
+
+	// the one type with the name and fields in the file
+	auto recordType = [&]() -> RecordTypePtr {
+		InternedString name = asts.name( in.u32() );
+		uint32_t       n    = in.u32();
+		if ( n > MAX_ARITY ) LLLM_FAIL( "Corrupt image " << in.file << ": record " << name << " has too many fields" );
+
+		std::vector<InternedString> fields;
+		for ( uint32_t i = 0; i < n; i++ ) fields.push_back( asts.name( in.u32() ) );
+		return RecordType::get( name, fields );
+	};
+
+	switch ( in.u8() ) {
+		case NONE:
+			return nullptr;
+		case NIL:
+			return nil;
+		case INT:
+			return number( (long) in.u64() );
+		case REAL: {
+			uint64_t bits = in.u64();
+			double   d;
+			std::memcpy( &d, &bits, sizeof(d) );
+			return number( d );
+		}
+		case CHAR:
+			return character( (char) in.u8() );
+		case STRING:
+			return string( GC_STRDUP( asts.string( in.u32() ) ) );
+		case SYMBOL:
+			return symbol( asts.name( in.u32() ) );
+		case CONS: {
+			ValuePtr car = operand();
+			ValuePtr cdr = operand();
+			if ( !Value::isList( cdr ) ) LLLM_FAIL( "Corrupt image " << in.file << ": improper list" );
+			return cons( car, static_cast<ListPtr>( cdr ) );
+		}
+		case REF:
+			return value::ref();
+		case VECTOR:
+			return value::vector( in.u32(), nullptr );
+		case HASHTABLE:
+			return value::hashTable();
+		case F64VECTOR: {
+			F64Vector* vec = F64Vector::alloc( elements(), 0 );
+			for ( size_t i = 0; i < vec->length; i++ ) {
+				uint64_t bits = in.u64();
+				std::memcpy( &vec->elements[i], &bits, sizeof(bits) );
+			}
+			return vec;
+		}
+		case I64VECTOR: {
+			I64Vector* vec = I64Vector::alloc( elements(), 0 );
+			for ( size_t i = 0; i < vec->length; i++ ) vec->elements[i] = (long) in.u64();
+			return vec;
+		}
+		case RECORD: {
+			RecordTypePtr type = recordType();
+
+			ValueVector fields;
+			for ( size_t i = 0; i < type->numFields(); i++ ) fields.push_back( operand() );
+			return Record::alloc( type, fields.data() );
+		}
+		case RECORDFN: {
+			RecordTypePtr type  = recordType();
+			uint32_t      which = in.u32();
+
+			if ( which == 0 ) return type->constructor();
+			if ( which == 1 ) return type->predicate();
+			if ( which - 2 >= type->numFields() ) LLLM_FAIL( "Corrupt image " << in.file << ": " << type->name << " has no field " << (which - 2) );
+			return type->accessor( which - 2 );
+		}
+		case LAMBDA: {
+			ast::LambdaPtr ast = asts.at( in.u32() )->as<ast::Lambda>();
+			if ( !ast ) LLLM_FAIL( "Corrupt image " << in.file << ": expected a lambda" );
+
+			ast->data->callCnt = in.u64();
+
+			if ( in.u32() != ast->envSize() ) LLLM_FAIL( "Corrupt image " << in.file << ": wrong environment size for " << ast->name );
+
+			Lambda* fn = Lambda::alloc( ast );
+			for ( size_t i = 0; i < ast->envSize(); i++ ) fn->env[i] = operand();
+			Gc::written( fn );
+			return fn;
+		}
+		case BUILTIN: {
+			InternedString name = asts.name( in.u32() );
+
+			ValuePtr builtin;
+			if ( !Builtins::get().lookup( name, &builtin ) ) LLLM_FAIL( "Image " << in.file << " uses unknown builtin '" << name << "'" );
+			return builtin;
+		}
+	}
+
+	LLLM_FAIL( "Corrupt image " << in.file << ": unknown value" );
+}
+
+bool Image::restore( CStr fileName, GlobalScopePtr scope ) {
+	int fd = open( fileName, O_RDONLY );
+	if ( fd < 0 ) return false;
+
+	struct stat st;
+	void* data = nullptr;
+
+	if ( fstat( fd, &st ) == 0 && size_t( st.st_size ) >= HEADER_SIZE ) {
+		data = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if ( data == MAP_FAILED ) data = nullptr;
+	}
+
+	close( fd );
+
+	if ( !data ) return false;
+
+	// unmapped on every way out, strings are copied out of the file as they are read
+	struct Unmap final {
+		~Unmap() { munmap( data, size ); }
+
+		void*  data;
+		size_t size;
+	} unmap{ data, size_t( st.st_size ) };
+
+	ImageReader in( fileName, (const char*) data, st.st_size );
+
+	if ( std::memcmp( in.data, MAGIC, sizeof(MAGIC) ) != 0 ) return false;
+	in.pos = sizeof(MAGIC);
+
+	uint32_t version     = in.u32();
+	uint64_t fileSize    = in.u64();
+	uint64_t astSize     = in.u64();
+	uint32_t numValues   = in.u32();
+	uint32_t numFixups   = in.u32();
+	uint32_t numBindings = in.u32();
+
+	if ( version != VERSION || fileSize != in.size ) return false;
+	if ( astSize > in.size - in.pos ) LLLM_FAIL( "Corrupt image " << fileName << ": truncated AST section" );
+
+	AstReader asts( in.data + in.pos, astSize, 0 );
+	if ( !asts.valid() ) LLLM_FAIL( "Corrupt image " << fileName << ": bad AST section" );
+	in.pos += astSize;
+
+	// nearly everything built here stays alive, collecting in between would be wasted work
+	GC_disable();
+	struct Enable final {
+		~Enable() { GC_enable(); }
+	} enable;
+
+	ImageGlobals globals( scope );
+	asts.read( &globals );
+
+	ValueVector values;
+	values.reserve( numValues );
+	for ( uint32_t i = 0; i < numValues; i++ ) values.push_back( restoreValue( in, asts, values ) );
+
+	// hash tables are filled after all fixups, when their keys are complete and hash like they did when saved
+	std::unordered_map<uint32_t,ValueVector> tables;
+
+	for ( uint32_t i = 0; i < numFixups; i++ ) {
+		uint32_t target   = in.u32();
+		uint32_t slot     = in.u32();
+		uint32_t contents = in.u32();
+
+		if ( target >= numValues || contents >= numValues ) LLLM_FAIL( "Corrupt image " << fileName << ": bad fixup" );
+
+		if ( RefPtr ref = Value::asRef( values[target] ) ) {
+			if ( slot != 0 ) LLLM_FAIL( "Corrupt image " << fileName << ": bad ref" );
+
+			ref->set( values[contents] );
+		} else if ( VectorPtr vec = Value::asVector( values[target] ) ) {
+			if ( slot >= vec->length ) LLLM_FAIL( "Corrupt image " << fileName << ": bad vector" );
+
+			vec->elements[slot] = values[contents];
+			Gc::written( vec );
+		} else if ( Value::asHashTable( values[target] ) ) {
+			ValueVector& entries = tables[target];
+			if ( slot != entries.size() ) LLLM_FAIL( "Corrupt image " << fileName << ": bad hash table" );
+
+			entries.push_back( values[contents] );
+		} else {
+			LLLM_FAIL( "Corrupt image " << fileName << ": bad fixup" );
+		}
+	}
+	for ( auto& table : tables ) {
+		HashTablePtr t       = Value::asHashTable( values[table.first] );
+		ValueVector& entries = table.second;
+
+		if ( entries.size() % 2 ) LLLM_FAIL( "Corrupt image " << fileName << ": bad hash table" );
+		for ( size_t i = 0; i < entries.size(); i += 2 ) t->put( entries[i], entries[i + 1] );
+	}
+
+	for ( uint32_t i = 0; i < numBindings; i++ ) {
+		uint32_t val  = in.u32();
+		uint32_t ast  = in.u32();
+		uint32_t name = in.u32();
+		uint32_t file = in.u32();
+		unsigned line = in.u32();
+		unsigned col  = in.u32();
+
+		if ( val >= numValues ) LLLM_FAIL( "Corrupt image " << fileName << ": value " << val << " does not exist" );
+
+		SourceLocation loc( asts.name( file ), line, col );
+
+		scope->add( loc, asts.name( name ), ast ? asts.at( ast - 1 ) : nullptr, values[val] );
+	}
+
+	return true;
+}
@@ -1,15 +1,28 @@
 
 #include "lllm/Jit.hpp"
 #include "lllm/Evaluator.hpp"
+#include "lllm/Fiber.hpp"
+#include "lllm/JitCache.hpp"
+#include "lllm/Vm.hpp"
 #include "lllm/ast/AstIO.hpp"
 #include "lllm/value/ValueIO.hpp"
+#include "lllm/value/Telemetry.hpp"
+#include "lllm/value/Gc.hpp"
+#include "lllm/value/Heap.hpp"
+#include "lllm/value/HashCons.hpp"
+#include "lllm/Builtins.hpp"
 #include "lllm/util/fail.hpp"
 #include "lllm/util/util_io.hpp"
 
 #include <jit/jit.h>
 #include <jit/jit-dump.h>
+#include <jit/jit-memory.h>
+
+#include <gc_allocator.h>
 
 #include <map>
+#include <mutex>
+#include <unordered_map>
 #include <cassert>
 #include <cstdio>
 #include <iostream>
@@ -47,6 +60,28 @@ void Jit::setInliningDepth( size_t maxRecursion ) {
 	inliningDepth = maxRecursion;
 }
 
+size_t Jit::currentInliningThreshold() {
+	VmPtr vm = Vm::current();
+	return vm ? vm->inliningThreshold() : inliningThreshold;
+}
+size_t Jit::currentInliningDepth() {
+	VmPtr vm = Vm::current();
+	return vm ? vm->inliningDepth() : inliningDepth;
+}
+
+// bump whenever the code generated for the same AST changes
+static const uint64_t COMPILER_VERSION = 5;
+
+uint64_t Jit::codeKey( ast::LambdaPtr fn ) {
+	uint64_t key = ast::hash( fn );
+
+	for ( uint64_t part : { COMPILER_VERSION, uint64_t( currentInliningThreshold() ), uint64_t( currentInliningDepth() ) } ) {
+		key = (key ^ part) * 0x100000001b3UL;
+	}
+
+	return key;
+}
+
 class ScopeAdapter final : public JitScope {
 	public:
 		ScopeAdapter( util::ScopePtr<value::ValuePtr> scope, jit_function_t fn ) : scope( scope ), fn( fn ) {}
@@ -172,14 +207,55 @@ struct Jit::SharedData {
 	jit_type_t ref_t;
 
 	jit_type_t fail_signature;
+	jit_type_t barrier_signature;
+	jit_type_t charge_signature;
+	jit_type_t heap_signature;
+	jit_type_t preempt_signature;
 
 	std::map<size_t, jit_type_t> signature_ts;
 
+	// heap objects whose address is baked into generated code.
+	// the GC cannot see pointers in machine code, so they are kept alive here.
+	std::vector<const void*, traceable_allocator<const void*>> constants;
+
+	// code by structural hash of the inlined AST.
+	// the code of a function depends on its AST, the values of the globals it uses and some modes.
+	struct Code {
+		ast::LambdaPtr                                ast;
+		std::vector<value::ValuePtr, traceable_allocator<value::ValuePtr>> deps;
+		Gc::Mode                                      gcMode;
+		bool                                          hashCons;
+		Lambda::FnPtr                                 code;
+		size_t                                        size;
+	};
+	typedef std::pair<const size_t, Code>                                       CodeEntry;
+	std::unordered_multimap<size_t, Code, std::hash<size_t>, std::equal_to<size_t>, traceable_allocator<CodeEntry>> code;
+
+	Jit::Stats stats;
+
 	jit_type_t signature( size_t arity );
+	jit_value_t constant( jit_function_t fn, const void* ptr );
+
+	Lambda::FnPtr findCode( size_t key, ast::LambdaPtr ast, util::ScopePtr<value::ValuePtr> globals );
+	void          addCode( size_t key, ast::LambdaPtr ast, util::ScopePtr<value::ValuePtr> globals, Lambda::FnPtr code );
 };
 
 static inline int envElementOffset( int elemIdx ) {
-	return 24 + (elemIdx * sizeof(ValuePtr));
+	return LAMBDA_ENV_OFFSET + (elemIdx * sizeof(ValuePtr));
+}
+
+extern "C" {
+	static void lllm_charge( void* data ) {
+		Telemetry::current = reinterpret_cast<Lambda::DataPtr>( data );
+	}
+	static void lllm_called( void* data ) {
+		__atomic_add_fetch( &reinterpret_cast<Lambda::DataPtr>( data )->callCnt, 1, __ATOMIC_RELAXED );
+	}
+}
+
+// store data into Telemetry::current, which is thread local so the code can not store to it directly
+static inline void emitCharge( jit_function_t fn, jit_type_t signature, jit_value_t data ) {
+	jit_insn_call_native( fn, "lllm_charge", (void*)lllm_charge, signature, &data, 1, 0 );
 }
 
 static inline bool isTailRecursive( ast::AstPtr fun, jit_value_t env, JitScopePtr scope ) {
@@ -194,10 +270,10 @@ static inline bool isTailRecursive( ast::AstPtr fun, jit_value_t env, JitScopePt
 }
 
 static inline ast::LambdaPtr asLambda( ast::AstPtr ast, util::ScopePtr<value::ValuePtr> scope ) {
-	if ( ast::LambdaPtr lambda = dynamic_cast<ast::LambdaPtr>( ast ) ) {
+	if ( ast::LambdaPtr lambda = ast->as<ast::Lambda>() ) {
 		return lambda;
 	}
-	if ( ast::VariablePtr var = dynamic_cast<ast::VariablePtr>( ast ) ) {
+	if ( ast::VariablePtr var = ast->as<ast::Variable>() ) {
 		ValuePtr val;
 		if ( scope->lookup( var->name, &val ) ) {
 			if ( LambdaPtr lambda = Value::asLambda( val ) ) {
@@ -209,7 +285,7 @@ static inline ast::LambdaPtr asLambda( ast::AstPtr ast, util::ScopePtr<value::Va
 	return nullptr;
 }
 static inline Lambda::FnPtr getCodeOrNull( ast::AstPtr ast, util::ScopePtr<value::ValuePtr> scope ) {
-	if ( ast::VariablePtr var = dynamic_cast<ast::VariablePtr>( ast ) ) {
+	if ( ast::VariablePtr var = ast->as<ast::Variable>() ) {
 		ValuePtr val;
 		if ( scope->lookup( var->name, &val ) ) {
 			if ( LambdaPtr lambda = Value::asLambda( val ) ) {
@@ -220,8 +296,105 @@ static inline Lambda::FnPtr getCodeOrNull( ast::AstPtr ast, util::ScopePtr<value
 
 	return nullptr;
 }
+// the function a global is bound to, like getCodeOrNull
+static inline LambdaPtr getFnOrNull( ast::AstPtr ast, util::ScopePtr<value::ValuePtr> scope ) {
+	if ( ast::VariablePtr var = ast->as<ast::Variable>() ) {
+		ValuePtr val;
+		if ( scope->lookup( var->name, &val ) ) return Value::asLambda( val );
+	}
+
+	return nullptr;
+}
+// does the code of a function allocate conses or closures?
+// the bodies of nested lambdas are compiled on their own and are not searched.
+static bool allocatesInline( ast::AstPtr ast, ast::LambdaPtr cons, util::ScopePtr<value::ValuePtr> globals ) {
+	struct Visitor {
+		bool visit( ast::AstPtr         ast ) const { return false; }
+		bool visit( ast::IfPtr          ast ) const {
+			return ast->test->visit<bool>( *this ) || ast->thenBranch->visit<bool>( *this ) || ast->elseBranch->visit<bool>( *this );
+		}
+		bool visit( ast::DoPtr          ast ) const {
+			for ( auto it = ast->begin(), end = ast->end(); it != end; ++it ) {
+				if ( (*it)->visit<bool>( *this ) ) return true;
+			}
+			return false;
+		}
+		bool visit( ast::LetPtr         ast ) const {
+			for ( auto it = ast->begin(), end = ast->end(); it != end; ++it ) {
+				if ( it->second->visit<bool>( *this ) ) return true;
+			}
+			return ast->body->visit<bool>( *this );
+		}
+		bool visit( ast::LetStarPtr     ast ) const {
+			for ( auto it = ast->begin(), end = ast->end(); it != end; ++it ) {
+				if ( it->second->visit<bool>( *this ) ) return true;
+			}
+			return ast->body->visit<bool>( *this );
+		}
+		bool visit( ast::LambdaPtr      ast ) const { return true; }
+		bool visit( ast::ApplicationPtr ast ) const {
+			if ( cons && asLambda( ast->fun, globals ) == cons ) return true;
+
+			if ( ast->fun->visit<bool>( *this ) ) return true;
+			for ( auto it = ast->begin(), end = ast->end(); it != end; ++it ) {
+				if ( (*it)->visit<bool>( *this ) ) return true;
+			}
+			return false;
+		}
+
+		ast::LambdaPtr                  cons;
+		util::ScopePtr<value::ValuePtr> globals;
+	};
+
+	return ast->visit<bool>( Visitor{ cons, globals } );
+}
+
+// values of the globals a function uses, in the order they appear.
+// nested lambdas are searched too: code shared with another vm makes closures from the same
+// Lambda::Data, so their code sees the globals of the vm it was compiled in.
+static void globalsUsed( ast::AstPtr ast, util::ScopePtr<value::ValuePtr> globals, std::vector<ValuePtr, traceable_allocator<ValuePtr>>* dst ) {
+	struct Visitor {
+		void visit( ast::AstPtr         ast ) const {}
+		void visit( ast::VariablePtr    ast ) const {
+			if ( !ast->hasGlobalStorage ) return;
+
+			ValuePtr val = nullptr;
+			globals->lookup( ast->name, &val );
+			dst->push_back( val );
+		}
+		void visit( ast::IfPtr          ast ) const {
+			ast->test->visit<void>( *this );
+			ast->thenBranch->visit<void>( *this );
+			ast->elseBranch->visit<void>( *this );
+		}
+		void visit( ast::DoPtr          ast ) const {
+			for ( auto it = ast->begin(), end = ast->end(); it != end; ++it ) (*it)->visit<void>( *this );
+		}
+		void visit( ast::LetPtr         ast ) const {
+			for ( auto it = ast->begin(), end = ast->end(); it != end; ++it ) it->second->visit<void>( *this );
+			ast->body->visit<void>( *this );
+		}
+		void visit( ast::LetStarPtr     ast ) const {
+			for ( auto it = ast->begin(), end = ast->end(); it != end; ++it ) it->second->visit<void>( *this );
+			ast->body->visit<void>( *this );
+		}
+		void visit( ast::ApplicationPtr ast ) const {
+			ast->fun->visit<void>( *this );
+			for ( auto it = ast->begin(), end = ast->end(); it != end; ++it ) (*it)->visit<void>( *this );
+		}
+		void visit( ast::LambdaPtr      ast ) const {
+			if ( ast->body ) ast->body->visit<void>( *this );
+		}
+
+		util::ScopePtr<value::ValuePtr>                          globals;
+		std::vector<ValuePtr, traceable_allocator<ValuePtr>>* dst;
+	};
+
+	ast->visit<void>( Visitor{ globals, dst } );
+}
+
 static inline const char* getNameOrFail( ast::AstPtr ast ) {
-	if ( ast::VariablePtr var = dynamic_cast<ast::VariablePtr>( ast ) ) {
+	if ( ast::VariablePtr var = ast->as<ast::Variable>() ) {
 		return var->name;
 	}
 
@@ -235,10 +408,39 @@ extern "C" {
 	static void* lllm_alloc_lambda( void* v ) {
 		return Lambda::alloc( reinterpret_cast<ast::LambdaPtr>( v ) );
 	}
+	static void lllm_written( void* v ) {
+		Gc::written( v );
+	}
+	static void* lllm_heap() {
+		return &Heap::local();
+	}
+	static void lllm_preempt() {
+		Fibers::preempt();
+	}
+	static void* lllm_refill( void* heap, void* granules ) {
+		return reinterpret_cast<Heap*>( heap )->refill( reinterpret_cast<size_t>( granules ) );
+	}
+
+	// hash table builtins minus their checks, compiled code has checked the table already
+	static void* lllm_hash_ref( void* table, void* key, void* otherwise ) {
+		ValuePtr v;
+		return reinterpret_cast<HashTablePtr>( table )->lookup( (ValuePtr) key, &v ) ? (void*) v : otherwise;
+	}
+	static void* lllm_hash_set( void* table, void* key, void* val ) {
+		return (void*) reinterpret_cast<HashTablePtr>( table )->put( (ValuePtr) key, (ValuePtr) val );
+	}
+	static void* lllm_hash_remove( void* table, void* key ) {
+		ValuePtr old = nullptr;
+		reinterpret_cast<HashTablePtr>( table )->remove( (ValuePtr) key, &old );
+		return (void*) old;
+	}
+
+	// code does not know its globals, so vms can share it. callees see the globals of the running evaluation
+	static void* lllm_jit( void* rawFn ) {
+		auto fn  = (value::LambdaPtr)                rawFn;
+		auto env = util::ScopePtr<value::ValuePtr>( Evaluator::globals() );
 
-	static void* lllm_jit( void* rawFn, void* rawEnv ) {
-		auto fn    = (value::LambdaPtr)                      rawFn;
-		auto env   = (const util::ScopePtr<value::ValuePtr>) rawEnv;
+		if ( !env ) LLLM_FAIL( "Cannot compile " << fn << " outside of an evaluation" );
 
 		Jit::compile( fn, env );
 
@@ -248,30 +450,78 @@ extern "C" {
 	}
 }
 
-void Jit::compile( value::LambdaPtr fn, util::ScopePtr<value::ValuePtr> globals ) {
-	if ( !shared ) shared = new SharedData();
+// one thread compiles at a time, the others wait and usually find the code done
+static std::mutex compileLock;
+
+// code is stored after it is complete, threads that find it can call it right away
+static inline void publish( Lambda::FnPtr* dst, Lambda::FnPtr code ) {
+	__atomic_store_n( dst, code, __ATOMIC_RELEASE );
+}
+
+namespace {
+	// holds libjit's build lock. if compiling fails (and the failure is caught, see CatchFailures)
+	// the unfinished function is dropped and the lock released, so the next compile does not hang
+	struct Build final {
+		Build( jit_context_t ctx ) : ctx( ctx ), fn( nullptr ) {
+			jit_context_build_start( ctx );
+		}
+		~Build() {
+			if ( fn ) jit_function_abandon( fn );
+			if ( ctx ) jit_context_build_end( ctx );
+		}
+
+		Build( const Build& ) = delete;
+		Build& operator=( const Build& ) = delete;
+
+		// the function was compiled
+		void done() {
+			jit_context_build_end( ctx );
+			ctx = nullptr;
+			fn  = nullptr;
+		}
 
+		jit_context_t  ctx;
+		jit_function_t fn;
+	};
+}
+
+void Jit::compile( value::LambdaPtr fn, util::ScopePtr<value::ValuePtr> globals ) {
 	// don't compile twice
 	if ( fn->code ) return;
 
+	std::lock_guard<std::mutex> guard( compileLock );
+
+	if ( !shared ) shared = new SharedData();
+
 	if ( fn->data->code ) {
-		fn->code = fn->data->code;
+		publish( &fn->code, fn->data->code );
 		return;
 	}
 
-	// start compiling
-	jit_context_build_start( shared->ctx );
-	
 	ast::LambdaPtr      ast = fn->data->ast;
 
-	std::cout << "JITTING " << ast->name << std::endl;
-
 	// do inlining
 	ast = performInlining( ast, globals );
 
+	// reuse the code of an equal function.
+	// with telemetry code charges to the function it was compiled for, so it is not shared.
+	size_t key = ast::hash( ast );
+	if ( !Telemetry::enabled() ) {
+		if ( Lambda::FnPtr code = shared->findCode( key, ast, globals ) ) {
+			publish( &fn->data->code, code );
+			publish( &fn->code,       code );
+
+			JitCache::add( fn->data->ast );
+			return;
+		}
+	}
+
+	// start compiling
+	Build build( shared->ctx );
+
 //	printf( "JITTING %s\n", (util::CStr)ast->name );
 
-	jit_function_t fnIr = jit_function_create( shared->ctx, shared->signature( fn->arity() ) );
+	jit_function_t fnIr = build.fn = jit_function_create( shared->ctx, shared->signature( fn->arity() ) );
 	
 	struct Visitor {
 		jit_value_t visit( ast::NilPtr         ast, JitScopePtr scope, bool tail ) {
@@ -280,19 +530,19 @@ void Jit::compile( value::LambdaPtr fn, util::ScopePtr<value::ValuePtr> globals
 		}
 		jit_value_t visit( ast::IntPtr         ast, JitScopePtr scope, bool tail ) {
 			DBG( Int );
-			return jit_value_create_long_constant( ir, shared->ptr_t, (long)(void*) number( ast->value ) );
+			return shared->constant( ir, ast->constant );
 		}
 		jit_value_t visit( ast::RealPtr        ast, JitScopePtr scope, bool tail ) {
 			DBG( Real );
-			return jit_value_create_long_constant( ir, shared->ptr_t, (long)(void*) number( ast->value ) );
+			return shared->constant( ir, ast->constant );
 		}
 		jit_value_t visit( ast::CharPtr        ast, JitScopePtr scope, bool tail ) {
 			DBG( Char );
-			return jit_value_create_long_constant( ir, shared->ptr_t, (long)(void*) character( ast->value ) );
+			return shared->constant( ir, ast->constant );
 		}
 		jit_value_t visit( ast::StringPtr      ast, JitScopePtr scope, bool tail ) {
 			DBG( String );
-			return jit_value_create_long_constant( ir, shared->ptr_t, (long)(void*) string( ast->value ) );
+			return shared->constant( ir, ast->constant );
 		}
 		jit_value_t visit( ast::VariablePtr    ast, JitScopePtr scope, bool tail ) {
 			DBG( Variable );
@@ -306,7 +556,7 @@ void Jit::compile( value::LambdaPtr fn, util::ScopePtr<value::ValuePtr> globals
 		}
 		jit_value_t visit( ast::QuotePtr       ast, JitScopePtr scope, bool tail ) {
 			DBG( Quote );
-			return jit_value_create_long_constant( ir, shared->ptr_t, (long)(void*) ast->value );
+			return shared->constant( ir, ast->value );
 		}
 		jit_value_t visit( ast::IfPtr          ast, JitScopePtr scope, bool tail ) {
 			DBG( If );
@@ -316,8 +566,16 @@ void Jit::compile( value::LambdaPtr fn, util::ScopePtr<value::ValuePtr> globals
 
 			jit_value_t result = jit_value_create( ir, shared->ptr_t );
 
-			// emit test code
-			jit_value_t test = ast->test->visit<jit_value_t>( *this, scope, false ); 
+			// emit test code, identity tests branch on the comparison directly
+			jit_value_t test;
+			ast::ApplicationPtr app = ast->test->as<ast::Application>();
+			if ( app && app->arity() == 2 && asLambda( app->fun, globals ) == eq ) {
+				jit_value_t a = app->args[0]->visit<jit_value_t>( *this, scope, false );
+				jit_value_t b = app->args[1]->visit<jit_value_t>( *this, scope, false );
+				test = jit_insn_eq( ir, a, b );
+			} else {
+				test = ast->test->visit<jit_value_t>( *this, scope, false );
+			}
 			// branch to else part if test == 0
 			jit_insn_branch_if_not( ir, test, &elseLabel );    
 			// emit then part
@@ -387,12 +645,25 @@ void Jit::compile( value::LambdaPtr fn, util::ScopePtr<value::ValuePtr> globals
 		jit_value_t visit( ast::LambdaPtr      ast, JitScopePtr scope, bool tail ) {
 			DBG( Lambda );
 
-			jit_value_t args[1];
-			args[0] = jit_value_create_long_constant( ir, shared->ptr_t, (long)(void*) ast );
+			size_t      size = sizeof(Lambda) + ast->envSize() * sizeof(ValuePtr);
+			jit_value_t lambda;
+
+			if ( heap && Heap::granules( size ) <= Heap::MAX_GRANULES ) {
+				// create closure inline, like Lambda::alloc( ast )
+				lambda = emitAlloc( size );
 
-			// create closure
-			jit_value_t lambda = jit_insn_call_native( ir, "lllm::value::Lambda::alloc", (void*)lllm_alloc_lambda, 
-			                                           shared->signature( 0 ), args, 1, 0 );
+				jit_value_t tag = jit_value_create_long_constant( ir, shared->tag_t, size_t(Type::Lambda) + ast->arity() );
+				jit_insn_store_relative( ir, lambda, 0,                        tag );
+				jit_insn_store_relative( ir, lambda, LAMBDA_CODE_OFFSET, jit_value_create_long_constant( ir, shared->ptr_t, 0 ) );
+				jit_insn_store_relative( ir, lambda, LAMBDA_DATA_OFFSET, shared->constant( ir, ast->data ) );
+			} else {
+				jit_value_t args[1];
+				args[0] = shared->constant( ir, ast );
+
+				// create closure
+				lambda = jit_insn_call_native( ir, "lllm::value::Lambda::alloc", (void*)lllm_alloc_lambda, 
+				                               shared->signature( 0 ), args, 1, 0 );
+			}
 
 			// fill env
 			int idx = 0;
@@ -404,17 +675,27 @@ void Jit::compile( value::LambdaPtr fn, util::ScopePtr<value::ValuePtr> globals
 					LLLM_FAIL( (*it)->location << ": Unknown variable " << (*it)->name );
 				}
 			}
+			// write barrier, only needed if the collector was incremental when this was compiled
+			if ( idx && Gc::mode() == Gc::Mode::INCREMENTAL ) {
+				jit_insn_call_native( ir, "lllm_written", (void*)lllm_written, shared->barrier_signature, &lambda, 1, 0 );
+			}
 
 			return lambda;
 		}
 		jit_value_t visit( ast::ApplicationPtr ast, JitScopePtr scope, bool tail ) {
 			DBG( Application );
 
+			jit_value_t result;
 			if ( ast::LambdaPtr lambda = asLambda( ast->fun, globals ) ) {
-				return emitCallToConstant( ast, lambda, scope, tail );
+				result = emitCallToConstant( ast, lambda, scope, tail );
 			} else {
-				return emitNormalCall( ast, scope, tail );
+				result = emitNormalCall( ast, scope, tail );
 			}
+
+			// the callee charged allocations to itself, take over again
+			if ( chargeTo ) emitCharge( ir, shared->charge_signature, chargeTo );
+
+			return result;
 		}
 
 		jit_value_t emitCallToConstant( ast::ApplicationPtr ast, ast::LambdaPtr fn, JitScopePtr scope, bool tail ) {
@@ -437,6 +718,41 @@ void Jit::compile( value::LambdaPtr fn, util::ScopePtr<value::ValuePtr> globals
 
 			args[idx] = jit_value_create_long_constant( ir, shared->ptr_t, (long)(void*) globals );
 
+			if ( heap && fn == cons ) {
+				return emitCons( args, getCodeOrNull( ast->fun, globals ) );
+			}
+			if ( fn == eq ) {
+				return emitEq( args[1], args[2] );
+			}
+			if ( fn == vectorRef ) {
+				return emitVectorRef( args, getCodeOrNull( ast->fun, globals ) );
+			}
+			if ( fn == vectorSet ) {
+				return emitVectorSet( args, getCodeOrNull( ast->fun, globals ) );
+			}
+			if ( fn == hashRef ) {
+				return emitHashCall( args, arity, "hash-ref",     (void*)lllm_hash_ref,    getCodeOrNull( ast->fun, globals ) );
+			}
+			if ( fn == hashSet ) {
+				return emitHashCall( args, arity, "hash-set!",    (void*)lllm_hash_set,    getCodeOrNull( ast->fun, globals ) );
+			}
+			if ( fn == hashRemove ) {
+				return emitHashCall( args, arity, "hash-remove!", (void*)lllm_hash_remove, getCodeOrNull( ast->fun, globals ) );
+			}
+
+			// the functions defrecord defines know their type, accessors and predicates only check it inline
+			if ( LambdaPtr constant = getFnOrNull( ast->fun, globals ) ) {
+				RecordTypePtr type;
+				size_t        field;
+
+				if ( RecordType::isAccessor( constant, &type, &field ) ) {
+					return emitRecordLoad( args, type, field, constant );
+				}
+				if ( RecordType::isPredicate( constant, &type ) ) {
+					return emitRecordTest( args[1], type );
+				}
+			}
+
 			// emit code for call
 			if ( fun == self ) {
 				if ( tail ) {
@@ -470,8 +786,8 @@ void Jit::compile( value::LambdaPtr fn, util::ScopePtr<value::ValuePtr> globals
 					jit_insn_branch( ir, &end );
 					// jit uncompiled function, then call it
 					jit_insn_label( ir, &fnIsNotCompiled );
-					jit_value_t jitArgs[] = { fun, jit_value_create_long_constant( ir, shared->ptr_t, (long)(void*)globals ) };
-					jit_value_t newCode   = jit_insn_call_native( ir, "lllm_jit", (void*)lllm_jit, shared->signature(1), jitArgs, 2, 0 );
+					jit_value_t jitArgs[] = { fun };
+					jit_value_t newCode   = jit_insn_call_native( ir, "lllm_jit", (void*)lllm_jit, shared->signature(0), jitArgs, 1, 0 );
 					jit_value_t tmp       = jit_insn_call_indirect( ir, newCode, shared->signature( arity ), args, arity + 1, 0 );
 					jit_insn_store( ir, result, tmp );
 					jit_insn_branch( ir, &end );
@@ -537,8 +853,8 @@ void Jit::compile( value::LambdaPtr fn, util::ScopePtr<value::ValuePtr> globals
 				jit_insn_branch( ir, &end );
 				// jit uncompiled function, then call it
 				jit_insn_label( ir, &fnIsNotCompiled );
-				jit_value_t jitArgs[] = { fun, jit_value_create_long_constant( ir, shared->ptr_t, (long)(void*)globals ) };
-				jit_value_t newCode   = jit_insn_call_native( ir, "lllm_jit", (void*)lllm_jit, shared->signature(1), jitArgs, 2, 0 );
+				jit_value_t jitArgs[] = { fun };
+				jit_value_t newCode   = jit_insn_call_native( ir, "lllm_jit", (void*)lllm_jit, shared->signature(0), jitArgs, 1, 0 );
 				jit_value_t tmp       = jit_insn_call_indirect( ir, newCode, shared->signature( arity ), args, arity + 1, 0 );
 				jit_insn_store( ir, result, tmp );
 				jit_insn_branch( ir, &end );
@@ -554,6 +870,184 @@ void Jit::compile( value::LambdaPtr fn, util::ScopePtr<value::ValuePtr> globals
 				return result;
 			}
 		}
+		// pop an object from the thread's free list, refill it out of line if it is empty
+		jit_value_t emitAlloc( size_t bytes ) {
+			size_t g      = Heap::granules( bytes );
+			long   offset = offsetof( Heap, lists ) + g * sizeof(void*);
+
+			jit_label_t empty = jit_label_undefined;
+			jit_label_t end   = jit_label_undefined;
+
+			jit_value_t obj = jit_value_create( ir, shared->ptr_t );
+
+			jit_value_t head = jit_insn_load_relative( ir, heap, offset, shared->ptr_t );
+			jit_insn_branch_if_not( ir, head, &empty );
+			jit_insn_store( ir, obj, head );
+			jit_insn_store_relative( ir, heap, offset, jit_insn_load_relative( ir, head, 0, shared->ptr_t ) );
+			jit_insn_branch( ir, &end );
+			// refill
+			jit_insn_label( ir, &empty );
+			jit_value_t refillArgs[] = { heap, jit_value_create_long_constant( ir, shared->ptr_t, g ) };
+			jit_value_t refilled     = jit_insn_call_native( ir, "lllm_refill", (void*)lllm_refill, shared->signature(1), refillArgs, 2, 0 );
+			jit_insn_store( ir, obj, refilled );
+			// done
+			jit_insn_label( ir, &end );
+			return obj;
+		}
+		// cons with inline allocation, the builtin only handles the case where cdr is no list (and fails)
+		jit_value_t emitCons( jit_value_t* args, Lambda::FnPtr builtin ) {
+			jit_label_t isList  = jit_label_undefined;
+			jit_label_t notList = jit_label_undefined;
+			jit_label_t end     = jit_label_undefined;
+
+			jit_value_t result = jit_value_create( ir, shared->ptr_t );
+
+			jit_value_t car = args[1];
+			jit_value_t cdr = args[2];
+
+			// type check cdr
+			jit_insn_branch_if_not( ir, cdr, &isList );
+			jit_value_t cdrTag  = jit_insn_load_relative( ir, cdr, 0, shared->tag_t );
+			jit_value_t consTag = jit_value_create_long_constant( ir, shared->tag_t, size_t(Type::Cons) );
+			jit_insn_branch_if_not( ir, jit_insn_eq( ir, cdrTag, consTag ), &notList );
+			// allocate & init
+			jit_insn_label( ir, &isList );
+			jit_value_t obj = emitAlloc( sizeof(Cons) );
+			jit_insn_store_relative( ir, obj, 0,                     consTag );
+			jit_insn_store_relative( ir, obj, CONS_CAR_OFFSET, car );
+			jit_insn_store_relative( ir, obj, CONS_CDR_OFFSET, cdr );
+			jit_insn_store( ir, result, obj );
+			jit_insn_branch( ir, &end );
+			// let the builtin report the error
+			jit_insn_label( ir, &notList );
+			jit_value_t tmp = jit_insn_call_native( ir, "cons", (void*) builtin, shared->signature( 2 ), args, 3, 0 );
+			jit_insn_store( ir, result, tmp );
+			// done
+			jit_insn_label( ir, &end );
+			return result;
+		}
+		// (eq a b) is a single compare, turned into true or nil
+		jit_value_t emitEq( jit_value_t a, jit_value_t b ) {
+			jit_value_t same = jit_insn_convert( ir, jit_insn_eq( ir, a, b ), shared->ptr_t, 0 );
+			return jit_insn_mul( ir, same, shared->constant( ir, trueValue ) );
+		}
+		// branches to fail unless vec is a vector and idx an int in range, the address of the element
+		jit_value_t emitElementAddress( jit_value_t vec, jit_value_t idx, jit_label_t* fail ) {
+			jit_value_t vectorTag = jit_value_create_long_constant( ir, shared->tag_t, size_t(Type::Vector) );
+			jit_value_t intTag    = jit_value_create_long_constant( ir, shared->tag_t, size_t(Type::Int) );
+
+			// type checks
+			jit_insn_branch_if_not( ir, vec, fail );
+			jit_insn_branch_if_not( ir, jit_insn_eq( ir, jit_insn_load_relative( ir, vec, 0, shared->tag_t ), vectorTag ), fail );
+			jit_insn_branch_if_not( ir, idx, fail );
+			jit_insn_branch_if_not( ir, jit_insn_eq( ir, jit_insn_load_relative( ir, idx, 0, shared->tag_t ), intTag ), fail );
+			// bounds check, unsigned so negative indices are out of range too
+			jit_value_t i      = jit_insn_load_relative( ir, idx, INT_VALUE_OFFSET,     jit_type_nuint );
+			jit_value_t length = jit_insn_load_relative( ir, vec, VECTOR_LENGTH_OFFSET, jit_type_nuint );
+			jit_insn_branch_if_not( ir, jit_insn_lt( ir, i, length ), fail );
+
+			jit_value_t elements = jit_insn_add_relative( ir, vec, VECTOR_ELEMENTS_OFFSET );
+			return jit_insn_load_elem_address( ir, elements, i, shared->ptr_t );
+		}
+		// vector-ref with inline checks, the builtin only reports errors
+		jit_value_t emitVectorRef( jit_value_t* args, Lambda::FnPtr builtin ) {
+			jit_label_t fail = jit_label_undefined;
+			jit_label_t end  = jit_label_undefined;
+
+			jit_value_t result = jit_value_create( ir, shared->ptr_t );
+
+			jit_value_t addr = emitElementAddress( args[1], args[2], &fail );
+			jit_insn_store( ir, result, jit_insn_load_relative( ir, addr, 0, shared->ptr_t ) );
+			jit_insn_branch( ir, &end );
+			// let the builtin report the error
+			jit_insn_label( ir, &fail );
+			jit_insn_store( ir, result, jit_insn_call_native( ir, "vector-ref", (void*) builtin, shared->signature( 2 ), args, 3, 0 ) );
+			// done
+			jit_insn_label( ir, &end );
+			return result;
+		}
+		// vector-set! like vector-ref, the write barrier is only needed if the collector was incremental when this was compiled
+		jit_value_t emitVectorSet( jit_value_t* args, Lambda::FnPtr builtin ) {
+			jit_label_t fail = jit_label_undefined;
+			jit_label_t end  = jit_label_undefined;
+
+			jit_value_t result = jit_value_create( ir, shared->ptr_t );
+
+			jit_value_t addr = emitElementAddress( args[1], args[2], &fail );
+			jit_insn_store( ir, result, jit_insn_load_relative( ir, addr, 0, shared->ptr_t ) );
+			jit_insn_store_relative( ir, addr, 0, args[3] );
+			if ( Gc::mode() == Gc::Mode::INCREMENTAL ) {
+				jit_insn_call_native( ir, "lllm_written", (void*)lllm_written, shared->barrier_signature, &args[1], 1, 0 );
+			}
+			jit_insn_branch( ir, &end );
+			// let the builtin report the error
+			jit_insn_label( ir, &fail );
+			jit_insn_store( ir, result, jit_insn_call_native( ir, "vector-set!", (void*) builtin, shared->signature( 3 ), args, 4, 0 ) );
+			// done
+			jit_insn_label( ir, &end );
+			return result;
+		}
+		// hash-ref, hash-set! and hash-remove! check the table inline and call it without the builtin,
+		// which only reports errors. entry takes the arguments without the function
+		jit_value_t emitHashCall( jit_value_t* args, size_t arity, util::CStr name, void* entry, Lambda::FnPtr builtin ) {
+			jit_label_t fail = jit_label_undefined;
+			jit_label_t end  = jit_label_undefined;
+
+			jit_value_t result   = jit_value_create( ir, shared->ptr_t );
+			jit_value_t tableTag = jit_value_create_long_constant( ir, shared->tag_t, size_t(Type::HashTable) );
+
+			jit_insn_branch_if_not( ir, args[1], &fail );
+			jit_insn_branch_if_not( ir, jit_insn_eq( ir, jit_insn_load_relative( ir, args[1], 0, shared->tag_t ), tableTag ), &fail );
+			// the entry has one parameter less than the builtin, which is the signature of one argument less
+			jit_insn_store( ir, result, jit_insn_call_native( ir, name, entry, shared->signature( arity - 1 ), args + 1, arity, 0 ) );
+			jit_insn_branch( ir, &end );
+			// let the builtin report the error
+			jit_insn_label( ir, &fail );
+			jit_insn_store( ir, result, jit_insn_call_native( ir, name, (void*) builtin, shared->signature( arity ), args, arity + 1, 0 ) );
+			// done
+			jit_insn_label( ir, &end );
+			return result;
+		}
+		// branches to fail unless val is a record of the type, which is a constant
+		void emitRecordCheck( jit_value_t val, RecordTypePtr type, jit_label_t* fail ) {
+			jit_value_t recordTag = jit_value_create_long_constant( ir, shared->tag_t, size_t(Type::Record) );
+
+			jit_insn_branch_if_not( ir, val, fail );
+			jit_insn_branch_if_not( ir, jit_insn_eq( ir, jit_insn_load_relative( ir, val, 0, shared->tag_t ), recordTag ), fail );
+			jit_value_t actual = jit_insn_load_relative( ir, val, RECORD_TYPE_OFFSET, shared->ptr_t );
+			jit_insn_branch_if_not( ir, jit_insn_eq( ir, actual, shared->constant( ir, type ) ), fail );
+		}
+		// a field of a checked record is one load from a constant offset, like a variable from an env.
+		// the accessor only runs to report the error
+		jit_value_t emitRecordLoad( jit_value_t* args, RecordTypePtr type, size_t field, LambdaPtr accessor ) {
+			jit_label_t fail = jit_label_undefined;
+			jit_label_t end  = jit_label_undefined;
+
+			jit_value_t result = jit_value_create( ir, shared->ptr_t );
+
+			emitRecordCheck( args[1], type, &fail );
+			jit_insn_store( ir, result, jit_insn_load_relative( ir, args[1], RECORD_FIELDS_OFFSET + field * sizeof(ValuePtr), shared->ptr_t ) );
+			jit_insn_branch( ir, &end );
+			// let the accessor report the error
+			jit_insn_label( ir, &fail );
+			util::CStr fn = accessor->data->ast->name;
+			jit_insn_store( ir, result, jit_insn_call_native( ir, fn, (void*) accessor->code, shared->signature( 1 ), args, 2, 0 ) );
+			// done
+			jit_insn_label( ir, &end );
+			return result;
+		}
+		// the predicate of a record type is true or nil, it never fails
+		jit_value_t emitRecordTest( jit_value_t val, RecordTypePtr type ) {
+			jit_label_t fail = jit_label_undefined;
+
+			jit_value_t result = jit_value_create( ir, shared->ptr_t );
+
+			jit_insn_store( ir, result, shared->constant( ir, nullptr ) );
+			emitRecordCheck( val, type, &fail );
+			jit_insn_store( ir, result, shared->constant( ir, trueValue ) );
+			jit_insn_label( ir, &fail );
+			return result;
+		}
 		jit_value_t visit( ast::DefinePtr      ast, JitScopePtr scope, bool tail ) {
 			DBG( Define );
 			LLLM_FAIL( ast->location << ": Define statements may not appear within a function" );
@@ -566,13 +1060,24 @@ void Jit::compile( value::LambdaPtr fn, util::ScopePtr<value::ValuePtr> globals
 		jit_label_t*    fnEntry;
 
 		util::ScopePtr<value::ValuePtr> globals;
+		jit_value_t                     chargeTo;
+		jit_value_t                     heap;
+		ast::LambdaPtr                  cons;
+		ast::LambdaPtr                  eq;
+		value::ValuePtr                 trueValue;
+		ast::LambdaPtr                  vectorRef;
+		ast::LambdaPtr                  vectorSet;
+		ast::LambdaPtr                  hashRef;
+		ast::LambdaPtr                  hashSet;
+		ast::LambdaPtr                  hashRemove;
 	};
 
 	JitScopePtr scope = new ScopeAdapter( globals, fnIr );
 
 	int idx;
 
-	jit_value_t self = jit_value_create_long_constant( fnIr, shared->ptr_t, (long)(void*) fn );
+	// the closure being run is its own first parameter, so the code does not depend on the closure it was compiled for
+	jit_value_t self = jit_value_get_param( fnIr, 0 );
 
 	// add captured vars to scope
 	jit_value_t env = jit_value_get_param( fnIr, 0 );
@@ -595,32 +1100,89 @@ void Jit::compile( value::LambdaPtr fn, util::ScopePtr<value::ValuePtr> globals
 		scope = new JitValueScope( (*it)->name, jit_value_get_param( fnIr, idx ), scope );
 	}	
 
+	// count calls and charge allocations to this function
+	jit_value_t chargeTo = nullptr;
+	if ( Telemetry::enabled() ) {
+		chargeTo = shared->constant( fnIr, fn->data );
+
+		jit_insn_call_native( fnIr, "lllm_called", (void*)lllm_called, shared->charge_signature, &chargeTo, 1, 0 );
+
+		emitCharge( fnIr, shared->charge_signature, chargeTo );
+	}
+
+	// conses and closures are allocated inline from the thread's free lists.
+	// telemetry counts allocations in the runtime, so it turns this off.
+	ast::AstPtr    consVar = nullptr;
+	Builtins::get().lookup( "cons", &consVar );
+	// hash consed cells have to go through the table
+	ast::LambdaPtr cons    = HashCons::enabled() ? nullptr : consVar->as<ast::Lambda>();
+
+	ast::AstPtr     eqVar     = nullptr;
+	value::ValuePtr trueValue = nullptr;
+	Builtins::get().lookup( "eq",   &eqVar );
+	Builtins::get().lookup( "true", &trueValue );
+	ast::LambdaPtr  eq        = eqVar->as<ast::Lambda>();
+
+	// indexing is a few checks and a load or store
+	ast::AstPtr vectorRefVar = nullptr, vectorSetVar = nullptr;
+	Builtins::get().lookup( "vector-ref",  &vectorRefVar );
+	Builtins::get().lookup( "vector-set!", &vectorSetVar );
+	ast::LambdaPtr vectorRef = vectorRefVar->as<ast::Lambda>();
+	ast::LambdaPtr vectorSet = vectorSetVar->as<ast::Lambda>();
+
+	// hash tables are called directly once the table is checked
+	ast::AstPtr hashRefVar = nullptr, hashSetVar = nullptr, hashRemoveVar = nullptr;
+	Builtins::get().lookup( "hash-ref",     &hashRefVar );
+	Builtins::get().lookup( "hash-set!",    &hashSetVar );
+	Builtins::get().lookup( "hash-remove!", &hashRemoveVar );
+	ast::LambdaPtr hashRef    = hashRefVar->as<ast::Lambda>();
+	ast::LambdaPtr hashSet    = hashSetVar->as<ast::Lambda>();
+	ast::LambdaPtr hashRemove = hashRemoveVar->as<ast::Lambda>();
+
+	// every function needs the thread's heap for its fuel
+	jit_value_t runtime = jit_value_create( fnIr, shared->ptr_t );
+	jit_insn_store( fnIr, runtime, jit_insn_call_native( fnIr, "lllm_heap", (void*)lllm_heap, shared->heap_signature, nullptr, 0, 0 ) );
+
+	jit_value_t heap = nullptr;
+	if ( !Telemetry::enabled() && allocatesInline( ast->body, cons, globals ) ) heap = runtime;
+
 	// create label for tail recursion hack
 	jit_label_t fnEntry = jit_label_undefined;
 	jit_insn_label( fnIr, &fnEntry );
 
+	// calls and loops burn fuel, a green thread that runs out yields (see Fibers)
+	{
+		jit_label_t fueled = jit_label_undefined;
+
+		jit_value_t fuel = jit_insn_load_relative( fnIr, runtime, offsetof( Heap, fuel ), jit_type_long );
+		fuel = jit_insn_sub( fnIr, fuel, jit_value_create_long_constant( fnIr, jit_type_long, 1 ) );
+		jit_insn_store_relative( fnIr, runtime, offsetof( Heap, fuel ), fuel );
+
+		jit_insn_branch_if_not( fnIr, jit_insn_lt( fnIr, fuel, jit_value_create_long_constant( fnIr, jit_type_long, 0 ) ), &fueled );
+		jit_insn_call_native( fnIr, "lllm_preempt", (void*)lllm_preempt, shared->preempt_signature, nullptr, 0, 0 );
+		jit_insn_label( fnIr, &fueled );
+	}
+
 	// create libjit ir
-	Visitor v{ (util::CStr)ast->name, fnIr, self, env, &fnEntry, globals };
+	Visitor v{ (util::CStr)ast->name, fnIr, self, env, &fnEntry, globals, chargeTo, heap, cons, eq, trueValue, vectorRef, vectorSet, hashRef, hashSet, hashRemove };
 	jit_value_t retVal = ast->body->visit<jit_value_t>( v, scope, true );
 	if ( retVal ) jit_insn_return( fnIr, retVal );
 
-	std::printf("-- ABOUT TO COMPILE %s ------------------------------------\n", (util::CStr)ast->name );
-	jit_dump_function( stderr, fnIr, ast->name );
-	std::printf("-----------------------------------------------------------\n");
-
 	if ( jit_function_compile( fnIr ) == 0 ) {
 		LLLM_FAIL( ast->location << "Could not compile function " << ast );
 	}
 
-	std::printf("-- COMPILED %s --------------------------------------------\n", (util::CStr)ast->name );
-	jit_dump_function( stderr, fnIr, ast->name );
-	std::printf("-----------------------------------------------------------\n");
+	build.done();
 
-	jit_context_build_end( shared->ctx );
+	Lambda::FnPtr code = (Lambda::FnPtr) jit_function_to_closure( fnIr );
 
-	fn->data->code = (Lambda::FnPtr) jit_function_to_closure( fnIr );
+	publish( &fn->data->code, code );
+	publish( &fn->code,       code );
 
-	printf(">> %p\n", fn->data->code );
+	if ( !Telemetry::enabled() ) shared->addCode( key, ast, globals, code );
+
+	Telemetry::addFunction( fn->data );
+	JitCache::add( fn->data->ast );
 }
 
 
@@ -629,6 +1191,9 @@ ast::LambdaPtr Jit::performInlining( ast::LambdaPtr fn, util::ScopePtr<value::Va
 //	std::cout << "INLINING " << (util::CStr)fn->name << std::endl;
 
 	struct Visitor {
+		// functions deeper than this are not inlined
+		const size_t threshold;
+
 		ast::AstPtr visit( ast::AstPtr         ast, util::ScopePtr<value::ValuePtr> globals ) const {
 			//std::cout << "BORING " << ast << std::endl;
 			return ast;
@@ -650,7 +1215,7 @@ ast::LambdaPtr Jit::performInlining( ast::LambdaPtr fn, util::ScopePtr<value::Va
 		ast::AstPtr visit( ast::DoPtr          ast, util::ScopePtr<value::ValuePtr> globals ) const {
 			DBG( Do );
 
-			std::vector<ast::AstPtr> exprs;
+			ast::AstVector exprs;
 			bool changed = false;
 
 			for ( auto it = ast->begin(), end = ast->end(); it != end; ++it ) {
@@ -746,7 +1311,7 @@ ast::LambdaPtr Jit::performInlining( ast::LambdaPtr fn, util::ScopePtr<value::Va
 		ast::AstPtr visit( ast::ApplicationPtr ast, util::ScopePtr<value::ValuePtr> globals ) const {
 			ast::LambdaPtr lambda = asLambda( ast->fun, globals );
 			if ( !lambda ) return ast;
-			if ( !(lambda->body) || (lambda->depth() > Jit::inliningThreshold) ) return ast;
+			if ( !(lambda->body) || (lambda->depth() > threshold) ) return ast;
 
 			ast::Let::Bindings bindings;
 				
@@ -763,7 +1328,7 @@ ast::LambdaPtr Jit::performInlining( ast::LambdaPtr fn, util::ScopePtr<value::Va
 		}
 	};
 
-	auto newFn = dynamic_cast<ast::LambdaPtr>( fn->visit<ast::AstPtr>( Visitor(), globals ) );
+	auto newFn = fn->visit<ast::AstPtr>( Visitor{ currentInliningThreshold() }, globals )->as<ast::Lambda>();
 
 	assert( newFn );
 
@@ -772,10 +1337,32 @@ ast::LambdaPtr Jit::performInlining( ast::LambdaPtr fn, util::ScopePtr<value::Va
 	return newFn;
 }
 
+Jit::Stats Jit::stats() {
+	std::lock_guard<std::mutex> guard( compileLock );
+	return shared ? shared->stats : Stats{ 0, 0, 0, 0 };
+}
+
 Jit::SharedData* Jit::shared = nullptr;
 
-Jit::SharedData::SharedData() {
+// the default memory manager, but remembers the memory context it creates.
+// it is needed to find the size of functions.
+static jit_memory_context_t memctx = nullptr;
+
+static jit_memory_context_t createMemoryContext( jit_context_t ctx );
+
+static const jit_memory_manager sizingManager = []() {
+	jit_memory_manager mgr = *jit_default_memory_manager();
+	mgr.create = createMemoryContext;
+	return mgr;
+}();
+
+static jit_memory_context_t createMemoryContext( jit_context_t ctx ) {
+	return memctx = jit_default_memory_manager()->create( ctx );
+}
+
+Jit::SharedData::SharedData() : stats{ 0, 0, 0, 0 } {
 	ctx = jit_context_create();
+	jit_context_set_memory_manager( ctx, &sizingManager );
 
 	tag_t = jit_type_sys_ulong;
 	ptr_t = jit_type_sys_ulong;//jit_type_void_ptr;
@@ -820,6 +1407,14 @@ Jit::SharedData::SharedData() {
 	fail_params[0] = ptr_t;
 
 	fail_signature = jit_type_create_signature( jit_abi_cdecl, jit_type_void, fail_params, 1, 1 );
+
+	// void (void*), same shape as fail
+	barrier_signature = fail_signature;
+	charge_signature  = fail_signature;
+
+	heap_signature = jit_type_create_signature( jit_abi_cdecl, ptr_t, nullptr, 0, 1 );
+
+	preempt_signature = jit_type_create_signature( jit_abi_cdecl, jit_type_void, nullptr, 0, 1 );
 }
 
 jit_type_t Jit::SharedData::SharedData::signature( size_t arity ) {
@@ -843,5 +1438,43 @@ jit_type_t Jit::SharedData::SharedData::signature( size_t arity ) {
 		return ty;
 	}
 }
+jit_value_t Jit::SharedData::constant( jit_function_t fn, const void* ptr ) {
+	if ( ptr ) constants.push_back( ptr );
+
+	return jit_value_create_long_constant( fn, ptr_t, (long) ptr );
+}
+
+Lambda::FnPtr Jit::SharedData::findCode( size_t key, ast::LambdaPtr ast, util::ScopePtr<value::ValuePtr> globals ) {
+	auto range = code.equal_range( key );
+	if ( range.first == range.second ) return nullptr;
 
+	std::vector<ValuePtr, traceable_allocator<ValuePtr>> deps;
+	globalsUsed( ast->body, globals, &deps );
 
+	for ( auto it = range.first; it != range.second; ++it ) {
+		const Code& c = it->second;
+
+		if ( c.gcMode != Gc::mode() || c.hashCons != HashCons::enabled() ) continue;
+		if ( c.deps != deps || !ast::equal( c.ast, ast ) ) continue;
+
+		stats.shared++;
+		stats.sharedBytes += c.size;
+		return c.code;
+	}
+
+	return nullptr;
+}
+void Jit::SharedData::addCode( size_t key, ast::LambdaPtr ast, util::ScopePtr<value::ValuePtr> globals, Lambda::FnPtr fn ) {
+	Code c{ ast, {}, Gc::mode(), HashCons::enabled(), fn, 0 };
+	globalsUsed( ast->body, globals, &c.deps );
+
+	auto mgr = jit_default_memory_manager();
+	if ( jit_function_info_t info = mgr->find_function_info( memctx, (void*) fn ) ) {
+		c.size = (char*) mgr->get_function_end( memctx, info ) - (char*) mgr->get_function_start( memctx, info );
+	}
+
+	stats.compiled++;
+	stats.codeBytes += c.size;
+
+	code.insert( std::make_pair( key, c ) );
+}
@@ -0,0 +1,97 @@
+#include "lllm/JitCache.hpp"
+#include "lllm/Jit.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using namespace lllm;
+using namespace lllm::util;
+
+static const char     MAGIC[8] = { 'L', 'L', 'L', 'M', 'J', 'I', 'T', '\0' };
+static const uint32_t VERSION  = 1;
+
+static bool                         on = false;
+static std::unordered_set<uint64_t> keys;
+static std::mutex                   lock;
+
+void JitCache::setEnabled( bool b ) { on = b;    }
+bool JitCache::enabled()            { return on; }
+
+bool JitCache::contains( ast::LambdaPtr fn ) {
+	if ( !on ) return false;
+
+	uint64_t                    key = Jit::codeKey( fn );
+	std::lock_guard<std::mutex> guard( lock );
+	return keys.count( key );
+}
+
+void JitCache::add( ast::LambdaPtr fn ) {
+	if ( !on ) return;
+
+	uint64_t                    key = Jit::codeKey( fn );
+	std::lock_guard<std::mutex> guard( lock );
+	keys.insert( key );
+}
+
+size_t JitCache::size() {
+	std::lock_guard<std::mutex> guard( lock );
+	return keys.size();
+}
+
+// magic, version, number of keys, keys
+bool JitCache::load( CStr fileName ) {
+	FILE* in = std::fopen( fileName, "rb" );
+	if ( !in ) return false;
+
+	char     magic[sizeof(MAGIC)];
+	uint32_t version, count;
+
+	bool ok = std::fread( magic,    1, sizeof(magic),   in ) == sizeof(magic)
+	       && std::fread( &version, 1, sizeof(version), in ) == sizeof(version)
+	       && std::fread( &count,   1, sizeof(count),   in ) == sizeof(count)
+	       && std::memcmp( magic, MAGIC, sizeof(MAGIC) ) == 0
+	       && version == VERSION;
+
+	std::vector<uint64_t> read( ok ? count : 0 );
+	ok = ok && std::fread( read.data(), sizeof(uint64_t), count, in ) == count;
+
+	std::fclose( in );
+
+	// a broken file adds nothing
+	if ( ok ) {
+		std::lock_guard<std::mutex> guard( lock );
+		keys.insert( read.begin(), read.end() );
+	}
+
+	return ok;
+}
+
+bool JitCache::save( CStr fileName ) {
+	std::unique_lock<std::mutex> guard( lock );
+	std::vector<uint64_t>        all( keys.begin(), keys.end() );
+	guard.unlock();
+
+	uint32_t              count = all.size();
+
+	// written to the side and renamed, like AST caches
+	std::string tmp = std::string( fileName ) + ".tmp";
+
+	FILE* out = std::fopen( tmp.c_str(), "wb" );
+	if ( !out ) return false;
+
+	bool ok = std::fwrite( MAGIC,      1, sizeof(MAGIC),   out ) == sizeof(MAGIC)
+	       && std::fwrite( &VERSION,   1, sizeof(VERSION), out ) == sizeof(VERSION)
+	       && std::fwrite( &count,     1, sizeof(count),   out ) == sizeof(count)
+	       && std::fwrite( all.data(), sizeof(uint64_t), count, out ) == count;
+
+	ok = (std::fclose( out ) == 0) && ok;
+	ok = ok && (std::rename( tmp.c_str(), fileName ) == 0);
+
+	if ( !ok ) std::remove( tmp.c_str() );
+
+	return ok;
+}
@@ -0,0 +1,186 @@
+#include "lllm/Loader.hpp"
+#include "lllm/Analyzer.hpp"
+#include "lllm/AstCache.hpp"
+#include "lllm/Evaluator.hpp"
+#include "lllm/GlobalScope.hpp"
+#include "lllm/util/fail.hpp"
+#include "lllm/sexpr/SexprIO.hpp"
+#include "lllm/util/util_io.hpp"
+
+#include <chrono>
+#include <iostream>
+
+using namespace lllm;
+using namespace lllm::util;
+
+typedef std::chrono::steady_clock Clock;
+
+static void printError( const Loader::Error& err ) {
+	if ( err.form ) std::cerr << "error in form at " << err.form->location << ":\n";
+	std::cerr << err.message << std::endl;
+}
+
+Loader::Loader( GlobalScopePtr scope ) : scope( scope ), timing( false ), caching( false ), onError( printError ) {}
+
+void Loader::setTiming( bool b )                            { timing  = b;       }
+void Loader::setCaching( bool b )                           { caching = b;       }
+void Loader::setErrorHandler( const ErrorHandler& handler ) { onError = handler; }
+
+void Loader::report( Stats& stats, sexpr::SexprPtr form, CStr message ) {
+	stats.errors++;
+
+	if ( onError ) onError( Error{ form, message } );
+}
+
+namespace {
+	// adds the time since the last stamp to a stage, does nothing if timing is off
+	struct Stopwatch final {
+		Stopwatch( bool on ) : on( on ), last( on ? Clock::now() : Clock::time_point() ) {}
+
+		void stamp( unsigned long long& stage ) {
+			if ( !on ) return;
+
+			Clock::time_point now = Clock::now();
+			stage += std::chrono::duration_cast<std::chrono::nanoseconds>( now - last ).count();
+			last   = now;
+		}
+
+		const bool        on;
+		Clock::time_point last;
+	};
+}
+
+// the value of a form with definitions is the value of the last one
+value::ValuePtr Loader::evaluate( ast::AstPtr ast ) {
+	Analyzer::Definitions defs = Analyzer::definitions( ast );
+
+	if ( defs.empty() ) return Evaluator::evaluate( ast, scope );
+
+	value::ValuePtr val = nullptr;
+
+	for ( ast::DefinePtr def : defs ) {
+		val = Evaluator::evaluate( def->expr, scope );
+
+		scope->add( def->location, def->name, def, val );
+	}
+
+	return val;
+}
+
+Loader::Stats Loader::load( Reader& reader ) {
+	return load( reader, nullptr );
+}
+
+Loader::Stats Loader::load( Reader& reader, AstWriter* cache ) {
+	CatchFailures catching;
+
+	Stats     stats;
+	Stopwatch clock( timing );
+
+	while ( true ) {
+		sexpr::SexprPtr expr;
+
+		try {
+			expr = reader.read();
+		} catch ( const Failure& f ) {
+			// the reader can not find the start of the next form
+			report( stats, nullptr, f.message.c_str() );
+			break;
+		}
+
+		clock.stamp( stats.readNs );
+
+		if ( !expr ) break;
+
+		stats.forms++;
+
+		unsigned long long* stage = &stats.analyzeNs;
+
+		try {
+			ast::AstPtr ast = Analyzer::analyze( expr, scope );
+
+			if ( cache ) cache->add( ast );
+
+			clock.stamp( *stage );
+			stage = &stats.evaluateNs;
+
+			stats.value = evaluate( ast );
+
+			clock.stamp( *stage );
+		} catch ( const Failure& f ) {
+			report( stats, expr, f.message.c_str() );
+
+			clock.stamp( *stage );
+		}
+	}
+
+	return stats;
+}
+
+Loader::Stats Loader::load( AstReader& cache ) {
+	CatchFailures catching;
+
+	Stats     stats;
+	Stopwatch clock( timing );
+
+	stats.cached = true;
+
+	while ( true ) {
+		ast::AstPtr ast;
+
+		try {
+			ast = cache.read( scope );
+		} catch ( const Failure& f ) {
+			// the rest of the cache can not be trusted
+			report( stats, nullptr, f.message.c_str() );
+			break;
+		}
+
+		clock.stamp( stats.readNs );
+
+		if ( !ast ) break;
+
+		stats.forms++;
+
+		try {
+			stats.value = evaluate( ast );
+		} catch ( const Failure& f ) {
+			report( stats, nullptr, f.message.c_str() );
+		}
+
+		clock.stamp( stats.evaluateNs );
+	}
+
+	return stats;
+}
+
+Loader::Stats Loader::loadFile( CStr fileName ) {
+	CatchFailures catching;
+
+	try {
+		if ( !caching ) {
+			Reader reader = Reader::fromFile( fileName );
+			return load( reader );
+		}
+
+		uint64_t    hash      = AstCache::hashFile( fileName );
+		std::string cacheFile = AstCache::pathFor( fileName );
+
+		AstReader cached( cacheFile.c_str(), hash );
+		if ( cached.valid() ) return load( cached );
+
+		Reader    reader = Reader::fromFile( fileName );
+		AstWriter writer( fileName, hash );
+
+		Stats stats = load( reader, &writer );
+
+		// forms that failed are not in the cache, so only complete files are cached
+		if ( !stats.errors ) writer.write( cacheFile.c_str() );
+
+		return stats;
+	} catch ( const Failure& f ) {
+		Stats stats;
+		report( stats, nullptr, f.message.c_str() );
+		return stats;
+	}
+}
@@ -1,14 +1,18 @@
-
 #include "lllm/Reader.hpp"
 #include "lllm/util/fail.hpp"
 #include "lllm/util/util_io.hpp"
 
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <cassert>
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
-#include <algorithm>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace lllm;
@@ -20,362 +24,396 @@ using namespace lllm::sexpr;
 #	include <iomanip>
 #	include "lllm/sexpr/SexprIO.hpp"
 #	define DBG()
-#else 
+#else
 #	define DBG()
 #endif
 
+//***** CHARACTER CLASSES **********************************************************************************************
+
+enum : unsigned char {
+	SPACE = 1, // skipped between tokens
+	DELIM = 2, // ends a token
+	DIGIT = 4,
+};
+
+namespace {
+	struct CharClasses final {
+		CharClasses() {
+			for ( int c = '0'; c <= '9'; c++ ) table[c] = DIGIT;
+
+			for ( unsigned char c : { ' ', '\t', '\n', '\r' } ) table[c] = SPACE | DELIM;
+			for ( unsigned char c : { '(', ')' } )              table[c] = DELIM;
+		}
+
+		unsigned char table[256] = {};
+	};
+	static const CharClasses classes;
+}
+
+static inline bool is( int c, unsigned char cls ) {
+	return (c >= 0) && (classes.table[c] & cls);
+}
+
+//***** CONSTRUCTION ***************************************************************************************************
+
 SexprPtr Reader::read( CStr str ) {
-	return Reader::fromString( str ).read();
+	return read( "*string*", str );
 }
 SexprPtr Reader::read( CStr srcName, CStr str ) {
-	return Reader::fromString( srcName, str ).read();
+	return Reader( srcName, Source::STRING, str, std::strlen( str ), false ).read();
 }
 
 Reader Reader::fromString( CStr source ) {
 	return fromString( "*string*", source );
 }
 Reader Reader::fromString( CStr sourceName, CStr source ) {
-	return Reader( sourceName, new stringstream( source ) );
+	return fromString( sourceName, source, std::strlen( source ) );
 }
-	
+Reader Reader::fromString( CStr sourceName, const char* source, size_t length ) {
+	return Reader( sourceName, Source::STRING, source, length, true );
+}
+
 Reader Reader::fromFile( CStr fileName ) {
-	return Reader( fileName, new fstream( fileName ) );
+	int fd = open( fileName, O_RDONLY );
+	if ( fd < 0 ) LLLM_FAIL( "Could not open '" << fileName << "': " << std::strerror( errno ) );
+
+	struct stat st;
+	if ( fstat( fd, &st ) < 0 ) LLLM_FAIL( "Could not stat '" << fileName << "': " << std::strerror( errno ) );
+
+	size_t size = st.st_size;
+	void*  data = nullptr;
+
+	// an empty file can not be mapped
+	if ( size ) {
+		data = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if ( data == MAP_FAILED ) LLLM_FAIL( "Could not map '" << fileName << "': " << std::strerror( errno ) );
+
+		madvise( data, size, MADV_SEQUENTIAL );
+	}
+
+	// the mapping stays valid after the file is closed
+	close( fd );
+
+	return Reader( fileName, Source::FILE, (const char*) data, size, true );
 }
 Reader Reader::fromStdin() {
-	return Reader( "*stdin*", &cin );
+	return Reader( "*stdin*", Source::STDIN, nullptr, 0, true );
+}
+
+Reader::Reader( CStr srcName, Source source, const char* data, size_t size, bool useArena ) :
+	srcName( srcName ),
+	source( source ),
+	data( data ),
+	size( size ),
+	pos( 0 ),
+	line( 1 ),
+	lineStart( 0 ),
+	useArena( useArena ) {}
+
+Reader::Reader( Reader&& r ) :
+	srcName( r.srcName ),
+	source( r.source ),
+	data( r.data ),
+	size( r.size ),
+	pos( r.pos ),
+	line( r.line ),
+	lineStart( r.lineStart ),
+	buffer( std::move( r.buffer ) ),
+	useArena( r.useArena ),
+	arena( std::move( r.arena ) ) {
+	if ( source == Source::STDIN ) data = buffer.data();
+
+	// the mapping now belongs to this reader
+	r.source = Source::STRING;
+	r.data   = nullptr;
 }
 
-Reader::Reader( CStr srcName, std::istream* src ) : stream( src ), loc( srcName ) {
-	la = stream->get();
+Reader::~Reader() {
+	if ( source == Source::FILE && data ) munmap( (void*) data, size );
 }
 
-Reader::~Reader() { 
-	if ( stream != &cin ) delete stream;
+//***** INPUT **********************************************************************************************************
+
+bool Reader::fill() {
+	if ( source != Source::STDIN ) return false;
+
+	std::string next;
+	if ( !std::getline( std::cin, next ) ) return false;
+
+	buffer.append( next );
+	buffer.push_back( '\n' );
+
+	data = buffer.data();
+	size = buffer.size();
+	return true;
+}
+
+size_t Reader::token() {
+	size_t start = pos;
+
+	while ( true ) {
+		int c = peek();
+
+		if ( c < 0 || is( c, DELIM ) ) return pos - start;
+
+		pos++;
+	}
 }
 
+SourceLocation Reader::location( size_t offset ) const {
+	return SourceLocation( srcName, line, offset - lineStart );
+}
+
+//***** PARSING ********************************************************************************************************
+
 SexprPtr Reader::read() {
+	release();
+
+	// lines that were completely read are not needed any more
+	if ( source == Source::STDIN && lineStart ) {
+		buffer.erase( 0, lineStart );
+		pos      -= lineStart;
+		lineStart = 0;
+		data      = buffer.data();
+		size      = buffer.size();
+	}
+
+	return readExpr();
+}
+
+void Reader::release() {
+	arena.release();
+}
+
+SexprPtr Reader::readExpr() {
 	skipWhitespace();
 
+	int c = peek();
+
 	// return null if we reach EOF
-	if ( la < 0 ) return nullptr;
-
-	// at this point there is at least one 
-	// valid char left in the input
-
-//	cout << "DISPATCHING " << (char)la << endl;
-
-	SexprPtr expr;
-
-	switch ( la ) {
-		case '(':  expr = readList(); break;
-		case ')':  LLLM_FAIL( "Unexpected ')' in " << loc );
-		case '.':
-		case '0':
-		case '1':
-		case '2':
-		case '3':
-		case '4':
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':  expr = readNumber(); break;
-		case '\\': expr = readChar();   break;
-		case '\'': expr = readQuote();  break;
-		case '"':  expr = readString(); break;
-		default:   expr = readSymbol(); break;
+	if ( c < 0 ) return nullptr;
+
+	switch ( c ) {
+		case '(':  return readList();
+		case ')':  LLLM_FAIL( "Unexpected ')' in " << location( pos ) );
+		case '#':  if ( pos + 1 < size && data[pos + 1] == '(' ) return readVector();
+		           return readSymbol();
+		case '.':  return readNumber();
+		case '\\': return readChar();
+		case '\'': return readQuote();
+		case '"':  return readString();
+		default:   return is( c, DIGIT ) ? readNumber() : readSymbol();
 	}
+}
 
-//	std::cout << loc << ": READ '" << expr << "'" << std::endl;
+ListPtr   Reader::readList() {
+	SourceLocation start = location( pos );
 
-	return expr;
+	assert( peek() == '(' );
+	pos++;
 
-//	LLLM_FAIL( loc << ": Malformed input to reader, la=" << la );
+	size_t first = readItems( "list" );
+
+	ListPtr list = makeList( nodes(), start, items.data() + first, items.size() - first );
+	items.resize( first );
+	return list;
 }
 
-ListPtr   Reader::readList() {
-	SourceLocation start = loc;
+VectorPtr Reader::readVector() {
+	SourceLocation start = location( pos );
+
+	assert( peek() == '#' );
+	pos += 2;
 
-	consume( '(' );
-	loc.incColumn();	
+	size_t first = readItems( "vector" );
 
-	std::vector<SexprPtr> exprs;
+	VectorPtr vec = makeVector( nodes(), start, items.data() + first, items.size() - first );
+	items.resize( first );
+	return vec;
+}
+
+// children are collected on a stack shared by all lists and then copied into the list.
+// reads up to and including the closing paren, the index of the first child
+size_t    Reader::readItems( CStr what ) {
+	size_t first = items.size();
 
 	while ( true ) {
 		skipWhitespace();
 
-		if ( la < 0 ) LLLM_FAIL( loc << ": Unexpected EOF while reading a list" );
+		int c = peek();
+
+		if ( c < 0 ) LLLM_FAIL( location( pos ) << ": Unexpected EOF while reading a " << what );
 
-		if ( la == ')' ) {
-			consume(')');
-			loc.incColumn();
+		if ( c == ')' ) {
+			pos++;
 			break;
 		}
 
-		exprs.push_back( read() );
+		SexprPtr expr = readExpr();
+		items.push_back( expr );
 	}
 
-	return new List( start, exprs );
+	return first;
 }
 
 ListPtr   Reader::readQuote() {
-	SourceLocation start = loc;
+	SourceLocation start = location( pos );
 
-	consume( '\'' );
+	assert( peek() == '\'' );
+	pos++;
 
-	SymbolPtr sym = new Symbol( start, "quote" );
-	loc.incColumn();
+	SymbolPtr sym = make<Symbol>( nodes(), start, InternedString( "quote" ) );
 
-	SexprPtr val = read();
+	SexprPtr val = readExpr();
 
-	if ( !val ) LLLM_FAIL( loc << ": Unexpected EOF while reading a quotation" );
+	if ( !val ) LLLM_FAIL( location( pos ) << ": Unexpected EOF while reading a quotation" );
 
-	std::vector<SexprPtr> exprs;
-	exprs.push_back( sym );
-	exprs.push_back( val );
+	SexprPtr exprs[] = { sym, val };
 
-	return new List( start, exprs );
+	return makeList( nodes(), start, exprs, 2 );
 }
 
 SexprPtr  Reader::readNumber() {
-	SourceLocation start = loc;
+	size_t         begin = pos;
+	SourceLocation start = location( begin );
+
+	size_t len = token();
+	CStr   str = data + begin;
+
+	// ints are accumulated directly, underscores in numbers are ignored
+	long l        = 0;
+	bool real     = false;
+	bool overflow = false;
+
+	for ( size_t i = 0; i < len; i++ ) {
+		char c = str[i];
+
+		if ( is( c, DIGIT ) ) {
+			// only matters for ints, reals with that many digits are read by strtod
+			overflow = overflow || __builtin_mul_overflow( l, 10, &l ) || __builtin_add_overflow( l, c - '0', &l );
+		} else if ( c == '.' ) {
+			if ( real ) LLLM_FAIL( location( begin + i ) << ": More than one decimal point in a number literal" );
+			real = true;
+		} else if ( c != '_' ) {
+			LLLM_FAIL( location( begin + i ) << ": Illegal character '" << c << "' in number literal" );
+		}
+	}
 
-	assert( ('0' <= la && la <= '9') || (la == '_') || (la == '.') );
+	if ( !real ) {
+		if ( overflow ) LLLM_FAIL( start << ": Integer literal '" << std::string( str, len ) << "' is too large" );
 
-	std::stringstream str;
+		return make<Int>( nodes(), start, l );
+	}
 
-	while ( true ) {
-		if ( la < 0 ) goto return_int;
-
-		switch ( la ) {
-			case ' ':
-			case '\t':
-			case '\n':
-			case '(':
-			case ')':
-				goto return_int;
-			case '.':
-				str << '.';
-				loc.incColumn();
-				goto read_real;
-			case '_':
-				loc.incColumn();
-				break; // underscores in numbers are ignored
-			case '0':
-			case '1':
-			case '2':
-			case '3':
-			case '4':
-			case '5':
-			case '6':
-			case '7':
-			case '8':
-			case '9':
-				str << ((char)la);
-				loc.incColumn();
-				break;
-			default:
-				LLLM_FAIL( loc << ": Illegal character '" << (char) la << "' in number literal" );
-				break;
-		}
+	// reals are parsed by strtod, which needs a zero terminated copy without underscores
+	char  small[64];
+	char* buf = len < sizeof(small) ? small : (char*) std::malloc( len + 1 );
+	size_t n  = 0;
 
-		la = stream->get();
-	}
-read_real:
-	while ( true ) {
-		la = stream->get();
-
-		if ( la < 0 ) goto return_real;
-
-		switch ( la ) {
-			case ' ':
-			case '\t':
-			case '\n':
-			case '(':
-			case ')':
-				goto return_real;
-			case '.':
-				LLLM_FAIL( loc << ": More than one decimal point in a number literal" );
-				break;
-			case '_':
-				loc.incColumn();
-				break; // underscores in numbers are ignored
-			case '0':
-			case '1':
-			case '2':
-			case '3':
-			case '4':
-			case '5':
-			case '6':
-			case '7':
-			case '8':
-			case '9':
-				str << ((char)la);
-				loc.incColumn();
-				break;
-			default:
-				LLLM_FAIL( loc << ": Illegal character '" << (char) la << "' in number literal" );
-				break;
-		}
+	for ( size_t i = 0; i < len; i++ ) {
+		if ( str[i] != '_' ) buf[n++] = str[i];
 	}
+	buf[n] = '\0';
+
+	double d = std::strtod( buf, nullptr );
 
-return_int:
-		long l;
-		str >> l;
-		return new Int( start, l );
-return_real:
-		double d;
-		str >> d;
-		return new Real( start, d );
+	if ( buf != small ) std::free( buf );
+
+	return make<Real>( nodes(), start, d );
 }
 
 CharPtr   Reader::readChar() {
-	SourceLocation start = loc;
+	SourceLocation start = location( pos );
 
-	consume( '\\' );
-	loc.incColumn();
+	assert( peek() == '\\' );
+	pos++;
 
-	stringstream buf;
+	size_t begin = pos;
+	size_t len   = token();
+	CStr   str   = data + begin;
 
-	while ( true ) {
-		if ( la < 0 ) goto loop_end;
-
-		switch ( la ) {
-			case ' ':
-			case '\t':
-			case '\n':
-			case '(':
-			case ')':
-				goto loop_end;
-			default:
-				buf << ((char)la);
-				loc.incColumn();
-		}
-
-		la = stream->get();
-	}
-loop_end:
-	const std::string& str = buf.str();
-
-	if ( str.size() == 1 ) {
-		return new Char( start, str[0] );
-	} else if ( str == "tab" ) {
-		return new Char( start, '\t' );
-	} else if ( str == "newline" ) {
-		return new Char( start, '\n' );
+	if ( len == 1 ) {
+		return make<Char>( nodes(), start, str[0] );
+	} else if ( len == 3 && std::memcmp( str, "tab", 3 ) == 0 ) {
+		return make<Char>( nodes(), start, '\t' );
+	} else if ( len == 7 && std::memcmp( str, "newline", 7 ) == 0 ) {
+		return make<Char>( nodes(), start, '\n' );
 	} else {
-		LLLM_FAIL( loc << ": Illegal character literal '\\" << str << "'" );
+		LLLM_FAIL( start << ": Illegal character literal '\\" << std::string( str, len ) << "'" );
 	}
 }
 
 StringPtr Reader::readString() {
-	SourceLocation start = loc;
+	SourceLocation start = location( pos );
 
-	consume( '"' );
-	loc.incColumn();
+	assert( peek() == '"' );
+	pos++;
 
-	stringstream buf;
+	size_t begin = pos;
 
 	while ( true ) {
-		if ( la < 0 ) LLLM_FAIL( loc << ": Unexpected EOF while reading a string" );
+		int c = peek();
 
-		if ( la == '"' ) {
-			consume( '"' );
-			loc.incColumn();
-			break;
-		}
+		if ( c < 0 ) LLLM_FAIL( location( pos ) << ": Unexpected EOF while reading a string" );
+
+		if ( c == '"' ) break;
 
-		buf << ((char) la);
+		pos++;
 
-		la = stream->get();
-		loc.incColumn();
+		if ( c == '\n' ) {
+			line++;
+			lineStart = pos;
+		}
 	}
 
-	const std::string& str = buf.str();
-	char*              out = new char[str.size()];
+	size_t len = pos - begin;
+	pos++;
+
+	CStr out;
 
-	strcpy( out, str.c_str() );
+	if ( useArena ) {
+		out = arena.copy( data + begin, len );
+	} else {
+		char* mem = (char*) GC_MALLOC_ATOMIC( len + 1 );
+		std::memcpy( mem, data + begin, len );
+		mem[len] = '\0';
+		out = mem;
+	}
 
-	return new String( start, out );
+	return make<String>( nodes(), start, out );
 }
 
 SymbolPtr Reader::readSymbol() {
-	SourceLocation start = loc;
+	size_t         begin = pos;
+	SourceLocation start = location( begin );
 
-	stringstream buf;
+	size_t len = token();
+	CStr   str = data + begin;
 
-	while ( true ) {
-		buf << ((char) la);
-
-		la = stream->get();
-
-		if ( la < 0 ) goto loop_end;
-
-		switch ( la ) {
-			case ' ':
-			case '\t':
-			case '\n':
-			case '(':
-			case ')':
-				goto loop_end;
-			case '\'':
-				LLLM_FAIL( loc << ": Unexpected ' in symbol" );
-			case '\\':
-				LLLM_FAIL( loc << ": Unexpected \\ in symbol" );
-			default:
-				loc.incColumn();
-				break;
-		}
+	for ( size_t i = 1; i < len; i++ ) {
+		if ( str[i] == '\'' ) LLLM_FAIL( location( begin + i ) << ": Unexpected ' in symbol" );
+		if ( str[i] == '\\' ) LLLM_FAIL( location( begin + i ) << ": Unexpected \\ in symbol" );
 	}
-loop_end:
-	const std::string& str = buf.str();
-	char*              out = new char[str.size()];
 
-	strcpy( out, str.c_str() );
-
-	return new Symbol( start, out );
-}
-
-void Reader::consume( char expected ) {
-	assert( la == expected );
-
-	la = stream->get();
+	// interned straight from the input, the intern table copies the name if it has not seen it yet
+	return make<Symbol>( nodes(), start, InternedString( str, len ) );
 }
 
 void Reader::skipWhitespace() {
 	while ( true ) {
-		switch ( la ) {
-			case '\n':
-				loc.incLine();
-				break;
-			case ' ':
-			case '\t':
-				loc.incColumn();
-				break;
-			case ';':
-				skipComment();
-				break;
-			default:
-				return;
-		}
-
-		la = stream->get();
-	}
-}
-void Reader::skipComment() {
-	consume(';');
-
-	while ( true ) {
-		if ( la == '\n' ) {
-			loc.incLine();
+		int c = peek();
+
+		if ( c == '\n' ) {
+			pos++;
+			line++;
+			lineStart = pos;
+		} else if ( is( c, SPACE ) ) {
+			pos++;
+		} else if ( c == ';' ) {
+			// comments end at the end of the line
+			while ( (c = peek()) >= 0 && c != '\n' ) pos++;
+		} else {
 			return;
 		}
-
-		la = stream->get();
 	}
 }
-
-
-
-
-
@@ -0,0 +1,238 @@
+
+#include "lllm/Scheduler.hpp"
+#include "lllm/Evaluator.hpp"
+#include "lllm/Fiber.hpp"
+#include "lllm/Vm.hpp"
+#include "lllm/value/Gc.hpp"
+#include "lllm/util/fail.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace lllm;
+using namespace lllm::util;
+using namespace lllm::value;
+
+Task::Task() : result( nullptr ), globals( Evaluator::globals() ), vm( Vm::current() ), failure( nullptr ), finished( false ) {}
+
+bool Task::done() const {
+	return __atomic_load_n( &finished, __ATOMIC_ACQUIRE );
+}
+
+void Task::execute() {
+	try {
+		CatchFailures catching;
+		Vm::Enter             enter( vm );
+		Evaluator::GlobalsFor scope( globals );
+
+		run();
+	} catch ( const Failure& f ) {
+		failure = GC_STRDUP( f.message.c_str() );
+	}
+
+	// publishes the result and failure to threads waiting for the task
+	__atomic_store_n( &finished, true, __ATOMIC_RELEASE );
+}
+
+namespace {
+	// a deque with a lock, only the owner pushes, anyone takes
+	struct Deque final {
+		void push( TaskPtr t ) {
+			std::lock_guard<std::mutex> lock( mutex );
+			tasks.push_back( t );
+			__atomic_store_n( &size, tasks.size(), __ATOMIC_RELEASE );
+		}
+		// the newest task, for the owner
+		TaskPtr pop() {
+			if ( empty() ) return nullptr;
+
+			std::lock_guard<std::mutex> lock( mutex );
+			if ( tasks.empty() ) return nullptr;
+
+			TaskPtr t = tasks.back();
+			tasks.pop_back();
+			__atomic_store_n( &size, tasks.size(), __ATOMIC_RELEASE );
+			return t;
+		}
+		// the oldest task, for thieves. old tasks tend to be the big ones
+		TaskPtr steal() {
+			if ( empty() ) return nullptr;
+
+			std::lock_guard<std::mutex> lock( mutex );
+			if ( tasks.empty() ) return nullptr;
+
+			TaskPtr t = tasks.front();
+			tasks.pop_front();
+			__atomic_store_n( &size, tasks.size(), __ATOMIC_RELEASE );
+			return t;
+		}
+		bool empty() const { return __atomic_load_n( &size, __ATOMIC_ACQUIRE ) == 0; }
+
+		std::mutex                                       mutex;
+		std::deque<TaskPtr,traceable_allocator<TaskPtr>> tasks;
+		size_t                                           size = 0;
+	};
+
+	// never destroyed, the workers sleep on it until the process ends
+	struct Pool final {
+		Pool() : active( 0 ), idle( 0 ), queued( 0 ) {}
+
+		std::vector<Deque*>     deques;
+		Deque                   injected;
+		size_t                  active;
+		std::mutex              sleepLock;
+		std::condition_variable wakeUp;
+		size_t                  idle;
+		size_t                  queued;
+	};
+
+	Pool* pool = nullptr;
+
+	// index + 1 of the worker running on this thread, 0 for other threads
+	__thread size_t worker = 0;
+
+	Deque& ownDeque() {
+		return worker ? *pool->deques[worker - 1] : pool->injected;
+	}
+
+	TaskPtr findWork() {
+		Deque& own = ownDeque();
+
+		if ( TaskPtr t = own.pop() ) return t;
+
+		if ( &own != &pool->injected ) {
+			if ( TaskPtr t = pool->injected.steal() ) return t;
+		}
+
+		// tasks left with a worker that was switched off are stolen too
+		size_t n     = pool->deques.size();
+		size_t start = worker;
+
+		for ( size_t i = 0; i < n; i++ ) {
+			Deque* victim = pool->deques[(start + i) % n];
+
+			if ( victim == &own ) continue;
+
+			if ( TaskPtr t = victim->steal() ) return t;
+		}
+
+		return nullptr;
+	}
+
+	void runWorker( size_t index ) {
+		Gc::Thread registered;
+		worker = index + 1;
+
+		for (;;) {
+			if ( index < __atomic_load_n( &pool->active, __ATOMIC_RELAXED ) ) {
+				if ( TaskPtr t = findWork() ) {
+					__atomic_sub_fetch( &pool->queued, 1, __ATOMIC_SEQ_CST );
+					t->execute();
+					continue;
+				}
+			}
+
+			std::unique_lock<std::mutex> lock( pool->sleepLock );
+			__atomic_add_fetch( &pool->idle, 1, __ATOMIC_SEQ_CST );
+
+			// spawn checks idle after counting its task, so one of the two always sees the other
+			if ( index >= __atomic_load_n( &pool->active, __ATOMIC_SEQ_CST ) || !__atomic_load_n( &pool->queued, __ATOMIC_SEQ_CST ) ) {
+				pool->wakeUp.wait_for( lock, std::chrono::milliseconds( 10 ) );
+			}
+
+			__atomic_sub_fetch( &pool->idle, 1, __ATOMIC_SEQ_CST );
+		}
+	}
+
+	void start() {
+		static std::once_flag started;
+
+		std::call_once( started, []() {
+			CStr   env = std::getenv( "LLLM_WORKERS" );
+			size_t n   = env ? std::strtoul( env, nullptr, 10 ) : std::thread::hardware_concurrency() - 1;
+
+			// the number of cores is 0 if it is not known
+			if ( n < 1 || n > 1024 ) n = 1;
+
+			Gc::enableThreads();
+
+			Pool* p = new Pool();
+			for ( size_t i = 0; i < n; i++ ) p->deques.push_back( new Deque() );
+			p->active = n;
+
+			__atomic_store_n( &pool, p, __ATOMIC_RELEASE );
+
+			for ( size_t i = 0; i < n; i++ ) std::thread( runWorker, i ).detach();
+		} );
+	}
+}
+
+void Scheduler::spawn( TaskPtr task ) {
+	start();
+
+	ownDeque().push( task );
+	__atomic_add_fetch( &pool->queued, 1, __ATOMIC_SEQ_CST );
+
+	if ( __atomic_load_n( &pool->idle, __ATOMIC_SEQ_CST ) ) {
+		{ std::lock_guard<std::mutex> lock( pool->sleepLock ); }
+		pool->wakeUp.notify_one();
+	}
+}
+
+void Scheduler::wait( TaskPtr task ) {
+	while ( !task->done() ) {
+		// the task itself, or work of whoever is running it.
+		// a green thread lets the other fibers of its worker run instead, the one it waits for may be among them
+		TaskPtr t = Fibers::current() || !__atomic_load_n( &pool, __ATOMIC_ACQUIRE ) ? nullptr : findWork();
+
+		if ( t ) {
+			__atomic_sub_fetch( &pool->queued, 1, __ATOMIC_SEQ_CST );
+			t->execute();
+		} else {
+			relax( 0 );
+		}
+	}
+}
+
+void Scheduler::relax( size_t round ) {
+	// after a while the other side is probably a thread that needs this core
+	if ( Fibers::current() ) {
+		if ( !Fibers::yield() && round >= SPINS ) std::this_thread::sleep_for( std::chrono::microseconds( 20 ) );
+	} else if ( round < SPINS ) {
+		std::this_thread::yield();
+	} else {
+		std::this_thread::sleep_for( std::chrono::microseconds( 20 ) );
+	}
+}
+
+value::ValuePtr Scheduler::join( TaskPtr task ) {
+	wait( task );
+
+	if ( task->failure ) LLLM_FAIL( task->failure );
+
+	return task->result;
+}
+
+bool Scheduler::hungry() {
+	return pool && ownDeque().empty();
+}
+
+size_t Scheduler::workers() {
+	start();
+
+	return pool->deques.size();
+}
+
+void Scheduler::setWorkers( size_t n ) {
+	start();
+
+	if ( n < 1 || n > pool->deques.size() ) n = pool->deques.size();
+
+	__atomic_store_n( &pool->active, n, __ATOMIC_SEQ_CST );
+	pool->wakeUp.notify_all();
+}
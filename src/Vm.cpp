@@ -0,0 +1,75 @@
+
+#include "lllm/Vm.hpp"
+#include "lllm/Evaluator.hpp"
+#include "lllm/Jit.hpp"
+#include "lllm/Reader.hpp"
+#include "lllm/util/fail.hpp"
+#include "lllm/sexpr/Sexpr.hpp"
+#include "lllm/util/util_io.hpp"
+
+#include <sstream>
+#include <string>
+
+using namespace lllm;
+using namespace lllm::util;
+
+__thread Vm* Vm::active = nullptr;
+
+Vm::Vm() :
+  jitting( Evaluator::jittingThreshold ),
+  inlining( Jit::inliningThreshold ),
+  inliningRecursion( Jit::inliningDepth ) {}
+
+GlobalScopePtr Vm::globals() { return &scope; }
+
+void Vm::setJittingThreshold( size_t threshold )       { jitting           = threshold;      }
+void Vm::setInliningThreshold( size_t depthThreshold ) { inlining          = depthThreshold; }
+void Vm::setInliningDepth( size_t maxRecursion )       { inliningRecursion = maxRecursion;   }
+
+size_t Vm::jittingThreshold()  const { return jitting;           }
+size_t Vm::inliningThreshold() const { return inlining;          }
+size_t Vm::inliningDepth()     const { return inliningRecursion; }
+
+value::ValuePtr Vm::evaluate( CStr source ) {
+	Enter  enter( this );
+	Reader reader = Reader::fromString( source );
+	Loader loader( &scope );
+
+	std::string error;
+	loader.setErrorHandler( [&error]( const Loader::Error& err ) {
+		if ( !error.empty() ) return;
+
+		std::stringstream str;
+		if ( err.form ) str << "error in form at " << err.form->location << ": ";
+		str << err.message;
+		error = str.str();
+	} );
+
+	Loader::Stats stats = loader.load( reader );
+
+	if ( stats.errors ) LLLM_FAIL( error );
+
+	return stats.value;
+}
+
+Loader::Stats Vm::load( Reader& reader ) {
+	Enter enter( this );
+
+	return Loader( &scope ).load( reader );
+}
+Loader::Stats Vm::loadFile( CStr fileName ) {
+	Enter enter( this );
+
+	return Loader( &scope ).loadFile( fileName );
+}
+
+void Vm::setCurrent( VmPtr vm ) {
+	active = vm;
+}
+
+Vm::Enter::Enter( VmPtr vm ) : saved( active ) {
+	active = vm;
+}
+Vm::Enter::~Enter() {
+	active = saved;
+}
@@ -3,21 +3,32 @@
 
 #include "lllm/util/fail.hpp"
 
+#include <cstring>
 #include <iostream>
 
 using namespace lllm;
 using namespace lllm::ast;
 using namespace lllm::util;
 
-Ast::Ast( Type t, const SourceLocation& loc ) : location( loc ), type( t ) {}
+Ast::Ast( Type t, const SourceLocation& loc, size_t depth ) : location( loc ), type( t ), _depth( depth ) {}
+
+namespace {
+	// calls the (non virtual) possibleTypes of the concrete class
+	struct PossibleTypes final {
+		template<typename T>
+		TypeSet visit( const T* ast ) const { return ast->possibleTypes(); }
+	};
+}
+
+TypeSet Ast::possibleTypes() const { return visit<TypeSet>( PossibleTypes() ); }
 
 //***** ATOMS                ****************************************************************//
-Atom::Atom( Type type, const SourceLocation& loc )      : Ast( type, loc ) {}
-Nil::Nil( const SourceLocation& loc )                   : Atom( Type::Nil, loc ) {}
-Int::Int( const SourceLocation& loc, long value )       : Atom( Type::Int,    loc ), value( value ) {}
-Real::Real( const SourceLocation& loc, double value )   : Atom( Type::Real,   loc ), value( value ) {}
-Char::Char( const SourceLocation& loc, char value )     : Atom( Type::Char,   loc ), value( value ) {}
-String::String( const SourceLocation& loc, CStr value ) : Atom( Type::String, loc ), value( value ) {}
+Atom::Atom( Type type, const SourceLocation& loc, value::ValuePtr c )       : Ast( type, loc ), constant( c ) {}
+Nil::Nil( const SourceLocation& loc )                                       : Atom( Type::Nil,    loc, nullptr ) {}
+Int::Int( const SourceLocation& loc, long value, value::ValuePtr c )        : Atom( Type::Int,    loc, c ), value( value ) {}
+Real::Real( const SourceLocation& loc, double value, value::ValuePtr c )    : Atom( Type::Real,   loc, c ), value( value ) {}
+Char::Char( const SourceLocation& loc, char value, value::ValuePtr c )      : Atom( Type::Char,   loc, c ), value( value ) {}
+String::String( const SourceLocation& loc, CStr value, value::ValuePtr c )  : Atom( Type::String, loc, c ), value( value ) {}
 
 TypeSet Nil   ::possibleTypes() const { return TypeSet::Nil();    }
 TypeSet Int   ::possibleTypes() const { return TypeSet::Int();    }
@@ -25,11 +36,9 @@ TypeSet Real  ::possibleTypes() const { return TypeSet::Real();   }
 TypeSet Char  ::possibleTypes() const { return TypeSet::Char();   }
 TypeSet String::possibleTypes() const { return TypeSet::String(); }
 
-size_t Atom::depth() const { return 1; }
-
 //***** VARIABLES            ****************************************************************//
 Variable::Variable( const util::SourceLocation& loc, const util::InternedString& name, const AstPtr ast, bool global ) :
-  Ast( Type::Variable, loc ),
+  Ast( Type::Variable, loc, ast ? ast->depth() : 1 ),
   name( name ),
   ast( ast ),
   hasGlobalStorage( global ),
@@ -50,20 +59,17 @@ VariablePtr Variable::makeCaptured( const util::SourceLocation& loc, const util:
 
 TypeSet Variable::possibleTypes() const { return ast ? ast->possibleTypes() : TypeSet::all(); }
 
-size_t Variable::depth() const { return ast ? ast->depth() : 1; }
-
 //***** SPECIAL FORMS        ****************************************************************//
 Quote::Quote( const SourceLocation& loc, value::ValuePtr value ) : Ast( Type::Quote, loc ), value( value ) {}	
 If::If( const SourceLocation& loc, AstPtr test, AstPtr thenBranch, AstPtr elseBranch ) :
-	  Ast( Type::If, loc ),
+	  Ast( Type::If, loc, std::max( std::max( test->depth(), thenBranch->depth() ), elseBranch->depth() ) ),
 	  test( test ),
 	  thenBranch( thenBranch ), 
-	  elseBranch( elseBranch ),
-	  _depth( std::max( std::max( test->depth(), thenBranch->depth() ), elseBranch->depth() ) ) {}
-Do::Do( const SourceLocation& loc, const std::vector<AstPtr>& exprs ) : Ast( Type::Do, loc ), exprs( exprs ) {
+	  elseBranch( elseBranch ) {}
+Do::Do( const SourceLocation& loc, const AstVector& exprs ) : Ast( Type::Do, loc ), exprs( exprs ) {
 	_depth = 0;
 	for ( auto it = begin(), _end = end(); it != _end; ++it ) {
-		_depth = std::max( _depth, (*it)->depth() );
+		_depth = std::max<size_t>( _depth, (*it)->depth() );
 	}
 }
 Let::Let( const SourceLocation& loc, const Let::Bindings& bindings, AstPtr expr ) :
@@ -72,7 +78,7 @@ Let::Let( const SourceLocation& loc, const Let::Bindings& bindings, AstPtr expr
 	body( expr ) {
 	_depth = body->depth();
 	for ( auto it = begin(), _end = end(); it != _end; ++it ) {
-		_depth = std::max( _depth, (*it).second->depth() );
+		_depth = std::max<size_t>( _depth, (*it).second->depth() );
 	}
 }
 LetStar::LetStar( const SourceLocation& loc, const Let::Bindings& bindings, AstPtr expr ) :
@@ -81,7 +87,7 @@ LetStar::LetStar( const SourceLocation& loc, const Let::Bindings& bindings, AstP
 	body( expr ) {
 	_depth = body->depth();
 	for ( auto it = begin(), _end = end(); it != _end; ++it ) {
-		_depth = std::max( _depth, (*it).second->depth() );
+		_depth = std::max<size_t>( _depth, (*it).second->depth() );
 	}
 }
 Lambda::Lambda( const SourceLocation& loc, 
@@ -89,7 +95,7 @@ Lambda::Lambda( const SourceLocation& loc,
                 const Bindings& params,
                 const Bindings& capture,
                 AstPtr body )
- : Ast( Type::Lambda, loc ),
+ : Ast( Type::Lambda, loc, body ? body->depth() : 1 ),
    name( name ),
    body( body ),
    params( params ),
@@ -98,7 +104,7 @@ Lambda::Lambda( const SourceLocation& loc,
 	escapes.resize( arity(), EscapeStatus::NO_ESCAPE );
 }
 Define::Define( const SourceLocation& loc, const util::InternedString& name, AstPtr ast ) :
-	Ast( Type::Define, loc ),
+	Ast( Type::Define, loc, ast->depth() ),
 	name( name ),
 	expr( ast ) {}
 
@@ -110,16 +116,8 @@ TypeSet LetStar::possibleTypes() const { return body->possibleTypes(); }
 TypeSet Lambda ::possibleTypes() const { return TypeSet::Lambda(); }
 TypeSet Define ::possibleTypes() const { return expr->possibleTypes();  }
 
-size_t Quote  ::depth() const { return 1; }
-size_t If     ::depth() const { return _depth; }
-size_t Do     ::depth() const { return _depth; }
-size_t Let    ::depth() const { return _depth; }
-size_t LetStar::depth() const { return _depth; }
-size_t Lambda ::depth() const { return body ? body->depth() : 1; }
-size_t Define ::depth() const { return expr->depth(); }
-
-std::vector<AstPtr>::const_iterator Do::begin() const { return exprs.begin(); }
-std::vector<AstPtr>::const_iterator Do::end()   const { return exprs.end();   }
+AstVector::const_iterator Do::begin() const { return exprs.begin(); }
+AstVector::const_iterator Do::end()   const { return exprs.end();   }
 
 Let::Bindings::const_iterator Let::begin() const { return bindings.begin(); }
 Let::Bindings::const_iterator Let::end()   const { return bindings.end();   }
@@ -149,7 +147,7 @@ void         Lambda::paramEscape( Iterator param, EscapeStatus ) {
 }
 
 //***** FUNCTION APPLICATION ****************************************************************//
-Application::Application( const SourceLocation& loc, AstPtr fun, const std::vector<AstPtr>& args ) : 
+Application::Application( const SourceLocation& loc, AstPtr fun, const AstVector& args ) : 
   Ast( Type::Application, loc ),
   fun( fun ),
   args( args ) {
@@ -159,14 +157,12 @@ Application::Application( const SourceLocation& loc, AstPtr fun, const std::vect
 
 	_depth = fun->depth();
 	for ( auto it = begin(), _end = end(); it != _end; ++it ) {
-		_depth = std::max( _depth, (*it)->depth() );
+		_depth = std::max<size_t>( _depth, (*it)->depth() );
 	}
 }
 
 TypeSet Application::possibleTypes() const { return fun->possibleTypes(); }
 
-size_t Application::depth() const { return _depth; }
-
 Application::iterator Application::begin() const { return args.begin(); }
 Application::iterator Application::end()   const { return args.end();   }
 size_t                Application::arity() const { return args.size();  }
@@ -184,3 +180,216 @@ size_t                Application::arity() const { return args.size();  }
 
 
 
+
+//***** STRUCTURAL HASH      ****************************************************************//
+
+namespace {
+	// FNV-1a over the parts of a tree, names and literals are hashed by content, never by address
+	struct Hasher final {
+		void bytes( const void* data, size_t len ) {
+			const unsigned char* p = (const unsigned char*) data;
+			for ( size_t i = 0; i < len; i++ ) h = (h ^ p[i]) * 0x100000001b3UL;
+		}
+		void word( size_t w )  { bytes( &w, sizeof(w) ); }
+		void str( CStr s )     { bytes( s, std::strlen( s ) + 1 ); }
+
+		void node( ConstAstPtr ast ) { ast->visit<void>( *this ); }
+
+		void value( value::ValuePtr val ) {
+			value::Type type = value::typeOf( val );
+			word( size_t( type ) );
+
+			switch ( type ) {
+				case value::Type::Int:    word( value::Value::asInt( val )->value ); return;
+				case value::Type::Real:   bytes( &value::Value::asReal( val )->value, sizeof(double) ); return;
+				case value::Type::Char:   word( value::Value::asChar( val )->value ); return;
+				case value::Type::String: str( value::Value::asString( val )->value ); return;
+				case value::Type::Symbol: str( value::Value::asSymbol( val )->value ); return;
+				case value::Type::Cons:
+					for ( ; value::typeOf( val ) == value::Type::Cons; val = value::Value::asCons( val )->cdr ) {
+						value( value::Value::asCons( val )->car );
+					}
+					value( val );
+					return;
+				default: return;
+			}
+		}
+
+		void visit( ConstNilPtr )           { word( size_t( Nil::TAG ) ); }
+		void visit( ConstIntPtr ast )       { word( size_t( Int::TAG ) );    word( ast->value ); }
+		void visit( ConstRealPtr ast )      { word( size_t( Real::TAG ) );   bytes( &ast->value, sizeof(ast->value) ); }
+		void visit( ConstCharPtr ast )      { word( size_t( Char::TAG ) );   word( ast->value ); }
+		void visit( ConstStringPtr ast )    { word( size_t( String::TAG ) ); str( ast->value ); }
+		void visit( ConstVariablePtr ast )  { word( size_t( Variable::TAG ) ); word( ast->hasGlobalStorage ); str( ast->name ); }
+		void visit( ConstQuotePtr ast )     { word( size_t( Quote::TAG ) ); value( ast->value ); }
+		void visit( ConstIfPtr ast ) {
+			word( size_t( If::TAG ) );
+			node( ast->test );
+			node( ast->thenBranch );
+			node( ast->elseBranch );
+		}
+		void visit( ConstDoPtr ast ) {
+			word( size_t( Do::TAG ) );
+			word( ast->exprs.size() );
+			for ( AstPtr expr : ast->exprs ) node( expr );
+		}
+		void visit( ConstLetPtr ast ) {
+			word( size_t( Let::TAG ) );
+			bindings( ast->bindings );
+			node( ast->body );
+		}
+		void visit( ConstLetStarPtr ast ) {
+			word( size_t( LetStar::TAG ) );
+			bindings( ast->bindings );
+			node( ast->body );
+		}
+		void visit( ConstLambdaPtr ast ) {
+			word( size_t( Lambda::TAG ) );
+			str( ast->name );
+			word( ast->params.size() );
+			for ( VariablePtr var : ast->params ) node( var );
+			word( ast->capture.size() );
+			for ( VariablePtr var : ast->capture ) node( var );
+			// builtins have no body
+			if ( ast->body ) node( ast->body );
+		}
+		void visit( ConstDefinePtr ast ) {
+			word( size_t( Define::TAG ) );
+			str( ast->name );
+			node( ast->expr );
+		}
+		void visit( ConstApplicationPtr ast ) {
+			word( size_t( Application::TAG ) );
+			node( ast->fun );
+			word( ast->args.size() );
+			for ( AstPtr arg : ast->args ) node( arg );
+		}
+
+		void bindings( const Let::Bindings& bindings ) {
+			word( bindings.size() );
+			for ( auto& binding : bindings ) {
+				str( binding.first );
+				node( binding.second );
+			}
+		}
+
+		size_t h = 0xcbf29ce484222325UL;
+	};
+}
+
+size_t ast::hash( ConstAstPtr ast ) {
+	Hasher h;
+	h.node( ast );
+	return h.h;
+}
+
+namespace {
+	// compares a node with a node of the same type
+	struct Equal final {
+		static bool node( ConstAstPtr a, ConstAstPtr b ) {
+			if ( a == b ) return true;
+			if ( !a || !b ) return false;
+
+			return a->visit<bool>( Equal(), b );
+		}
+
+		template<typename T>
+		static const T* same( ConstAstPtr b ) { return b->as<T>(); }
+
+		bool visit( ConstNilPtr a, ConstAstPtr b ) const { return same<Nil>( b ); }
+		bool visit( ConstIntPtr a, ConstAstPtr b ) const {
+			auto o = same<Int>( b );
+			return o && o->value == a->value;
+		}
+		bool visit( ConstRealPtr a, ConstAstPtr b ) const {
+			auto o = same<Real>( b );
+			return o && std::memcmp( &o->value, &a->value, sizeof(a->value) ) == 0;
+		}
+		bool visit( ConstCharPtr a, ConstAstPtr b ) const {
+			auto o = same<Char>( b );
+			return o && o->value == a->value;
+		}
+		bool visit( ConstStringPtr a, ConstAstPtr b ) const {
+			auto o = same<String>( b );
+			return o && std::strcmp( o->value, a->value ) == 0;
+		}
+		bool visit( ConstVariablePtr a, ConstAstPtr b ) const {
+			auto o = same<Variable>( b );
+			return o && o->name == a->name && o->hasGlobalStorage == a->hasGlobalStorage;
+		}
+		bool visit( ConstQuotePtr a, ConstAstPtr b ) const {
+			auto o = same<Quote>( b );
+			return o && sameValue( a->value, o->value );
+		}
+		bool visit( ConstIfPtr a, ConstAstPtr b ) const {
+			auto o = same<If>( b );
+			return o && node( a->test, o->test ) && node( a->thenBranch, o->thenBranch ) && node( a->elseBranch, o->elseBranch );
+		}
+		bool visit( ConstDoPtr a, ConstAstPtr b ) const {
+			auto o = same<Do>( b );
+			return o && nodes( a->exprs, o->exprs );
+		}
+		bool visit( ConstLetPtr a, ConstAstPtr b ) const {
+			auto o = same<Let>( b );
+			return o && bindings( a->bindings, o->bindings ) && node( a->body, o->body );
+		}
+		bool visit( ConstLetStarPtr a, ConstAstPtr b ) const {
+			auto o = same<LetStar>( b );
+			return o && bindings( a->bindings, o->bindings ) && node( a->body, o->body );
+		}
+		bool visit( ConstLambdaPtr a, ConstAstPtr b ) const {
+			auto o = same<Lambda>( b );
+			return o && o->name == a->name && nodes( a->params, o->params ) && nodes( a->capture, o->capture ) && node( a->body, o->body );
+		}
+		bool visit( ConstDefinePtr a, ConstAstPtr b ) const {
+			auto o = same<Define>( b );
+			return o && o->name == a->name && node( a->expr, o->expr );
+		}
+		bool visit( ConstApplicationPtr a, ConstAstPtr b ) const {
+			auto o = same<Application>( b );
+			return o && node( a->fun, o->fun ) && nodes( a->args, o->args );
+		}
+
+		template<typename Vector>
+		static bool nodes( const Vector& a, const Vector& b ) {
+			if ( a.size() != b.size() ) return false;
+
+			for ( size_t i = 0; i < a.size(); i++ ) {
+				if ( !node( a[i], b[i] ) ) return false;
+			}
+			return true;
+		}
+		// stricter than value::equal, 1 and 1.0 are different literals
+		static bool sameValue( value::ValuePtr a, value::ValuePtr b ) {
+			for ( ; a != b; a = value::Value::asCons( a )->cdr, b = value::Value::asCons( b )->cdr ) {
+				value::Type type = value::typeOf( a );
+				if ( type != value::typeOf( b ) ) return false;
+
+				switch ( type ) {
+					case value::Type::Int:    return value::Value::asInt( a )->value == value::Value::asInt( b )->value;
+					case value::Type::Real:   return std::memcmp( &value::Value::asReal( a )->value, &value::Value::asReal( b )->value, sizeof(double) ) == 0;
+					case value::Type::Char:   return value::Value::asChar( a )->value == value::Value::asChar( b )->value;
+					case value::Type::String: return std::strcmp( value::Value::asString( a )->value, value::Value::asString( b )->value ) == 0;
+					case value::Type::Cons:
+						if ( !sameValue( value::Value::asCons( a )->car, value::Value::asCons( b )->car ) ) return false;
+						break;
+					// nil, symbols and everything else are equal if they are identical
+					default: return false;
+				}
+			}
+			return true;
+		}
+		static bool bindings( const Let::Bindings& a, const Let::Bindings& b ) {
+			if ( a.size() != b.size() ) return false;
+
+			for ( size_t i = 0; i < a.size(); i++ ) {
+				if ( !(a[i].first == b[i].first) || !node( a[i].second, b[i].second ) ) return false;
+			}
+			return true;
+		}
+	};
+}
+
+bool ast::equal( ConstAstPtr a, ConstAstPtr b ) {
+	return Equal::node( a, b );
+}
@@ -0,0 +1,53 @@
+
+#include "lllm/Reader.hpp"
+#include "lllm/Analyzer.hpp"
+#include "lllm/Evaluator.hpp"
+#include "lllm/GlobalScope.hpp"
+#include "lllm/value/Value.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace lllm;
+using namespace lllm::value;
+using namespace lllm::util;
+
+typedef std::chrono::steady_clock Clock;
+
+static const long LIST_LENGTH = 1000;
+static const int  ROUNDS      = 20000;
+
+int main() {
+	Evaluator::setJittingThreshold( 0 );
+
+	GlobalScope scope;
+
+	#define GLOBAL( NAME, BODY ) ({ 						\
+		auto ast = Analyzer::analyze( Reader::read( BODY ), &scope ); \
+		scope.add( SourceLocation("*bench*"), NAME, ast, Evaluator::evaluate( ast, &scope ) ); \
+	})
+	#define BENCH( NAME, CODE ) ({                                                      \
+		auto start = Clock::now();                                                      \
+		for ( int i = 0; i < ROUNDS; i++ ) { CODE; }                                    \
+		double secs = std::chrono::duration<double>( Clock::now() - start ).count();   \
+		std::printf( "%-12s %8.3fs  %6.1f ns/element\n", NAME, secs,                   \
+		             secs * 1e9 / (double( ROUNDS ) * LIST_LENGTH) );                   \
+	})
+
+	GLOBAL( "range",    "(lambda range (n acc) (if (= n 0) acc (range (- n 1) (cons n acc))))" );
+	GLOBAL( "closures", "(lambda closures (n acc) (if (= n 0) acc (closures (- n 1) (lambda () acc))))" );
+
+	auto range    = Analyzer::analyze( Reader::read( "(range    1000 nil)" ), &scope );
+	auto closures = Analyzer::analyze( Reader::read( "(closures 1000 nil)" ), &scope );
+
+	std::printf( ">>> ALLOCATION, %d rounds of %ld elements\n", ROUNDS, LIST_LENGTH );
+
+	BENCH( "c++ cons", ({
+		ListPtr l = nil;
+		for ( long j = 0; j < LIST_LENGTH; j++ ) l = value::cons( nullptr, l );
+	}) );
+	BENCH( "jit cons",    Evaluator::evaluate( range,    &scope ) );
+	BENCH( "jit closure", Evaluator::evaluate( closures, &scope ) );
+
+	return 0;
+}
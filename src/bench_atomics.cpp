@@ -0,0 +1,113 @@
+#include "lllm/Reader.hpp"
+#include "lllm/Analyzer.hpp"
+#include "lllm/Evaluator.hpp"
+#include "lllm/GlobalScope.hpp"
+#include "lllm/value/Value.hpp"
+#include "lllm/value/Gc.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace lllm;
+using namespace lllm::value;
+using namespace lllm::util;
+
+typedef std::chrono::steady_clock Clock;
+
+// increments per thread
+static const int INCREMENTS = 100000;
+
+// every increment is one evaluation, the locked one holds a global lock around it
+static CStr FETCH_ADD = "(lambda fetch-add (r) (fetch-add! r 1))";
+static CStr SWAP      = "(lambda swap (r) (swap! r (lambda (x) (+ x 1))))";
+static CStr LOCKED    = "(lambda locked (r) (set r (+ (get r) 1)))";
+
+static std::mutex lock;
+
+// seconds for all threads to finish their increments
+static double run( size_t threads, ast::AstPtr increment, bool locked, GlobalScopePtr scope ) {
+	std::vector<std::thread> workers;
+
+	auto start = Clock::now();
+
+	for ( size_t i = 0; i < threads; i++ ) {
+		workers.emplace_back( [=]() {
+			Gc::Thread registered;
+
+			for ( int n = 0; n < INCREMENTS; n++ ) {
+				if ( locked ) {
+					std::lock_guard<std::mutex> guard( lock );
+					Evaluator::evaluate( increment, scope );
+				} else {
+					Evaluator::evaluate( increment, scope );
+				}
+			}
+		} );
+	}
+	for ( auto& w : workers ) w.join();
+
+	return std::chrono::duration<double>( Clock::now() - start ).count();
+}
+
+// bench_atomics [MAX_THREADS]
+int main( int argc, char** argv ) {
+	GC_INIT();
+	Gc::enableThreads();
+
+	size_t maxThreads = argc > 1 ? std::strtoul( argv[1], nullptr, 10 ) : std::thread::hardware_concurrency();
+	if ( maxThreads < 2 ) maxThreads = 2;
+
+	Evaluator::setJittingThreshold( 5 );
+
+	GlobalScope scope;
+
+	#define GLOBAL( NAME, BODY ) ({ 						\
+		auto ast = Analyzer::analyze( Reader::read( BODY ), &scope ); \
+		scope.add( SourceLocation("*bench*"), NAME, ast, Evaluator::evaluate( ast, &scope ) ); \
+	})
+
+	GLOBAL( "fetch-add", FETCH_ADD );
+	GLOBAL( "swap",      SWAP      );
+	GLOBAL( "locked",    LOCKED    );
+	GLOBAL( "counter",   "(ref)"   );
+
+	ValuePtr counter;
+	scope.lookup( "counter", &counter );
+	RefPtr   ref = Value::asRef( counter );
+
+	struct { CStr name; CStr source; bool locked; } variants[] = {
+		{ "fetch-add!", "(fetch-add counter)", false },
+		{ "swap!",      "(swap counter)",      false },
+		{ "mutex",      "(locked counter)",    true  },
+	};
+
+	// powers of two and the maximum
+	std::vector<size_t> counts;
+	for ( size_t threads = 1; threads < maxThreads; threads *= 2 ) counts.push_back( threads );
+	counts.push_back( maxThreads );
+
+	std::printf( ">>> ATOMICS (%d increments of one ref per thread)\n", INCREMENTS );
+
+	for ( auto& v : variants ) {
+		auto increment = Analyzer::analyze( Reader::read( v.source ), &scope );
+
+		for ( size_t threads : counts ) {
+			ref->set( number( 0 ) );
+
+			double secs = run( threads, increment, v.locked, &scope );
+
+			if ( !(*ref->get() == *number( long( threads * INCREMENTS ) )) ) {
+				std::printf( "%s lost increments with %zu threads\n", v.name, threads );
+				return 1;
+			}
+
+			std::printf( "%-10s %3zu threads %8.3fs %8.0f ns per increment\n", v.name, threads, secs, secs * 1e9 / (threads * INCREMENTS) );
+		}
+	}
+
+	return 0;
+}
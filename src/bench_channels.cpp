@@ -0,0 +1,80 @@
+#include "lllm/Reader.hpp"
+#include "lllm/Analyzer.hpp"
+#include "lllm/Evaluator.hpp"
+#include "lllm/GlobalScope.hpp"
+#include "lllm/value/Value.hpp"
+#include "lllm/value/Gc.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace lllm;
+using namespace lllm::value;
+using namespace lllm::util;
+
+typedef std::chrono::steady_clock Clock;
+
+static CStr FUNCTIONS[][2] = {
+	{ "ping",    "(lambda ping (out in n) (if (= n 0) 0 (do (send out n) (recv in) (ping out in (- n 1)))))" },
+	{ "echo",    "(lambda echo (in out n) (if (= n 0) 0 (do (send out (recv in)) (echo in out (- n 1)))))" },
+	{ "produce", "(lambda produce (c i n) (if (= i n) 0 (do (send c 1) (produce c (+ i 1) n))))" },
+	{ "consume", "(lambda consume (c n acc) (if (= n 0) acc (consume c (- n 1) (+ acc (recv c)))))" },
+};
+
+static double run( GlobalScopePtr scope, const std::string& code ) {
+	auto start = Clock::now();
+	Evaluator::evaluate( Analyzer::analyze( Reader::read( code.c_str() ), scope ), scope );
+	return std::chrono::duration<double>( Clock::now() - start ).count();
+}
+
+// bench_channels [ROUND_TRIPS] [MESSAGES]
+int main( int argc, char** argv ) {
+	GC_INIT();
+
+	size_t trips    = argc > 1 ? std::strtoul( argv[1], nullptr, 10 ) : 200000;
+	size_t messages = argc > 2 ? std::strtoul( argv[2], nullptr, 10 ) : 1000000;
+
+	Evaluator::setJittingThreshold( 5 );
+
+	GlobalScope scope;
+	for ( auto& fn : FUNCTIONS ) {
+		ast::AstPtr ast = Analyzer::analyze( Reader::read( fn[1] ), &scope );
+		scope.add( SourceLocation( "*bench*" ), fn[0], ast, Evaluator::evaluate( ast, &scope ) );
+	}
+
+	std::string n = std::to_string( trips );
+
+	// both ends are fibers, on one worker a round trip is two switches
+	double fibers = run( &scope,
+		"(let (a (channel 1)) (b (channel 1)) "
+		  "(do (spawn (lambda () (echo a b " + n + "))) (touch (spawn (lambda () (ping a b " + n + "))))))" );
+
+	// this thread against a fiber, every round trip goes through the OS scheduler
+	double threads = run( &scope,
+		"(let (a (channel 1)) (b (channel 1)) "
+		  "(do (spawn (lambda () (echo a b " + n + "))) (ping a b " + n + ")))" );
+
+	std::printf( ">>> PING PONG %zu round trips\n", trips );
+	std::printf( "fiber  <-> fiber  %8.3fs  %8.0f ns per round trip\n", fibers,  fibers  * 1e9 / trips );
+	std::printf( "thread <-> fiber  %8.3fs  %8.0f ns per round trip\n", threads, threads * 1e9 / trips );
+
+	std::printf( ">>> FAN IN %zu messages\n", messages );
+	for ( size_t producers : { 1, 4, 16 } ) {
+		std::string each = std::to_string( messages / producers );
+		std::string all  = std::to_string( messages / producers * producers );
+
+		// producers are started by a loop in the consumer's fiber, they only run when it waits
+		double secs = run( &scope,
+			"(let (c (channel 64)) "
+			  "(touch (spawn (lambda () "
+			    "(do ((lambda start (k) (if (= k 0) 0 (do (spawn (lambda () (produce c 0 " + each + "))) (start (- k 1))))) " + std::to_string( producers ) + ") "
+			        "(consume c " + all + " 0))))))" );
+
+		std::printf( "%2zu producers      %8.3fs  %8.0f ns per message  %8.2f M messages/s\n",
+		             producers, secs, secs * 1e9 / messages, messages / secs / 1e6 );
+	}
+
+	return 0;
+}
@@ -0,0 +1,63 @@
+
+#include "lllm/Reader.hpp"
+#include "lllm/Analyzer.hpp"
+#include "lllm/Evaluator.hpp"
+#include "lllm/GlobalScope.hpp"
+#include "lllm/Jit.hpp"
+#include "lllm/value/Value.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace lllm;
+using namespace lllm::value;
+using namespace lllm::util;
+
+typedef std::chrono::steady_clock Clock;
+
+static const int ROUNDS = 20000;
+
+static CStr FIB  = "(lambda fib (n) (if (< n 2) n (+ (fib (- n 2)) (fib (- n 1)))))";
+// small enough to be inlined into each other
+static CStr SQR  = "(lambda sqr (x) (* x x))";
+static CStr POLY = "(lambda poly (x y) (if (< (sqr x) (sqr y)) (+ (sqr (+ x 1)) y) (- (sqr y) (* (sqr x) 2))))";
+
+int main() {
+	// interpreter only, the jit is measured on its own
+	Evaluator::setJittingThreshold( 999999999 );
+
+	GlobalScope scope;
+
+	#define GLOBAL( NAME, BODY ) ({ 						\
+		auto ast = Analyzer::analyze( Reader::read( BODY ), &scope ); \
+		scope.add( SourceLocation("*bench*"), NAME, ast, Evaluator::evaluate( ast, &scope ) ); \
+	})
+	#define BENCH( NAME, N, CODE ) ({                                                   \
+		auto start = Clock::now();                                                      \
+		for ( int i = 0; i < (N); i++ ) { CODE; }                                       \
+		double secs = std::chrono::duration<double>( Clock::now() - start ).count();   \
+		std::printf( "%-12s %8.3fs  %8.1f us/round\n", NAME, secs, secs * 1e6 / (N) );  \
+	})
+
+	GLOBAL( "fib",  FIB  );
+	GLOBAL( "sqr",  SQR  );
+	GLOBAL( "poly", POLY );
+
+	auto fib  = Analyzer::analyze( Reader::read( "(fib 22)" ), &scope );
+	auto poly = Analyzer::analyze( Reader::read( "(poly 3 4)" ), &scope );
+
+	ValuePtr polyFn;
+	scope.lookup( "poly", &polyFn );
+
+	sexpr::SexprPtr polySrc = Reader::read( POLY );
+
+	std::printf( ">>> EVALUATION\n" );
+
+	BENCH( "eval fib",  5,      Evaluator::evaluate( fib,  &scope ) );
+	BENCH( "eval poly", ROUNDS, Evaluator::evaluate( poly, &scope ) );
+	// compile time is spent in the analyzer and the inliner
+	BENCH( "analyze",   ROUNDS, Analyzer::analyze( polySrc, &scope ) );
+	BENCH( "inline",    ROUNDS, Jit::performInlining( Value::asLambda( polyFn )->data->ast, &scope ) );
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+
+#include "lllm/value/Value.hpp"
+#include "lllm/value/Gc.hpp"
+#include "lllm/value/Telemetry.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace lllm;
+using namespace lllm::value;
+
+typedef std::chrono::steady_clock Clock;
+
+// allocations that take longer than this are counted as pauses
+static const long PAUSE_THRESHOLD_NS = 20000;
+
+static const size_t LIVE_REFS    = 50000;
+static const size_t LIST_LENGTH  = 20;
+static const size_t ALLOCATIONS  = 20000000;
+
+// old refs pointing to fresh lists keep the write barrier busy
+static RefPtr* live;
+
+static ListPtr buildList( size_t n ) {
+	ListPtr l = nil;
+	for ( size_t i = 0; i < n; i++ ) l = cons( nullptr, l );
+	return l;
+}
+
+static long percentile( std::vector<long>& v, double p ) {
+	if ( v.empty() ) return 0;
+	std::sort( v.begin(), v.end() );
+	return v[ std::min( v.size() - 1, size_t( p * v.size() ) ) ];
+}
+
+static void run( Gc::Mode mode ) {
+	if ( mode == Gc::Mode::INCREMENTAL ) Gc::setMode( mode );
+
+	live = (RefPtr*) GC_MALLOC( LIVE_REFS * sizeof(RefPtr) );
+	for ( size_t i = 0; i < LIVE_REFS; i++ ) live[i] = ref( buildList( LIST_LENGTH ) );
+
+	std::vector<long> pauses;
+	pauses.reserve( 100000 );
+
+	auto start = Clock::now();
+	auto last  = start;
+
+	ListPtr garbage = nil;
+	for ( size_t i = 0; i < ALLOCATIONS; i++ ) {
+		garbage = cons( nullptr, garbage );
+
+		if ( i % LIST_LENGTH == 0 ) {
+			live[(i / LIST_LENGTH) % LIVE_REFS]->set( garbage );
+			garbage = nil;
+		}
+
+		auto now = Clock::now();
+		long ns  = std::chrono::duration_cast<std::chrono::nanoseconds>( now - last ).count();
+		if ( ns > PAUSE_THRESHOLD_NS ) pauses.push_back( ns );
+		last = now;
+	}
+
+	double secs = std::chrono::duration<double>( Clock::now() - start ).count();
+
+	Telemetry::GcStats gc = Telemetry::gc();
+
+	std::printf( "%-15s %8.2fs %8zu pauses   p50 %8.1fus   p99 %8.1fus   max %8.1fus   (%llu collections, heap %zu KiB)\n",
+		mode == Gc::Mode::INCREMENTAL ? "incremental" : "stop-the-world",
+		secs,
+		pauses.size(),
+		percentile( pauses, 0.50 ) / 1000.0,
+		percentile( pauses, 0.99 ) / 1000.0,
+		percentile( pauses, 1.00 ) / 1000.0,
+		gc.collections,
+		gc.heapSize / 1024
+	);
+	std::fflush( stdout );
+}
+
+// the incremental mode can't be switched off again, so each mode runs in its own process
+int main( int argc, char** argv ) {
+	if ( argc > 1 ) {
+		run( std::strcmp( argv[1], "incremental" ) == 0 ? Gc::Mode::INCREMENTAL : Gc::Mode::STOP_THE_WORLD );
+		return 0;
+	}
+
+	std::printf( ">>> GC LATENCY, %zu allocations, pause goal %lums\n", ALLOCATIONS, Gc::DEFAULT_PAUSE_GOAL_MS );
+	std::fflush( stdout );
+
+	for ( Gc::Mode mode : { Gc::Mode::STOP_THE_WORLD, Gc::Mode::INCREMENTAL } ) {
+		pid_t pid = fork();
+
+		if ( pid == 0 ) {
+			run( mode );
+			_exit( 0 );
+		}
+
+		int status;
+		waitpid( pid, &status, 0 );
+	}
+
+	return 0;
+}
@@ -0,0 +1,73 @@
+#include "lllm/Reader.hpp"
+#include "lllm/Analyzer.hpp"
+#include "lllm/Evaluator.hpp"
+#include "lllm/GlobalScope.hpp"
+#include "lllm/Fiber.hpp"
+#include "lllm/value/Value.hpp"
+#include "lllm/value/Gc.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace lllm;
+using namespace lllm::value;
+using namespace lllm::util;
+
+typedef std::chrono::steady_clock Clock;
+
+// every fiber yields a few times before it finishes
+static CStr TICK = "(lambda tick (n) (if (= n 0) 1 (do (yield) (tick (- n 1)))))";
+static CStr BODY = "(lambda () (tick 10))";
+
+// bench_green [FIBERS]
+int main( int argc, char** argv ) {
+	GC_INIT();
+
+	size_t n = argc > 1 ? std::strtoul( argv[1], nullptr, 10 ) : 100000;
+
+	Evaluator::setJittingThreshold( 5 );
+
+	GlobalScope scope;
+
+	ast::AstPtr tick = Analyzer::analyze( Reader::read( TICK ), &scope );
+	scope.add( SourceLocation( "*bench*" ), "tick", tick, Evaluator::evaluate( tick, &scope ) );
+
+	LambdaPtr   body = Value::asLambda( Evaluator::evaluate( Analyzer::analyze( Reader::read( BODY ), &scope ), &scope ) );
+
+	// fibers call body with the globals of whoever spawns them
+	Evaluator::GlobalsFor globals( &scope );
+
+	// fibers are only reachable from the scheduler and this
+	std::vector<Fiber*,traceable_allocator<Fiber*>> fibers;
+	fibers.reserve( n );
+
+	size_t heapBefore = GC_get_heap_size();
+	auto   start      = Clock::now();
+
+	for ( size_t i = 0; i < n; i++ ) fibers.push_back( Fibers::spawn( body ) );
+
+	double spawn = std::chrono::duration<double>( Clock::now() - start ).count();
+
+	size_t finished = 0;
+	for ( Fiber* f : fibers ) finished += *Scheduler::join( f ) == *number( 1 );
+
+	double total = std::chrono::duration<double>( Clock::now() - start ).count();
+
+	Fibers::Stats stats = Fibers::stats();
+
+	if ( finished != n ) {
+		std::printf( "only %zu of %zu fibers finished right\n", finished, n );
+		return 1;
+	}
+
+	std::printf( ">>> FIBERS %zu on %zu workers\n", n, Fibers::workers() );
+	std::printf( "spawn       %8.3fs  %8.0f ns per fiber\n", spawn, spawn * 1e9 / n );
+	std::printf( "total       %8.3fs  %8.0f ns per fiber\n", total, total * 1e9 / n );
+	std::printf( "switches    %8zu   %8.0f ns per switch (everything included)\n", stats.switches, total * 1e9 / stats.switches );
+	std::printf( "heap growth %8zu KB  %8zu bytes per fiber\n", (GC_get_heap_size() - heapBefore) / 1024, (GC_get_heap_size() - heapBefore) / n );
+	std::printf( "stacks      %8zu KB  %8zu bytes per fiber at the peak\n", stats.peakBytes / 1024, stats.peakBytes / n );
+
+	return 0;
+}
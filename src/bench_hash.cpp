@@ -0,0 +1,93 @@
+#include "lllm/Reader.hpp"
+#include "lllm/Analyzer.hpp"
+#include "lllm/Evaluator.hpp"
+#include "lllm/GlobalScope.hpp"
+#include "lllm/value/Value.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace lllm;
+using namespace lllm::value;
+using namespace lllm::util;
+
+typedef std::chrono::steady_clock Clock;
+
+// maps from the ints 0..n-1 to themselves, as an association list of (key value) lists and as a hash table
+static CStr ALIST   = "(lambda alist (i n acc) (if (= i n) acc (alist (+ i 1) n (cons (cons i (cons i nil)) acc))))";
+static CStr ASSOC   = "(lambda assoc (l k) (if l (if (= (car (car l)) k) (car (cdr (car l))) (assoc (cdr l) k)) nil))";
+static CStr TABLE   = "(lambda table (h i n) (if (= i n) h (do (hash-set! h i i) (table h (+ i 1) n))))";
+// looks up every key once
+static CStr ALL_A   = "(lambda all-a (l i n acc) (if (= i n) acc (all-a l (+ i 1) n (+ acc (assoc l i)))))";
+static CStr ALL_H   = "(lambda all-h (h i n acc) (if (= i n) acc (all-h h (+ i 1) n (+ acc (hash-ref h i 0)))))";
+
+static double seconds( ast::AstPtr expr, GlobalScopePtr scope ) {
+	auto start = Clock::now();
+	Evaluator::evaluate( expr, scope );
+	return std::chrono::duration<double>( Clock::now() - start ).count();
+}
+
+// bench_hash [MAX_ENTRIES]
+int main( int argc, char** argv ) {
+	GC_INIT();
+
+	size_t maxEntries = argc > 1 ? std::strtoul( argv[1], nullptr, 10 ) : 10000;
+
+	Evaluator::setJittingThreshold( 1 );
+
+	GlobalScope scope;
+
+	#define GLOBAL( NAME, BODY ) ({ 						\
+		auto ast = Analyzer::analyze( Reader::read( BODY ), &scope ); \
+		scope.add( SourceLocation("*bench*"), NAME, ast, Evaluator::evaluate( ast, &scope ) ); \
+	})
+
+	GLOBAL( "alist", ALIST );
+	GLOBAL( "assoc", ASSOC );
+	GLOBAL( "table", TABLE );
+	GLOBAL( "all-a", ALL_A );
+	GLOBAL( "all-h", ALL_H );
+
+	std::printf( ">>> HASH TABLES (ns per lookup)\n" );
+
+	for ( size_t n = 10; n <= maxEntries; n *= 10 ) {
+		std::string size = std::to_string( n );
+
+		GLOBAL( "l", ("(alist 0 " + size + " nil)").c_str() );
+		GLOBAL( "h", ("(table (make-hash-table) 0 " + size + ")").c_str() );
+
+		auto a = Analyzer::analyze( Reader::read( ("(all-a l 0 " + size + " 0)").c_str() ), &scope );
+		auto h = Analyzer::analyze( Reader::read( ("(all-h h 0 " + size + " 0)").c_str() ), &scope );
+
+		// warm up, which also compiles
+		seconds( a, &scope );
+		seconds( h, &scope );
+
+		std::printf( "%8zu entries  alist %10.1f  hash table %8.1f\n", n, seconds( a, &scope ) * 1e9 / n, seconds( h, &scope ) * 1e9 / n );
+	}
+
+	// growing moves a few old slots per put, so no single put pays for a whole resize.
+	// collections would hide that, so there are none meanwhile
+	GC_disable();
+
+	HashTablePtr table   = hashTable();
+	double       slowest = 0, total = 0;
+
+	for ( size_t i = 0; i < maxEntries * 100; i++ ) {
+		auto start = Clock::now();
+		table->put( number( long( i ) ), nullptr );
+		double secs = std::chrono::duration<double>( Clock::now() - start ).count();
+
+		slowest = std::max( slowest, secs );
+		total  += secs;
+	}
+
+	GC_enable();
+
+	std::printf( ">>> PUT LATENCY (%zu puts)\nmean %.0f ns, slowest %.0f ns\n", maxEntries * 100, total * 1e9 / (maxEntries * 100), slowest * 1e9 );
+
+	return 0;
+}
@@ -0,0 +1,107 @@
+#include "lllm/Reader.hpp"
+#include "lllm/Analyzer.hpp"
+#include "lllm/Evaluator.hpp"
+#include "lllm/GlobalScope.hpp"
+#include "lllm/value/Value.hpp"
+#include "lllm/value/ValueIO.hpp"
+#include "lllm/value/Kernels.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <sstream>
+
+using namespace lllm;
+using namespace lllm::value;
+using namespace lllm::util;
+
+typedef std::chrono::steady_clock Clock;
+
+// the same work on lists of boxed numbers in compiled lisp code
+static CStr LIST_DOT = "(lambda list-dot (a b acc) (if a (list-dot (cdr a) (cdr b) (+ acc (* (car a) (car b)))) acc))";
+static CStr LIST_SUM = "(lambda list-sum (a acc) (if a (list-sum (cdr a) (+ acc (car a))) acc))";
+// builds the sums in reverse, so long lists do not overflow the stack
+static CStr LIST_ADD = "(lambda list-add (a b acc) (if a (list-add (cdr a) (cdr b) (cons (+ (car a) (car b)) acc)) acc))";
+static CStr LIST_MAX = "(lambda list-max (a m) (if a (list-max (cdr a) (if (> (car a) m) (car a) m)) m))";
+
+// nanoseconds per element, the best of a few runs
+static double run( ast::AstPtr expr, GlobalScopePtr scope, size_t elements, size_t repeats ) {
+	double best = 1e30;
+
+	for ( int round = 0; round < 5; round++ ) {
+		auto start = Clock::now();
+		for ( size_t i = 0; i < repeats; i++ ) Evaluator::evaluate( expr, scope );
+		double secs = std::chrono::duration<double>( Clock::now() - start ).count();
+
+		if ( secs < best ) best = secs;
+	}
+
+	return best * 1e9 / (elements * repeats);
+}
+
+// bench_numeric [ELEMENTS]
+int main( int argc, char** argv ) {
+	GC_INIT();
+
+	size_t n       = argc > 1 ? std::strtoul( argv[1], nullptr, 10 ) : 10000;
+	size_t repeats = 1000000 / n + 1;
+
+	Evaluator::setJittingThreshold( 1 );
+
+	GlobalScope scope;
+
+	#define GLOBAL( NAME, BODY ) ({ 						\
+		auto ast = Analyzer::analyze( Reader::read( BODY ), &scope ); \
+		scope.add( SourceLocation("*bench*"), NAME, ast, Evaluator::evaluate( ast, &scope ) ); \
+	})
+
+	GLOBAL( "list-dot", LIST_DOT );
+	GLOBAL( "list-sum", LIST_SUM );
+	GLOBAL( "list-add", LIST_ADD );
+	GLOBAL( "list-max", LIST_MAX );
+
+	// the same numbers as reals in a list and in an f64vector
+	std::ostringstream numbers;
+	numbers << "'(";
+	for ( size_t i = 0; i < n; i++ ) numbers << ' ' << double( i % 1000 ) + 0.5;
+	numbers << ')';
+
+	GLOBAL( "xs",  numbers.str().c_str() );
+	GLOBAL( "fxs", ("(list->f64vector " + numbers.str() + ")").c_str() );
+
+	struct { CStr name; CStr list; CStr vector; } ops[] = {
+		{ "dot", "(list-dot xs xs 0)",   "(vector-dot fxs fxs)" },
+		{ "sum", "(list-sum xs 0)",      "(vector-sum fxs)"     },
+		{ "add", "(list-add xs xs nil)", "(vector-add fxs fxs)" },
+		{ "max", "(list-max xs 0)",      "(vector-max fxs)"     },
+	};
+
+	std::printf( ">>> NUMERIC (%zu doubles, ns per element)\n", n );
+	std::printf( "%-5s %10s", "op", "list" );
+	for ( Kernels::Isa isa : { Kernels::Isa::SCALAR, Kernels::Isa::SSE2, Kernels::Isa::AVX2 } ) std::printf( " %10s", Kernels::name( isa ) );
+	std::printf( "\n" );
+
+	for ( auto& op : ops ) {
+		auto list   = Analyzer::analyze( Reader::read( op.list ),   &scope );
+		auto vector = Analyzer::analyze( Reader::read( op.vector ), &scope );
+
+		// the lists are slow, fewer repeats do
+		std::printf( "%-5s %10.3f", op.name, run( list, &scope, n, repeats / 10 + 1 ) );
+
+		for ( Kernels::Isa isa : { Kernels::Isa::SCALAR, Kernels::Isa::SSE2, Kernels::Isa::AVX2 } ) {
+			Kernels::use( isa );
+
+			if ( Kernels::current() == isa ) {
+				std::printf( " %10.3f", run( vector, &scope, n, repeats ) );
+			} else {
+				std::printf( " %10s", "-" );
+			}
+		}
+		std::printf( "\n" );
+
+		Kernels::use( Kernels::best() );
+	}
+
+	return 0;
+}
@@ -0,0 +1,102 @@
+#include "lllm/Reader.hpp"
+#include "lllm/Analyzer.hpp"
+#include "lllm/Evaluator.hpp"
+#include "lllm/GlobalScope.hpp"
+#include "lllm/Scheduler.hpp"
+#include "lllm/value/Value.hpp"
+#include "lllm/value/Gc.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using namespace lllm;
+using namespace lllm::value;
+using namespace lllm::util;
+
+typedef std::chrono::steady_clock Clock;
+
+static CStr FIB   = "(lambda fib (n) (if (< n 2) n (+ (fib (- n 2)) (fib (- n 1)))))";
+static CStr RANGE = "(lambda range (n acc) (if (< n 1) acc (range (- n 1) (cons n acc))))";
+
+// uneven work per element, fib of 10 to 19
+static CStr SIZES = "(lambda sizes (n acc) (if (< n 1) acc (sizes (- n 1) (cons (+ 10 (- n (* 10 (/ n 10)))) acc))))";
+
+static CStr MAP    = "(lambda map (f l) (if l (cons (f (car l)) (map f (cdr l))) nil))";
+static CStr REDUCE = "(lambda reduce (f acc l) (if l (reduce f (f acc (car l)) (cdr l)) acc))";
+
+// name, parallel and sequential version
+static CStr WORKLOADS[][3] = {
+	{ "pmap",    "(pmap fib (sizes 200 nil))",
+	             "(map fib (sizes 200 nil))" },
+	{ "preduce", "(preduce (lambda (a b) (+ a (fib (- b (* 10 (/ b 10)))))) 0 (range 4000 nil))",
+	             "(reduce (lambda (a b) (+ a (fib (- b (* 10 (/ b 10)))))) 0 (range 4000 nil))" },
+};
+
+// best of a few runs
+static double run( ast::AstPtr workload, GlobalScopePtr scope ) {
+	double best = 1e9;
+
+	for ( int i = 0; i < 3; i++ ) {
+		auto start = Clock::now();
+		Evaluator::evaluate( workload, scope );
+		double secs = std::chrono::duration<double>( Clock::now() - start ).count();
+
+		if ( secs < best ) best = secs;
+	}
+
+	return best;
+}
+
+// bench_parallel, LLLM_WORKERS sets the most workers to try
+int main() {
+	GC_INIT();
+
+	GlobalScope scope;
+
+	#define GLOBAL( NAME, BODY ) ({ 						\
+		auto ast = Analyzer::analyze( Reader::read( BODY ), &scope ); \
+		scope.add( SourceLocation("*bench*"), NAME, ast, Evaluator::evaluate( ast, &scope ) ); \
+	})
+
+	GLOBAL( "fib",   FIB   );
+	GLOBAL( "range", RANGE );
+	GLOBAL( "sizes", SIZES );
+	GLOBAL( "map",    MAP    );
+	GLOBAL( "reduce", REDUCE );
+
+	Evaluator::setJittingThreshold( 5 );
+
+	size_t maxWorkers = Scheduler::workers();
+
+	// powers of two and the maximum
+	std::vector<size_t> counts;
+	for ( size_t workers = 1; workers < maxWorkers; workers *= 2 ) counts.push_back( workers );
+	counts.push_back( maxWorkers );
+
+	std::printf( ">>> PARALLEL (up to %zu workers, the evaluating thread helps)\n", maxWorkers );
+
+	for ( auto& w : WORKLOADS ) {
+		auto workload   = Analyzer::analyze( Reader::read( w[1] ), &scope );
+		auto sequential = Analyzer::analyze( Reader::read( w[2] ), &scope );
+
+		// warm up, compiles everything
+		Evaluator::evaluate( workload,   &scope );
+		Evaluator::evaluate( sequential, &scope );
+
+		// speedups are against the plain sequential version
+		double base = run( sequential, &scope );
+
+		std::printf( "%-8s  sequential %8.3fs\n", w[0], base );
+
+		for ( size_t workers : counts ) {
+			Scheduler::setWorkers( workers );
+
+			double secs = run( workload, &scope );
+
+			std::printf( "%-8s %3zu workers %8.3fs  %5.2fx\n", w[0], workers, secs, base / secs );
+		}
+	}
+
+	return 0;
+}
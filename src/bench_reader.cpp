@@ -0,0 +1,50 @@
+
+#include "lllm/Reader.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace lllm;
+using namespace lllm::util;
+
+typedef std::chrono::steady_clock Clock;
+
+// one form per line, a mix of every kind of token
+static CStr FORMS[] = {
+	"(lambda fib (n) (if (< n 2) n (+ (fib (- n 2)) (fib (- n 1)))))\n",
+	"(define pi 3.141_592_653) ; a comment\n",
+	"(cons \\a (cons \\newline (cons \"a string of some length\" nil)))\n",
+	"(let ((xs '(1 2 3 4 5 6 7 8 9 10)) (big 1_000_000)) (map (lambda (x) (* x big)) xs))\n",
+};
+
+// usage: bench_reader [megabytes] [file]
+int main( int argc, char** argv ) {
+	size_t mb   = argc > 1 ? std::atol( argv[1] ) : 100;
+	CStr   file = argc > 2 ? argv[2] : "/tmp/lllm_bench_reader.lll";
+
+	FILE* out = std::fopen( file, "w" );
+	if ( !out ) { std::perror( file ); return 1; }
+
+	size_t bytes = 0;
+	for ( size_t i = 0; bytes < mb * 1024 * 1024; i++ ) {
+		std::fputs( FORMS[i % 4], out );
+		bytes += std::strlen( FORMS[i % 4] );
+	}
+	std::fclose( out );
+
+	auto start = Clock::now();
+
+	size_t forms  = 0;
+	Reader reader = Reader::fromFile( file );
+	while ( reader.read() ) forms++;
+
+	double secs = std::chrono::duration<double>( Clock::now() - start ).count();
+
+	std::printf( ">>> READER, %zu bytes\n", bytes );
+	std::printf( "%-12s %8.3fs  %8.1f MB/s  %zu forms\n", "read file", secs, bytes / (1024.0 * 1024.0) / secs, forms );
+
+	std::remove( file );
+	return 0;
+}
@@ -0,0 +1,77 @@
+#include "lllm/Reader.hpp"
+#include "lllm/Analyzer.hpp"
+#include "lllm/Evaluator.hpp"
+#include "lllm/GlobalScope.hpp"
+#include "lllm/value/Value.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace lllm;
+using namespace lllm::value;
+using namespace lllm::util;
+
+typedef std::chrono::steady_clock Clock;
+
+// points with three coordinates, as lists (x y z) and as records
+static CStr LISTS   = "(lambda lists (i n acc) (if (= i n) acc (lists (+ i 1) n (cons (cons i (cons 1 (cons i nil))) acc))))";
+static CStr RECORDS = "(lambda records (i n acc) (if (= i n) acc (records (+ i 1) n (cons (make-point i 1 i) acc))))";
+// the z of the last point, reads every z on the way without allocating
+static CStr LAST_L  = "(lambda last-l (l z) (if l (last-l (cdr l) (car (cdr (cdr (car l))))) z))";
+static CStr LAST_R  = "(lambda last-r (l z) (if l (last-r (cdr l) (point-z (car l))) z))";
+
+// nanoseconds per point, the best of a few runs
+static double run( ast::AstPtr expr, GlobalScopePtr scope, size_t points ) {
+	double best = 1e30;
+
+	for ( int round = 0; round < 5; round++ ) {
+		auto start = Clock::now();
+		Evaluator::evaluate( expr, scope );
+		double secs = std::chrono::duration<double>( Clock::now() - start ).count();
+
+		if ( secs < best ) best = secs;
+	}
+
+	return best * 1e9 / points;
+}
+
+// bench_record [POINTS]
+int main( int argc, char** argv ) {
+	GC_INIT();
+
+	size_t n = argc > 1 ? std::strtoul( argv[1], nullptr, 10 ) : 100000;
+
+	Evaluator::setJittingThreshold( 1 );
+
+	GlobalScope scope;
+
+	for ( ast::DefinePtr def : Analyzer::definitions( Analyzer::analyze( Reader::read( "(defrecord point x y z)" ), &scope ) ) ) {
+		scope.add( def->location, def->name, def, Evaluator::evaluate( def->expr, &scope ) );
+	}
+
+	#define GLOBAL( NAME, BODY ) ({ 						\
+		auto ast = Analyzer::analyze( Reader::read( BODY ), &scope ); \
+		scope.add( SourceLocation("*bench*"), NAME, ast, Evaluator::evaluate( ast, &scope ) ); \
+	})
+
+	GLOBAL( "lists",   LISTS   );
+	GLOBAL( "records", RECORDS );
+	GLOBAL( "last-l",  LAST_L  );
+	GLOBAL( "last-r",  LAST_R  );
+
+	std::string size = std::to_string( n );
+
+	GLOBAL( "ls", ("(lists 0 "   + size + " nil)").c_str() );
+	GLOBAL( "rs", ("(records 0 " + size + " nil)").c_str() );
+
+	auto l = Analyzer::analyze( Reader::read( "(last-l ls nil)" ), &scope );
+	auto r = Analyzer::analyze( Reader::read( "(last-r rs nil)" ), &scope );
+
+	std::printf( ">>> RECORDS (%zu points, ns per point)\n", n );
+	std::printf( "car/cdr %8.2f\n", run( l, &scope, n ) );
+	std::printf( "fields  %8.2f\n", run( r, &scope, n ) );
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+#include "lllm/Vm.hpp"
+#include "lllm/Evaluator.hpp"
+#include "lllm/Jit.hpp"
+#include "lllm/value/Value.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace lllm;
+using namespace lllm::util;
+
+typedef std::chrono::steady_clock Clock;
+
+// every tenant loads the same library, then serves a few requests with its own data
+static CStr PRELUDE =
+	"(define fib   (lambda fib (n) (if (< n 2) n (+ (fib (- n 2)) (fib (- n 1))))))"
+	"(define range (lambda range (n acc) (if (< n 1) acc (range (- n 1) (cons n acc)))))"
+	"(define len   (lambda len (l n) (if l (len (cdr l) (+ n 1)) n)))";
+
+static CStr REQUEST = "(+ (fib 12) (len (range 200 nil) 0))";
+
+static const int REQUESTS = 20;
+
+// bench_tenants [TENANTS]
+int main( int argc, char** argv ) {
+	GC_INIT();
+
+	size_t tenants = argc > 1 ? std::strtoul( argv[1], nullptr, 10 ) : 500;
+
+	Evaluator::setJittingThreshold( 5 );
+
+	std::vector<std::unique_ptr<Vm>> vms;
+
+	size_t heapBefore = GC_get_heap_size();
+	auto   start      = Clock::now();
+
+	for ( size_t i = 0; i < tenants; i++ ) {
+		vms.emplace_back( new Vm() );
+		vms.back()->evaluate( PRELUDE );
+		vms.back()->evaluate( ("(define id " + std::to_string( i ) + ")").c_str() );
+	}
+
+	double setup = std::chrono::duration<double>( Clock::now() - start ).count();
+
+	start = Clock::now();
+
+	for ( int r = 0; r < REQUESTS; r++ ) {
+		for ( auto& vm : vms ) vm->evaluate( REQUEST );
+	}
+
+	double serve = std::chrono::duration<double>( Clock::now() - start ).count();
+
+	Jit::Stats stats = Jit::stats();
+
+	std::printf( ">>> TENANTS %zu\n", tenants );
+	std::printf( "setup       %8.3fs  %8.0f us per tenant\n", setup, setup * 1e6 / tenants );
+	std::printf( "requests    %8.3fs  %8.0f requests/s\n", serve, tenants * REQUESTS / serve );
+	std::printf( "heap growth %8zu KB  %8zu bytes per tenant\n", (GC_get_heap_size() - heapBefore) / 1024, (GC_get_heap_size() - heapBefore) / tenants );
+	std::printf( "functions   %8zu compiled, %zu shared (%zu KB of code, %zu KB not generated)\n",
+	             stats.compiled, stats.shared, stats.codeBytes / 1024, stats.sharedBytes / 1024 );
+
+	return 0;
+}
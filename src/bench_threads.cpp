@@ -0,0 +1,94 @@
+#include "lllm/Reader.hpp"
+#include "lllm/Analyzer.hpp"
+#include "lllm/Evaluator.hpp"
+#include "lllm/GlobalScope.hpp"
+#include "lllm/Jit.hpp"
+#include "lllm/value/Value.hpp"
+#include "lllm/value/Gc.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace lllm;
+using namespace lllm::value;
+using namespace lllm::util;
+
+typedef std::chrono::steady_clock Clock;
+
+// requests per thread, every thread does the same amount of work
+static const int REQUESTS = 200;
+
+static CStr FIB   = "(lambda fib (n) (if (< n 2) n (+ (fib (- n 2)) (fib (- n 1)))))";
+static CStr RANGE = "(lambda range (n acc) (if (< n 1) acc (range (- n 1) (cons n acc))))";
+static CStr LEN   = "(lambda len (l n) (if l (len (cdr l) (+ n 1)) n))";
+
+// a request computes a little and allocates a little, all threads share the globals
+static CStr REQUEST = "(+ (fib 12) (len (range 500 nil) 0))";
+
+// seconds for all threads to finish their requests
+static double run( size_t threads, ast::AstPtr request, GlobalScopePtr scope ) {
+	std::vector<std::thread> workers;
+
+	auto start = Clock::now();
+
+	for ( size_t i = 0; i < threads; i++ ) {
+		workers.emplace_back( [=]() {
+			Gc::Thread registered;
+
+			for ( int r = 0; r < REQUESTS; r++ ) Evaluator::evaluate( request, scope );
+		} );
+	}
+	for ( auto& w : workers ) w.join();
+
+	return std::chrono::duration<double>( Clock::now() - start ).count();
+}
+
+// bench_threads [MAX_THREADS]
+int main( int argc, char** argv ) {
+	GC_INIT();
+	Gc::enableThreads();
+
+	size_t maxThreads = argc > 1 ? std::strtoul( argv[1], nullptr, 10 ) : std::thread::hardware_concurrency();
+	if ( maxThreads < 1 ) maxThreads = 1;
+
+	GlobalScope scope;
+
+	#define GLOBAL( NAME, BODY ) ({ 						\
+		auto ast = Analyzer::analyze( Reader::read( BODY ), &scope ); \
+		scope.add( SourceLocation("*bench*"), NAME, ast, Evaluator::evaluate( ast, &scope ) ); \
+	})
+
+	GLOBAL( "fib",   FIB   );
+	GLOBAL( "range", RANGE );
+	GLOBAL( "len",   LEN   );
+
+	auto request = Analyzer::analyze( Reader::read( REQUEST ), &scope );
+
+	// powers of two and the maximum
+	std::vector<size_t> counts;
+	for ( size_t threads = 1; threads < maxThreads; threads *= 2 ) counts.push_back( threads );
+	counts.push_back( maxThreads );
+
+	std::printf( ">>> THREADS (%d requests per thread)\n", REQUESTS );
+
+	for ( int jit = 0; jit <= 1; jit++ ) {
+		// the interpreter first, then compiled code (the first requests compile it)
+		Evaluator::setJittingThreshold( jit ? 5 : 999999999 );
+
+		double base = 0;
+
+		for ( size_t threads : counts ) {
+			double secs = run( threads, request, &scope );
+			double rate = threads * REQUESTS / secs;
+
+			if ( threads == 1 ) base = rate;
+
+			std::printf( "%-5s %3zu threads %8.3fs %10.0f requests/s  %5.2fx\n", jit ? "jit" : "eval", threads, secs, rate, rate / base );
+		}
+	}
+
+	return 0;
+}
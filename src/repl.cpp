@@ -7,15 +7,20 @@
 #include "lllm/Analyzer.hpp"
 #include "lllm/Evaluator.hpp"
 #include "lllm/Jit.hpp"
+#include "lllm/JitCache.hpp"
 #include "lllm/Builtins.hpp"
+#include "lllm/Loader.hpp"
+#include "lllm/Image.hpp"
 
 #include "lllm/sexpr/SexprIO.hpp"
 #include "lllm/ast/AstIO.hpp"
 #include "lllm/value/ValueIO.hpp"
 
+#include <chrono>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <cstring>
 
 #include <map>
 
@@ -40,14 +45,114 @@ CStr argsString( int argc, char** argv ) {
 	return cs;
 }
 
-int main( int argc, char** argv ) {
-	std::cout << "Starting LLLM REPL" << std::endl;		
-	std::cout << ">> " << std::flush;
+// repl --load [--time] [--cache] [--image IMAGE] [--save-image IMAGE] [--jit-cache CACHE] FILE...
+// loads the files one after another without printing anything but errors.
+// the scope starts out as the contents of --image and is saved to --save-image at the end,
+// functions jitted in earlier runs with the same --jit-cache are compiled on their first call
+int load( int argc, char** argv ) {
+	GlobalScope scope;
+	Loader      loader( &scope );
+
+	bool timing    = false;
+	CStr imageIn   = nullptr;
+	CStr imageOut  = nullptr;
+	CStr jitCache  = nullptr;
+
+	for ( ; argc > 0 && strncmp( argv[0], "--", 2 ) == 0; argc--, argv++ ) {
+		if ( strcmp( argv[0], "--time" ) == 0 ) {
+			timing = true;
+		} else if ( strcmp( argv[0], "--cache" ) == 0 ) {
+			loader.setCaching( true );
+		} else if ( strcmp( argv[0], "--image" ) == 0 && argc > 1 ) {
+			imageIn = (++argv)[0];
+			argc--;
+		} else if ( strcmp( argv[0], "--save-image" ) == 0 && argc > 1 ) {
+			imageOut = (++argv)[0];
+			argc--;
+		} else if ( strcmp( argv[0], "--jit-cache" ) == 0 && argc > 1 ) {
+			jitCache = (++argv)[0];
+			argc--;
+		} else {
+			std::cerr << "Unknown option " << argv[0] << std::endl;
+			return 1;
+		}
+	}
+
+	loader.setTiming( timing );
+
+	if ( jitCache ) {
+		JitCache::setEnabled( true );
+		// a missing cache is created at the end
+		JitCache::load( jitCache );
+	}
+
+	if ( imageIn ) {
+		auto start = std::chrono::steady_clock::now();
+
+		if ( !Image::restore( imageIn, &scope ) ) {
+			std::cerr << "Could not restore image " << imageIn << std::endl;
+			return 1;
+		}
+
+		if ( timing ) {
+			auto ms = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start ).count();
+			std::cerr << imageIn << ": restored in " << ms << "ms" << std::endl;
+		}
+	}
+
+	size_t errors = 0;
+
+	for ( int i = 0; i < argc; i++ ) {
+		Loader::Stats stats = loader.loadFile( argv[i] );
+
+		errors += stats.errors;
+
+		if ( timing ) {
+			std::cerr << argv[i] << ": " << stats.forms << " forms" << (stats.cached ? " (cached)" : "") << ", " << stats.errors << " errors, ";
+			std::cerr << "read "     << (stats.readNs     / 1000000) << "ms, ";
+			std::cerr << "analyze "  << (stats.analyzeNs  / 1000000) << "ms, ";
+			std::cerr << "evaluate " << (stats.evaluateNs / 1000000) << "ms" << std::endl;
+		}
+	}
+
+	if ( timing ) {
+		Jit::Stats jit = Jit::stats();
+		std::cerr << "jit: " << jit.compiled << " functions compiled (" << jit.codeBytes << " bytes), ";
+		std::cerr << jit.shared << " shared (" << jit.sharedBytes << " bytes saved)" << std::endl;
+	}
+
+	if ( jitCache && !JitCache::save( jitCache ) ) {
+		std::cerr << "Could not save JIT cache " << jitCache << std::endl;
+		return 1;
+	}
+
+	if ( imageOut ) {
+		auto start = std::chrono::steady_clock::now();
+
+		if ( !Image::save( &scope, imageOut ) ) {
+			std::cerr << "Could not save image " << imageOut << std::endl;
+			return 1;
+		}
+
+		if ( timing ) {
+			auto ms = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start ).count();
+			std::cerr << imageOut << ": saved in " << ms << "ms" << std::endl;
+		}
+	}
 
+	return errors ? 1 : 0;
+}
+
+int main( int argc, char** argv ) {
 	Evaluator::setJittingThreshold( 5 );
 
 	Jit::setInliningThreshold( 10 );
 
+	if ( argc > 1 && strcmp( argv[1], "--load" ) == 0 ) return load( argc - 2, argv + 2 );
+
+	std::cout << "Starting LLLM REPL" << std::endl;		
+	std::cout << ">> " << std::flush;
+
 	GlobalScope scope;
 
 	Reader r = argc <= 1 ? Reader::fromStdin() : Reader::fromString( argsString( argc, argv ) );
@@ -65,13 +170,17 @@ int main( int argc, char** argv ) {
 
 		std::cout << "AST:   " << std::flush << ast << std::endl;
 
-		if ( ast::DefinePtr def = dynamic_cast<ast::DefinePtr>( ast ) ) {
+		Analyzer::Definitions defs = Analyzer::definitions( ast );
+
+		for ( ast::DefinePtr def : defs ) {
 			value::ValuePtr val = Evaluator::evaluate( def->expr, &scope );	
 
-			scope.add( def->location, def->name, ast, val );
+			scope.add( def->location, def->name, def, val );
 
 			std::cout << "DEFINED " << def->name << " TO " << val << std::endl;			
-		} else {
+		}
+
+		if ( defs.empty() ) {
 			value::ValuePtr val = Evaluator::evaluate( ast, &scope );
 
 			if ( val == Builtins::CLEAR_MARK ) {
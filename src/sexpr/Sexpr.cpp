@@ -2,8 +2,12 @@
 #include "lllm/sexpr/Sexpr.hpp"
 #include "lllm/util/fail.hpp"
 
+#include <gc_allocator.h>
+
+#include <algorithm>
 #include <cstring>
 #include <iostream>
+#include <vector>
 
 using namespace lllm;
 using namespace lllm::sexpr;
@@ -27,15 +31,33 @@ using namespace lllm::util;
 #include "lllm/sexpr/Sexpr_concrete.inc"
 
 
-size_t        sexpr::length( ListPtr l )         { return l->value.size();  }
-SexprIterator sexpr::begin( ListPtr l )          { return l->value.begin(); }
-SexprIterator sexpr::end( ListPtr l)             { return l->value.end();   }
-SexprPtr      sexpr::at( ListPtr l, size_t idx ) { return l->value[idx];    }
+template<typename T>
+static T* makeItems( util::Arena* arena, const SourceLocation& loc, const SexprPtr* items, size_t length ) {
+	size_t bytes = sizeof(T) + length * sizeof(SexprPtr);
+	char*  mem   = (char*) (arena ? arena->alloc( bytes ) : GC_MALLOC( bytes ));
+
+	SexprPtr* copy = (SexprPtr*) (mem + sizeof(T));
+	std::copy( items, items + length, copy );
+
+	return new (mem) T( loc, ListItems{ copy, length } );
+}
+
+ListPtr sexpr::makeList( util::Arena* arena, const SourceLocation& loc, const SexprPtr* items, size_t length ) {
+	return makeItems<List>( arena, loc, items, length );
+}
+VectorPtr sexpr::makeVector( util::Arena* arena, const SourceLocation& loc, const SexprPtr* items, size_t length ) {
+	return makeItems<Vector>( arena, loc, items, length );
+}
+
+size_t        sexpr::length( ListPtr l )         { return l->value.length; }
+SexprIterator sexpr::begin( ListPtr l )          { return l->value.items; }
+SexprIterator sexpr::end( ListPtr l)             { return l->value.items + l->value.length; }
+SexprPtr      sexpr::at( ListPtr l, size_t idx ) { return l->value.items[idx]; }
 SexprPtr      sexpr::last( ListPtr l ) {
-	if ( l->value.empty() ) 
+	if ( l->value.length == 0 ) 
 		LLLM_FAIL( "LIST IS EMPTY" );
 
-	return l->value.back();
+	return l->value.items[l->value.length - 1];
 }
 
 bool lllm::operator!=( const sexpr::Sexpr& a, const sexpr::Sexpr& b ) {
@@ -55,6 +77,7 @@ bool sexpr::equal( SexprPtr a, SexprPtr b ) {
 		bool visit( StringPtr a, SexprPtr b ) const { return false; }
 		bool visit( SymbolPtr a, SexprPtr b ) const { return false; }
 		bool visit( ListPtr   a, SexprPtr b ) const { return false; }
+		bool visit( VectorPtr a, SexprPtr b ) const { return false; }
 
 		bool visit( IntPtr    a, IntPtr    b ) const { return a->value == b->value; }
 		bool visit( RealPtr   a, IntPtr    b ) const { return a->value == b->value; }
@@ -63,14 +86,14 @@ bool sexpr::equal( SexprPtr a, SexprPtr b ) {
 		bool visit( CharPtr   a, CharPtr   b ) const { return a->value == b->value; }
 		bool visit( StringPtr a, StringPtr b ) const { return std::strcmp( a->value, b->value ) == 0; }
 		bool visit( SymbolPtr a, SymbolPtr b ) const { return a->value == b->value; }
-		bool visit( ListPtr   a, ListPtr   b ) const {
-			if ( length( a ) != length( b ) ) return false;
+		bool visit( ListPtr   a, ListPtr   b ) const { return items( a->value, b->value ); }
+		bool visit( VectorPtr a, VectorPtr b ) const { return items( a->value, b->value ); }
 
-			auto aIt = begin( a );
-			auto bIt = begin( b );
+		static bool items( const ListItems& a, const ListItems& b ) {
+			if ( a.length != b.length ) return false;
 
-			for ( auto end = sexpr::end( a ); aIt != end; ++aIt, ++bIt ) {
-				if ( **aIt != **bIt ) return false;
+			for ( size_t i = 0; i < a.length; i++ ) {
+				if ( *a.items[i] != *b.items[i] ) return false;
 			}
 			return true;
 		}
@@ -82,6 +105,7 @@ bool sexpr::equal( SexprPtr a, SexprPtr b ) {
 		bool visit( StringPtr a, SexprPtr b ) const { return b->visit<bool>( V1(), a ); }
 		bool visit( SymbolPtr a, SexprPtr b ) const { return b->visit<bool>( V1(), a ); }
 		bool visit( ListPtr   a, SexprPtr b ) const { return b->visit<bool>( V1(), a ); }
+		bool visit( VectorPtr a, SexprPtr b ) const { return b->visit<bool>( V1(), a ); }
 	};
 
 	return a->visit<bool>( V2(), b );
@@ -91,7 +115,7 @@ static inline SourceLocation loc() {
 	return SourceLocation("*test*");
 }
 
-static List NIL( SourceLocation("*test*"), SexprVector() );
+static List NIL( SourceLocation("*test*"), ListItems{ nullptr, 0 } );
 
 SexprPtr  sexpr::nil = &NIL;
 IntPtr    sexpr::number( int    value )                { return new Int( SourceLocation("*test*"), value );     }
@@ -101,15 +125,12 @@ RealPtr   sexpr::number( double value )                { return new Real( Source
 CharPtr   sexpr::character( char value )               { return new Char( SourceLocation("*test*"), value );    }
 StringPtr sexpr::string( CStr value )                  { return new String( SourceLocation("*test*"), value );  }
 SymbolPtr sexpr::symbol( const InternedString& value ) { return new Symbol( SourceLocation("*test*"), value );  }
-ListPtr   sexpr::list()                                { return new List( SourceLocation("*test*"), SexprVector() ); }
+ListPtr   sexpr::list()                                { return makeList( nullptr, SourceLocation("*test*"), nullptr, 0 ); }
 ListPtr   sexpr::cons( SexprPtr car, ListPtr cdr )     {
-	std::vector<SexprPtr> exprs;
+	std::vector<SexprPtr, traceable_allocator<SexprPtr>> exprs;
 
 	exprs.push_back( car );
-	for ( auto it = begin( cdr ), end = sexpr::end( cdr ); it != end; ++it ) {
-		exprs.push_back( *it );
-	}
+	exprs.insert( exprs.end(), begin( cdr ), end( cdr ) );
 
-	return new List( SourceLocation("*test*"), exprs );
+	return makeList( nullptr, SourceLocation("*test*"), exprs.data(), exprs.size() );
 }
-
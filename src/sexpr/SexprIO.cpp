@@ -44,6 +44,13 @@ std::ostream& lllm::operator<<( std::ostream& os, SexprPtr expr ) {
 
 			os << ')';
 		}
+		void visit( VectorPtr expr, std::ostream& os ) const {
+			os << "#(";
+
+			for ( size_t i = 0; i < expr->value.length; i++ ) os << (i ? " " : "") << expr->value.items[i];
+
+			os << ')';
+		}
 		void visit( SexprIterator it, const SexprIterator end, std::ostream& os ) const {
 			if ( it != end ) {
 				os << ' ' << *it;
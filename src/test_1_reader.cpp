@@ -1,9 +1,13 @@
 
 #include "lllm/Reader.hpp"
 #include "lllm/sexpr/SexprIO.hpp"
+#include "lllm/util/fail.hpp"
 
 #include <cassert>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <string>
 
 using namespace lllm;
 using namespace lllm::sexpr;
@@ -43,6 +47,52 @@ int main() {
 	TEST( " 8", ==, "(1)",      list( number( 1 ) ) );
 	TEST( " 9", ==, "(() ())",  list( nil, nil ) );
 	TEST( "10", ==, "(1 ())",   list( number( 1 ), nil ) );
+	TEST( "11", ==, "1_000",    number( 1000 ) );
+	TEST( "12", ==, "; x\n2",   number( 2 ) );
+
+	SexprPtr items[] = { number( 1 ), list( number( 2 ) ) };
+	TEST( "13", ==, "#(1 (2))", makeVector( nullptr, util::SourceLocation( "*test*" ), items, 2 ) );
+	TEST( "14", !=, "#(1 (2))", list( number( 1 ), list( number( 2 ) ) ) );
+	TEST( "15", ==, "#a",       symbol( "#a" ) );
+
+	// trees of a reader instance live in its arena until the next read
+	Reader r = Reader::fromString( "(a \"b\" 'c) (1.5 \\x)" );
+	if ( *r.read() == *list( symbol( "a" ), string( "b" ), list( symbol( "quote" ), symbol( "c" ) ) ) &&
+	     *r.read() == *list( number( 1.5 ), character( 'x' ) ) && !r.read() ) {
+		testsPassed++;
+	} else {
+		std::cout << "Test: arena failed" << std::endl;
+	}
+	testsRun++;
+
+	// ints that do not fit are an error, reals with as many digits are not
+	TEST( "16", ==, "9_223_372_036_854_775_807", number( 9223372036854775807L ) );
+	TEST( "17", ==, "92233720368547758070.5",    number( 92233720368547758070.5 ) );
+	try {
+		util::CatchFailures catching;
+		Reader::read( "(1 92233720368547758070)" );
+
+		std::cout << "Test: int overflow failed: read a literal that is too large" << std::endl;
+	} catch ( const util::Failure& f ) {
+		if ( f.message.find( ":1:3: Integer literal '92233720368547758070' is too large" ) != std::string::npos ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: int overflow failed: " << f.message << std::endl;
+		}
+	}
+	testsRun++;
+
+	// files are mapped and lexed in place
+	util::CStr file = "/tmp/lllm_test_reader.lll";
+	std::ofstream( file ) << "(foo 1_0.25)\n; comment at the end";
+	Reader f = Reader::fromFile( file );
+	if ( *f.read() == *list( symbol( "foo" ), number( 10.25 ) ) && !f.read() ) {
+		testsPassed++;
+	} else {
+		std::cout << "Test: file failed" << std::endl;
+	}
+	testsRun++;
+	std::remove( file );
 
 	std::cout << ">>> READER PASSED " << testsPassed << " TESTS OUT OF " << testsRun << std::endl;
 
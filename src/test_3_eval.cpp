@@ -3,13 +3,32 @@
 #include "lllm/Analyzer.hpp"
 #include "lllm/Evaluator.hpp"
 #include "lllm/GlobalScope.hpp"
+#include "lllm/Loader.hpp"
+#include "lllm/AstCache.hpp"
+#include "lllm/Image.hpp"
+#include "lllm/Vm.hpp"
+#include "lllm/Fiber.hpp"
 #include "lllm/sexpr/SexprIO.hpp"
 #include "lllm/ast/AstIO.hpp"
 #include "lllm/value/ValueIO.hpp"
+#include "lllm/value/Telemetry.hpp"
+#include "lllm/value/HashCons.hpp"
+#include "lllm/value/Gc.hpp"
+#include "lllm/value/Kernels.hpp"
 #include "lllm/util/util_io.hpp"
+#include "lllm/util/fail.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 using namespace lllm;
 using namespace lllm::value;
@@ -62,10 +81,604 @@ int main() {
 	TEST( "const lambda",  ==, "(((lambda const (x) (lambda (y) x)) 'x) 'y)",  symbol("x") );
 	TEST( "recursion",     ==, "((lambda sum (a b) (if (= a 0) b (sum (- a 1) (+ 1 b)))) 5 5)", number( 10 ) );
 	TEST( "fib",           ==, "((lambda fib (n) (if (< n 2) n (+ (fib (- n 2)) (fib (- n 1))))) 6)", number(8) );
+	TEST( "eq",            ==, "(eq 'abba 'abba)",   number( 1 ) );
+	TEST( "unique symbol", ==, "(eq 'abba 'baab)",   nil );
 	TEST( "tail_fib",      ==, "((lambda tail_fib (n result next) (if (= n 0) result (tail_fib (- n 1) next (+ result next)))) 8 0 1)", number(21) );
 
 	TEST("xxx", ==, "((lambda sum (a b) (if (<= a 0) b (let (a (- a 1)) (b (+ 1 b)) (if (<= a 0) b (sum (- a 1) (+ 1 b)))))) 5 6)", number(11) );
 
+	Telemetry::enable( true );
+	Telemetry::reset();
+	Evaluator::evaluate( Analyzer::analyze( Reader::read( "(cons 1.5 (cons 2.5 nil))" ), &scope ), &scope );
+	if ( Telemetry::allocations( Type::Cons ).count == 2 && Telemetry::allocations( Type::Real ).count == 2 ) {
+		testsPassed++;
+	} else {
+		std::cout << "Test: telemetry failed: counted " << Telemetry::allocations( Type::Cons ).count << " conses and ";
+		std::cout << Telemetry::allocations( Type::Real ).count << " reals, should be 2 and 2" << std::endl;
+	}
+	testsRun++;
+	Telemetry::enable( false );
+
+	auto loop = Analyzer::analyze( Reader::read( "((lambda loop (n) (if (= n 0) n (do \"abc\" 2.5 \\x (loop (- n 1))))) 10)" ), &scope );
+	Telemetry::enable( true );
+	Telemetry::reset();
+	Evaluator::evaluate( loop, &scope );
+	if ( Telemetry::allocations( Type::String ).count + Telemetry::allocations( Type::Real ).count + Telemetry::allocations( Type::Char ).count == 0 ) {
+		testsPassed++;
+	} else {
+		std::cout << "Test: constant pool failed: evaluating literals allocated" << std::endl;
+	}
+	testsRun++;
+	Telemetry::enable( false );
+
+	// string literals are copied out of the reader's arena
+	Reader r = Reader::fromString( "\"abc\" 1" );
+	auto str = Analyzer::analyze( r.read(), &scope );
+	r.read();
+	if ( *Evaluator::evaluate( str, &scope ) == *string( "abc" ) ) {
+		testsPassed++;
+	} else {
+		std::cout << "Test: arena failed: string literal did not survive the arena" << std::endl;
+	}
+	testsRun++;
+
+	HashCons::enable( true );
+	auto a = Evaluator::evaluate( Analyzer::analyze( Reader::read( "(cons 1 (cons 2.5 (quote (a \"b\"))))" ), &scope ), &scope );
+	auto b = Evaluator::evaluate( Analyzer::analyze( Reader::read( "(cons 1 (cons 2.5 (quote (a \"b\"))))" ), &scope ), &scope );
+	if ( a == b && equal( a, b ) && HashCons::stats().shared >= 2 ) {
+		testsPassed++;
+	} else {
+		std::cout << "Test: hash consing failed: " << a << " and " << b << " are not shared" << std::endl;
+	}
+	testsRun++;
+	HashCons::enable( false );
+
+	// an error in one form does not stop the loader
+	Loader loader( &scope );
+	size_t reported = 0;
+	loader.setErrorHandler( [&]( const Loader::Error& ) { reported++; } );
+	Reader src = Reader::fromString( "(define loaded1 1) (undefined-fn 2) (define loaded2 (+ loaded1 1))" );
+	Loader::Stats stats = loader.load( src );
+	value::ValuePtr loaded;
+	if ( stats.forms == 3 && stats.errors == 1 && reported == 1 &&
+	     scope.lookup( "loaded2", &loaded ) && *loaded == *number( 2 ) ) {
+		testsPassed++;
+	} else {
+		std::cout << "Test: loader failed: " << stats.forms << " forms, " << stats.errors << " errors" << std::endl;
+	}
+	testsRun++;
+
+	// the second load reads the AST cache written by the first
+	{
+		util::CStr  src   = "/tmp/lllm_test_cache.lll";
+		std::string cache = AstCache::pathFor( src );
+		std::remove( cache.c_str() );
+		std::ofstream( src ) << "(define k 3)\n"
+		                        "(define mk (lambda (n) (let (m (+ n k)) (lambda () (cons m (quote (a \"b\" 2.5)))))))\n"
+		                        "(define cached ((mk 1)))\n"
+		                        "(defrecord cell v)\n"
+		                        "(define boxed (cell-v (make-cell cached)))\n";
+
+		GlobalScope first, second;
+		Loader      writer( &first ), reader( &second );
+		writer.setCaching( true );
+		reader.setCaching( true );
+
+		Loader::Stats written = writer.loadFile( src );
+		Loader::Stats read    = reader.loadFile( src );
+
+		value::ValuePtr a, b;
+		if ( !written.cached && read.cached && read.forms == 5 && !read.errors &&
+		     first.lookup( "cached", &a ) && second.lookup( "cached", &b ) && equal( a, b ) &&
+		     second.lookup( "boxed", &b ) && equal( a, b ) ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: ast cache failed" << std::endl;
+		}
+		testsRun++;
+
+		std::remove( src );
+		std::remove( cache.c_str() );
+	}
+
+	// a restored image binds the same values, closures and refs keep working
+	{
+		util::CStr image = "/tmp/lllm_test_image.img";
+
+		GlobalScope saved, restored;
+		Loader      loader( &saved );
+		Reader      src = Reader::fromString( "(define counter (ref))\n"
+		                                      "(define old (set counter 0))\n"
+		                                      "(define loop (ref))\n"
+		                                      "(define tie (set loop loop))\n"
+		                                      "(define bump (lambda () (set counter (+ (get counter) 1))))\n"
+		                                      "(define add (lambda (n) (lambda (m) (+ n m))))\n"
+		                                      "(define add2 (add 2))\n"
+		                                      "(define data (quote (a \"b\" 2.5 \\c)))\n"
+		                                      "(define first car)\n"
+		                                      "(define vec (make-vector 2 1))\n"
+		                                      "(define knot (vector-set! vec 0 vec))\n"
+		                                      "(define reals (list->f64vector '(1.5 2.5)))\n"
+		                                      "(define table (make-hash-table))\n"
+		                                      "(define entry (hash-set! table '(k) table))\n"
+		                                      "(defrecord point3 x y z)\n"
+		                                      "(define pt (make-point3 1 'b \"c\"))\n" );
+		Loader::Stats stats = loader.load( src );
+
+		value::ValuePtr data, first, result, count, loop, vec, reals, table, pt, z;
+		bool ok = !stats.errors && Image::save( &saved, image ) && Image::restore( image, &restored );
+
+		Evaluator::evaluate( Analyzer::analyze( Reader::read( "(bump)" ), &restored ), &restored );
+		result = Evaluator::evaluate( Analyzer::analyze( Reader::read( "(add2 (get counter))" ), &restored ), &restored );
+		z      = Evaluator::evaluate( Analyzer::analyze( Reader::read( "(point3-z pt)" ), &restored ), &restored );
+
+		if ( ok && restored.lookup( "data", &data ) && saved.lookup( "data", &first ) && equal( data, first ) &&
+		     restored.lookup( "first", &first ) && saved.lookup( "first", &count ) && first == count &&
+		     *result == *number( 3 ) && saved.lookup( "counter", &count ) && *Value::asRef( count )->get() == *number( 0 ) &&
+		     restored.lookup( "loop", &loop ) && Value::asRef( loop )->get() == loop &&
+		     restored.lookup( "vec", &vec ) && Value::asVector( vec )->elements[0] == vec && *Value::asVector( vec )->elements[1] == *number( 1 ) &&
+		     restored.lookup( "reals", &reals ) && saved.lookup( "reals", &first ) && equal( reals, first ) && reals != first &&
+		     restored.lookup( "table", &table ) && Value::asHashTable( table )->lookup( list( symbol( "k" ) ), &first ) && first == table &&
+		     restored.lookup( "pt", &pt ) && saved.lookup( "pt", &first ) && equal( pt, first ) && pt != first && *z == *string( "c" ) &&
+		     restored.lookup( "point3-x", &first ) && saved.lookup( "point3-x", &count ) && first == count ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: image failed" << std::endl;
+		}
+		testsRun++;
+
+		std::remove( image );
+	}
+
+	// threads evaluate with the same globals while another one defines new ones
+	{
+		Gc::enableThreads();
+
+		GlobalScope shared;
+		auto fib = Analyzer::analyze( Reader::read( "(lambda fib (n) (if (< n 2) n (+ (fib (- n 2)) (fib (- n 1)))))" ), &shared );
+		shared.add( SourceLocation( "*test*" ), "fib", fib, Evaluator::evaluate( fib, &shared ) );
+
+		auto call = Analyzer::analyze( Reader::read( "(fib 12)" ), &shared );
+
+		std::vector<std::thread> threads;
+		std::vector<int>         wrong( 4, 0 );
+		for ( size_t t = 0; t < wrong.size(); t++ ) {
+			threads.emplace_back( [&, t]() {
+				Gc::Thread registered;
+
+				for ( int i = 0; i < 20; i++ ) {
+					if ( !(*Evaluator::evaluate( call, &shared ) == *number( 144 )) ) wrong[t]++;
+				}
+			} );
+		}
+
+		for ( long i = 0; i < 1000; i++ ) {
+			shared.add( SourceLocation( "*test*" ), ("g" + std::to_string( i )).c_str(), nullptr, number( i ) );
+		}
+		for ( auto& t : threads ) t.join();
+
+		bool ok = true;
+		for ( long i = 0; i < 1000; i++ ) {
+			value::ValuePtr val;
+			ok = ok && shared.lookup( ("g" + std::to_string( i )).c_str(), &val ) && *val == *number( i );
+		}
+		for ( int w : wrong ) ok = ok && !w;
+
+		if ( ok ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: threads failed" << std::endl;
+		}
+		testsRun++;
+	}
+
+	// tasks run on the scheduler's workers with the globals of the evaluation that made them
+	TEST( "future",        ==, "(touch (future (lambda () (+ 20 22))))", number( 42 ) );
+	TEST( "touch value",   ==, "(touch 5)", number( 5 ) );
+	TEST( "pmap",          ==, "(pmap (lambda (x) (* x x)) '(1 2 3 4))", list( number( 1 ), number( 4 ), number( 9 ), number( 16 ) ) );
+	TEST( "pmap nil",      ==, "(pmap (lambda (x) x) nil)", nil );
+
+	auto range = Analyzer::analyze( Reader::read( "(lambda range (n acc) (if (< n 1) acc (range (- n 1) (cons n acc))))" ), &scope );
+	scope.add( SourceLocation( "*test*" ), "range", range, Evaluator::evaluate( range, &scope ) );
+
+	TEST( "pmap order",    ==, "(= (pmap (lambda (x) (- 0 x)) (range 2000 nil)) ((lambda neg (l) (if l (cons (- 0 (car l)) (neg (cdr l))) nil)) (range 2000 nil)))", number( 1 ) );
+	TEST( "preduce",       ==, "(preduce + 0 (range 2000 nil))", number( 2001000 ) );
+	TEST( "preduce empty", ==, "(preduce + 0 nil)", number( 0 ) );
+
+	// a failing task fails whoever touches it
+	{
+		bool failed = false;
+		try {
+			CatchFailures catching;
+			Evaluator::evaluate( Analyzer::analyze( Reader::read( "(touch (future (lambda () (car 5))))" ), &scope ), &scope );
+		} catch ( const Failure& f ) {
+			failed = f.message.find( "car" ) != std::string::npos;
+		}
+
+		if ( failed ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: future failure failed" << std::endl;
+		}
+		testsRun++;
+	}
+
+	// green threads
+	TEST( "spawn",         ==, "(touch (spawn (lambda () (+ 20 22))))", number( 42 ) );
+	TEST( "yield",         ==, "(yield)", nil );
+	TEST( "spawn yield",   ==, "(touch (spawn (lambda () (do (yield) (yield) 7))))", number( 7 ) );
+	TEST( "spawn many",    ==, "(touch (spawn (lambda () "
+	                             "((lambda sum (l acc) (if l (sum (cdr l) (+ acc (touch (car l)))) acc)) "
+	                              "((lambda mk (l) (if l (cons (spawn (lambda () (do (yield) (car l)))) (mk (cdr l))) nil)) (range 1000 nil)) 0))))",
+	                           number( 500500 ) );
+
+	// a fiber that never yields is switched out when its fuel runs out.
+	// (fib 20) makes about 20000 calls
+	{
+		size_t before = Fibers::stats().switches;
+
+		ValuePtr val = Evaluator::evaluate( Analyzer::analyze( Reader::read(
+			"(let (long  (spawn (lambda () ((lambda fib (n) (if (< n 2) n (+ (fib (- n 2)) (fib (- n 1))))) 20))))"
+			"     (short (spawn (lambda () 2)))"
+			"  (+ (touch long) (touch short)))"
+		), &scope ), &scope );
+
+		if ( *val == *number( 6767 ) && Fibers::stats().switches >= before + 2 ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: preemption failed" << std::endl;
+		}
+		testsRun++;
+	}
+
+	// channels
+	TEST( "channel",       ==, "(let (c (channel 2)) (do (send c 1) (send c 2) (+ (recv c) (recv c))))", number( 3 ) );
+	TEST( "channel order", ==, "(let (c (channel 4)) (do (send c 1) (send c 2) (send c 3) (cons (recv c) (cons (recv c) (cons (recv c) nil)))))",
+	                           list( number( 1 ), number( 2 ), number( 3 ) ) );
+	TEST( "try-send full", ==, "(let (c (channel 1)) (do (try-send c 1) (try-send c 2)))", nil );
+	TEST( "try-recv",      ==, "(let (c (channel 1)) (do (send c nil) (try-recv c 'empty)))", nil );
+	TEST( "try-recv empty",==, "(try-recv (channel 1) 'empty)", symbol( "empty" ) );
+	{
+		bool failed = false;
+		try {
+			CatchFailures catching;
+			Evaluator::evaluate( Analyzer::analyze( Reader::read( "(channel 9223372036854775807)" ), &scope ), &scope );
+		} catch ( const Failure& f ) {
+			failed = f.message.find( "at most" ) != std::string::npos;
+		}
+
+		if ( failed ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: channel capacity failed" << std::endl;
+		}
+		testsRun++;
+	}
+	TEST( "ping pong",     ==, "(let (ping (channel 1)) (pong (channel 1)) "
+	                             "(do (spawn (lambda () (send pong (+ 1 (recv ping))))) (send ping 41) (recv pong)))", number( 42 ) );
+	// senders block on the small channel until the receiver catches up
+	TEST( "fan in",        ==, "(let (c (channel 4)) "
+	                             "(do ((lambda start (n) (if (= n 0) nil (do (spawn (lambda () ((lambda go (i) (if (> i 100) nil (do (send c i) (go (+ i 1))))) 1))) (start (- n 1))))) 4) "
+	                                 "((lambda sum (n acc) (if (= n 0) acc (sum (- n 1) (+ acc (recv c))))) 400 0)))", number( 20200 ) );
+
+	// vectors
+	{
+		Vector* inner = Vector::alloc( 1, number( 2 ) );
+		Vector* outer = Vector::alloc( 2, number( 1 ) );
+		outer->elements[1] = inner;
+
+		TEST( "vector literal", ==, "#(1 #(2))", outer );
+	}
+	TEST( "make-vector",   ==, "(vector-length (make-vector 5 0))", number( 5 ) );
+	TEST( "vector-ref",    ==, "(vector-ref #(1 (2 3) \\c) 1)", list( number( 2 ), number( 3 ) ) );
+	TEST( "vector-set!",   ==, "(let (v (make-vector 3 nil)) (do (vector-set! v 2 'x) (vector-ref v 2)))", symbol( "x" ) );
+	TEST( "vector equal",  ==, "(= #(1 2) (let (v (make-vector 2 1)) (do (vector-set! v 1 2) v)))", number( 1 ) );
+	// changing a vector does not lose the keys or lists it is in
+	TEST( "vector key",    ==, "(let (v (make-vector 1 0)) (h (make-hash-table)) "
+	                             "(do (hash-set! h (cons v nil) 'found) (vector-set! v 0 1) (hash-ref h (cons #(1) nil) nil)))", symbol( "found" ) );
+	TEST( "vector in list",==, "(let (v (make-vector 1 0)) (h (make-hash-table)) (let (k (cons v nil)) (k2 (cons #(1) nil)) "
+	                             "(do (hash-set! h k 1) (hash-set! h k2 2) (vector-set! v 0 1) (= k k2))))", number( 1 ) );
+	TEST( "vector quoted", ==, "(vector-length (car '(#(a b) c)))", number( 2 ) );
+	{
+		bool failed = false;
+		try {
+			CatchFailures catching;
+			Evaluator::evaluate( Analyzer::analyze( Reader::read( "(vector-ref #(1) 1)" ), &scope ), &scope );
+		} catch ( const Failure& f ) {
+			failed = f.message.find( "out of range" ) != std::string::npos;
+		}
+
+		if ( failed ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: vector range failed" << std::endl;
+		}
+		testsRun++;
+	}
+	for ( CStr src : { "(make-vector 2305843009213693952 0)", "(make-f64vector 2305843009213693952 0)", "(make-i64vector 2305843009213693952 0)" } ) {
+		bool failed = false;
+		try {
+			CatchFailures catching;
+			Evaluator::evaluate( Analyzer::analyze( Reader::read( src ), &scope ), &scope );
+		} catch ( const Failure& f ) {
+			failed = f.message.find( "too large" ) != std::string::npos;
+		}
+
+		if ( failed ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: vector size failed: " << src << std::endl;
+		}
+		testsRun++;
+	}
+
+	// typed vectors
+	TEST( "f64vector",     ==, "(vector-sum (vector-add (list->f64vector '(1 2.5 3)) (make-f64vector 3 1)))", number( 9.5 ) );
+	TEST( "i64vector",     ==, "(vector-dot (list->i64vector '(1 2 3 4 5)) (list->i64vector '(5 4 3 2 1)))", number( 35 ) );
+	TEST( "vector-mul",    ==, "(vector-mul (list->i64vector '(1 2 3)) (list->i64vector '(4 5 6)))", ({
+		I64Vector* v = I64Vector::alloc( 3, 4 );
+		v->elements[1] = 10;
+		v->elements[2] = 18;
+		v;
+	}) );
+	TEST( "vector-scale",  ==, "(vector-ref (vector-scale (make-f64vector 9 1.5) 2) 8)", number( 3.0 ) );
+	TEST( "vector-min",    ==, "(vector-min (list->i64vector '(3 1 4 1 5 9 2 6 5 3 5)))", number( 1 ) );
+	TEST( "vector-max",    ==, "(vector-max (list->f64vector '(3 1 4 1 5 9 2 6 5 3 5)))", number( 9.0 ) );
+	TEST( "typed set!",    ==, "(let (v (make-i64vector 2 7)) (cons (vector-set! v 1 8) (cons (vector-ref v 1) nil)))", list( number( 7 ), number( 8 ) ) );
+	// every set of kernels the cpu has agrees with the scalar ones, the numbers are exact so the order of sums does not matter
+	{
+		const size_t N = 37;
+		double fa[N], fb[N], fout[N], fexpect[N];
+		long   la[N], lb[N], lout[N], lexpect[N];
+
+		for ( size_t i = 0; i < N; i++ ) {
+			fa[i] = double( i ) - 20.5;
+			fb[i] = double( (i * 7) % 11 ) * 0.25;
+			la[i] = long( (i * 13) % 17 ) - 8;
+			lb[i] = long( i ) * 3 - 50;
+		}
+
+		Kernels::Isa original = Kernels::current();
+		Kernels::use( Kernels::Isa::SCALAR );
+
+		Kernels::add( fa, fb, fexpect, N );
+		Kernels::add( la, lb, lexpect, N );
+		double fsum = Kernels::sum( fa, N ), fdot = Kernels::dot( fa, fb, N ), fmin = Kernels::min( fa, N ), fmax = Kernels::max( fb, N );
+		long   lsum = Kernels::sum( la, N ), ldot = Kernels::dot( la, lb, N ), lmin = Kernels::min( la, N ), lmax = Kernels::max( lb, N );
+
+		bool ok = true;
+		for ( Kernels::Isa isa : { Kernels::Isa::SSE2, Kernels::Isa::AVX2 } ) {
+			Kernels::use( isa );
+
+			Kernels::add( fa, fb, fout, N );
+			Kernels::add( la, lb, lout, N );
+			ok = ok && std::equal( fout, fout + N, fexpect ) && std::equal( lout, lout + N, lexpect );
+			ok = ok && Kernels::sum( fa, N ) == fsum && Kernels::dot( fa, fb, N ) == fdot && Kernels::min( fa, N ) == fmin && Kernels::max( fb, N ) == fmax;
+			ok = ok && Kernels::sum( la, N ) == lsum && Kernels::dot( la, lb, N ) == ldot && Kernels::min( la, N ) == lmin && Kernels::max( lb, N ) == lmax;
+		}
+
+		Kernels::use( original );
+
+		if ( ok ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: kernels failed" << std::endl;
+		}
+		testsRun++;
+	}
+
+	// min and max of doubles return the first NaN on every set of kernels, wherever it sits in the lanes or the tail
+	{
+		const size_t N = 37;
+		const double pos = std::numeric_limits<double>::quiet_NaN(), neg = -pos;
+		double a[N];
+
+		Kernels::Isa original = Kernels::current();
+
+		bool ok = true;
+		for ( size_t at : { size_t( 0 ), size_t( 5 ), size_t( 17 ), size_t( 34 ), N - 1 } ) {
+			for ( size_t i = 0; i < N; i++ ) a[i] = double( (i * 7) % 11 ) - 5;
+			a[at] = neg;
+			if ( at + 3 < N ) a[at + 3] = pos;
+
+			for ( Kernels::Isa isa : { Kernels::Isa::SCALAR, Kernels::Isa::SSE2, Kernels::Isa::AVX2 } ) {
+				Kernels::use( isa );
+
+				double lo = Kernels::min( a, N ), hi = Kernels::max( a, N );
+				ok = ok && std::memcmp( &lo, &neg, sizeof( double ) ) == 0 && std::memcmp( &hi, &neg, sizeof( double ) ) == 0;
+			}
+		}
+
+		// without a NaN all sets still agree
+		for ( size_t i = 0; i < N; i++ ) a[i] = double( (i * 7) % 11 ) - 5;
+		for ( Kernels::Isa isa : { Kernels::Isa::SCALAR, Kernels::Isa::SSE2, Kernels::Isa::AVX2 } ) {
+			Kernels::use( isa );
+			ok = ok && Kernels::min( a, N ) == -5 && Kernels::max( a, N ) == 5;
+		}
+
+		Kernels::use( original );
+
+		if ( ok ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: kernels NaN failed" << std::endl;
+		}
+		testsRun++;
+	}
+
+	// hash tables
+	TEST( "hash-set!",     ==, "(let (h (make-hash-table)) (do (hash-set! h 'a 1) (hash-set! h 'b 2) (+ (hash-ref h 'a nil) (hash-ref h 'b nil))))", number( 3 ) );
+	TEST( "hash-ref",      ==, "(hash-ref (make-hash-table) 'a 'none)", symbol( "none" ) );
+	TEST( "hash equal",    ==, "(let (h (make-hash-table)) (do (hash-set! h '(1 \\a) 'x) (hash-set! h 2 'y) (cons (hash-ref h (cons 1 (cons \\a nil)) nil) (cons (hash-ref h 2.0 nil) nil))))",
+	                            list( symbol( "x" ), symbol( "y" ) ) );
+	TEST( "hash-remove!",  ==, "(let (h (make-hash-table)) (do (hash-set! h 'a 1) (cons (hash-remove! h 'a) (cons (hash-count h) (cons (hash-ref h 'a 'gone) nil)))))",
+	                            list( number( 1 ), number( 0 ), symbol( "gone" ) ) );
+	// grows a few times, halfway removes entries while old slots are still being moved
+	TEST( "hash grow",     ==, "(let (h (make-hash-table)) "
+	                             "(do ((lambda fill (i) (if (= i 1000) nil (do (hash-set! h i (* i i)) (if (= (- i (* (/ i 3) 3)) 0) (hash-remove! h (- i 1)) nil) (fill (+ i 1))))) 0) "
+	                                 "(cons (hash-count h) (cons (hash-ref h 999 nil) (cons (hash-ref h 998 nil) (cons (hash-ref h 997 nil) nil))))))",
+	                            list( number( 667 ), number( 998001 ), nullptr, number( 994009 ) ) );
+
+	// random puts and removes agree with std::map, through many resizes
+	{
+		HashTablePtr         table = hashTable();
+		std::map<long, long> expected;
+		unsigned             seed  = 12345;
+		bool                 ok    = true;
+
+		for ( int i = 0; i < 50000 && ok; i++ ) {
+			seed = seed * 1103515245 + 12345;
+			long key = (seed >> 8) % (i < 25000 ? 2000 : 200);
+
+			ValuePtr old;
+			if ( (seed >> 4) % 3 ) {
+				bool had = expected.count( key );
+				old = table->put( number( key ), number( long( i ) ) );
+				ok  = had ? (old && Value::asInt( old )->value == expected[key]) : !old;
+				expected[key] = i;
+			} else {
+				bool had = expected.count( key );
+				ok = table->remove( number( key ), &old ) == had && (!had || Value::asInt( old )->value == expected[key]);
+				expected.erase( key );
+			}
+		}
+		ok = ok && table->size() == expected.size();
+		for ( auto& e : expected ) {
+			ValuePtr v;
+			ok = ok && table->lookup( number( e.first ), &v ) && Value::asInt( v )->value == e.second;
+		}
+
+		if ( ok ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: hash table failed" << std::endl;
+		}
+		testsRun++;
+	}
+
+	// records
+	{
+		Loader records( &scope );
+		size_t failed = 0;
+		records.setErrorHandler( [&]( const Loader::Error& ) { failed++; } );
+		// the same defrecord twice defines the same functions, the others are all errors
+		Reader defs = Reader::fromString( "(defrecord point x y) (defrecord none) (define p1 make-point) (defrecord point x y) "
+		                                  "(defrecord bad x x) (defrecord) ((lambda () (defrecord inner a))) (point-x '(1 2)) (record-accessor 'point '(x y) 'z)" );
+		Loader::Stats stats = records.load( defs );
+
+		value::ValuePtr p1, p2;
+		if ( stats.forms == 9 && stats.errors == 5 && failed == 5 &&
+		     scope.lookup( "p1", &p1 ) && scope.lookup( "make-point", &p2 ) && p1 == p2 ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: defrecord failed: " << stats.forms << " forms, " << stats.errors << " errors" << std::endl;
+		}
+		testsRun++;
+	}
+	TEST( "record fields",  ==, "(let (p (make-point 1 '(2))) (cons (point-x p) (point-y p)))", list( number( 1 ), number( 2 ) ) );
+	TEST( "record?",        ==, "(cons (point? (make-point 1 2)) (cons (point? '(1 2)) (cons (point? (make-none)) (cons (none? (make-none)) nil))))",
+	                            list( True(), nil, nil, True() ) );
+	TEST( "record equal",   ==, "(cons (= (make-point 1 '(2)) (make-point 1.0 '(2))) (cons (= (make-point 1 2) (make-point 2 1)) nil))", list( True(), nil ) );
+	TEST( "record hash",    ==, "(let (h (make-hash-table)) (do (hash-set! h (make-point 1 2) 'found) (hash-ref h (make-point 1 2) nil)))", symbol( "found" ) );
+	{
+		std::ostringstream out;
+		out << Evaluator::evaluate( Analyzer::analyze( Reader::read( "(make-point 1 'a)" ), &scope ), &scope );
+
+		if ( out.str() == "#point(1 a)" ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: record print failed: " << out.str() << std::endl;
+		}
+		testsRun++;
+	}
+
+	// atomic refs
+	TEST( "cas!",          ==, "(let (r (ref)) (do (set r 1) (cas! r 1 2) (get r)))", number( 2 ) );
+	TEST( "cas! fails",    ==, "(let (r (ref)) (do (set r 1) (cas! r 5 2)))", nil );
+	TEST( "swap!",         ==, "(let (r (ref)) (do (set r 1) (swap! r (lambda (x) (* x 10)))))", number( 10 ) );
+	TEST( "fetch-add!",    ==, "(let (r (ref)) (do (set r 5) (cons (fetch-add! r 2) (cons (get r) nil))))", list( number( 5 ), number( 7 ) ) );
+	TEST( "fetch-add! all",==, "(let (r (ref)) (do (set r 0) (pmap (lambda (x) (fetch-add! r x)) (range 1000 nil)) (get r)))", number( 500500 ) );
+	// fibers switch out halfway through an update, so the others make it retry
+	TEST( "swap! retries", ==, "(let (r (ref)) "
+	                             "(do (set r 0) "
+	                                 "((lambda join (fs) (if fs (do (touch (car fs)) (join (cdr fs))) (get r))) "
+	                                  "((lambda start (n acc) (if (= n 0) acc (start (- n 1) (cons (spawn (lambda () "
+	                                      "((lambda go (i) (if (= i 0) nil (do (swap! r (lambda (x) (do (yield) (+ x 1)))) (go (- i 1))))) 50))) acc)))) 4 nil))))", number( 200 ) );
+
+	// vms have their own globals and settings
+	{
+		Vm a, b;
+		a.setJittingThreshold( 0 );
+
+		a.evaluate( "(define x 1) (define f (lambda f (y) (+ x y)))" );
+		b.evaluate( "(define x 2) (define f (lambda f (y) (* x y)))" );
+
+		ValuePtr fa = a.evaluate( "(f 10)" );
+		ValuePtr fb = b.evaluate( "(f 10)" );
+
+		ValuePtr la, lb;
+		a.globals()->lookup( "f", &la );
+		b.globals()->lookup( "f", &lb );
+
+		if ( *fa == *number( 11 ) && *fb == *number( 20 ) && !scope.contains( "f" ) &&
+		     Value::asLambda( la )->code && !Value::asLambda( lb )->code && !Vm::current() ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: vm failed" << std::endl;
+		}
+		testsRun++;
+	}
+
+	// threads read, analyze and evaluate source text in the same vm
+	{
+		Gc::enableThreads();
+
+		Vm vm;
+		vm.evaluate( "(define fib (lambda fib (n) (if (< n 2) n (+ (fib (- n 2)) (fib (- n 1))))))" );
+
+		std::vector<std::thread> threads;
+		std::vector<int>         wrong( 8, 0 );
+		for ( size_t t = 0; t < wrong.size(); t++ ) {
+			threads.emplace_back( [&, t]() {
+				Gc::Thread registered;
+
+				for ( long i = 0; i < 500; i++ ) {
+					long        n    = i * 1000 + long( t );
+					std::string name = "t" + std::to_string( t );
+					std::string src  = "(define " + name + " " + std::to_string( n ) + ") "
+					                   "(cons (+ " + name + " 0.5) (cons \"" + name + "\" (cons (fib 5) nil)))";
+
+					ValuePtr val = vm.evaluate( src.c_str() );
+					ValuePtr own;
+
+					if ( !(*val == *list( number( n + 0.5 ), string( name.c_str() ), number( 5 ) )) ) wrong[t]++;
+					if ( !vm.globals()->lookup( name.c_str(), &own ) || !(*own == *number( n )) ) wrong[t]++;
+				}
+			} );
+		}
+		for ( auto& t : threads ) t.join();
+
+		bool ok = true;
+		for ( int w : wrong ) ok = ok && !w;
+
+		// errors go through the loader, which fails with the first one after the other forms
+		bool failed = false;
+		try {
+			CatchFailures catching;
+			vm.evaluate( "(undefined-fn 1) (define after 1)" );
+		} catch ( const Failure& ) {
+			failed = true;
+		}
+		ok = ok && failed && vm.globals()->contains( "after" );
+
+		if ( ok ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: threads in one vm failed" << std::endl;
+		}
+		testsRun++;
+	}
+
 	std::cout << ">>> EVALUATOR PASSED " << testsPassed << " TESTS OUT OF " << testsRun << std::endl;
 
 	#undef TEST
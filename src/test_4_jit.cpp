@@ -3,12 +3,18 @@
 #include "lllm/Analyzer.hpp"
 #include "lllm/Evaluator.hpp"
 #include "lllm/Jit.hpp"
+#include "lllm/Loader.hpp"
+#include "lllm/Vm.hpp"
+#include "lllm/Fiber.hpp"
+#include "lllm/JitCache.hpp"
 #include "lllm/GlobalScope.hpp"
 #include "lllm/value/ValueIO.hpp"
+#include "lllm/value/Telemetry.hpp"
 #include "lllm/ast/AstIO.hpp"
 #include "lllm/util/util_io.hpp"
 
 #include <cassert>
+#include <cstdio>
 #include <iostream>
 
 using namespace lllm;
@@ -85,6 +91,7 @@ int main() {
 	GLOBAL( "mul",      "(lambda A (a b) (* a b))" );
 	GLOBAL( "apply2",   "(lambda B (fn a b) (fn a b))" );
 	GLOBAL( "!",        "(lambda ! (n) (if (<= n 0) 1 (* n (! (- n 1)))))" );
+	GLOBAL( "range",    "(lambda range (n acc) (if (= n 0) acc (range (- n 1) (cons n acc))))" );
 //	TEST( "", ==, "((lambda x (a b) (sum2 a b)) 5 5)", False );
 
 // (define id (lambda id    (x)   x))
@@ -107,8 +114,194 @@ int main() {
 	TEST( "closures",       ==, "(apply2 mul 4 3)",                                  number(12)       );
 	TEST( "tail_fib",       ==, "(tail_fib 8 0 1)",                                  number(fib(8))   );
 	TEST( "factorial",      ==, "(! 6)",                                             number(720)      );
+	TEST( "inline cons",    ==, "(range 3 nil)",                                     list( number(1), number(2), number(3) ) );
+	TEST( "eq if",          ==, "((lambda eq1  (x) (if (eq x 'a) 'y 'n)) 'a)",          symbol("y")      );
+	TEST( "eq value",       ==, "((lambda eq2  (x) (eq x 'b)) 'a)",                     nil              );
 //	TEST( "xxx", !=, "(lamba a (x) ", nil );
 
+	Telemetry::enable( true );
+	GLOBAL( "pair", "(lambda pair (a) (cons a nil))" );
+	TEST( "telemetry-1",    ==, "(pair 1)",                                          list( number(1) ) );
+	TEST( "telemetry-2",    ==, "(pair 2)",                                          list( number(2) ) );
+	ValuePtr pair;
+	if ( scope.lookup( "pair", &pair ) && Value::asLambda( pair )->data->allocCnt == 2 ) {
+		testsPassed++;
+	} else {
+		std::cout << "Test: telemetry failed: allocations were not charged to 'pair'" << std::endl;
+	}
+	testsRun++;
+	Telemetry::enable( false );
+
+	// the cache knows functions with the same structure as jitted ones, also after a reload
+	JitCache::setEnabled( true );
+	GLOBAL( "square", "(lambda square (x) (* x x))" );
+	TEST( "jit cache",      ==, "(square 3)",                                        number(9)        );
+	{
+		util::CStr file   = "/tmp/lllm_test_jit.cache";
+		auto       same   = Analyzer::analyze( Reader::read( "(lambda square (x) (* x x))" ), &scope )->as<ast::Lambda>();
+		auto       other  = Analyzer::analyze( Reader::read( "(lambda square (x) (+ x x))" ), &scope )->as<ast::Lambda>();
+		size_t     before = JitCache::size();
+
+		if ( JitCache::contains( same ) && !JitCache::contains( other ) &&
+		     JitCache::save( file ) && JitCache::load( file ) && JitCache::size() == before ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: jit cache failed" << std::endl;
+		}
+		testsRun++;
+
+		std::remove( file );
+	}
+	JitCache::setEnabled( false );
+
+	// recursive closures run with their own captured values
+	GLOBAL( "countdown", "(lambda countdown (n) (lambda down (x) (if (< x 1) n (down (- x 1)))))" );
+	TEST( "closure self-1", ==, "((countdown 1) 3)",                                 number(1)        );
+	TEST( "closure self-2", ==, "((countdown 2) 3)",                                 number(2)        );
+
+	// equal functions share code, unless they see different globals
+	GLOBAL( "k",      "5" );
+	GLOBAL( "scale1", "(lambda scale (x) (* x k))" );
+	GLOBAL( "scale2", "(lambda scale (x) (* x k))" );
+	TEST( "shared code-1",  ==, "(scale1 2)",                                        number(10)       );
+	TEST( "shared code-2",  ==, "(scale2 3)",                                        number(15)       );
+	GLOBAL( "k",      "7" );
+	GLOBAL( "scale3", "(lambda scale (x) (* x k))" );
+	TEST( "shared code-3",  ==, "(scale3 2)",                                        number(14)       );
+	{
+		ValuePtr scale1, scale2, scale3;
+		scope.lookup( "scale1", &scale1 );
+		scope.lookup( "scale2", &scale2 );
+		scope.lookup( "scale3", &scale3 );
+
+		Lambda::FnPtr code1 = Value::asLambda( scale1 )->code;
+		Lambda::FnPtr code2 = Value::asLambda( scale2 )->code;
+		Lambda::FnPtr code3 = Value::asLambda( scale3 )->code;
+
+		if ( code1 && code1 == code2 && code3 && code3 != code1 && Jit::stats().shared > 0 ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: shared code failed" << std::endl;
+		}
+		testsRun++;
+	}
+
+	// workers call compiled code and compile what they call
+	GLOBAL( "sq",    "(lambda sq (x) (* x (scale1 1)))" );
+	TEST( "pmap",           ==, "(pmap sq (cons 1 (cons 2 (cons 3 nil))))",         list( number(5), number(10), number(15) ) );
+	TEST( "future",         ==, "(touch (future (lambda () (sq 4))))",               number(20)       );
+
+	// compiled code passes messages like the interpreter
+	GLOBAL( "relay", "(lambda relay (c v) (do (send c v) (try-send c v) (recv c)))" );
+	TEST( "channel",        ==, "(relay (channel 1) 7)",                              number(7)        );
+	GLOBAL( "bump",  "(lambda bump (r n) (if (= n 0) (get r) (do (fetch-add! r 1) (cas! r 'never 0) (bump r (- n 1)))))" );
+	// indexing is inlined, the builtins only report errors (which abort in compiled code)
+	GLOBAL( "vsum",  "(lambda vsum (v i acc) (if (= i (vector-length v)) acc (vsum v (+ i 1) (+ acc (vector-ref v i)))))" );
+	GLOBAL( "vfill", "(lambda vfill (v i) (if (= i (vector-length v)) v (do (vector-set! v i (* i i)) (vfill v (+ i 1)))))" );
+	GLOBAL( "vat",   "(lambda vat (v i) (vector-ref v i))" );
+	TEST( "vector-ref",     ==, "(vsum #(1 2 3 4) 0 0)",                              number(10)       );
+	TEST( "vector-set!",    ==, "(vsum (vfill (make-vector 4 0) 0) 0 0)",             number(14)       );
+	TEST( "vector bounds",  ==, "(+ (vat #(1 2 3) 0) (vat #(1 2 3) 2))",              number(4)        );
+	GLOBAL( "hfill",  "(lambda hfill (h i n) (if (= i n) h (do (hash-set! h i (* i 2)) (hfill h (+ i 1) n))))" );
+	GLOBAL( "hsum",   "(lambda hsum (h i n acc) (if (= i n) acc (hsum h (+ i 1) n (+ acc (hash-ref h i 0)))))" );
+	GLOBAL( "hdrop",  "(lambda hdrop (h i n) (if (>= i n) h (do (hash-remove! h i) (hdrop h (+ i 2) n))))" );
+	TEST( "hash tables",    ==, "(hsum (hdrop (hfill (make-hash-table) 0 100) 0 100) 0 100 0)",   number(5000)     );
+	// typed vectors take the slow path through the builtins
+	TEST( "typed vectors",  ==, "(+ (vsum (vfill (make-i64vector 4 0) 0) 0 0) (vsum (list->f64vector '(0.5 1.5)) 0 0))", number(16.0) );
+	TEST( "fetch-add!",     ==, "(let (r (ref)) (do (set r 0) (bump r 100)))",        number(100)      );
+	// record fields are loaded inline once the type is checked, other records with the same fields have another type
+	for ( CStr rec : { "(defrecord vec2 x y)", "(defrecord pos2 x y)" } ) {
+		for ( ast::DefinePtr def : Analyzer::definitions( Analyzer::analyze( Reader::read( rec ), &scope ) ) ) {
+			scope.add( def->location, def->name, def, Evaluator::evaluate( def->expr, &scope ) );
+		}
+	}
+	GLOBAL( "dot2",   "(lambda dot2 (a b) (+ (* (vec2-x a) (vec2-x b)) (* (vec2-y a) (vec2-y b))))" );
+	GLOBAL( "nvec2",  "(lambda nvec2 (l n) (if l (nvec2 (cdr l) (if (vec2? (car l)) (+ n 1) n)) n))" );
+	TEST( "records",        ==, "(dot2 (make-vec2 1 2) (make-vec2 3 4))",             number(11)       );
+	TEST( "record?",        ==, "(nvec2 (cons (make-vec2 1 2) (cons (make-pos2 1 2) (cons nil (cons 5 (cons (make-vec2 0 0) nil))))) 0)", number(2) );
+
+	// compiled loops burn fuel too, so a green thread running one gets switched out.
+	// calls that were inlined are free, so it is switched out less often than the interpreter would
+	GLOBAL( "spin",  "(lambda spin (n) (if (= n 0) 0 (spin (- n 1))))" );
+	{
+		size_t   before = Fibers::stats().switches;
+		ValuePtr val    = Evaluator::evaluate( Analyzer::analyze( Reader::read( "(touch (spawn (lambda () (spin 100000))))" ), &scope ), &scope );
+
+		if ( *val == *number( 0 ) && Fibers::stats().switches > before ) {
+			std::cout << "Test: fuel passed" << std::endl;
+			testsPassed++;
+		} else {
+			std::cout << "Test: fuel failed" << std::endl;
+		}
+		testsRun++;
+	}
+
+	// a function that fails to compile does not stop the loader from compiling the next one
+	{
+		Loader loader( &scope );
+		size_t reported = 0;
+		loader.setErrorHandler( [&]( const Loader::Error& ) { reported++; } );
+
+		Reader        src   = Reader::fromString( "(define broken (lambda broken (x) (if x 1 (car 1 2)))) (broken 1) "
+		                                          "(define after (lambda after (x) (+ x 1))) (define compiled (after 41))" );
+		Loader::Stats stats = loader.load( src );
+
+		ValuePtr compiled;
+		if ( stats.forms == 4 && stats.errors == 1 && reported == 1 &&
+		     scope.lookup( "compiled", &compiled ) && *compiled == *number( 42 ) ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: loader after compile error failed: " << stats.errors << " errors" << std::endl;
+		}
+		testsRun++;
+	}
+
+	// vms share the code of equal functions
+	{
+		Vm a, b;
+		b.setInliningThreshold( 0 );
+
+		ValuePtr ra = a.evaluate( "(define sq (lambda sq (x) (* x x))) (sq 3)" );
+		ValuePtr rb = b.evaluate( "(define sq (lambda sq (x) (* x x))) (sq 4)" );
+
+		ValuePtr sqa, sqb;
+		a.globals()->lookup( "sq", &sqa );
+		b.globals()->lookup( "sq", &sqb );
+
+		Lambda::FnPtr codeA = Value::asLambda( sqa )->code;
+		Lambda::FnPtr codeB = Value::asLambda( sqb )->code;
+
+		if ( *ra == *number( 9 ) && *rb == *number( 16 ) && sqa != sqb && codeA && codeA == codeB ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: vm shared code failed" << std::endl;
+		}
+		testsRun++;
+	}
+
+	// closures made by shared code see the globals of their own vm
+	{
+		Vm a, b;
+		a.setJittingThreshold( 2 );
+		b.setJittingThreshold( 2 );
+
+		a.evaluate( "(define k 1) (define mk (lambda () (lambda () k)))" );
+		b.evaluate( "(define k 2) (define mk (lambda () (lambda () k)))" );
+
+		bool ok = true;
+		for ( int i = 0; i < 6; i++ ) {
+			ok = ok && *a.evaluate( "((mk))" ) == *number( 1 );
+			ok = ok && *b.evaluate( "((mk))" ) == *number( 2 );
+		}
+
+		if ( ok ) {
+			testsPassed++;
+		} else {
+			std::cout << "Test: vm shared closure failed" << std::endl;
+		}
+		testsRun++;
+	}
+
 	std::cout << ">>> JIT PASSED " << testsPassed << " TESTS OUT OF " << testsRun << std::endl;
 
 	#undef TEST
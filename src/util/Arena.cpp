@@ -0,0 +1,77 @@
+
+#include "lllm/util/Arena.hpp"
+#include "lllm/util/fail.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+using namespace lllm;
+using namespace lllm::util;
+
+// chunk headers are padded to keep allocations aligned
+static const size_t HEADER = (sizeof(void*) * 2 + Arena::ALIGN - 1) & ~(Arena::ALIGN - 1);
+
+Arena::Arena() : chunks( nullptr ), top( nullptr ), end( nullptr ) {}
+
+Arena::Arena( Arena&& a ) : chunks( a.chunks ), top( a.top ), end( a.end ) {
+	a.chunks = nullptr;
+	a.top    = nullptr;
+	a.end    = nullptr;
+}
+
+Arena::~Arena() {
+	while ( chunks ) {
+		Chunk* next = chunks->next;
+		std::free( chunks );
+		chunks = next;
+	}
+}
+
+void* Arena::grow( size_t bytes ) {
+	// chunks double in size, big objects get a chunk of their own
+	size_t size = std::max( chunks ? chunks->size * 2 : CHUNK_SIZE, bytes + HEADER );
+
+	Chunk* chunk = (Chunk*) std::malloc( size );
+
+	if ( !chunk ) LLLM_FAIL( "Out of memory" );
+
+	chunk->next = chunks;
+	chunk->size = size;
+	chunks = chunk;
+
+	top = ((char*) chunk) + HEADER;
+	end = ((char*) chunk) + size;
+
+	void* mem = top;
+	top += bytes;
+	return mem;
+}
+
+CStr Arena::copy( const char* str, size_t length ) {
+	char* mem = (char*) alloc( length + 1 );
+
+	std::memcpy( mem, str, length );
+	mem[length] = '\0';
+
+	return mem;
+}
+
+void Arena::release() {
+	if ( !chunks ) return;
+
+	// the newest chunk is the biggest
+	while ( Chunk* next = chunks->next ) {
+		chunks->next = next->next;
+		std::free( next );
+	}
+
+	top = ((char*) chunks) + HEADER;
+	end = ((char*) chunks) + chunks->size;
+}
+
+size_t Arena::size() const {
+	size_t size = 0;
+	for ( Chunk* c = chunks; c; c = c->next ) size += c->size;
+	return size;
+}
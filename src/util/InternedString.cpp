@@ -1,43 +1,69 @@
-
 #include "lllm/util/InternedString.hpp"
 
-#include <set>
+#include <unordered_set>
 #include <cstring>
+#include <mutex>
+
+#include <gc.h>
 
 using namespace std;
 using namespace lllm;
 using namespace lllm::util;
 
 namespace {
-	struct CmpStr final {
-		bool operator()( CStr a, CStr b) { 
-			return std::strcmp( a, b ) < 0;
+	// interned strings are looked up by slices, so the reader can intern names straight from its input
+	struct Slice final {
+		const char* str;
+		size_t      length;
+	};
+	struct HashSlice final {
+		size_t operator()( const Slice& s ) const {
+			size_t h = 0xcbf29ce484222325UL;
+			for ( size_t i = 0; i < s.length; i++ ) h = (h ^ (unsigned char) s.str[i]) * 0x100000001b3UL;
+			return h;
+		}
+	};
+	struct EqSlice final {
+		bool operator()( const Slice& a, const Slice& b ) const {
+			return (a.length == b.length) && (std::memcmp( a.str, b.str, a.length ) == 0);
 		}
 	};
 
-	typedef std::set<CStr, CmpStr> InternTable;
+	typedef std::unordered_set<Slice, HashSlice, EqSlice> InternTable;
 
 	static InternTable* intern_table;
+	// interning is rare after reading, one lock for all threads is enough
+	static std::mutex   intern_lock;
 };
 
 CStr InternedString::intern( CStr str ) {
 	if ( !str ) return str;
 
+	return intern( str, std::strlen( str ) );
+}
+
+CStr InternedString::intern( const char* str, size_t length ) {
+	std::lock_guard<std::mutex> guard( intern_lock );
+
 	if ( !intern_table ) intern_table = new InternTable();
 
 	InternTable& tmp = *intern_table;
 
-	auto lb = tmp.lower_bound( str );
+	auto it = tmp.find( Slice{ str, length } );
 
-	if ( lb != tmp.end() && (std::strcmp( str, *lb ) == 0) ) {
+	if ( it != tmp.end() ) {
 		// symbol already exists
-		return *lb;
+		return it->str;
 	} else {
 		// the symbol does not exist in the map
-		// add it to the map using lb as a hint to insert, so it can avoid another lookup
-		tmp.insert( lb, str );
+		// copy it, interned strings live forever and must not be freed under our feet by the GC.
+		// they contain no pointers so the GC never has to scan them.
+		char* copy = (char*) GC_MALLOC_ATOMIC_UNCOLLECTABLE( length + 1 );
+		std::memcpy( copy, str, length );
+		copy[length] = '\0';
 
-		return str;
+		tmp.insert( Slice{ copy, length } );
+
+		return copy;
 	}
 }
-
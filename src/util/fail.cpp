@@ -10,9 +10,16 @@ using namespace lllm;
 
 #define MAX_FRAMES 100
 
+static __thread int catching = 0;
+
+util::CatchFailures::CatchFailures()  { catching++; }
+util::CatchFailures::~CatchFailures() { catching--; }
+
 static inline void demangle( const char* symbol, std::string& dst );
 
 void util::fail( const char* file, const char* function, int line, const char* msg ) {
+	if ( catching ) throw Failure{ msg };
+
 	void* stackFrames[MAX_FRAMES];
 
 	int    size    = backtrace( stackFrames, MAX_FRAMES );
@@ -0,0 +1,87 @@
+
+#include "lllm/value/Gc.hpp"
+#include "lllm/value/Heap.hpp"
+#include "lllm/util/fail.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace lllm;
+using namespace lllm::value;
+
+bool          Gc::incremental = false;
+unsigned long Gc::pauseGoalMs = GC_TIME_UNLIMITED;
+
+namespace {
+	struct Setup final {
+		Setup() {
+			util::CStr mode = std::getenv( "LLLM_GC" );
+
+			if ( mode && std::strcmp( mode, "incremental" ) == 0 ) {
+				util::CStr goal = std::getenv( "LLLM_GC_PAUSE_MS" );
+
+				Gc::setMode( Gc::Mode::INCREMENTAL, goal ? std::strtoul( goal, nullptr, 10 ) : Gc::DEFAULT_PAUSE_GOAL_MS );
+			}
+		}
+	} setup;
+}
+
+void Gc::setMode( Mode mode, unsigned long pauseGoal ) {
+	switch ( mode ) {
+		case Mode::STOP_THE_WORLD:
+			if ( incremental ) LLLM_FAIL( "The incremental collector can not be switched off again" );
+			break;
+		case Mode::INCREMENTAL:
+			pauseGoalMs = pauseGoal;
+			GC_set_time_limit( pauseGoal );
+
+			if ( !incremental ) {
+				GC_enable_incremental();
+				incremental = GC_is_incremental_mode();
+			}
+			break;
+	}
+}
+
+Gc::Mode Gc::mode() {
+	return incremental ? Mode::INCREMENTAL : Mode::STOP_THE_WORLD;
+}
+
+unsigned long Gc::pauseGoal() {
+	return incremental ? pauseGoalMs : GC_TIME_UNLIMITED;
+}
+
+void Gc::enableThreads() {
+#ifdef GC_THREADS
+	GC_allow_register_threads();
+#endif
+}
+
+Gc::Thread::Thread() : registered( false ) {
+#ifdef GC_THREADS
+	if ( GC_thread_is_registered() ) return;
+
+	GC_stack_base base;
+	if ( GC_get_stack_base( &base ) != GC_SUCCESS ) LLLM_FAIL( "Could not find the stack of a new thread" );
+
+	registered = GC_register_my_thread( &base ) == GC_SUCCESS;
+#endif
+}
+Gc::Thread::~Thread() {
+	// the free lists of the thread go back to the collector
+	Heap::release();
+
+#ifdef GC_THREADS
+	if ( registered ) GC_unregister_my_thread();
+#endif
+}
+
+size_t Gc::markers() {
+#ifdef GC_THREADS
+	// parallel marking is set up by bdwgc itself (GC_MARKERS), it counts the helper threads only
+	int n = GC_get_parallel();
+	return n > 0 ? size_t( n ) + 1 : 1;
+#else
+	return 1;
+#endif
+}
@@ -0,0 +1,179 @@
+
+#include "lllm/value/HashCons.hpp"
+#include "lllm/value/Telemetry.hpp"
+#include "lllm/value/Heap.hpp"
+#include "lllm/value/Gc.hpp"
+#include "lllm/util/fail.hpp"
+
+#include <gc.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+using namespace lllm;
+using namespace lllm::value;
+
+bool HashCons::on = false;
+
+namespace {
+	// the cell is hidden from the GC and cleared by it once the cons is collected
+	struct Entry final {
+		Entry*            next;
+		size_t            hash;
+		GC_hidden_pointer cell;
+	};
+
+	static const size_t INITIAL_BUCKETS = 1024;
+
+	// buckets live in an uncollectable array so the entries stay reachable
+	static Entry** buckets    = nullptr;
+	static size_t  numBuckets = 0;
+	static size_t  numEntries = 0;
+
+	static unsigned long long lookups = 0;
+	static unsigned long long shared  = 0;
+
+	// threads share one table
+	static std::mutex         lock;
+
+	struct Setup final {
+		Setup() {
+			if ( util::CStr hc = std::getenv( "LLLM_HASHCONS" ) ) HashCons::enable( std::strcmp( hc, "0" ) != 0 );
+		}
+	} setup;
+}
+
+static Entry** allocBuckets( size_t n ) {
+	Entry** bs = (Entry**) GC_MALLOC_UNCOLLECTABLE( n * sizeof(Entry*) );
+
+	if ( !bs ) LLLM_FAIL( "Out of memory" );
+
+	return bs;
+}
+
+static inline size_t mix( size_t h ) {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdUL;
+	h ^= h >> 33;
+	return h;
+}
+// cells in the car or cdr are hashed by identity, canonical ones are unique anyway.
+// walking them like value::hash would make consing onto a list take as long as the list
+static inline size_t key( ValuePtr v ) {
+	return typeOf( v ) == Type::Cons ? mix( (size_t) v ) : hash( v );
+}
+static inline size_t key( ValuePtr car, ListPtr cdr ) {
+	return mix( key( car ) * 31 + key( cdr ) );
+}
+
+// stricter than equal: 1 and 1.0 are equal but must not share a cell.
+// like the key, cells are compared by identity
+static bool same( ValuePtr a, ValuePtr b ) {
+	if ( a == b ) return true;
+
+	Type t = typeOf( a );
+	if ( t != typeOf( b ) ) return false;
+
+	switch ( t ) {
+		case Type::Int:    return static_cast<IntPtr>( a )->value  == static_cast<IntPtr>( b )->value;
+		case Type::Real:   return static_cast<RealPtr>( a )->value == static_cast<RealPtr>( b )->value;
+		case Type::Char:   return static_cast<CharPtr>( a )->value == static_cast<CharPtr>( b )->value;
+		case Type::String: return std::strcmp( static_cast<StringPtr>( a )->value, static_cast<StringPtr>( b )->value ) == 0;
+		case Type::Symbol: return static_cast<SymbolPtr>( a )->value == static_cast<SymbolPtr>( b )->value;
+		// cells, refs and lambdas are only the same as themselves
+		default:           return false;
+	}
+}
+
+static void grow() {
+	size_t  n  = numBuckets * 2;
+	Entry** bs = allocBuckets( n );
+
+	numEntries = 0;
+	for ( size_t i = 0; i < numBuckets; i++ ) {
+		for ( Entry* e = buckets[i]; e; ) {
+			Entry* next = e->next;
+
+			// entries of collected cells are dropped, their links were already cleared
+			if ( e->cell ) {
+				e->next = bs[e->hash % n];
+				bs[e->hash % n] = e;
+				numEntries++;
+			}
+
+			e = next;
+		}
+	}
+
+	GC_FREE( buckets );
+	buckets    = bs;
+	numBuckets = n;
+}
+
+void HashCons::enable( bool b ) {
+	std::lock_guard<std::mutex> guard( lock );
+
+	if ( b && !buckets ) {
+		buckets    = allocBuckets( INITIAL_BUCKETS );
+		numBuckets = INITIAL_BUCKETS;
+	}
+
+	on = b;
+}
+
+ConsPtr HashCons::cons( ValuePtr car, ListPtr cdr ) {
+	size_t h = key( car, cdr );
+
+	std::lock_guard<std::mutex> guard( lock );
+
+	lookups++;
+
+	// owner is the object link points into, for the write barrier
+	void*   owner = buckets;
+	Entry** link  = &buckets[h % numBuckets];
+
+	while ( Entry* e = *link ) {
+		ConsPtr c = e->cell ? (ConsPtr) GC_REVEAL_POINTER( e->cell ) : nullptr;
+
+		if ( !c ) {
+			// the cell was collected, unlink its entry
+			*link = e->next;
+			Gc::written( owner );
+			numEntries--;
+			continue;
+		}
+
+		if ( e->hash == h && same( c->car, car ) && same( c->cdr, cdr ) ) {
+			shared++;
+			return c;
+		}
+
+		owner = e;
+		link  = &e->next;
+	}
+
+	Telemetry::allocated( Type::Cons, sizeof(Cons) );
+	Cons* c = new (Heap::local().alloc( sizeof(Cons) )) Cons( car, cdr );
+
+	Entry* e = (Entry*) GC_MALLOC( sizeof(Entry) );
+	if ( !e ) LLLM_FAIL( "Out of memory" );
+
+	e->hash = h;
+	e->cell = GC_HIDE_POINTER( c );
+	if ( GC_general_register_disappearing_link( (void**) &e->cell, c ) == GC_NO_MEMORY ) LLLM_FAIL( "Out of memory" );
+
+	e->next = buckets[h % numBuckets];
+	buckets[h % numBuckets] = e;
+	Gc::written( buckets );
+
+	if ( ++numEntries > 2 * numBuckets ) grow();
+
+	return c;
+}
+
+HashCons::Stats HashCons::stats() {
+	std::lock_guard<std::mutex> guard( lock );
+
+	return Stats{ lookups, shared, numEntries, numBuckets };
+}
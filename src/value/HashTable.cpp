@@ -0,0 +1,180 @@
+#include "lllm/value/Value.hpp"
+#include "lllm/value/Telemetry.hpp"
+#include "lllm/value/Gc.hpp"
+#include "lllm/util/fail.hpp"
+
+#include <gc.h>
+
+using namespace lllm;
+using namespace lllm::value;
+
+typedef HashTable::Slot Slot;
+
+static const size_t MIN_CAPACITY = 8;
+// old slots looked at by every put and remove while the table grows.
+// a table grows when it is 3/4 full, the new slots are at least as many as the old ones and at most 1/2 full,
+// so the old slots are all moved long before the new ones fill up
+static const size_t STEP = 16;
+
+// 0 and 1 mark free slots
+static inline size_t hashOf( ValuePtr key ) {
+	size_t h = hash( key );
+	return h > 1 ? h : h + 2;
+}
+
+static Slot* allocSlots( size_t n ) {
+	// GC_MALLOC clears the memory, so all slots start out free
+	Slot* slots = (Slot*) GC_MALLOC( n * sizeof(Slot) );
+	if ( !slots ) LLLM_FAIL( "Out of memory for a hash table of " << n << " slots" );
+
+	Telemetry::allocated( Type::HashTable, n * sizeof(Slot) );
+	return slots;
+}
+
+// the slot holding key, null if there is none.
+// there is always a slot that was never used, which ends the search
+static Slot* find( Slot* slots, size_t capacity, size_t h, ValuePtr key ) {
+	if ( !capacity ) return nullptr;
+
+	for ( size_t i = h & (capacity - 1);; i = (i + 1) & (capacity - 1) ) {
+		Slot* s = &slots[i];
+
+		if ( s->hash == 0 ) return nullptr;
+		if ( s->hash == h && (s->key == key || equal( s->key, key )) ) return s;
+	}
+}
+// for a key that is not in the table yet, true if it took a slot that was never used
+static bool insert( Slot* slots, size_t capacity, size_t h, ValuePtr key, ValuePtr val ) {
+	for ( size_t i = h & (capacity - 1);; i = (i + 1) & (capacity - 1) ) {
+		Slot* s = &slots[i];
+
+		if ( s->hash <= 1 ) {
+			bool fresh = s->hash == 0;
+			*s = Slot{ h, key, val };
+			return fresh;
+		}
+	}
+}
+static inline void clear( Slot* s ) {
+	*s = Slot{ 1, nullptr, nullptr };
+}
+
+HashTable::HashTable() : Value( Type::HashTable ), slots( nullptr ), capacity( 0 ), used( 0 ), count( 0 ), old( nullptr ), oldCapacity( 0 ), next( 0 ) {}
+
+HashTablePtr value::hashTable() {
+	Telemetry::allocated( Type::HashTable, sizeof(HashTable) );
+	return new HashTable();
+}
+
+bool HashTable::lookup( ValuePtr key, ValuePtr* dst ) const {
+	size_t h = hashOf( key );
+
+	Slot* s = find( slots, capacity, h, key );
+	if ( !s ) s = find( old, oldCapacity, h, key );
+	if ( !s ) return false;
+
+	*dst = s->value;
+	return true;
+}
+
+ValuePtr HashTable::put( ValuePtr key, ValuePtr val ) const {
+	step();
+
+	size_t h = hashOf( key );
+
+	if ( Slot* s = find( slots, capacity, h, key ) ) {
+		ValuePtr previous = s->value;
+		s->value = val;
+		Gc::written( slots );
+		return previous;
+	}
+
+	// a key is either in the old or the new slots, it goes to the new ones when it is set
+	ValuePtr previous = nullptr;
+	if ( Slot* s = find( old, oldCapacity, h, key ) ) {
+		previous = s->value;
+		clear( s );
+		count--;
+	}
+
+	if ( (used + 1) * 4 > capacity * 3 ) grow();
+
+	if ( insert( slots, capacity, h, key, val ) ) used++;
+	count++;
+	Gc::written( slots );
+	return previous;
+}
+
+bool HashTable::remove( ValuePtr key, ValuePtr* previous ) const {
+	step();
+
+	size_t h = hashOf( key );
+
+	Slot* s = find( slots, capacity, h, key );
+	if ( !s ) s = find( old, oldCapacity, h, key );
+	if ( !s ) return false;
+
+	// the slot is not freed, searches for keys after it have to go on
+	*previous = s->value;
+	clear( s );
+	count--;
+	return true;
+}
+
+size_t HashTable::size() const { return count; }
+
+// moves the next few old slots
+void HashTable::step() const {
+	if ( !old ) return;
+
+	for ( size_t seen = 0; seen < STEP && next < oldCapacity; seen++, next++ ) {
+		Slot* s = &old[next];
+		if ( s->hash <= 1 ) continue;
+
+		if ( insert( slots, capacity, s->hash, s->key, s->value ) ) used++;
+		clear( s );
+	}
+	Gc::written( slots );
+
+	if ( next == oldCapacity ) {
+		old         = nullptr;
+		oldCapacity = 0;
+		next        = 0;
+		Gc::written( this );
+	}
+}
+
+// room for twice the entries, removed ones are dropped on the way. tables never shrink
+void HashTable::grow() const {
+	size_t newCapacity = capacity ? capacity : MIN_CAPACITY;
+	while ( (count + 1) * 2 > newCapacity ) newCapacity *= 2;
+
+	Slot* fresh = allocSlots( newCapacity );
+
+	if ( old ) {
+		// grew again before all old slots were moved, which STEP should prevent. move everything now
+		size_t n = 0;
+		auto moveAll = [&]( Slot* from, size_t begin, size_t end ) {
+			for ( size_t i = begin; i < end; i++ ) {
+				if ( from[i].hash > 1 && insert( fresh, newCapacity, from[i].hash, from[i].key, from[i].value ) ) n++;
+			}
+		};
+		moveAll( old,   next, oldCapacity );
+		moveAll( slots, 0,    capacity    );
+
+		old         = nullptr;
+		oldCapacity = 0;
+		next        = 0;
+		used        = n;
+	} else {
+		old         = capacity ? slots : nullptr;
+		oldCapacity = capacity;
+		next        = 0;
+		used        = 0;
+	}
+
+	slots    = fresh;
+	capacity = newCapacity;
+	Gc::written( slots );
+	Gc::written( this );
+}
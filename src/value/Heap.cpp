@@ -0,0 +1,41 @@
+
+#include "lllm/value/Heap.hpp"
+#include "lllm/util/fail.hpp"
+
+#include <climits>
+#include <new>
+
+using namespace lllm;
+using namespace lllm::value;
+
+__thread Heap* Heap::current = nullptr;
+
+Heap::Heap() : fuel( LONG_MAX ) {
+	for ( size_t i = 0; i <= MAX_GRANULES; i++ ) lists[i] = nullptr;
+}
+
+// thread locals are not scanned by the GC, the lists have to live in an uncollectable object
+Heap* Heap::create() {
+	void* memory = GC_MALLOC_UNCOLLECTABLE( sizeof(Heap) );
+
+	if ( !memory ) LLLM_FAIL( "Out of memory" );
+
+	return new (memory) Heap();
+}
+
+void Heap::release() {
+	if ( !current ) return;
+
+	GC_FREE( current );
+	current = nullptr;
+}
+
+void* Heap::refill( size_t granules ) {
+	// bdwgc adds a byte to every request (for pointers just past an object), so ask for one less
+	void* obj = GC_malloc_many( granules * GRANULE_BYTES - 1 );
+
+	if ( !obj ) LLLM_FAIL( "Out of memory" );
+
+	lists[granules] = GC_NEXT( obj );
+	return obj;
+}
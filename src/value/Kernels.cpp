@@ -0,0 +1,410 @@
+
+#include "lllm/value/Kernels.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+
+#if defined( __x86_64__ )
+#	include <immintrin.h>
+#	define LLLM_X86 1
+#endif
+
+using namespace lllm;
+using namespace lllm::value;
+
+struct Kernels::Table {
+	void   (*addF)( const double*, const double*, double*, size_t );
+	void   (*mulF)( const double*, const double*, double*, size_t );
+	void   (*scaleF)( const double*, double, double*, size_t );
+	double (*dotF)( const double*, const double*, size_t );
+	double (*sumF)( const double*, size_t );
+	double (*minF)( const double*, size_t );
+	double (*maxF)( const double*, size_t );
+
+	void   (*addI)( const long*, const long*, long*, size_t );
+	void   (*mulI)( const long*, const long*, long*, size_t );
+	void   (*scaleI)( const long*, long, long*, size_t );
+	long   (*dotI)( const long*, const long*, size_t );
+	long   (*sumI)( const long*, size_t );
+	long   (*minI)( const long*, size_t );
+	long   (*maxI)( const long*, size_t );
+};
+
+//***** SCALAR *********************************************************************************************************
+
+namespace {
+	// ints go through unsigned arithmetic, so overflow wraps instead of being undefined
+	inline double plus( double a, double b )  { return a + b; }
+	inline long   plus( long a, long b )      { return long( (unsigned long) a + (unsigned long) b ); }
+	inline double times( double a, double b ) { return a * b; }
+	inline long   times( long a, long b )     { return long( (unsigned long) a * (unsigned long) b ); }
+
+	template<typename T>
+	struct Scalar final {
+		static void add( const T* a, const T* b, T* out, size_t n ) {
+			for ( size_t i = 0; i < n; i++ ) out[i] = plus( a[i], b[i] );
+		}
+		static void mul( const T* a, const T* b, T* out, size_t n ) {
+			for ( size_t i = 0; i < n; i++ ) out[i] = times( a[i], b[i] );
+		}
+		static void scale( const T* a, T k, T* out, size_t n ) {
+			for ( size_t i = 0; i < n; i++ ) out[i] = times( a[i], k );
+		}
+		static T dot( const T* a, const T* b, size_t n ) {
+			T acc = 0;
+			for ( size_t i = 0; i < n; i++ ) acc = plus( acc, times( a[i], b[i] ) );
+			return acc;
+		}
+		static T sum( const T* a, size_t n ) {
+			T acc = 0;
+			for ( size_t i = 0; i < n; i++ ) acc = plus( acc, a[i] );
+			return acc;
+		}
+		// the first NaN wins, !(x >= acc) is true for a NaN x and acc == acc is false once one was found
+		static T min( const T* a, size_t n ) {
+			T acc = a[0];
+			for ( size_t i = 1; i < n && acc == acc; i++ ) if ( !(a[i] >= acc) ) acc = a[i];
+			return acc;
+		}
+		static T max( const T* a, size_t n ) {
+			T acc = a[0];
+			for ( size_t i = 1; i < n && acc == acc; i++ ) if ( !(a[i] <= acc) ) acc = a[i];
+			return acc;
+		}
+	};
+
+	const Kernels::Table SCALAR = {
+		Scalar<double>::add, Scalar<double>::mul, Scalar<double>::scale, Scalar<double>::dot, Scalar<double>::sum, Scalar<double>::min, Scalar<double>::max,
+		Scalar<long>::add,   Scalar<long>::mul,   Scalar<long>::scale,   Scalar<long>::dot,   Scalar<long>::sum,   Scalar<long>::min,   Scalar<long>::max,
+	};
+}
+
+#ifdef LLLM_X86
+
+//***** SSE2 ***********************************************************************************************************
+
+// every x86-64 cpu has SSE2. there are no 64 bit int multiplies or compares, those stay scalar
+namespace {
+	struct Sse2 final {
+		static void addF( const double* a, const double* b, double* out, size_t n ) {
+			size_t i = 0;
+			for ( ; i + 2 <= n; i += 2 ) _mm_storeu_pd( out + i, _mm_add_pd( _mm_loadu_pd( a + i ), _mm_loadu_pd( b + i ) ) );
+			Scalar<double>::add( a + i, b + i, out + i, n - i );
+		}
+		static void mulF( const double* a, const double* b, double* out, size_t n ) {
+			size_t i = 0;
+			for ( ; i + 2 <= n; i += 2 ) _mm_storeu_pd( out + i, _mm_mul_pd( _mm_loadu_pd( a + i ), _mm_loadu_pd( b + i ) ) );
+			Scalar<double>::mul( a + i, b + i, out + i, n - i );
+		}
+		static void scaleF( const double* a, double k, double* out, size_t n ) {
+			__m128d kk = _mm_set1_pd( k );
+			size_t  i  = 0;
+			for ( ; i + 2 <= n; i += 2 ) _mm_storeu_pd( out + i, _mm_mul_pd( _mm_loadu_pd( a + i ), kk ) );
+			Scalar<double>::scale( a + i, k, out + i, n - i );
+		}
+		static double dotF( const double* a, const double* b, size_t n ) {
+			__m128d acc = _mm_setzero_pd();
+			size_t  i   = 0;
+			for ( ; i + 2 <= n; i += 2 ) acc = _mm_add_pd( acc, _mm_mul_pd( _mm_loadu_pd( a + i ), _mm_loadu_pd( b + i ) ) );
+			return lanes( acc ) + Scalar<double>::dot( a + i, b + i, n - i );
+		}
+		static double sumF( const double* a, size_t n ) {
+			__m128d acc = _mm_setzero_pd();
+			size_t  i   = 0;
+			for ( ; i + 2 <= n; i += 2 ) acc = _mm_add_pd( acc, _mm_loadu_pd( a + i ) );
+			return lanes( acc ) + Scalar<double>::sum( a + i, n - i );
+		}
+		static double minF( const double* a, size_t n ) {
+			if ( n < 2 ) return a[0];
+
+			__m128d acc = _mm_loadu_pd( a );
+			__m128d nan = _mm_cmpunord_pd( acc, acc );
+			size_t  i   = 2;
+			for ( ; i + 2 <= n; i += 2 ) {
+				__m128d x = _mm_loadu_pd( a + i );
+				nan = _mm_or_pd( nan, _mm_cmpunord_pd( x, x ) );
+				acc = _mm_min_pd( acc, x );
+			}
+			// minpd drops NaNs, let the scalar version find the first one
+			if ( _mm_movemask_pd( nan ) ) return Scalar<double>::min( a, n );
+
+			double l[2];
+			_mm_storeu_pd( l, acc );
+			double m = l[0] < l[1] ? l[0] : l[1];
+			for ( ; i < n && m == m; i++ ) if ( !(a[i] >= m) ) m = a[i];
+			return m;
+		}
+		static double maxF( const double* a, size_t n ) {
+			if ( n < 2 ) return a[0];
+
+			__m128d acc = _mm_loadu_pd( a );
+			__m128d nan = _mm_cmpunord_pd( acc, acc );
+			size_t  i   = 2;
+			for ( ; i + 2 <= n; i += 2 ) {
+				__m128d x = _mm_loadu_pd( a + i );
+				nan = _mm_or_pd( nan, _mm_cmpunord_pd( x, x ) );
+				acc = _mm_max_pd( acc, x );
+			}
+			// maxpd drops NaNs, let the scalar version find the first one
+			if ( _mm_movemask_pd( nan ) ) return Scalar<double>::max( a, n );
+
+			double l[2];
+			_mm_storeu_pd( l, acc );
+			double m = l[0] > l[1] ? l[0] : l[1];
+			for ( ; i < n && m == m; i++ ) if ( !(a[i] <= m) ) m = a[i];
+			return m;
+		}
+
+		static void addI( const long* a, const long* b, long* out, size_t n ) {
+			size_t i = 0;
+			for ( ; i + 2 <= n; i += 2 ) {
+				__m128i s = _mm_add_epi64( _mm_loadu_si128( (const __m128i*) (a + i) ), _mm_loadu_si128( (const __m128i*) (b + i) ) );
+				_mm_storeu_si128( (__m128i*) (out + i), s );
+			}
+			Scalar<long>::add( a + i, b + i, out + i, n - i );
+		}
+		static long sumI( const long* a, size_t n ) {
+			__m128i acc = _mm_setzero_si128();
+			size_t  i   = 0;
+			for ( ; i + 2 <= n; i += 2 ) acc = _mm_add_epi64( acc, _mm_loadu_si128( (const __m128i*) (a + i) ) );
+
+			long l[2];
+			_mm_storeu_si128( (__m128i*) l, acc );
+			return plus( plus( l[0], l[1] ), Scalar<long>::sum( a + i, n - i ) );
+		}
+
+		static double lanes( __m128d v ) {
+			double l[2];
+			_mm_storeu_pd( l, v );
+			return l[0] + l[1];
+		}
+	};
+
+	const Kernels::Table SSE2 = {
+		Sse2::addF, Sse2::mulF,        Sse2::scaleF,        Sse2::dotF,        Sse2::sumF, Sse2::minF,        Sse2::maxF,
+		Sse2::addI, Scalar<long>::mul, Scalar<long>::scale, Scalar<long>::dot, Sse2::sumI, Scalar<long>::min, Scalar<long>::max,
+	};
+}
+
+//***** AVX2 ***********************************************************************************************************
+
+// compiled for AVX2 no matter what the rest of the code is compiled for, only called if the cpu has it.
+// there is no 64 bit int multiply (that came with AVX-512), those stay scalar
+#define LLLM_AVX2 __attribute__((target("avx2")))
+
+namespace {
+	struct Avx2 final {
+		LLLM_AVX2 static void addF( const double* a, const double* b, double* out, size_t n ) {
+			size_t i = 0;
+			for ( ; i + 4 <= n; i += 4 ) _mm256_storeu_pd( out + i, _mm256_add_pd( _mm256_loadu_pd( a + i ), _mm256_loadu_pd( b + i ) ) );
+			Scalar<double>::add( a + i, b + i, out + i, n - i );
+		}
+		LLLM_AVX2 static void mulF( const double* a, const double* b, double* out, size_t n ) {
+			size_t i = 0;
+			for ( ; i + 4 <= n; i += 4 ) _mm256_storeu_pd( out + i, _mm256_mul_pd( _mm256_loadu_pd( a + i ), _mm256_loadu_pd( b + i ) ) );
+			Scalar<double>::mul( a + i, b + i, out + i, n - i );
+		}
+		LLLM_AVX2 static void scaleF( const double* a, double k, double* out, size_t n ) {
+			__m256d kk = _mm256_set1_pd( k );
+			size_t  i  = 0;
+			for ( ; i + 4 <= n; i += 4 ) _mm256_storeu_pd( out + i, _mm256_mul_pd( _mm256_loadu_pd( a + i ), kk ) );
+			Scalar<double>::scale( a + i, k, out + i, n - i );
+		}
+		// two accumulators, so an add does not wait for the one before
+		LLLM_AVX2 static double dotF( const double* a, const double* b, size_t n ) {
+			__m256d acc0 = _mm256_setzero_pd();
+			__m256d acc1 = _mm256_setzero_pd();
+			size_t  i    = 0;
+			for ( ; i + 8 <= n; i += 8 ) {
+				acc0 = _mm256_add_pd( acc0, _mm256_mul_pd( _mm256_loadu_pd( a + i ),     _mm256_loadu_pd( b + i ) ) );
+				acc1 = _mm256_add_pd( acc1, _mm256_mul_pd( _mm256_loadu_pd( a + i + 4 ), _mm256_loadu_pd( b + i + 4 ) ) );
+			}
+			return lanes( _mm256_add_pd( acc0, acc1 ) ) + Scalar<double>::dot( a + i, b + i, n - i );
+		}
+		LLLM_AVX2 static double sumF( const double* a, size_t n ) {
+			__m256d acc0 = _mm256_setzero_pd();
+			__m256d acc1 = _mm256_setzero_pd();
+			size_t  i    = 0;
+			for ( ; i + 8 <= n; i += 8 ) {
+				acc0 = _mm256_add_pd( acc0, _mm256_loadu_pd( a + i ) );
+				acc1 = _mm256_add_pd( acc1, _mm256_loadu_pd( a + i + 4 ) );
+			}
+			return lanes( _mm256_add_pd( acc0, acc1 ) ) + Scalar<double>::sum( a + i, n - i );
+		}
+		LLLM_AVX2 static double minF( const double* a, size_t n ) {
+			if ( n < 4 ) return Scalar<double>::min( a, n );
+
+			__m256d acc = _mm256_loadu_pd( a );
+			__m256d nan = _mm256_cmp_pd( acc, acc, _CMP_UNORD_Q );
+			size_t  i   = 4;
+			for ( ; i + 4 <= n; i += 4 ) {
+				__m256d x = _mm256_loadu_pd( a + i );
+				nan = _mm256_or_pd( nan, _mm256_cmp_pd( x, x, _CMP_UNORD_Q ) );
+				acc = _mm256_min_pd( acc, x );
+			}
+			if ( _mm256_movemask_pd( nan ) ) return Scalar<double>::min( a, n );
+
+			double l[4];
+			_mm256_storeu_pd( l, acc );
+			double m = Scalar<double>::min( l, 4 );
+			for ( ; i < n && m == m; i++ ) if ( !(a[i] >= m) ) m = a[i];
+			return m;
+		}
+		LLLM_AVX2 static double maxF( const double* a, size_t n ) {
+			if ( n < 4 ) return Scalar<double>::max( a, n );
+
+			__m256d acc = _mm256_loadu_pd( a );
+			__m256d nan = _mm256_cmp_pd( acc, acc, _CMP_UNORD_Q );
+			size_t  i   = 4;
+			for ( ; i + 4 <= n; i += 4 ) {
+				__m256d x = _mm256_loadu_pd( a + i );
+				nan = _mm256_or_pd( nan, _mm256_cmp_pd( x, x, _CMP_UNORD_Q ) );
+				acc = _mm256_max_pd( acc, x );
+			}
+			if ( _mm256_movemask_pd( nan ) ) return Scalar<double>::max( a, n );
+
+			double l[4];
+			_mm256_storeu_pd( l, acc );
+			double m = Scalar<double>::max( l, 4 );
+			for ( ; i < n && m == m; i++ ) if ( !(a[i] <= m) ) m = a[i];
+			return m;
+		}
+
+		LLLM_AVX2 static void addI( const long* a, const long* b, long* out, size_t n ) {
+			size_t i = 0;
+			for ( ; i + 4 <= n; i += 4 ) {
+				__m256i s = _mm256_add_epi64( _mm256_loadu_si256( (const __m256i*) (a + i) ), _mm256_loadu_si256( (const __m256i*) (b + i) ) );
+				_mm256_storeu_si256( (__m256i*) (out + i), s );
+			}
+			Scalar<long>::add( a + i, b + i, out + i, n - i );
+		}
+		LLLM_AVX2 static long sumI( const long* a, size_t n ) {
+			__m256i acc = _mm256_setzero_si256();
+			size_t  i   = 0;
+			for ( ; i + 4 <= n; i += 4 ) acc = _mm256_add_epi64( acc, _mm256_loadu_si256( (const __m256i*) (a + i) ) );
+
+			long l[4];
+			_mm256_storeu_si256( (__m256i*) l, acc );
+			return plus( Scalar<long>::sum( l, 4 ), Scalar<long>::sum( a + i, n - i ) );
+		}
+		// min and max by compare and blend
+		LLLM_AVX2 static long minI( const long* a, size_t n ) {
+			if ( n < 4 ) return Scalar<long>::min( a, n );
+
+			__m256i acc = _mm256_loadu_si256( (const __m256i*) a );
+			size_t  i   = 4;
+			for ( ; i + 4 <= n; i += 4 ) {
+				__m256i v = _mm256_loadu_si256( (const __m256i*) (a + i) );
+				acc = _mm256_blendv_epi8( acc, v, _mm256_cmpgt_epi64( acc, v ) );
+			}
+
+			long l[4];
+			_mm256_storeu_si256( (__m256i*) l, acc );
+			long m = Scalar<long>::min( l, 4 );
+			for ( ; i < n; i++ ) if ( a[i] < m ) m = a[i];
+			return m;
+		}
+		LLLM_AVX2 static long maxI( const long* a, size_t n ) {
+			if ( n < 4 ) return Scalar<long>::max( a, n );
+
+			__m256i acc = _mm256_loadu_si256( (const __m256i*) a );
+			size_t  i   = 4;
+			for ( ; i + 4 <= n; i += 4 ) {
+				__m256i v = _mm256_loadu_si256( (const __m256i*) (a + i) );
+				acc = _mm256_blendv_epi8( acc, v, _mm256_cmpgt_epi64( v, acc ) );
+			}
+
+			long l[4];
+			_mm256_storeu_si256( (__m256i*) l, acc );
+			long m = Scalar<long>::max( l, 4 );
+			for ( ; i < n; i++ ) if ( a[i] > m ) m = a[i];
+			return m;
+		}
+
+		LLLM_AVX2 static double lanes( __m256d v ) {
+			double l[4];
+			_mm256_storeu_pd( l, v );
+			return (l[0] + l[1]) + (l[2] + l[3]);
+		}
+	};
+
+	const Kernels::Table AVX2 = {
+		Avx2::addF, Avx2::mulF,        Avx2::scaleF,        Avx2::dotF,        Avx2::sumF, Avx2::minF, Avx2::maxF,
+		Avx2::addI, Scalar<long>::mul, Scalar<long>::scale, Scalar<long>::dot, Avx2::sumI, Avx2::minI, Avx2::maxI,
+	};
+}
+
+#endif /* LLLM_X86 */
+
+//***** SELECTION ******************************************************************************************************
+
+const Kernels::Table* Kernels::active    = &SCALAR;
+Kernels::Isa          Kernels::activeIsa = Kernels::Isa::SCALAR;
+
+namespace {
+	struct Setup final {
+		Setup() {
+			Kernels::Isa isa = Kernels::best();
+
+			if ( util::CStr simd = std::getenv( "LLLM_SIMD" ) ) {
+				for ( Kernels::Isa i : { Kernels::Isa::SCALAR, Kernels::Isa::SSE2, Kernels::Isa::AVX2 } ) {
+					if ( std::strcmp( simd, Kernels::name( i ) ) == 0 ) isa = i;
+				}
+			}
+
+			Kernels::use( isa );
+		}
+	} setup;
+}
+
+Kernels::Isa Kernels::best() {
+#ifdef LLLM_X86
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" ) ) return Isa::AVX2;
+	return Isa::SSE2;
+#else
+	return Isa::SCALAR;
+#endif
+}
+
+void Kernels::use( Isa isa ) {
+	if ( isa > best() ) isa = best();
+
+	switch ( isa ) {
+#ifdef LLLM_X86
+		case Isa::AVX2: active = &AVX2; break;
+		case Isa::SSE2: active = &SSE2; break;
+#endif
+		default:        active = &SCALAR; isa = Isa::SCALAR; break;
+	}
+
+	activeIsa = isa;
+}
+
+Kernels::Isa Kernels::current() { return activeIsa; }
+
+util::CStr Kernels::name( Isa isa ) {
+	switch ( isa ) {
+		case Isa::SCALAR: return "scalar";
+		case Isa::SSE2:   return "sse2";
+		case Isa::AVX2:   return "avx2";
+	}
+	return "?";
+}
+
+void   Kernels::add(   const double* a, const double* b, double* out, size_t n ) { active->addF( a, b, out, n ); }
+void   Kernels::mul(   const double* a, const double* b, double* out, size_t n ) { active->mulF( a, b, out, n ); }
+void   Kernels::scale( const double* a, double k,        double* out, size_t n ) { active->scaleF( a, k, out, n ); }
+double Kernels::dot(   const double* a, const double* b, size_t n )              { return active->dotF( a, b, n ); }
+double Kernels::sum(   const double* a, size_t n )                               { return active->sumF( a, n ); }
+double Kernels::min(   const double* a, size_t n )                               { return active->minF( a, n ); }
+double Kernels::max(   const double* a, size_t n )                               { return active->maxF( a, n ); }
+
+void   Kernels::add(   const long* a, const long* b, long* out, size_t n )       { active->addI( a, b, out, n ); }
+void   Kernels::mul(   const long* a, const long* b, long* out, size_t n )       { active->mulI( a, b, out, n ); }
+void   Kernels::scale( const long* a, long k,        long* out, size_t n )       { active->scaleI( a, k, out, n ); }
+long   Kernels::dot(   const long* a, const long* b, size_t n )                  { return active->dotI( a, b, n ); }
+long   Kernels::sum(   const long* a, size_t n )                                 { return active->sumI( a, n ); }
+long   Kernels::min(   const long* a, size_t n )                                 { return active->minI( a, n ); }
+long   Kernels::max(   const long* a, size_t n )                                 { return active->maxI( a, n ); }
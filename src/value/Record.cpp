@@ -0,0 +1,167 @@
+#include "lllm/value/Value.hpp"
+#include "lllm/value/Telemetry.hpp"
+#include "lllm/value/Gc.hpp"
+#include "lllm/value/Heap.hpp"
+#include "lllm/value/ValueIO.hpp"
+#include "lllm/ast/Ast.hpp"
+#include "lllm/util/fail.hpp"
+
+#include <map>
+#include <mutex>
+#include <string>
+
+using namespace lllm;
+using namespace lllm::value;
+using namespace lllm::util;
+
+static SourceLocation record_location("*record*");
+
+// the env of a record function holds its type and the index of its field (for accessors).
+// neither is a value, the ast of the function has no body, so only the code below looks at them
+static inline RecordTypePtr typeIn( LambdaPtr fn )  { return reinterpret_cast<RecordTypePtr>( fn->env[0] ); }
+static inline size_t        fieldIn( LambdaPtr fn ) { return reinterpret_cast<size_t>( fn->env[1] );        }
+
+namespace {
+	// the code of the constructor of records with N fields takes N values
+	template<size_t N, typename... Vs>
+	struct Constructor : Constructor<N - 1, ValuePtr, Vs...> {};
+	template<typename... Vs>
+	struct Constructor<0, Vs...> {
+		static ValuePtr make( LambdaPtr fn, Vs... vs ) {
+			// one more, so records without fields have an array too
+			ValuePtr fields[] = { vs..., nullptr };
+			return Record::alloc( typeIn( fn ), fields );
+		}
+	};
+}
+
+static const Lambda::FnPtr CONSTRUCTORS[] = {
+	(Lambda::FnPtr) Constructor< 0>::make, (Lambda::FnPtr) Constructor< 1>::make, (Lambda::FnPtr) Constructor< 2>::make,
+	(Lambda::FnPtr) Constructor< 3>::make, (Lambda::FnPtr) Constructor< 4>::make, (Lambda::FnPtr) Constructor< 5>::make,
+	(Lambda::FnPtr) Constructor< 6>::make, (Lambda::FnPtr) Constructor< 7>::make, (Lambda::FnPtr) Constructor< 8>::make,
+	(Lambda::FnPtr) Constructor< 9>::make, (Lambda::FnPtr) Constructor<10>::make, (Lambda::FnPtr) Constructor<11>::make,
+	(Lambda::FnPtr) Constructor<12>::make, (Lambda::FnPtr) Constructor<13>::make,
+};
+static_assert( sizeof(CONSTRUCTORS) / sizeof(CONSTRUCTORS[0]) == MAX_ARITY + 1, "There must be a constructor for every arity" );
+
+static ValuePtr isRecord( LambdaPtr fn, ValuePtr val ) {
+	RecordPtr r = Value::asRecord( val );
+	return (r && r->type == typeIn( fn )) ? True() : nullptr;
+}
+// compiled code loads the field itself and only calls this when the check fails (see Jit)
+static ValuePtr getField( LambdaPtr fn, ValuePtr val ) {
+	RecordPtr r = Value::asRecord( val );
+
+	if ( !r || r->type != typeIn( fn ) ) {
+		LLLM_FAIL( "builtin function '" << fn->data->ast->name << "' expects a " << typeIn( fn )->name << ", not " << val );
+	}
+
+	return r->fields[fieldIn( fn )];
+}
+
+// a function like a builtin, without body, whose env holds the type and a field
+static LambdaPtr makeFn( RecordTypePtr type, const std::string& name, size_t arity, Lambda::FnPtr code, size_t field ) {
+	ast::Lambda::Bindings params, env;
+
+	for ( size_t i = 0; i < arity; i++ ) params.push_back( ast::Variable::makeParameter( record_location, "arg" ) );
+	env.push_back( ast::Variable::makeParameter( record_location, "type"  ) );
+	env.push_back( ast::Variable::makeParameter( record_location, "field" ) );
+
+	auto ast = new ast::Lambda( record_location, InternedString( name.c_str() ), params, env, nullptr );
+	auto fn  = Lambda::alloc( ast, code );
+
+	fn->env[0] = reinterpret_cast<ValuePtr>( type );
+	fn->env[1] = reinterpret_cast<ValuePtr>( field );
+	Gc::written( fn );
+
+	return fn;
+}
+
+RecordType::RecordType( const InternedString& name, const std::vector<InternedString>& fields ) : name( name ), fields( fields ) {
+	std::string prefix( (CStr) name );
+
+	_constructor = makeFn( this, "make-" + prefix, fields.size(), CONSTRUCTORS[fields.size()], 0 );
+	_predicate   = makeFn( this, prefix + "?",     1,             (Lambda::FnPtr) isRecord,     0 );
+
+	for ( size_t i = 0; i < fields.size(); i++ ) {
+		_accessors.push_back( makeFn( this, prefix + "-" + (CStr) fields[i], 1, (Lambda::FnPtr) getField, i ) );
+	}
+}
+
+RecordTypePtr RecordType::get( const InternedString& name, const std::vector<InternedString>& fields ) {
+	if ( fields.size() > size_t( MAX_ARITY ) ) {
+		LLLM_FAIL( "Record " << name << " has " << fields.size() << " fields, at most " << MAX_ARITY << " are supported" );
+	}
+
+	// interned strings are unique, so the key compares them by address
+	typedef std::vector<CStr> Key;
+	static auto       types = new std::map<Key, RecordTypePtr>();
+	static std::mutex lock;
+
+	std::lock_guard<std::mutex> guard( lock );
+
+	Key key( 1, (CStr) name );
+	for ( auto& field : fields ) key.push_back( field );
+
+	RecordTypePtr& type = (*types)[key];
+
+	// like symbols types live forever, the collector still scans them for their functions
+	if ( !type ) type = new (NoGC) RecordType( name, fields );
+
+	return type;
+}
+
+size_t RecordType::numFields() const { return fields.size(); }
+
+bool RecordType::fieldIndex( const InternedString& field, size_t* dst ) const {
+	for ( size_t i = 0; i < fields.size(); i++ ) {
+		if ( fields[i] == field ) {
+			*dst = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+LambdaPtr RecordType::constructor()            const { return _constructor;        }
+LambdaPtr RecordType::predicate()              const { return _predicate;          }
+LambdaPtr RecordType::accessor( size_t field ) const { return _accessors.at( field ); }
+
+bool RecordType::isConstructor( LambdaPtr fn, RecordTypePtr* type ) {
+	if ( fn->arity() > size_t( MAX_ARITY ) || fn->code != CONSTRUCTORS[fn->arity()] ) return false;
+
+	*type = typeIn( fn );
+	return true;
+}
+bool RecordType::isPredicate( LambdaPtr fn, RecordTypePtr* type ) {
+	if ( fn->code != (Lambda::FnPtr) isRecord ) return false;
+
+	*type = typeIn( fn );
+	return true;
+}
+bool RecordType::isAccessor( LambdaPtr fn, RecordTypePtr* type, size_t* field ) {
+	if ( fn->code != (Lambda::FnPtr) getField ) return false;
+
+	*type  = typeIn( fn );
+	*field = fieldIn( fn );
+	return true;
+}
+
+Record::Record( RecordTypePtr type ) : Value( Type::Record ), type( type ) {}
+
+Record* Record::alloc( RecordTypePtr type, const ValuePtr* fields ) {
+	size_t n = type->numFields();
+
+	// the fields are values, so the record must be allocated in scanned memory
+	Telemetry::allocated( Type::Record, sizeof(Record) + n * sizeof(ValuePtr) );
+	void* memory = Heap::local().alloc( sizeof(Record) + n * sizeof(ValuePtr) );
+	if ( !memory ) LLLM_FAIL( "Out of memory for a " << type->name );
+
+	Record* r = new (memory) Record( type );
+
+	// only written here, before anyone else sees the record
+	for ( size_t i = 0; i < n; i++ ) r->fields[i] = fields[i];
+	Gc::written( r );
+
+	return r;
+}
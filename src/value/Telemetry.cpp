@@ -0,0 +1,238 @@
+
+#include "lllm/value/Telemetry.hpp"
+#include "lllm/value/Gc.hpp"
+#include "lllm/value/HashCons.hpp"
+#include "lllm/value/ValueIO.hpp"
+#include "lllm/ast/Ast.hpp"
+#include "lllm/util/util_io.hpp"
+
+#include <gc.h>
+#include <gc_allocator.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+using namespace lllm;
+using namespace lllm::value;
+
+typedef std::chrono::steady_clock Clock;
+
+bool                 Telemetry::on      = false;
+__thread Lambda::DataPtr Telemetry::current = nullptr;
+Telemetry::Counter   Telemetry::counters[size_t(Type::END) + 1];
+
+static Telemetry::GcStats gcStats;
+static Clock::time_point  gcStart;
+static Clock::duration    gcPause;
+static util::CStr         jsonFile = nullptr;
+
+static std::vector<Lambda::DataPtr, traceable_allocator<Lambda::DataPtr>>& functions() {
+	static auto fns = new std::vector<Lambda::DataPtr, traceable_allocator<Lambda::DataPtr>>();
+	return *fns;
+}
+
+// called with the GC lock held, must not allocate.
+// a pause is the stopped mark plus the reclaim that follows it,
+// incremental collections only stop the world for these phases.
+static void GC_CALLBACK onCollectionEvent( GC_EventType event ) {
+	switch ( event ) {
+		case GC_EVENT_MARK_START:
+		case GC_EVENT_RECLAIM_START:
+			gcStart = Clock::now();
+			break;
+		case GC_EVENT_MARK_END:
+			gcPause += Clock::now() - gcStart;
+			break;
+		case GC_EVENT_RECLAIM_END: {
+			gcPause += Clock::now() - gcStart;
+
+			unsigned long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>( gcPause ).count();
+
+			size_t bucket = 0;
+			while ( (bucket < Telemetry::PAUSE_BUCKETS - 1) && (ns >= (64000ull << bucket)) ) bucket++;
+
+			gcStats.collections++;
+			gcStats.totalPauseNs += ns;
+			gcStats.pauses[bucket]++;
+			if ( ns > gcStats.maxPauseNs ) gcStats.maxPauseNs = ns;
+
+			gcPause = Clock::duration::zero();
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+static void dumpJson() {
+	if ( std::strcmp( jsonFile, "-" ) == 0 ) {
+		Telemetry::printJson( std::cerr );
+	} else {
+		std::ofstream out( jsonFile );
+		Telemetry::printJson( out );
+	}
+}
+
+namespace {
+	struct Setup final {
+		Setup() {
+			GC_set_on_collection_event( onCollectionEvent );
+
+			if ( util::CStr file = std::getenv( "LLLM_TELEMETRY" ) ) {
+				Telemetry::enable( true );
+				Telemetry::dumpJsonAtExit( file );
+			}
+		}
+	} setup;
+}
+
+void Telemetry::enable( bool b ) { on = b; }
+bool Telemetry::enabled()        { return on; }
+
+void Telemetry::reset() {
+	for ( Counter& c : counters ) c = Counter{ 0, 0 };
+
+	for ( Lambda::DataPtr data : functions() ) {
+		data->allocCnt   = 0;
+		data->allocBytes = 0;
+	}
+
+	cacheHits   = 0;
+	cacheMisses = 0;
+}
+
+Telemetry::Counter Telemetry::allocations( Type t ) {
+	if ( t > Type::Lambda ) t = Type::Lambda;
+
+	return counters[size_t(t)];
+}
+
+Telemetry::GcStats Telemetry::gc() {
+	GC_word heap, free, unmapped, sinceGc, total;
+	GC_get_heap_usage_safe( &heap, &free, &unmapped, &sinceGc, &total );
+
+	GcStats stats = gcStats;
+	stats.heapSize      = heap;
+	stats.freeBytes     = free;
+	stats.unmappedBytes = unmapped;
+	stats.bytesSinceGc  = sinceGc;
+	stats.totalBytes    = total;
+	return stats;
+}
+
+void Telemetry::addFunction( Lambda::DataPtr data ) {
+	functions().push_back( data );
+}
+
+void Telemetry::dumpJsonAtExit( util::CStr file ) {
+	bool registered = jsonFile != nullptr;
+
+	jsonFile = strdup( file );
+
+	if ( !registered ) std::atexit( dumpJson );
+}
+
+static inline util::CStr functionName( Lambda::DataPtr data ) {
+	util::CStr name = data->ast ? (util::CStr) data->ast->name : "";
+	return *name ? name : "<anonymous>";
+}
+
+void Telemetry::print( std::ostream& os ) {
+	GcStats stats = gc();
+
+	os << "allocations:" << std::endl;
+	for ( Type t = Type::BEGIN; t <= Type::END; t = Type( size_t( t ) + 1 ) ) {
+		Counter c = allocations( t );
+		os << "  " << t << ": " << c.count << " (" << c.bytes << " bytes)" << std::endl;
+	}
+	os << "  int cache: " << cacheHits << " hits, " << cacheMisses << " misses" << std::endl;
+
+	if ( HashCons::enabled() ) {
+		HashCons::Stats hc = HashCons::stats();
+		os << "  hash consing: " << hc.shared << " of " << hc.lookups << " conses shared (" << hc.bytesSaved() << " bytes saved), ";
+		os << hc.entries << " cells in table" << std::endl;
+	}
+
+	os << "gc:" << std::endl;
+	if ( Gc::mode() == Gc::Mode::INCREMENTAL ) {
+		os << "  mode: incremental, pause goal " << Gc::pauseGoal() << "ms" << std::endl;
+	} else {
+		os << "  mode: stop the world" << std::endl;
+	}
+	os << "  markers: " << Gc::markers() << std::endl;
+	os << "  collections: " << stats.collections << std::endl;
+	os << "  pause total: " << (stats.totalPauseNs / 1000) << "us, max: " << (stats.maxPauseNs / 1000) << "us" << std::endl;
+	for ( size_t i = 0; i < PAUSE_BUCKETS; i++ ) {
+		if ( stats.pauses[i] ) os << "  pause < " << (64ull << i) << "us: " << stats.pauses[i] << std::endl;
+	}
+	os << "  heap: " << stats.heapSize << " bytes, " << stats.freeBytes << " free, " << stats.unmappedBytes << " unmapped" << std::endl;
+	os << "  allocated: " << stats.totalBytes << " bytes, " << stats.bytesSinceGc << " since last collection" << std::endl;
+
+	os << "functions:" << std::endl;
+	for ( Lambda::DataPtr data : functions() ) {
+		os << "  " << functionName( data );
+		if ( data->ast ) os << " @ " << data->ast->location;
+		os << ": " << data->callCnt << " calls, " << data->allocCnt << " allocations (" << data->allocBytes << " bytes)";
+		if ( data->callCnt ) os << ", " << (double( data->allocBytes ) / data->callCnt) << " bytes/call";
+		os << std::endl;
+	}
+}
+
+void Telemetry::printJson( std::ostream& os ) {
+	GcStats stats = gc();
+
+	os << "{\n";
+
+	os << "  \"allocations\": {";
+	for ( Type t = Type::BEGIN; t <= Type::END; t = Type( size_t( t ) + 1 ) ) {
+		Counter c = allocations( t );
+		os << (t == Type::BEGIN ? "\n" : ",\n");
+		os << "    \"" << t << "\": { \"count\": " << c.count << ", \"bytes\": " << c.bytes << " }";
+	}
+	os << "\n  },\n";
+
+	os << "  \"intCache\": { \"hits\": " << cacheHits << ", \"misses\": " << cacheMisses << " },\n";
+
+	HashCons::Stats hc = HashCons::stats();
+	os << "  \"hashCons\": { \"enabled\": " << (HashCons::enabled() ? "true" : "false");
+	os << ", \"lookups\": " << hc.lookups << ", \"shared\": " << hc.shared;
+	os << ", \"bytesSaved\": " << hc.bytesSaved() << ", \"entries\": " << hc.entries << " },\n";
+
+	os << "  \"gc\": {\n";
+	os << "    \"mode\": \"" << (Gc::mode() == Gc::Mode::INCREMENTAL ? "incremental" : "stop-the-world") << "\",\n";
+	os << "    \"pauseGoalMs\": "   << Gc::pauseGoal()     << ",\n";
+	os << "    \"markers\": "       << Gc::markers()       << ",\n";
+	os << "    \"collections\": "   << stats.collections   << ",\n";
+	os << "    \"totalPauseNs\": "  << stats.totalPauseNs  << ",\n";
+	os << "    \"maxPauseNs\": "    << stats.maxPauseNs    << ",\n";
+	os << "    \"pauseHistogramUs\": [";
+	for ( size_t i = 0; i < PAUSE_BUCKETS; i++ ) {
+		os << (i ? ", " : " ") << "{ \"lt\": " << (64ull << i) << ", \"count\": " << stats.pauses[i] << " }";
+	}
+	os << " ],\n";
+	os << "    \"heapSize\": "      << stats.heapSize      << ",\n";
+	os << "    \"freeBytes\": "     << stats.freeBytes     << ",\n";
+	os << "    \"unmappedBytes\": " << stats.unmappedBytes << ",\n";
+	os << "    \"bytesSinceGc\": "  << stats.bytesSinceGc  << ",\n";
+	os << "    \"totalBytes\": "    << stats.totalBytes    << "\n";
+	os << "  },\n";
+
+	os << "  \"functions\": [";
+	bool first = true;
+	for ( Lambda::DataPtr data : functions() ) {
+		os << (first ? "\n" : ",\n");
+		os << "    { \"name\": \"" << functionName( data ) << "\"";
+		if ( data->ast ) os << ", \"location\": \"" << data->ast->location << "\"";
+		os << ", \"calls\": " << data->callCnt;
+		os << ", \"allocations\": " << data->allocCnt;
+		os << ", \"bytes\": " << data->allocBytes << " }";
+		first = false;
+	}
+	os << (first ? "]\n" : "\n  ]\n");
+
+	os << "}" << std::endl;
+}
@@ -1,10 +1,18 @@
 
 #include "lllm/value/Value.hpp"
+#include "lllm/value/Telemetry.hpp"
+#include "lllm/value/Gc.hpp"
+#include "lllm/value/Heap.hpp"
+#include "lllm/value/HashCons.hpp"
 #include "lllm/ast/Ast.hpp"
 #include "lllm/util/InternedString.hpp"
+#include "lllm/util/fail.hpp"
 
+#include <cstdint>
 #include <cstring>
 #include <cstdlib>
+#include <mutex>
+#include <unordered_map>
 
 #include <iostream>
 #include "lllm/value/ValueIO.hpp"
@@ -23,16 +31,89 @@ String::String( CStr value )                  : Value( Type::String ), value( va
 Symbol::Symbol( const InternedString& value ) : Value( Type::Symbol ), value( value ) {}
 Ref::Ref()                                    : Ref( nullptr ) {}
 Ref::Ref( ValuePtr value )                    : Value( Type::Ref ), value( value ) {}
+Future::Future( TaskPtr task )                : Value( Type::Future ), task( task ) {}
+Channel::Channel( size_t capacity )           : Value( Type::Channel ), mask( capacity - 1 ), cells( (Cell*) GC_MALLOC( capacity * sizeof(Cell) ) ), head( 0 ), tail( 0 ) {
+	if ( !cells ) LLLM_FAIL( "Out of memory" );
+
+	// a free cell holds twice the position it will be sent at, a full one that + 1.
+	// doubled so that a channel of capacity one can tell full from free
+	for ( size_t i = 0; i < capacity; i++ ) cells[i] = Cell{ 2 * i, nullptr };
+	Gc::written( cells );
+}
+Vector::Vector( size_t length )               : Value( Type::Vector ), length( length ) {}
+F64Vector::F64Vector( size_t length )         : Value( Type::F64Vector ), length( length ) {}
+I64Vector::I64Vector( size_t length )         : Value( Type::I64Vector ), length( length ) {}
 Lambda::Lambda( size_t        arity, 
                 Lambda::Data* data,
                 Lambda::FnPtr code     ) : Value( Type(size_t(Type::Lambda) + arity) ), code( code ), data( data ) {}
 
-ValuePtr Ref::get()             const { return value; }
+ValuePtr Ref::get()             const { return __atomic_load_n( &value, __ATOMIC_SEQ_CST ); }
 ValuePtr Ref::set( ValuePtr v ) const {
-	ValuePtr old = value;
-	value = v;
+	ValuePtr old = __atomic_exchange_n( &value, v, __ATOMIC_SEQ_CST );
+	Gc::written( this );
 	return old;
 }
+bool Ref::compareAndSet( ValuePtr expected, ValuePtr v ) const {
+	if ( !__atomic_compare_exchange_n( &value, &expected, v, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ) ) return false;
+
+	Gc::written( this );
+	return true;
+}
+
+bool Channel::trySend( ValuePtr v ) const {
+	size_t pos = __atomic_load_n( &tail, __ATOMIC_RELAXED );
+	Cell*  cell;
+
+	for (;;) {
+		cell = &cells[pos & mask];
+
+		size_t   seq  = __atomic_load_n( &cell->sequence, __ATOMIC_ACQUIRE );
+		intptr_t diff = intptr_t( seq ) - intptr_t( 2 * pos );
+
+		if ( diff == 0 ) {
+			// a failed compare and swap loads the new tail into pos
+			if ( __atomic_compare_exchange_n( &tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) ) break;
+		} else if ( diff < 0 ) {
+			// the receiver of the last round has not taken this cell yet
+			return false;
+		} else {
+			pos = __atomic_load_n( &tail, __ATOMIC_RELAXED );
+		}
+	}
+
+	cell->value = v;
+	Gc::written( cells );
+	__atomic_store_n( &cell->sequence, 2 * pos + 1, __ATOMIC_RELEASE );
+	return true;
+}
+bool Channel::tryReceive( ValuePtr* v ) const {
+	size_t pos = __atomic_load_n( &head, __ATOMIC_RELAXED );
+	Cell*  cell;
+
+	for (;;) {
+		cell = &cells[pos & mask];
+
+		size_t   seq  = __atomic_load_n( &cell->sequence, __ATOMIC_ACQUIRE );
+		intptr_t diff = intptr_t( seq ) - intptr_t( 2 * pos + 1 );
+
+		if ( diff == 0 ) {
+			if ( __atomic_compare_exchange_n( &head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) ) break;
+		} else if ( diff < 0 ) {
+			// nothing was sent to this cell yet
+			return false;
+		} else {
+			pos = __atomic_load_n( &head, __ATOMIC_RELAXED );
+		}
+	}
+
+	*v = cell->value;
+	// the channel does not keep what it passed on alive
+	cell->value = nullptr;
+	Gc::written( cells );
+	__atomic_store_n( &cell->sequence, 2 * (pos + mask + 1), __ATOMIC_RELEASE );
+	return true;
+}
+size_t Channel::capacity() const { return mask + 1; }
 
 bool lllm::operator==( const Value& a, const Value& b ) {
 	return equal( &a, &b );
@@ -47,15 +128,52 @@ bool value::equal( ValuePtr a, ValuePtr b ) {
 		bool visit( ValuePtr  a, ValuePtr b ) const { return false; }
 
 		bool visit( NilPtr    a, NilPtr    b ) const { return true; }
-		bool visit( ConsPtr   a, ConsPtr   b ) const { return equal( a->car, b->car ) && equal( a->cdr, b->cdr ); }
+		bool visit( ConsPtr   a, ConsPtr   b ) const {
+			// hash consed lists are shared
+			if ( a == b ) return true;
+
+			return equal( a->car, b->car ) && equal( a->cdr, b->cdr );
+		}
 		bool visit( IntPtr    a, IntPtr    b ) const { return a->value == b->value; }
 		bool visit( RealPtr   a, IntPtr    b ) const { return a->value == b->value; }
 		bool visit( IntPtr    a, RealPtr   b ) const { return a->value == b->value; }
 		bool visit( RealPtr   a, RealPtr   b ) const { return a->value == b->value; }
 		bool visit( CharPtr   a, CharPtr   b ) const { return a->value == b->value; }
 		bool visit( StringPtr a, StringPtr b ) const { return std::strcmp( a->value, b->value ) == 0; }
-		bool visit( SymbolPtr a, SymbolPtr b ) const { return a->value == b->value; }
+		bool visit( SymbolPtr a, SymbolPtr b ) const { return a == b; }
 		bool visit( RefPtr    a, RefPtr    b ) const { return a == b; }
+		bool visit( FuturePtr a, FuturePtr b ) const { return a == b; }
+		bool visit( ChannelPtr a, ChannelPtr b ) const { return a == b; }
+		bool visit( VectorPtr a, VectorPtr b ) const {
+			if ( a == b ) return true;
+			if ( a->length != b->length ) return false;
+
+			for ( size_t i = 0; i < a->length; i++ ) {
+				if ( !equal( a->elements[i], b->elements[i] ) ) return false;
+			}
+			return true;
+		}
+		bool visit( F64VectorPtr a, F64VectorPtr b ) const {
+			if ( a->length != b->length ) return false;
+
+			for ( size_t i = 0; i < a->length; i++ ) {
+				if ( a->elements[i] != b->elements[i] ) return false;
+			}
+			return true;
+		}
+		bool visit( I64VectorPtr a, I64VectorPtr b ) const {
+			return a->length == b->length && std::memcmp( a->elements, b->elements, a->length * sizeof(long) ) == 0;
+		}
+		bool visit( HashTablePtr a, HashTablePtr b ) const { return a == b; }
+		bool visit( RecordPtr a, RecordPtr b ) const {
+			if ( a == b ) return true;
+			if ( a->type != b->type ) return false;
+
+			for ( size_t i = 0; i < a->type->numFields(); i++ ) {
+				if ( !equal( a->fields[i], b->fields[i] ) ) return false;
+			}
+			return true;
+		}
 		bool visit( LambdaPtr a, LambdaPtr b ) const { return a == b; }
 	};
 	struct V2 final {
@@ -67,6 +185,13 @@ bool value::equal( ValuePtr a, ValuePtr b ) {
 		bool visit( StringPtr a, ValuePtr b ) const { return value::visit<bool>( b, V1(), a ); }
 		bool visit( SymbolPtr a, ValuePtr b ) const { return value::visit<bool>( b, V1(), a ); }
 		bool visit( RefPtr    a, ValuePtr b ) const { return value::visit<bool>( b, V1(), a ); }		
+		bool visit( FuturePtr a, ValuePtr b ) const { return value::visit<bool>( b, V1(), a ); }
+		bool visit( ChannelPtr a, ValuePtr b ) const { return value::visit<bool>( b, V1(), a ); }
+		bool visit( VectorPtr a, ValuePtr b ) const { return value::visit<bool>( b, V1(), a ); }
+		bool visit( F64VectorPtr a, ValuePtr b ) const { return value::visit<bool>( b, V1(), a ); }
+		bool visit( I64VectorPtr a, ValuePtr b ) const { return value::visit<bool>( b, V1(), a ); }
+		bool visit( HashTablePtr a, ValuePtr b ) const { return value::visit<bool>( b, V1(), a ); }
+		bool visit( RecordPtr a, ValuePtr b ) const { return value::visit<bool>( b, V1(), a ); }
 		bool visit( LambdaPtr a, ValuePtr b ) const { return value::visit<bool>( b, V1(), a ); }
 	};
 
@@ -77,6 +202,61 @@ bool value::equal( ValuePtr a, ValuePtr b ) {
 	return eq;
 }
 
+static inline size_t mix( size_t h ) {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdUL;
+	h ^= h >> 33;
+	return h;
+}
+// ints and reals with the same value are equal
+static inline size_t hashDouble( double d ) {
+	long l = (long) d;
+	if ( double( l ) == d ) return mix( l );
+
+	size_t bits;
+	std::memcpy( &bits, &d, sizeof(bits) );
+	return mix( bits );
+}
+
+size_t value::hash( ValuePtr v ) {
+	switch ( typeOf( v ) ) {
+		case Type::Nil:    return 0x9e3779b97f4a7c15UL;
+		case Type::Int:    return mix( static_cast<IntPtr>( v )->value );
+		case Type::Real:   return hashDouble( static_cast<RealPtr>( v )->value );
+		case Type::Char:   return mix( static_cast<CharPtr>( v )->value ) + 1;
+		case Type::String: {
+			size_t h = 0xcbf29ce484222325UL;
+			for ( CStr c = static_cast<StringPtr>( v )->value; *c; c++ ) h = (h ^ (unsigned char) *c) * 0x100000001b3UL;
+			return h;
+		}
+		case Type::Symbol: return mix( (size_t)(CStr) static_cast<SymbolPtr>( v )->value );
+		case Type::Cons: {
+			ConsPtr c = static_cast<ConsPtr>( v );
+
+			return hash( c->car, c->cdr );
+		}
+		// the elements may change, so vectors hash by length only.
+		// a hash that depended on them would go stale in hash tables and in the hashes of conses
+		case Type::Vector:    return mix( static_cast<VectorPtr>( v )->length ) + 2;
+		case Type::F64Vector: return mix( static_cast<F64VectorPtr>( v )->length ) + 3;
+		case Type::I64Vector: return mix( static_cast<I64VectorPtr>( v )->length ) + 4;
+		// records can not change, but their fields may
+		case Type::Record: {
+			RecordPtr r = static_cast<RecordPtr>( v );
+
+			size_t h = mix( (size_t) r->type ) + 5;
+			for ( size_t i = 0; i < r->type->numFields(); i++ ) h = mix( h * 31 + hash( r->fields[i] ) );
+			return h;
+		}
+		// refs, futures, channels, hash tables and lambdas are only equal to themselves
+		default:           return mix( (size_t) v );
+	}
+}
+
+size_t value::hash( ValuePtr car, ListPtr cdr ) {
+	return mix( hash( car ) * 31 + hash( cdr ) );
+}
+
 bool Value::isList( ValuePtr val ) {
 	return typeOf( val ) <= Type::Cons;
 }
@@ -127,29 +307,128 @@ unsigned long long value::cacheMisses = 0;
 NilPtr    value::nil   = nullptr;
 ValuePtr  value::True() { return number(1); }
 ValuePtr  value::False = nullptr;
-ConsPtr   value::cons( ValuePtr car, ListPtr cdr )           { return new Cons( car, cdr );  }
+ConsPtr   value::cons( ValuePtr car, ListPtr cdr ) {
+	if ( HashCons::enabled() ) return HashCons::cons( car, cdr );
+
+	Telemetry::allocated( Type::Cons, sizeof(Cons) );
+	return new (Heap::local().alloc( sizeof(Cons) )) Cons( car, cdr );
+}
 IntPtr    value::number( int    value )                      { return number( (long)value ); }
 IntPtr    value::number( long   value )                      { 
 	if ( (MIN_INT <= value) && (value <= MAX_INT) ) {
 		IntPtr i = INTS[value + MAX_INT];
 
-		if ( !i ) { i = INTS[value + MAX_INT] = new Int( value ); }
-//		else { cacheHits++; }
+		if ( !i ) { i = INTS[value + MAX_INT] = new (PointerFreeGC) Int( value ); }
+		else { cacheHits++; }
 
 		return i;
-//	} else {
-//		cacheMisses++; 
+	} else {
+		cacheMisses++; 
+	}
+
+	Telemetry::allocated( Type::Int, sizeof(Int) );
+	return new (PointerFreeGC) Int( value );      
+}
+// numbers and characters contain no pointers, the GC does not need to scan them
+RealPtr   value::number( float  value )                      { return number( (double)value ); }
+RealPtr   value::number( double value ) {
+	Telemetry::allocated( Type::Real, sizeof(Real) );
+	return new (PointerFreeGC) Real( value );
+}
+CharPtr   value::character( char value ) {
+	Telemetry::allocated( Type::Char, sizeof(Char) );
+	return new (PointerFreeGC) Char( value );
+}
+StringPtr value::string( util::CStr value ) {
+	Telemetry::allocated( Type::String, sizeof(String) );
+	return new String( value );
+}
+SymbolPtr value::symbol( const util::InternedString& value ) {
+	// interned strings are unique, so they can be compared by address
+	static auto       symbols = new std::unordered_map<CStr, SymbolPtr>();
+	static std::mutex lock;
+
+	std::lock_guard<std::mutex> guard( lock );
+
+	SymbolPtr& sym = (*symbols)[value];
+
+	if ( !sym ) {
+		Telemetry::allocated( Type::Symbol, sizeof(Symbol) );
+		// like interned strings symbols live forever, the table is not scanned by the GC
+		sym = new (NoGC) Symbol( value );
 	}
 
-	return new Int( value );      
+	return sym;
 }
-RealPtr   value::number( float  value )                      { return new Real( value );     }
-RealPtr   value::number( double value )                      { return new Real( value );     }
-CharPtr   value::character( char value )                     { return new Char( value );     }
-StringPtr value::string( util::CStr value )                  { return new String( value );   }
-SymbolPtr value::symbol( const util::InternedString& value ) { return new Symbol( value );   }
 RefPtr    value::ref()                                       { return ref( nullptr );        }
-RefPtr    value::ref( ValuePtr value )                       { return new Ref( value );      }
+RefPtr    value::ref( ValuePtr value ) {
+	Telemetry::allocated( Type::Ref, sizeof(Ref) );
+	return new Ref( value );
+}
+FuturePtr value::future( TaskPtr task ) {
+	Telemetry::allocated( Type::Future, sizeof(Future) );
+	return new Future( task );
+}
+ChannelPtr value::channel( size_t capacity ) {
+	if ( capacity > Channel::MAX_CAPACITY ) LLLM_FAIL( "A channel can hold at most " << Channel::MAX_CAPACITY << " values, not " << capacity );
+
+	size_t rounded = 1;
+	while ( rounded < capacity ) rounded *= 2;
+
+	Telemetry::allocated( Type::Channel, sizeof(Channel) + rounded * sizeof(void*) * 2 );
+	return new Channel( rounded );
+}
+VectorPtr value::vector( size_t length, ValuePtr fill ) {
+	return Vector::alloc( length, fill );
+}
+
+Vector* Vector::alloc( size_t length, ValuePtr fill ) {
+	if ( length > (SIZE_MAX - sizeof(Vector)) / sizeof(ValuePtr) ) LLLM_FAIL( "A vector of " << length << " elements is too large" );
+
+	// the elements are values, so the vector must be allocated in scanned memory
+	Telemetry::allocated( Type::Vector, sizeof(Vector) + length * sizeof(ValuePtr) );
+	void* memory = Heap::local().alloc( sizeof(Vector) + length * sizeof(ValuePtr) );
+	if ( !memory ) LLLM_FAIL( "Out of memory for a vector of " << length << " elements" );
+
+	Vector* vec = new (memory) Vector( length );
+
+	for ( size_t i = 0; i < length; ++i ) {
+		vec->elements[i] = fill;
+	}
+	Gc::written( vec );
+
+	return vec;
+}
+
+// the elements are plain numbers, the collector does not have to look at them
+F64Vector* F64Vector::alloc( size_t length, double fill ) {
+	if ( length > (SIZE_MAX - sizeof(F64Vector)) / sizeof(double) ) LLLM_FAIL( "A vector of " << length << " elements is too large" );
+
+	Telemetry::allocated( Type::F64Vector, sizeof(F64Vector) + length * sizeof(double) );
+	void* memory = GC_MALLOC_ATOMIC( sizeof(F64Vector) + length * sizeof(double) );
+	if ( !memory ) LLLM_FAIL( "Out of memory for a vector of " << length << " elements" );
+
+	F64Vector* vec = new (memory) F64Vector( length );
+
+	for ( size_t i = 0; i < length; ++i ) {
+		vec->elements[i] = fill;
+	}
+	return vec;
+}
+I64Vector* I64Vector::alloc( size_t length, long fill ) {
+	if ( length > (SIZE_MAX - sizeof(I64Vector)) / sizeof(long) ) LLLM_FAIL( "A vector of " << length << " elements is too large" );
+
+	Telemetry::allocated( Type::I64Vector, sizeof(I64Vector) + length * sizeof(long) );
+	void* memory = GC_MALLOC_ATOMIC( sizeof(I64Vector) + length * sizeof(long) );
+	if ( !memory ) LLLM_FAIL( "Out of memory for a vector of " << length << " elements" );
+
+	I64Vector* vec = new (memory) I64Vector( length );
+
+	for ( size_t i = 0; i < length; ++i ) {
+		vec->elements[i] = fill;
+	}
+	return vec;
+}
 
 Lambda* Lambda::alloc( ast::LambdaPtr ast ) {
 	return alloc( ast, nullptr );
@@ -162,26 +441,31 @@ Lambda* Lambda::alloc( ast::LambdaPtr ast, Lambda::FnPtr code ) {
 //	data->ast = ast;
 	if ( code ) data->code = code;
 
-	void* memory = new char[sizeof(Lambda) + envSize * sizeof(ValuePtr)];
+	// the env holds values, so the closure must be allocated in scanned memory
+	Telemetry::allocated( Type::Lambda, sizeof(Lambda) + envSize * sizeof(ValuePtr) );
+	void* memory = Heap::local().alloc( sizeof(Lambda) + envSize * sizeof(ValuePtr) );
 
 	value::Lambda* clojure = new (memory) Lambda( arity, data, code );
 
 	for ( size_t i = 0; i < envSize; ++i ) {
 		clojure->env[i] = nullptr;
 	}
+	Gc::written( clojure );
 
 	return clojure;
 }
 Lambda* Lambda::alloc( size_t arity, size_t envSize, FnPtr code ) {
 	Lambda::Data* data = new Data( nullptr );
 
-	void* memory = new char[sizeof(Lambda) + envSize * sizeof(ValuePtr)];
+	Telemetry::allocated( Type::Lambda, sizeof(Lambda) + envSize * sizeof(ValuePtr) );
+	void* memory = Heap::local().alloc( sizeof(Lambda) + envSize * sizeof(ValuePtr) );
 
 	value::Lambda* clojure = new (memory) Lambda( arity, data, code );
 
 	for ( size_t i = 0; i < envSize; ++i ) {
 		clojure->env[i] = nullptr;
 	}
+	Gc::written( clojure );
 
 	return clojure;
 }
@@ -69,6 +69,48 @@ std::ostream& lllm::operator<<( std::ostream& os, ValuePtr v ) {
 			DBG( Ref );
 			os << "<ref " << expr->get() << ">";
 		}
+		void visit( FuturePtr expr, std::ostream& os ) const {
+			DBG( Future );
+			os << "<future>";
+		}
+		void visit( ChannelPtr expr, std::ostream& os ) const {
+			DBG( Channel );
+			os << "<channel " << expr->capacity() << ">";
+		}
+		void visit( VectorPtr expr, std::ostream& os ) const {
+			DBG( Vector );
+			os << "#(";
+			for ( size_t i = 0; i < expr->length; i++ ) os << (i ? " " : "") << expr->elements[i];
+			os << ')';
+		}
+		void visit( F64VectorPtr expr, std::ostream& os ) const {
+			DBG( F64Vector );
+			os << "#f64(";
+			for ( size_t i = 0; i < expr->length; i++ ) os << (i ? " " : "") << expr->elements[i];
+			os << ')';
+		}
+		void visit( I64VectorPtr expr, std::ostream& os ) const {
+			DBG( I64Vector );
+			os << "#i64(";
+			for ( size_t i = 0; i < expr->length; i++ ) os << (i ? " " : "") << expr->elements[i];
+			os << ')';
+		}
+		void visit( HashTablePtr expr, std::ostream& os ) const {
+			DBG( HashTable );
+			os << "#hash(";
+			bool first = true;
+			expr->each( [&]( ValuePtr key, ValuePtr val ) {
+				os << (first ? "" : " ") << '(' << key << " . " << val << ')';
+				first = false;
+			} );
+			os << ')';
+		}
+		void visit( RecordPtr expr, std::ostream& os ) const {
+			DBG( Record );
+			os << '#' << expr->type->name << '(';
+			for ( size_t i = 0; i < expr->type->numFields(); i++ ) os << (i ? " " : "") << expr->fields[i];
+			os << ')';
+		}
 		void visit( LambdaPtr expr, std::ostream& os ) const {
 			DBG( Lambda );
 	